@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "buffer_ring.hpp"
+#include "constant.hpp"
+#include "http_message.hpp"
+#include "http_parser.hpp"
+#include "local_task.hpp"
+#include "sync_wait.hpp"
+#include "task.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+std::atomic<size_t> allocation_count;
+} // namespace
+
+// Every allocation of the process is counted, including those of the thread
+// pool workers, so that allocations per operation can be reported.
+void *operator new(const size_t size)
+{
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+	if (void *const pointer = std::malloc(size == 0 ? 1 : size))
+	{
+		return pointer;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void *const pointer) noexcept { std::free(pointer); }
+
+void operator delete(void *const pointer, size_t) noexcept { std::free(pointer); }
+
+namespace {
+using couringserver::buffer_ring;
+using couringserver::http_parser;
+using couringserver::http_response;
+using couringserver::local_task;
+using couringserver::task;
+using couringserver::thread_pool;
+
+constexpr size_t TASK_ITERATION_COUNT = 10'000'000;
+constexpr size_t PARSER_ITERATION_COUNT = 1'000'000;
+constexpr size_t BUFFER_RING_ITERATION_COUNT = 10'000'000;
+constexpr size_t SCHEDULE_ITERATION_COUNT = 1'000'000;
+
+// Requests as sent by a command line client and by a browser, the latter is
+// also fed in three packets to cover a request that is split by the network.
+constexpr char CURL_REQUEST[] =
+	"GET /index.html HTTP/1.1\r\n"
+	"Host: 127.0.0.1:8080\r\n"
+	"User-Agent: curl/8.5.0\r\n"
+	"Accept: */*\r\n"
+	"\r\n";
+
+constexpr char BROWSER_REQUEST[] =
+	"GET /assets/app.js HTTP/1.1\r\n"
+	"Host: www.example.com\r\n"
+	"Connection: keep-alive\r\n"
+	"sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+	"sec-ch-ua-mobile: ?0\r\n"
+	"User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) "
+	"Chrome/124.0.0.0 Safari/537.36\r\n"
+	"sec-ch-ua-platform: \"Linux\"\r\n"
+	"Accept: */*\r\n"
+	"Sec-Fetch-Site: same-origin\r\n"
+	"Sec-Fetch-Mode: no-cors\r\n"
+	"Sec-Fetch-Dest: script\r\n"
+	"Referer: https://www.example.com/\r\n"
+	"Accept-Encoding: gzip, deflate, br, zstd\r\n"
+	"Accept-Language: en-US,en;q=0.9\r\n"
+	"If-None-Match: \"5e1f0c-1a2b-17f3c4d5e6f70812\"\r\n"
+	"If-Modified-Since: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+	"\r\n";
+
+template <typename function_type>
+void run(const char *name, const size_t iteration_count, function_type &&function)
+{
+	size_t sum = 0;
+	const size_t start_allocation_count = allocation_count.load(std::memory_order_relaxed);
+	const auto start = std::chrono::steady_clock::now();
+	function(iteration_count, sum);
+	const auto stop = std::chrono::steady_clock::now();
+	const size_t stop_allocation_count = allocation_count.load(std::memory_order_relaxed);
+
+	const double elapsed_ns = std::chrono::duration<double, std::nano>(stop - start).count();
+	std::printf("%-28s %12zu iterations %8.2f ns/op %6.2f allocs/op (checksum %zu)\n", name, iteration_count,
+				elapsed_ns / iteration_count,
+				static_cast<double>(stop_allocation_count - start_allocation_count) / iteration_count, sum);
+}
+
+template <template <typename> class task_type>
+task_type<size_t> leaf(const size_t value)
+{
+	co_return value + 1;
+}
+
+// Create, resume, complete and destroy one child coroutine per iteration.
+template <template <typename> class task_type>
+task_type<void> await_loop(const size_t iteration_count, size_t &sum)
+{
+	for (size_t index = 0; index < iteration_count; ++index)
+	{
+		sum += co_await leaf<task_type>(index);
+	}
+}
+
+// Start and detach one coroutine per iteration, the frame destroys itself.
+template <template <typename> class task_type>
+task_type<void> detached_leaf(size_t &sum)
+{
+	++sum;
+	co_return;
+}
+
+template <template <typename> class task_type>
+void run_task_suite(const char *await_name, const char *detach_name)
+{
+	run(await_name, TASK_ITERATION_COUNT, [](const size_t iteration_count, size_t &sum)
+		{
+		task_type<void> driver = await_loop<task_type>(iteration_count, sum);
+		driver.resume(); });
+
+	run(detach_name, TASK_ITERATION_COUNT, [](const size_t iteration_count, size_t &sum)
+		{
+		for (size_t index = 0; index < iteration_count; ++index)
+		{
+			task_type<void> leaf = detached_leaf<task_type>(sum);
+			leaf.resume();
+			leaf.detach();
+		} });
+}
+
+// Parse the request once per iteration, fed in 'packet_count' packets.
+void run_parser(const char *name, const std::string_view request, const size_t packet_count)
+{
+	run(name, PARSER_ITERATION_COUNT, [&](const size_t iteration_count, size_t &sum)
+		{
+		std::string packet_buffer(request);
+		const std::span<char> packet(packet_buffer);
+		const size_t packet_size = (packet.size() + packet_count - 1) / packet_count;
+		http_parser http_parser;
+		for (size_t index = 0; index < iteration_count; ++index)
+		{
+			for (size_t offset = 0; offset < packet.size(); offset += packet_size)
+			{
+				if (const auto http_request =
+						http_parser.parse_packet(packet.subspan(offset, std::min(packet_size, packet.size() - offset)));
+					http_request.has_value())
+				{
+					sum += http_request->header_list.size();
+				}
+			}
+		} });
+}
+
+void run_serializer()
+{
+	// The headers of a static file response.
+	http_response http_response;
+	http_response.version = "HTTP/1.1";
+	http_response.status = "200";
+	http_response.status_text = "OK";
+	http_response.header_list.emplace_back("etag", "\"5e1f0c-1a2b-17f3c4d5e6f70812\"");
+	http_response.header_list.emplace_back("last-modified", "Sun, 06 Nov 1994 08:49:37 GMT");
+	http_response.header_list.emplace_back("accept-ranges", "bytes");
+	http_response.header_list.emplace_back("content-length", "6699");
+
+	run("http_response/serialize", PARSER_ITERATION_COUNT, [&](const size_t iteration_count, size_t &sum)
+		{
+		for (size_t index = 0; index < iteration_count; ++index)
+		{
+			sum += http_response.serialize().size();
+		} });
+}
+
+// Only the user space side of a cycle is measured, the buffers are put back
+// on the ring without the kernel consuming them.
+void run_buffer_ring()
+{
+	buffer_ring &buffer_ring = buffer_ring::get_instance();
+	buffer_ring.register_buffer_ring(couringserver::BUFFER_RING_SIZE, couringserver::BUFFER_SIZE);
+
+	run("buffer_ring/borrow_return", BUFFER_RING_ITERATION_COUNT, [&](const size_t iteration_count, size_t &sum)
+		{
+		for (size_t index = 0; index < iteration_count; ++index)
+		{
+			const unsigned int buffer_id = index % couringserver::BUFFER_RING_SIZE;
+			sum += buffer_ring.borrow_buffer(buffer_id, couringserver::BUFFER_SIZE).size();
+			buffer_ring.return_buffer(buffer_id);
+		} });
+}
+
+task<> schedule_loop(thread_pool &thread_pool, const size_t iteration_count, std::atomic<size_t> &sum)
+{
+	for (size_t index = 0; index < iteration_count; ++index)
+	{
+		co_await thread_pool.schedule();
+	}
+	sum.fetch_add(iteration_count, std::memory_order_relaxed);
+}
+
+// Several coroutines per worker hop through the queue of the pool, so the
+// workers contend on it as they do in the server.
+void run_thread_pool()
+{
+	thread_pool thread_pool(std::max(1U, std::thread::hardware_concurrency()));
+	const size_t coroutine_count = thread_pool.size() * 4;
+
+	run("thread_pool/schedule", SCHEDULE_ITERATION_COUNT, [&](const size_t iteration_count, size_t &sum)
+		{
+		std::atomic<size_t> scheduled_count = 0;
+		std::vector<task<>> task_list;
+		for (size_t index = 0; index < coroutine_count; ++index)
+		{
+			task_list.emplace_back(schedule_loop(thread_pool, iteration_count / coroutine_count, scheduled_count));
+		}
+		couringserver::sync_wait_all(task_list);
+		sum = scheduled_count.load(std::memory_order_relaxed); });
+}
+} // namespace
+
+int main()
+{
+	run_parser("http_parser/curl", CURL_REQUEST, 1);
+	run_parser("http_parser/browser", BROWSER_REQUEST, 1);
+	run_parser("http_parser/browser_split", BROWSER_REQUEST, 3);
+	run_serializer();
+	run_buffer_ring();
+	run_task_suite<task>("task/await", "task/detach");
+	run_task_suite<local_task>("local_task/await", "local_task/detach");
+	run_thread_pool();
+}
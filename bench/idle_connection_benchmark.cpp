@@ -0,0 +1,196 @@
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+// The ephemeral ports of a single source address run out after about 28000
+// connections to the same port, so every this many connections the next
+// loopback address is used.
+constexpr size_t CONNECTIONS_PER_SOURCE_ADDRESS = 16384;
+
+// time for the server to settle after the last connection was opened
+constexpr std::chrono::seconds SETTLE_DURATION{2};
+
+struct benchmark_options
+{
+	size_t connection_count = 100000;
+	uint16_t port = 8080;
+	pid_t server_pid = 0;
+};
+
+// The resident set size of the process in KiB, or -1 if it is unknown.
+long read_resident_size(const pid_t pid)
+{
+	std::ifstream status_stream("/proc/" + std::to_string(pid) + "/status");
+	std::string line;
+	while (std::getline(status_stream, line))
+	{
+		if (line.starts_with("VmRSS:"))
+		{
+			return std::strtol(line.c_str() + 6, nullptr, 10);
+		}
+	}
+	return -1;
+}
+
+// Open a connection from the loopback address of the index and complete a
+// request on it, so that it is an idle keep-alive connection afterwards.
+// Return the file descriptor, or -1.
+int open_idle_connection(const benchmark_options &options, const size_t index)
+{
+	const int raw_file_descriptor = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (raw_file_descriptor == -1)
+	{
+		return -1;
+	}
+
+	// The port is picked when connecting, so that it only has to be unique
+	// for the destination.
+	const int enable = 1;
+	::setsockopt(raw_file_descriptor, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &enable, sizeof(enable));
+	sockaddr_in source_address{};
+	source_address.sin_family = AF_INET;
+	source_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK + 1 + index / CONNECTIONS_PER_SOURCE_ADDRESS);
+	sockaddr_in server_address{};
+	server_address.sin_family = AF_INET;
+	server_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	server_address.sin_port = htons(options.port);
+	if (::bind(raw_file_descriptor, reinterpret_cast<const sockaddr *>(&source_address), sizeof(source_address)) ==
+			-1 ||
+		::connect(raw_file_descriptor, reinterpret_cast<const sockaddr *>(&server_address), sizeof(server_address)) ==
+			-1)
+	{
+		::close(raw_file_descriptor);
+		return -1;
+	}
+
+	constexpr std::string_view REQUEST = "GET /healthz HTTP/1.1\r\nhost: 127.0.0.1\r\n\r\n";
+	if (::send(raw_file_descriptor, REQUEST.data(), REQUEST.size(), MSG_NOSIGNAL) !=
+		static_cast<ssize_t>(REQUEST.size()))
+	{
+		::close(raw_file_descriptor);
+		return -1;
+	}
+	std::string response;
+	char buffer[1024];
+	while (response.find("\r\n\r\n") == std::string::npos)
+	{
+		const ssize_t recv_size = ::recv(raw_file_descriptor, buffer, sizeof(buffer), 0);
+		if (recv_size <= 0)
+		{
+			::close(raw_file_descriptor);
+			return -1;
+		}
+		response.append(buffer, recv_size);
+	}
+	if (!response.starts_with("HTTP/1.1 200"))
+	{
+		::close(raw_file_descriptor);
+		return -1;
+	}
+	return raw_file_descriptor;
+}
+
+void print_usage(const char *program)
+{
+	std::fprintf(
+		stderr,
+		"usage: %s [-c connections] [-p port] server_pid\n"
+		"  opens idle keep-alive connections to 127.0.0.1 and reports the growth of\n"
+		"  the server's resident set per connection, the server must be started\n"
+		"  with a 'max_connection_count' above the connections\n",
+		program);
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+	benchmark_options options;
+	int option;
+	while ((option = getopt(argc, argv, "c:p:")) != -1)
+	{
+		switch (option)
+		{
+		case 'c':
+			options.connection_count = std::strtoull(optarg, nullptr, 10);
+			break;
+		case 'p':
+			options.port = static_cast<uint16_t>(std::strtoul(optarg, nullptr, 10));
+			break;
+		default:
+			print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind + 1 != argc || options.connection_count == 0)
+	{
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	options.server_pid = static_cast<pid_t>(std::strtol(argv[optind], nullptr, 10));
+
+	rlimit file_descriptor_limit;
+	getrlimit(RLIMIT_NOFILE, &file_descriptor_limit);
+	file_descriptor_limit.rlim_cur = file_descriptor_limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &file_descriptor_limit);
+	if (file_descriptor_limit.rlim_cur < options.connection_count + 16)
+	{
+		std::fprintf(stderr, "at most %zu connections allowed by RLIMIT_NOFILE\n",
+					 static_cast<size_t>(file_descriptor_limit.rlim_cur) - 16);
+		return EXIT_FAILURE;
+	}
+
+	const long resident_size_before = read_resident_size(options.server_pid);
+	if (resident_size_before == -1)
+	{
+		std::fprintf(stderr, "no process %d\n", static_cast<int>(options.server_pid));
+		return EXIT_FAILURE;
+	}
+
+	const auto start_time = std::chrono::steady_clock::now();
+	std::vector<int> raw_file_descriptor_list;
+	raw_file_descriptor_list.reserve(options.connection_count);
+	for (size_t index = 0; index < options.connection_count; ++index)
+	{
+		const int raw_file_descriptor = open_idle_connection(options, index);
+		if (raw_file_descriptor == -1)
+		{
+			std::fprintf(stderr, "connection %zu failed, stopping\n", index);
+			break;
+		}
+		raw_file_descriptor_list.push_back(raw_file_descriptor);
+	}
+	const double open_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+	std::this_thread::sleep_for(SETTLE_DURATION);
+	const long resident_size_after = read_resident_size(options.server_pid);
+	const size_t connection_count = raw_file_descriptor_list.size();
+	const double bytes_per_connection =
+		connection_count == 0 ? 0.0
+							  : static_cast<double>(resident_size_after - resident_size_before) * 1024 / connection_count;
+	std::printf(
+		"{\"connections\": %zu, \"open_seconds\": %.3f, \"server_rss_before_kib\": %ld, "
+		"\"server_rss_after_kib\": %ld, \"rss_bytes_per_connection\": %.1f}\n",
+		connection_count, open_seconds, resident_size_before, resident_size_after, bytes_per_connection);
+
+	for (const int raw_file_descriptor : raw_file_descriptor_list)
+	{
+		::close(raw_file_descriptor);
+	}
+	return connection_count == options.connection_count ? EXIT_SUCCESS : EXIT_FAILURE;
+}
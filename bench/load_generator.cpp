@@ -0,0 +1,754 @@
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <liburing.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "buffer_ring.hpp"
+#include "cancellation.hpp"
+#include "constant.hpp"
+#include "io_uring.hpp"
+#include "local_task.hpp"
+#include "socket.hpp"
+#include "when_all.hpp"
+
+namespace {
+using couringserver::buffer_ring;
+using couringserver::cancellation_token;
+using couringserver::client_socket;
+using couringserver::connect_awaiter;
+using couringserver::io_uring;
+using couringserver::local_task;
+using couringserver::sqe_data;
+using couringserver::timeout_awaiter;
+using couringserver::when_all;
+using couringserver::when_any;
+
+using clock_type = std::chrono::steady_clock;
+
+// Responses still missing this long after the run are counted as timeouts.
+constexpr std::chrono::seconds RESPONSE_GRACE_PERIOD{2};
+
+/**
+ * @brief latency histogram with a bounded relative error
+ * @details The layout follows HdrHistogram with 3 significant digits: values
+ * below 2048 ns have a bucket each, and every power of two above is split
+ * into 1024 linear buckets, so a recorded value is off by less than 0.1%.
+ * Histograms of the same layout are merged by adding their counts.
+ */
+class latency_histogram
+{
+public:
+	static constexpr int SUB_BUCKET_BITS = 11;
+	static constexpr uint64_t SUB_BUCKET_COUNT = uint64_t{1} << SUB_BUCKET_BITS;
+	static constexpr uint64_t SUB_BUCKET_HALF_COUNT = SUB_BUCKET_COUNT / 2;
+	// Up to 2^42 ns, more than an hour.
+	static constexpr int MAX_SHIFT = 42 - SUB_BUCKET_BITS;
+
+	latency_histogram() : count_list_(SUB_BUCKET_COUNT + MAX_SHIFT * SUB_BUCKET_HALF_COUNT) {}
+
+	void record(const uint64_t value)
+	{
+		++count_list_[get_index(value)];
+		++total_count_;
+		total_value_ += value;
+		min_value_ = std::min(min_value_, value);
+		max_value_ = std::max(max_value_, value);
+	}
+
+	void merge(const latency_histogram &other)
+	{
+		for (size_t index = 0; index < count_list_.size(); ++index)
+		{
+			count_list_[index] += other.count_list_[index];
+		}
+		total_count_ += other.total_count_;
+		total_value_ += other.total_value_;
+		min_value_ = std::min(min_value_, other.min_value_);
+		max_value_ = std::max(max_value_, other.max_value_);
+	}
+
+	// Return the highest value equivalent to the recorded value at the percentile.
+	uint64_t get_value_at_percentile(const double percentile) const
+	{
+		if (total_count_ == 0)
+		{
+			return 0;
+		}
+		const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(percentile / 100.0 * total_count_ + 0.5));
+		uint64_t count = 0;
+		for (size_t index = 0; index < count_list_.size(); ++index)
+		{
+			count += count_list_[index];
+			if (count >= rank)
+			{
+				return std::min(get_highest_value(index), max_value_);
+			}
+		}
+		return max_value_;
+	}
+
+	uint64_t get_total_count() const noexcept { return total_count_; }
+	uint64_t get_min_value() const noexcept { return total_count_ == 0 ? 0 : min_value_; }
+	uint64_t get_max_value() const noexcept { return max_value_; }
+	double get_mean_value() const noexcept
+	{
+		return total_count_ == 0 ? 0.0 : static_cast<double>(total_value_) / total_count_;
+	}
+
+private:
+	std::vector<uint64_t> count_list_;
+	uint64_t total_count_ = 0;
+	uint64_t total_value_ = 0;
+	uint64_t min_value_ = UINT64_MAX;
+	uint64_t max_value_ = 0;
+
+	static size_t get_index(uint64_t value)
+	{
+		if (value < SUB_BUCKET_COUNT)
+		{
+			return value;
+		}
+		int shift = std::bit_width(value) - SUB_BUCKET_BITS;
+		if (shift > MAX_SHIFT)
+		{
+			shift = MAX_SHIFT;
+			value = (SUB_BUCKET_COUNT << MAX_SHIFT) - 1;
+		}
+		return SUB_BUCKET_COUNT + (shift - 1) * SUB_BUCKET_HALF_COUNT + ((value >> shift) - SUB_BUCKET_HALF_COUNT);
+	}
+
+	static uint64_t get_highest_value(const size_t index)
+	{
+		if (index < SUB_BUCKET_COUNT)
+		{
+			return index;
+		}
+		const uint64_t shift = (index - SUB_BUCKET_COUNT) / SUB_BUCKET_HALF_COUNT + 1;
+		const uint64_t sub_bucket = (index - SUB_BUCKET_COUNT) % SUB_BUCKET_HALF_COUNT + SUB_BUCKET_HALF_COUNT;
+		return ((sub_bucket + 1) << shift) - 1;
+	}
+};
+
+/**
+ * @brief incremental parser of HTTP/1.1 responses
+ * @details The parser only keeps the head of the response being received, a
+ * body is skipped by counting its 'content-length' bytes. Chunked and
+ * close-delimited bodies are not supported and fail the connection.
+ */
+class response_parser
+{
+public:
+	explicit response_parser(const bool head_request) : head_request_{head_request} {}
+
+	// Consume the data and call 'on_response' with the status code of each
+	// completed response. Return false if a response cannot be parsed.
+	template <typename function_type>
+	bool parse(std::string_view data, function_type &&on_response)
+	{
+		while (!data.empty())
+		{
+			if (body_remaining_ != 0)
+			{
+				const size_t length = std::min<uintmax_t>(body_remaining_, data.size());
+				body_remaining_ -= length;
+				data.remove_prefix(length);
+				if (body_remaining_ == 0)
+				{
+					on_response(status_code_);
+				}
+				continue;
+			}
+
+			// The terminator may straddle two packets, so the search starts a
+			// few bytes before the new data.
+			const size_t search_start = head_buffer_.size() < 3 ? 0 : head_buffer_.size() - 3;
+			head_buffer_.append(data);
+			const size_t head_end = head_buffer_.find("\r\n\r\n", search_start);
+			if (head_end == std::string::npos)
+			{
+				return head_buffer_.size() <= MAX_HEAD_SIZE;
+			}
+			data = data.substr(data.size() - (head_buffer_.size() - head_end - 4));
+			head_buffer_.resize(head_end + 2);
+			if (!parse_head())
+			{
+				return false;
+			}
+			head_buffer_.clear();
+			if (body_remaining_ == 0)
+			{
+				on_response(status_code_);
+			}
+		}
+		return true;
+	}
+
+private:
+	static constexpr size_t MAX_HEAD_SIZE = 65536;
+
+	const bool head_request_;
+	std::string head_buffer_;
+	uintmax_t body_remaining_ = 0;
+	int status_code_ = 0;
+
+	bool parse_head()
+	{
+		const std::string_view head = head_buffer_;
+		if (head.size() < 12 || !head.starts_with("HTTP/1."))
+		{
+			return false;
+		}
+		const auto [_, status_error] = std::from_chars(head.data() + 9, head.data() + 12, status_code_);
+		if (status_error != std::errc())
+		{
+			return false;
+		}
+
+		std::optional<uintmax_t> content_length;
+		for (size_t line_start = head.find("\r\n") + 2; line_start < head.size();)
+		{
+			const size_t line_end = head.find("\r\n", line_start);
+			const std::string_view line = head.substr(line_start, line_end - line_start);
+			line_start = line_end + 2;
+
+			const size_t colon_position = line.find(':');
+			if (colon_position == std::string_view::npos)
+			{
+				continue;
+			}
+			const std::string_view name = line.substr(0, colon_position);
+			std::string_view value = line.substr(colon_position + 1);
+			while (value.starts_with(' '))
+			{
+				value.remove_prefix(1);
+			}
+			const auto equal_name = [name](const std::string_view expected)
+			{
+				return std::ranges::equal(name, expected, [](const unsigned char left, const unsigned char right)
+										  { return std::tolower(left) == right; });
+			};
+			if (equal_name("transfer-encoding"))
+			{
+				return false;
+			}
+			if (equal_name("content-length"))
+			{
+				uintmax_t length = 0;
+				const auto [_, length_error] = std::from_chars(value.data(), value.data() + value.size(), length);
+				if (length_error != std::errc())
+				{
+					return false;
+				}
+				content_length = length;
+			}
+		}
+
+		const bool bodyless = head_request_ || status_code_ / 100 == 1 || status_code_ == 204 || status_code_ == 304;
+		if (!bodyless && !content_length.has_value())
+		{
+			return false;
+		}
+		body_remaining_ = bodyless ? 0 : content_length.value();
+		return true;
+	}
+};
+
+struct load_options
+{
+	std::string host;
+	uint16_t port = 80;
+	std::string path = "/";
+	std::string method = "GET";
+	size_t connection_count = 64;
+	size_t thread_count = 1;
+	size_t pipeline_depth = 1;
+	std::chrono::seconds duration{10};
+	// Requests per second over all connections, 0 for a closed loop.
+	double rate = 0;
+	bool keep_alive = true;
+};
+
+// The counters of one thread, merged after the run.
+struct worker_statistics
+{
+	latency_histogram histogram;
+	uint64_t response_count = 0;
+	uint64_t status_error_count = 0;
+	uint64_t connect_error_count = 0;
+	uint64_t protocol_error_count = 0;
+	uint64_t timeout_count = 0;
+	uint64_t bytes_received = 0;
+};
+
+struct worker_context
+{
+	const load_options &options;
+	const sockaddr_storage &address;
+	const socklen_t address_size;
+	const std::string &request;
+	const clock_type::time_point start_time;
+	const clock_type::time_point end_time;
+	worker_statistics statistics;
+	std::unordered_set<int> open_socket_set;
+	bool done = false;
+};
+
+/**
+ * @brief one client connection
+ * @details The sender keeps up to 'pipeline_depth' requests in flight. In the
+ * closed loop a request is sent as soon as a slot frees up and its latency
+ * starts when it is sent. At a fixed rate each request has an intended send
+ * time on the schedule of the connection, and its latency starts at that time
+ * even if the request goes out late, so that a stalled server is not hidden
+ * by the client waiting for it (coordinated omission).
+ */
+struct connection
+{
+	worker_context &context;
+	couringserver::client_socket client_socket;
+	std::deque<clock_type::time_point> start_time_queue{};
+	clock_type::time_point next_send_time{};
+	std::coroutine_handle<> sender_coroutine{};
+	bool sender_done = false;
+	bool closed = false;
+};
+
+class slot_awaiter
+{
+public:
+	explicit slot_awaiter(connection &connection) : connection_{connection} {}
+
+	bool await_ready() const noexcept { return false; }
+	void await_suspend(std::coroutine_handle<> coroutine) const noexcept { connection_.sender_coroutine = coroutine; }
+	void await_resume() const noexcept {}
+
+private:
+	connection &connection_;
+};
+
+void wake_sender(connection &connection)
+{
+	if (connection.sender_coroutine)
+	{
+		std::exchange(connection.sender_coroutine, nullptr).resume();
+	}
+}
+
+local_task<> send_loop(connection &connection, const std::chrono::nanoseconds send_interval)
+{
+	const load_options &options = connection.context.options;
+	std::string send_buffer;
+	while (!connection.closed)
+	{
+		if (connection.start_time_queue.size() >= options.pipeline_depth)
+		{
+			co_await slot_awaiter(connection);
+			continue;
+		}
+		const clock_type::time_point now = clock_type::now();
+		if (now >= connection.context.end_time)
+		{
+			break;
+		}
+		if (send_interval.count() != 0 && connection.next_send_time > now)
+		{
+			co_await timeout_awaiter(std::min(connection.next_send_time, connection.context.end_time) - now);
+			continue;
+		}
+
+		// Every request that is due and fits in the pipeline goes out in one send.
+		send_buffer.clear();
+		while (connection.start_time_queue.size() < options.pipeline_depth &&
+			   (send_interval.count() == 0 || connection.next_send_time <= now))
+		{
+			connection.start_time_queue.emplace_back(send_interval.count() == 0 ? now : connection.next_send_time);
+			connection.next_send_time += send_interval;
+			send_buffer += connection.context.request;
+			if (!options.keep_alive)
+			{
+				break;
+			}
+		}
+		if (co_await connection.client_socket.send(send_buffer, send_buffer.size()) == -1)
+		{
+			break;
+		}
+		if (!options.keep_alive)
+		{
+			break;
+		}
+	}
+
+	// The server closes the connection after the last response once it sees
+	// the end of the requests.
+	connection.sender_done = true;
+	::shutdown(connection.client_socket.get_raw_file_descriptor(), SHUT_WR);
+}
+
+local_task<> recv_loop(connection &connection)
+{
+	worker_statistics &statistics = connection.context.statistics;
+	buffer_ring &buffer_ring = buffer_ring::get_instance();
+	response_parser response_parser(connection.context.options.method == "HEAD");
+	const auto on_response = [&](const int status_code)
+	{
+		const clock_type::time_point now = clock_type::now();
+		if (connection.start_time_queue.empty())
+		{
+			++statistics.protocol_error_count;
+			return;
+		}
+		statistics.histogram.record(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(now - connection.start_time_queue.front()).count());
+		connection.start_time_queue.pop_front();
+		++statistics.response_count;
+		if (status_code < 200 || status_code >= 400)
+		{
+			++statistics.status_error_count;
+		}
+	};
+
+	while (true)
+	{
+		const auto [recv_buffer_id, recv_buffer_size] =
+			co_await connection.client_socket.recv(couringserver::BUFFER_SIZE);
+		if (recv_buffer_size <= 0)
+		{
+			break;
+		}
+		const std::span<char> recv_buffer = buffer_ring.borrow_buffer(recv_buffer_id, recv_buffer_size);
+		statistics.bytes_received += recv_buffer_size;
+		const bool parsed = response_parser.parse({recv_buffer.data(), recv_buffer.size()}, on_response);
+		buffer_ring.return_buffer(recv_buffer_id);
+		if (!parsed)
+		{
+			++statistics.protocol_error_count;
+			break;
+		}
+		wake_sender(connection);
+	}
+
+	// The requests that never got a response count as timeouts.
+	statistics.timeout_count += connection.start_time_queue.size();
+	connection.start_time_queue.clear();
+	connection.closed = true;
+	wake_sender(connection);
+}
+
+local_task<> run_connection(worker_context &context, const size_t connection_index)
+{
+	const load_options &options = context.options;
+	const std::chrono::nanoseconds send_interval{
+		options.rate == 0 ? 0 : static_cast<int64_t>(options.connection_count * 1e9 / options.rate)};
+	// The schedules of the connections are staggered over one interval.
+	clock_type::time_point next_send_time =
+		context.start_time + send_interval * connection_index / options.connection_count;
+
+	// Without keep-alive, every request is sent on a new connection.
+	while (clock_type::now() < context.end_time)
+	{
+		const int raw_file_descriptor = ::socket(context.address.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (raw_file_descriptor == -1)
+		{
+			++context.statistics.connect_error_count;
+			break;
+		}
+		connection connection{context, client_socket(raw_file_descriptor)};
+		connection.next_send_time = next_send_time;
+		context.open_socket_set.insert(raw_file_descriptor);
+		if (co_await connect_awaiter(
+				raw_file_descriptor, reinterpret_cast<const sockaddr *>(&context.address), context.address_size) < 0)
+		{
+			++context.statistics.connect_error_count;
+			context.open_socket_set.erase(raw_file_descriptor);
+			break;
+		}
+		connection.client_socket.set_no_delay();
+
+		co_await when_all(send_loop(connection, send_interval), recv_loop(connection));
+		context.open_socket_set.erase(raw_file_descriptor);
+		next_send_time = connection.next_send_time;
+		if (options.keep_alive)
+		{
+			break;
+		}
+	}
+}
+
+// Shut down the connections that are still open after the grace period, the
+// pending 'recv' of each completes with 0 bytes.
+local_task<> expire_connections(worker_context &context, cancellation_token &cancellation_token)
+{
+	const std::chrono::nanoseconds timeout = context.end_time + RESPONSE_GRACE_PERIOD - clock_type::now();
+	if (co_await timeout_awaiter(timeout, &cancellation_token) == -ETIME)
+	{
+		for (const int raw_file_descriptor : context.open_socket_set)
+		{
+			::shutdown(raw_file_descriptor, SHUT_RDWR);
+		}
+	}
+}
+
+local_task<> run_worker(worker_context &context, const size_t first_connection_index, const size_t connection_count)
+{
+	std::vector<local_task<>> connection_task_list;
+	for (size_t index = 0; index < connection_count; ++index)
+	{
+		connection_task_list.emplace_back(run_connection(context, first_connection_index + index));
+	}
+	cancellation_token cancellation_token;
+	co_await when_any(
+		cancellation_token, when_all(std::move(connection_task_list)),
+		expire_connections(context, cancellation_token));
+	context.done = true;
+}
+
+// Drive the coroutines of the worker until they complete, the same way as
+// 'thread_worker::event_loop()'.
+void run_thread(worker_context &context, const size_t first_connection_index, const size_t connection_count)
+{
+	buffer_ring::get_instance().register_buffer_ring(couringserver::BUFFER_RING_SIZE, couringserver::BUFFER_SIZE);
+	io_uring &io_uring = io_uring::get_instance();
+
+	local_task<> worker_task = run_worker(context, first_connection_index, connection_count);
+	worker_task.resume();
+	while (!context.done)
+	{
+		io_uring.wait_for_completion(std::chrono::nanoseconds::zero());
+		for (io_uring_cqe *const cqe : io_uring)
+		{
+			auto *sqe_data = reinterpret_cast<struct sqe_data *>(io_uring_cqe_get_data(cqe));
+			if (sqe_data == nullptr)
+			{
+				io_uring.cqe_seen(cqe);
+				continue;
+			}
+			sqe_data->cqe_res = cqe->res;
+			sqe_data->cqe_flags = cqe->flags;
+			void *const coroutine_address = sqe_data->coroutine;
+			io_uring.cqe_seen(cqe);
+
+			if (coroutine_address != nullptr)
+			{
+				std::coroutine_handle<>::from_address(coroutine_address).resume();
+			}
+		}
+	}
+}
+
+// Parse 'http://host:port/path', the host is a numeric IPv4 or IPv6 address.
+bool parse_url(const std::string_view url, load_options &options)
+{
+	constexpr std::string_view scheme = "http://";
+	if (!url.starts_with(scheme))
+	{
+		return false;
+	}
+	std::string_view authority = url.substr(scheme.size());
+	const size_t path_position = authority.find('/');
+	if (path_position != std::string_view::npos)
+	{
+		options.path = authority.substr(path_position);
+		authority = authority.substr(0, path_position);
+	}
+
+	const size_t colon_position = authority.rfind(':');
+	if (colon_position != std::string_view::npos && !authority.ends_with(']'))
+	{
+		const std::string_view port = authority.substr(colon_position + 1);
+		const auto [_, port_error] = std::from_chars(port.data(), port.data() + port.size(), options.port);
+		if (port_error != std::errc())
+		{
+			return false;
+		}
+		authority = authority.substr(0, colon_position);
+	}
+	if (authority.starts_with('[') && authority.ends_with(']'))
+	{
+		authority = authority.substr(1, authority.size() - 2);
+	}
+	options.host = authority;
+	return !options.host.empty();
+}
+
+bool resolve_address(const load_options &options, sockaddr_storage &address, socklen_t &address_size)
+{
+	auto *ipv4_address = reinterpret_cast<sockaddr_in *>(&address);
+	auto *ipv6_address = reinterpret_cast<sockaddr_in6 *>(&address);
+	if (inet_pton(AF_INET, options.host.c_str(), &ipv4_address->sin_addr) == 1)
+	{
+		ipv4_address->sin_family = AF_INET;
+		ipv4_address->sin_port = htons(options.port);
+		address_size = sizeof(sockaddr_in);
+		return true;
+	}
+	if (inet_pton(AF_INET6, options.host.c_str(), &ipv6_address->sin6_addr) == 1)
+	{
+		ipv6_address->sin6_family = AF_INET6;
+		ipv6_address->sin6_port = htons(options.port);
+		address_size = sizeof(sockaddr_in6);
+		return true;
+	}
+	return false;
+}
+
+void print_usage(const char *program)
+{
+	std::fprintf(
+		stderr,
+		"usage: %s [-c connections] [-t threads] [-d seconds] [-p pipeline_depth]\n"
+		"          [-r requests_per_second] [-m GET|HEAD] [-K] http://host:port/path\n"
+		"  -r 0 (the default) runs a closed loop, -K opens a connection per request\n",
+		program);
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+	load_options options;
+	int option;
+	while ((option = getopt(argc, argv, "c:t:d:p:r:m:K")) != -1)
+	{
+		switch (option)
+		{
+		case 'c':
+			options.connection_count = std::strtoull(optarg, nullptr, 10);
+			break;
+		case 't':
+			options.thread_count = std::strtoull(optarg, nullptr, 10);
+			break;
+		case 'd':
+			options.duration = std::chrono::seconds(std::strtoull(optarg, nullptr, 10));
+			break;
+		case 'p':
+			options.pipeline_depth = std::strtoull(optarg, nullptr, 10);
+			break;
+		case 'r':
+			options.rate = std::strtod(optarg, nullptr);
+			break;
+		case 'm':
+			options.method = optarg;
+			break;
+		case 'K':
+			options.keep_alive = false;
+			break;
+		default:
+			print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	sockaddr_storage address{};
+	socklen_t address_size = 0;
+	if (optind + 1 != argc || !parse_url(argv[optind], options) || !resolve_address(options, address, address_size) ||
+		options.thread_count == 0 || options.connection_count < options.thread_count ||
+		options.pipeline_depth == 0 || options.rate < 0 || (options.method != "GET" && options.method != "HEAD"))
+	{
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (!options.keep_alive)
+	{
+		options.pipeline_depth = 1;
+	}
+	// Every connection may have a few requests queued at once, they must fit
+	// in the submission queue of its thread.
+	if (options.connection_count / options.thread_count > couringserver::IO_URING_QUEUE_SIZE / 2)
+	{
+		std::fprintf(stderr, "at most %zu connections per thread\n", couringserver::IO_URING_QUEUE_SIZE / 2);
+		return EXIT_FAILURE;
+	}
+
+	const bool ipv6 = address.ss_family == AF_INET6;
+	std::string request = options.method + " " + options.path + " HTTP/1.1\r\nhost: " + (ipv6 ? "[" : "") +
+						  options.host + (ipv6 ? "]" : "") + ":" + std::to_string(options.port) + "\r\n";
+	if (!options.keep_alive)
+	{
+		request += "connection: close\r\n";
+	}
+	request += "\r\n";
+
+	const clock_type::time_point start_time = clock_type::now();
+	const clock_type::time_point end_time = start_time + options.duration;
+	std::deque<worker_context> context_list;
+	for (size_t index = 0; index < options.thread_count; ++index)
+	{
+		context_list.emplace_back(options, address, address_size, request, start_time, end_time);
+	}
+	{
+		std::vector<std::jthread> thread_list;
+		size_t first_connection_index = 0;
+		for (size_t index = 0; index < options.thread_count; ++index)
+		{
+			const size_t connection_count = options.connection_count / options.thread_count +
+											(index < options.connection_count % options.thread_count ? 1 : 0);
+			thread_list.emplace_back(run_thread, std::ref(context_list[index]), first_connection_index, connection_count);
+			first_connection_index += connection_count;
+		}
+	}
+	const double elapsed_seconds = std::chrono::duration<double>(clock_type::now() - start_time).count();
+
+	worker_statistics statistics;
+	for (const worker_context &context : context_list)
+	{
+		statistics.histogram.merge(context.statistics.histogram);
+		statistics.response_count += context.statistics.response_count;
+		statistics.status_error_count += context.statistics.status_error_count;
+		statistics.connect_error_count += context.statistics.connect_error_count;
+		statistics.protocol_error_count += context.statistics.protocol_error_count;
+		statistics.timeout_count += context.statistics.timeout_count;
+		statistics.bytes_received += context.statistics.bytes_received;
+	}
+
+	// The report is a single JSON object, latencies are in nanoseconds.
+	const double measured_seconds = std::min<double>(elapsed_seconds, options.duration.count());
+	const latency_histogram &histogram = statistics.histogram;
+	std::printf(
+		"{\"url\": \"http://%s%s%s:%u%s\", \"method\": \"%s\", \"connections\": %zu, \"threads\": %zu, "
+		"\"pipeline_depth\": %zu, \"keep_alive\": %s, \"mode\": \"%s\", \"target_rate\": %.1f, "
+		"\"duration_seconds\": %.3f, \"responses\": %llu, \"throughput_rps\": %.1f, \"bytes_received\": %llu, "
+		"\"errors\": {\"status\": %llu, \"connect\": %llu, \"protocol\": %llu, \"timeout\": %llu}, "
+		"\"latency_ns\": {\"min\": %llu, \"mean\": %.0f, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, "
+		"\"p99_9\": %llu, \"p99_99\": %llu, \"max\": %llu}}\n",
+		ipv6 ? "[" : "", options.host.c_str(), ipv6 ? "]" : "", options.port, options.path.c_str(),
+		options.method.c_str(), options.connection_count, options.thread_count, options.pipeline_depth,
+		options.keep_alive ? "true" : "false", options.rate == 0 ? "closed_loop" : "fixed_rate", options.rate,
+		measured_seconds, static_cast<unsigned long long>(statistics.response_count),
+		statistics.response_count / measured_seconds, static_cast<unsigned long long>(statistics.bytes_received),
+		static_cast<unsigned long long>(statistics.status_error_count),
+		static_cast<unsigned long long>(statistics.connect_error_count),
+		static_cast<unsigned long long>(statistics.protocol_error_count),
+		static_cast<unsigned long long>(statistics.timeout_count),
+		static_cast<unsigned long long>(histogram.get_min_value()), histogram.get_mean_value(),
+		static_cast<unsigned long long>(histogram.get_value_at_percentile(50.0)),
+		static_cast<unsigned long long>(histogram.get_value_at_percentile(90.0)),
+		static_cast<unsigned long long>(histogram.get_value_at_percentile(99.0)),
+		static_cast<unsigned long long>(histogram.get_value_at_percentile(99.9)),
+		static_cast<unsigned long long>(histogram.get_value_at_percentile(99.99)),
+		static_cast<unsigned long long>(histogram.get_max_value()));
+	return statistics.response_count != 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
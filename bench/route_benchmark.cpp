@@ -0,0 +1,88 @@
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <string_view>
+
+#include "route_table.hpp"
+
+namespace {
+using couringserver::make_route_table;
+
+using handler_type = size_t (*)(size_t);
+
+constexpr size_t ITERATION_COUNT = 10'000'000;
+
+size_t handle(const size_t value) { return value + 1; }
+
+// A table the size of a small service: a handful of exact API routes plus
+// the static file prefixes.
+constexpr auto ROUTE_TABLE = make_route_table<handler_type>({
+	{"GET", "/healthz", handle},
+	{"GET", "/metrics", handle},
+	{"GET", "/api/v1/users", handle},
+	{"POST", "/api/v1/users", handle},
+	{"GET", "/api/v1/orders", handle},
+	{"POST", "/api/v1/orders", handle},
+	{"GET", "/api/v1/status", handle},
+	{"PUT", "/api/v1/config", handle},
+	{"GET", "/assets/*", handle},
+	{"GET", "/*", handle},
+	{"HEAD", "/*", handle},
+});
+
+struct request_line
+{
+	std::string_view method;
+	std::string_view path;
+};
+
+constexpr std::array REQUEST_LINE_LIST{
+	request_line{"GET", "/healthz"},
+	request_line{"POST", "/api/v1/orders"},
+	request_line{"GET", "/assets/app.js"},
+	request_line{"GET", "/index.html"},
+	request_line{"DELETE", "/api/v1/users"},
+};
+
+static_assert(ROUTE_TABLE.find("GET", "/healthz") != nullptr);
+static_assert(ROUTE_TABLE.find("DELETE", "/api/v1/users") == nullptr);
+
+template <typename function_type>
+void run(const char *name, function_type &&function)
+{
+	size_t sum = 0;
+	const auto start = std::chrono::steady_clock::now();
+	function(sum);
+	const auto stop = std::chrono::steady_clock::now();
+
+	const double elapsed_ns = std::chrono::duration<double, std::nano>(stop - start).count();
+	std::printf("%-28s %12zu iterations %8.2f ns/op (checksum %zu)\n", name, ITERATION_COUNT,
+				elapsed_ns / ITERATION_COUNT, sum);
+}
+
+void run_request_line(const char *name, const request_line request_line)
+{
+	run(name, [request_line](size_t &sum)
+		{
+		for (size_t index = 0; index < ITERATION_COUNT; ++index)
+		{
+			// Hide the request line from the optimizer, like a parsed request.
+			std::string_view method = request_line.method;
+			std::string_view path = request_line.path;
+			asm volatile("" : "+r"(method), "+r"(path));
+			const handler_type *const handler = ROUTE_TABLE.find(method, path);
+			sum += handler != nullptr ? (*handler)(index) : 0;
+		} });
+}
+} // namespace
+
+int main()
+{
+	run_request_line("route exact", REQUEST_LINE_LIST[0]);
+	run_request_line("route exact (post)", REQUEST_LINE_LIST[1]);
+	run_request_line("route prefix", REQUEST_LINE_LIST[2]);
+	run_request_line("route fallback prefix", REQUEST_LINE_LIST[3]);
+	run_request_line("route miss", REQUEST_LINE_LIST[4]);
+	return 0;
+}
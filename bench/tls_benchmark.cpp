@@ -0,0 +1,171 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+// Responses of each size are sent back to back on a single loopback
+// connection, the client decrypts them in user space in every case.
+struct workload
+{
+	const char *name;
+	size_t response_size;
+	size_t response_count;
+};
+
+constexpr workload WORKLOAD_LIST[]{
+	{"small (4 KiB)", 4096, 20000},
+	{"large (64 MiB)", 64 * 1024 * 1024, 8},
+};
+
+using ssl_context_pointer = std::unique_ptr<SSL_CTX, decltype(&SSL_CTX_free)>;
+using ssl_pointer = std::unique_ptr<SSL, decltype(&SSL_free)>;
+
+// A throwaway self-signed certificate, so that the benchmark needs no files.
+ssl_context_pointer make_server_context(const bool ktls)
+{
+	ssl_context_pointer ssl_context{SSL_CTX_new(TLS_server_method()), &SSL_CTX_free};
+	EVP_PKEY *private_key = EVP_EC_gen("P-256");
+	X509 *certificate = X509_new();
+	X509_set_version(certificate, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+	X509_gmtime_adj(X509_getm_notBefore(certificate), 0);
+	X509_gmtime_adj(X509_getm_notAfter(certificate), 3600);
+	X509_set_pubkey(certificate, private_key);
+	X509_NAME_add_entry_by_txt(
+		X509_get_subject_name(certificate), "CN", MBSTRING_ASC,
+		reinterpret_cast<const unsigned char *>("localhost"), -1, -1, 0);
+	X509_set_issuer_name(certificate, X509_get_subject_name(certificate));
+	X509_sign(certificate, private_key, EVP_sha256());
+	SSL_CTX_use_certificate(ssl_context.get(), certificate);
+	SSL_CTX_use_PrivateKey(ssl_context.get(), private_key);
+	X509_free(certificate);
+	EVP_PKEY_free(private_key);
+
+	// The same protocol and cipher as the server, so that only the record
+	// layer differs between the runs.
+	SSL_CTX_set_max_proto_version(ssl_context.get(), TLS1_2_VERSION);
+	SSL_CTX_set_cipher_list(ssl_context.get(), "ECDHE-ECDSA-AES128-GCM-SHA256");
+	if (ktls)
+	{
+		SSL_CTX_set_options(ssl_context.get(), SSL_OP_ENABLE_KTLS);
+	}
+	return ssl_context;
+}
+
+// Return the elapsed seconds, or a negative value if kTLS is unavailable.
+double run(const workload &workload, const bool ktls)
+{
+	char file_path[] = "/tmp/couringserver_tls_bench_XXXXXX";
+	const int file_descriptor = mkstemp(file_path);
+	unlink(file_path);
+	std::vector<char> body(workload.response_size, 'x');
+	if (write(file_descriptor, body.data(), body.size()) != static_cast<ssize_t>(body.size()))
+	{
+		std::abort();
+	}
+
+	const int listener = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in address{};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t address_size = sizeof(address);
+	bind(listener, reinterpret_cast<sockaddr *>(&address), address_size);
+	listen(listener, 1);
+	getsockname(listener, reinterpret_cast<sockaddr *>(&address), &address_size);
+
+	std::jthread client_thread([&address, &workload]()
+							   {
+		const ssl_context_pointer ssl_context{SSL_CTX_new(TLS_client_method()), &SSL_CTX_free};
+		const int client = socket(AF_INET, SOCK_STREAM, 0);
+		connect(client, reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+		const ssl_pointer ssl{SSL_new(ssl_context.get()), &SSL_free};
+		SSL_set_fd(ssl.get(), client);
+		if (SSL_connect(ssl.get()) == 1)
+		{
+			std::vector<char> buffer(256 * 1024);
+			size_t remaining_size = workload.response_size * workload.response_count;
+			while (remaining_size > 0)
+			{
+				const int result = SSL_read(ssl.get(), buffer.data(), buffer.size());
+				if (result <= 0)
+				{
+					break;
+				}
+				remaining_size -= result;
+			}
+		}
+		close(client); });
+
+	const int server = accept(listener, nullptr, nullptr);
+	const ssl_context_pointer ssl_context = make_server_context(ktls);
+	const ssl_pointer ssl{SSL_new(ssl_context.get()), &SSL_free};
+	SSL_set_fd(ssl.get(), server);
+	double elapsed_seconds = -1;
+	if (SSL_accept(ssl.get()) == 1 && (!ktls || BIO_get_ktls_send(SSL_get_wbio(ssl.get()))))
+	{
+		const auto start = std::chrono::steady_clock::now();
+		for (size_t index = 0; index < workload.response_count; ++index)
+		{
+			if (ktls)
+			{
+				// The kernel encrypts the page cache pages, like the 'splice' path.
+				SSL_sendfile(ssl.get(), file_descriptor, 0, workload.response_size, 0);
+			}
+			else
+			{
+				// A user space TLS server reads the file and encrypts a copy.
+				pread(file_descriptor, body.data(), body.size(), 0);
+				SSL_write(ssl.get(), body.data(), body.size());
+			}
+		}
+		shutdown(server, SHUT_WR);
+		client_thread.join();
+		elapsed_seconds =
+			std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	else
+	{
+		shutdown(server, SHUT_RDWR);
+	}
+
+	close(server);
+	close(listener);
+	close(file_descriptor);
+	return elapsed_seconds;
+}
+} // namespace
+
+int main()
+{
+	for (const workload &workload : WORKLOAD_LIST)
+	{
+		for (const bool ktls : {false, true})
+		{
+			const char *mode = ktls ? "kTLS sendfile" : "user space TLS";
+			const double elapsed_seconds = run(workload, ktls);
+			if (elapsed_seconds < 0)
+			{
+				std::printf("%-16s %-16s unavailable (is the 'tls' module loaded?)\n", workload.name, mode);
+				continue;
+			}
+			const double total_size = static_cast<double>(workload.response_size) * workload.response_count;
+			std::printf("%-16s %-16s %10.2f MiB/s %10.2f us/response\n", workload.name, mode,
+						total_size / elapsed_seconds / (1024 * 1024),
+						elapsed_seconds * 1e6 / workload.response_count);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,84 @@
+#ifndef ACCESS_LOG_HPP
+#define ACCESS_LOG_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "constant.hpp"
+#include "file_descriptor.hpp"
+#include "http_message.hpp"
+#include "local_task.hpp"
+#include "metrics.hpp"
+
+namespace couringserver {
+/**
+ * @brief access log of a single worker
+ * @details This class formats an entry per request in the combined log
+ * format, followed by the duration of the request in seconds, into the
+ * active one of two preallocated buffers. At the end of every event loop turn
+ * the entries are handed to io_uring in a single write while the other
+ * buffer takes the next entries, so logging costs a bounded copy per request
+ * and never blocks the ring. When both buffers are busy the entry is dropped
+ * and counted in 'worker_metrics'. The file is reopened before the next write
+ * once the reopen generation changes, so that a rotated file is let go.
+ */
+class access_log
+{
+public:
+	// An empty path disables the log. The file is opened for appending and
+	// created if needed.
+	access_log(
+		std::filesystem::path path, const std::atomic<uint64_t> &reopen_generation,
+		worker_metrics &worker_metrics);
+
+	access_log(access_log &&other) = delete;
+	access_log &operator=(access_log &&other) = delete;
+	access_log(const access_log &other) = delete;
+	access_log &operator=(const access_log &other) = delete;
+
+	bool is_enabled() const noexcept;
+
+	// Format an entry, long fields are truncated so that it fits in
+	// 'ACCESS_LOG_MAX_ENTRY_SIZE' bytes.
+	void append(
+		std::string_view peer_address, const http_request &http_request, const http_response &http_response,
+		uint64_t body_size, std::chrono::nanoseconds duration);
+
+	// Start writing the buffered entries, unless a write is in flight.
+	void flush();
+
+	// Whether every entry has been written.
+	bool is_idle() const noexcept;
+
+private:
+	// Write the active buffer and swap the buffers until no entry is left.
+	local_task<> write_loop();
+
+	const std::string path_;
+	const std::atomic<uint64_t> &reopen_generation_;
+	uint64_t generation_;
+	worker_metrics &worker_metrics_;
+	file_descriptor file_descriptor_;
+
+	std::array<std::unique_ptr<char[]>, 2> buffer_list_;
+	size_t active_index_ = 0;
+	size_t active_size_ = 0;
+	uint64_t active_entry_count_ = 0;
+	bool writing_ = false;
+
+	// The timestamp is formatted once per second.
+	std::time_t cached_time_ = -1;
+	std::array<char, 32> time_buffer_;
+	size_t time_size_ = 0;
+};
+} // namespace couringserver
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef ASSET_PACK_HPP
+#define ASSET_PACK_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+
+#include "file_descriptor.hpp"
+
+namespace couringserver {
+// The encodings of an asset, in the order of preference. The compressed ones
+// are the '.br' and '.gz' files next to the original in the directory.
+enum class asset_encoding : uint32_t
+{
+	br,
+	gzip,
+	identity,
+};
+
+inline constexpr size_t ASSET_ENCODING_COUNT = 3;
+
+// A string in the pack, at an offset from the start of the file.
+struct asset_pack_string
+{
+	uint64_t offset;
+	uint64_t size;
+};
+
+struct asset_pack_variant
+{
+	// the response header lines of a '200 OK', each ending with CRLF:
+	// 'content-type', 'content-length', 'etag', 'last-modified',
+	// 'accept-ranges' or, for a compressed variant, 'content-encoding', and
+	// 'vary' if the asset has compressed variants
+	asset_pack_string header_block;
+	asset_pack_string entity_tag;
+	// page-aligned
+	uint64_t body_offset;
+	uint64_t body_size;
+};
+
+// A slot of the hash table, empty if the path is.
+struct asset_pack_slot
+{
+	asset_pack_string path;
+	asset_pack_string last_modified;
+	int64_t modification_time;
+	// a bit per 'asset_encoding' that the asset has
+	uint32_t variant_mask;
+	uint32_t reserved;
+	std::array<asset_pack_variant, ASSET_ENCODING_COUNT> variant_list;
+};
+
+/**
+ * @brief first bytes of an asset pack
+ * @details The header is followed by the seeds of the buckets, the slots,
+ * the strings, and the bodies. The integers are in the byte order of the
+ * machine that built the pack, which 'byte_order' tells apart.
+ */
+struct asset_pack_header
+{
+	std::array<char, 8> magic;
+	uint32_t byte_order;
+	uint32_t version;
+	uint64_t file_size;
+	uint32_t asset_count;
+	uint32_t bucket_count;
+	uint64_t slot_count;
+	uint64_t seed_list_offset;
+	uint64_t slot_list_offset;
+};
+
+inline constexpr std::array<char, 8> ASSET_PACK_MAGIC{'C', 'U', 'S', 'P', 'A', 'C', 'K', '\0'};
+
+inline constexpr uint32_t ASSET_PACK_BYTE_ORDER = 0x01020304;
+
+inline constexpr uint32_t ASSET_PACK_VERSION = 1;
+
+// The hash of a path, a seed of 0 picks the bucket and the seed of the bucket
+// the slot.
+uint64_t hash_asset_path(std::string_view path, uint32_t seed) noexcept;
+
+struct asset_pack_summary
+{
+	size_t asset_count = 0;
+	// the assets that are a directory index, served for the directory path
+	size_t index_count = 0;
+	// the compressed variants
+	size_t variant_count = 0;
+	uintmax_t body_size = 0;
+	uintmax_t pack_size = 0;
+};
+
+// Pack the regular files below the directory into a pack at 'pack_path',
+// each under its path relative to the directory with a leading '/'. A
+// directory with an 'index.html' is also packed under its path with a
+// trailing '/'. Throw 'std::runtime_error' if a file cannot be read or the
+// pack cannot be written.
+asset_pack_summary build_asset_pack(const std::filesystem::path &directory, const std::filesystem::path &pack_path);
+
+/**
+ * @brief immutable pack of static assets, mapped into memory
+ * @details A path is looked up with a perfect hash ('hash and displace'): the
+ * hash of the path picks a bucket, the seed of the bucket the slot, which
+ * holds that path or no asset of the pack. A lookup thus reads two cache
+ * lines of the index and compares the path, without a system call. Only the
+ * header is checked when the pack is opened, so that startup does not depend
+ * on the number of assets; a slot is checked against the size of the pack
+ * when it is looked up. The pack is shared by the workers, it is never
+ * written.
+ */
+class asset_pack
+{
+public:
+	// Map the pack, 'populate' reads it into memory up front and 'huge_pages'
+	// asks for transparent huge pages, if the file system supports them.
+	// Throw 'std::runtime_error' if the pack cannot be mapped or is invalid.
+	asset_pack(const std::filesystem::path &pack_path, bool populate, bool huge_pages);
+	~asset_pack();
+
+	asset_pack(const asset_pack &) = delete;
+	asset_pack &operator=(const asset_pack &) = delete;
+
+	// Return the slot of the path, or nullptr if it is not in the pack.
+	const asset_pack_slot *find(std::string_view path) const noexcept;
+
+	// Return the best variant of the asset for an 'Accept-Encoding' value.
+	// 'identity' is always acceptable, as it is what an asset has at least.
+	static asset_encoding select_encoding(const asset_pack_slot &slot, std::optional<std::string_view> accept_encoding);
+
+	std::string_view get_string(const asset_pack_string &string) const noexcept;
+
+	std::span<const char> get_body(const asset_pack_variant &variant) const noexcept;
+
+	// The pack file, for splicing a body from its offset.
+	const file_descriptor &get_file_descriptor() const noexcept;
+
+	size_t get_asset_count() const noexcept;
+
+private:
+	bool is_valid(const asset_pack_slot &slot) const noexcept;
+
+	file_descriptor file_descriptor_;
+	const char *mapping_ = nullptr;
+	size_t mapping_size_ = 0;
+	const asset_pack_header *header_ = nullptr;
+	std::span<const uint32_t> seed_list_;
+	std::span<const asset_pack_slot> slot_list_;
+};
+} // namespace couringserver
+
+#endif
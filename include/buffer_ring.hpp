@@ -3,8 +3,10 @@
 
 #include <liburing/io_uring.h>
 
+#include <atomic>
 #include <bitset>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <span>
 #include <vector>
@@ -13,6 +15,19 @@
 
 namespace couringserver {
 
+/**
+ * @brief usage of the buffer ring
+ * @details Like 'event_loop_statistics', the counters are written by the
+ * thread of the buffer ring only and can be read by other threads.
+ */
+struct buffer_ring_statistics
+{
+	std::atomic<uint64_t> borrowed_count = 0;
+	std::atomic<uint64_t> max_borrowed_count = 0;
+	// receives that failed with '-ENOBUFS' because every buffer was taken
+	std::atomic<uint64_t> no_buffer_count = 0;
+};
+
 /**
  * @brief manage buffer ring
  * @details This class is a singleton class that manages the buffer ring.
@@ -27,11 +42,18 @@ public:
 	std::span<char> borrow_buffer(const unsigned int buffer_id, const size_t size);
 	// Return the buffer to the buffer ring.
 	void return_buffer(const unsigned int buffer_id);
+	// Count a receive that found no buffer in the ring.
+	void record_no_buffer() noexcept;
+	// The size of every buffer, the most a single receive returns.
+	size_t get_buffer_size() const noexcept;
+
+	const buffer_ring_statistics &get_statistics() const noexcept;
 
 private:
 	std::unique_ptr<io_uring_buf_ring> buffer_ring_;
 	std::vector<std::vector<char>> buffer_list_;
 	std::bitset<MAX_BUFFER_RING_SIZE> borrowed_buffer_set_;
+	buffer_ring_statistics buffer_ring_statistics_;
 };
 } // namespace couringserver
 
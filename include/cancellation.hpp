@@ -0,0 +1,92 @@
+#ifndef CANCELLATION_HPP
+#define CANCELLATION_HPP
+
+#include <linux/time_types.h>
+
+#include <chrono>
+#include <coroutine>
+#include <vector>
+
+#include "io_uring.hpp"
+#include "local_task.hpp"
+
+namespace couringserver {
+/**
+ * @brief cancellation of in-flight io_uring requests
+ * @details Awaiters that are given a cancellation_token register their
+ * 'sqe_data' with it while their request is in flight. 'cancel()' submits an
+ * 'IORING_OP_ASYNC_CANCEL' request for each of them and completes once the
+ * kernel has answered every cancel request, so the cancelled awaiters are
+ * resumed with '-ECANCELED' before their frames can be freed. Awaiters that
+ * start after the cancellation complete immediately with '-ECANCELED'. A
+ * token is bound to the thread of its io_uring and is not reusable.
+ */
+class cancellation_token
+{
+public:
+	cancellation_token() = default;
+
+	cancellation_token(const cancellation_token &other) = delete;
+	cancellation_token &operator=(const cancellation_token &other) = delete;
+
+	bool is_cancelled() const noexcept;
+
+	// Cancel every registered request and wait for the cancel completions.
+	local_task<> cancel();
+
+	void register_request(sqe_data *sqe_data);
+	void unregister_request(sqe_data *sqe_data);
+
+private:
+	bool cancelled_ = false;
+	std::vector<sqe_data *> request_list_;
+};
+
+// Used by the awaiters in 'await_ready()': return true and complete the
+// request with '-ECANCELED' if the token has already been cancelled.
+bool skip_cancelled_request(const cancellation_token *cancellation_token, sqe_data &sqe_data);
+
+/**
+ * @brief awaiter for cancel operation
+ * @details This class is the awaiter for an 'IORING_OP_ASYNC_CANCEL' request.
+ * Its completion carries its own 'sqe_data', so that the result can be
+ * correlated with the request being cancelled.
+ */
+class cancel_awaiter
+{
+public:
+	explicit cancel_awaiter(const sqe_data *target_sqe_data);
+
+	bool await_ready() const;
+	void await_suspend(std::coroutine_handle<> coroutine);
+	int await_resume() const;
+
+private:
+	const sqe_data *target_sqe_data_;
+	sqe_data sqe_data_;
+};
+
+/**
+ * @brief awaiter for timeout operation
+ * @details This class is the awaiter for an 'IORING_OP_TIMEOUT' request. It is
+ * resumed with '-ETIME' once the duration has elapsed, which makes it the
+ * deadline side of a 'when_any' race.
+ */
+class timeout_awaiter
+{
+public:
+	explicit timeout_awaiter(
+		std::chrono::nanoseconds duration, cancellation_token *cancellation_token = nullptr);
+
+	bool await_ready();
+	void await_suspend(std::coroutine_handle<> coroutine);
+	int await_resume();
+
+private:
+	__kernel_timespec timespec_;
+	cancellation_token *cancellation_token_;
+	sqe_data sqe_data_;
+};
+} // namespace couringserver
+
+#endif
@@ -1,13 +1,33 @@
 #ifndef CONSTANT_HPP
 #define CONSTANT_HPP
 
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
 
 namespace couringserver
 {
 
     constexpr unsigned int SOCKET_LISTEN_QUEUE_SIZE = 512;
 
+    // socket profile, 0 disables each of them or leaves the kernel default:
+    // the seconds 'TCP_DEFER_ACCEPT' holds a client back until its first bytes,
+    // the 'TCP_FASTOPEN' queue length, 'SO_SNDBUF'/'SO_RCVBUF' of the clients
+    // and their 'TCP_NOTSENT_LOWAT'
+    constexpr unsigned int TCP_DEFER_ACCEPT_TIMEOUT = 0;
+
+    constexpr unsigned int TCP_FASTOPEN_QUEUE_SIZE = 0;
+
+    constexpr unsigned int SOCKET_SEND_BUFFER_SIZE = 0;
+
+    constexpr unsigned int SOCKET_RECEIVE_BUFFER_SIZE = 0;
+
+    constexpr unsigned int TCP_NOTSENT_LOW_WATERMARK = 0;
+
+    // sends of at least this many bytes to a TCP client are zero-copy if the
+    // kernel supports 'IORING_OP_SEND_ZC', 0 disables them
+    constexpr unsigned int SEND_ZC_THRESHOLD = 0;
+
     constexpr unsigned int MAX_BUFFER_RING_SIZE = 65536;
 
     constexpr size_t IO_URING_QUEUE_SIZE = 2048;
@@ -18,6 +38,169 @@ namespace couringserver
 
     constexpr size_t BUFFER_SIZE = 1024;
 
+    // packets a connection may queue from its multishot receive while it is
+    // busy, at which the request is cancelled until they are processed
+    constexpr size_t MULTISHOT_RECV_QUEUE_SIZE = 8;
+
+    // per-worker admission control: the multishot accept is paused at the
+    // connection cap and resumed once the count drops to the low watermark
+    constexpr size_t MAX_CONNECTION_COUNT = 16384;
+
+    constexpr size_t CONNECTION_LOW_WATERMARK = 14336;
+
+    constexpr size_t MAX_INFLIGHT_REQUEST_COUNT = 4096;
+
+    // seconds a draining worker waits for its busy connections, e.g. with a
+    // partial request or a stalled stream, before it shuts them down
+    constexpr unsigned int DRAIN_GRACE_PERIOD = 30;
+
+    // limits of a request head: longer request lines are answered with
+    // '414 URI Too Long', more or larger header lines with '431 Request Header
+    // Fields Too Large'
+    constexpr size_t MAX_REQUEST_LINE_SIZE = 8192;
+
+    constexpr size_t MAX_HEADER_COUNT = 100;
+
+    constexpr size_t MAX_HEADER_SIZE = 16384;
+
+    // per-worker budget of the bytes buffered by the request parsers, a
+    // connection that grows its partial request beyond it is shed with
+    // '503 Service Unavailable'
+    constexpr size_t PARSER_MEMORY_BUDGET = 67108864;
+
+    // coroutine frames up to this size are carved from per-thread slabs
+    constexpr size_t MAX_SLAB_FRAME_SIZE = 2048;
+
+    constexpr size_t FRAME_SLAB_SIZE = 65536;
+
+    // answer requests beyond the in-flight cap with '503 Service Unavailable'
+    // instead of queueing them
+    constexpr bool REJECT_ON_OVERLOAD = true;
+
+    // busy polling for the low-latency tier in microseconds, 0 disables each
+    // of them: the event loop spins on the completion queue for up to the
+    // budget before sleeping, io_uring busy-polls the NIC queues while waiting
+    // (NAPI), and accepted sockets get 'SO_BUSY_POLL'
+    constexpr unsigned int EVENT_LOOP_SPIN_BUDGET = 0;
+
+    constexpr unsigned int NAPI_BUSY_POLL_TIMEOUT = 0;
+
+    constexpr unsigned int SOCKET_BUSY_POLL_TIMEOUT = 0;
+
+    // SQE/CQE tracing: every worker keeps its latest events in a ring of this
+    // many entries, dumped as a Chrome trace by 'GET /debug/trace' or written
+    // to the path on SIGUSR2. When disabled the hooks compile to nothing.
+    constexpr bool IO_TRACE = false;
+
+    constexpr size_t IO_TRACE_EVENT_COUNT = 65536;
+
+    constexpr char IO_TRACE_PATH[] = "/tmp/couringserver-trace.json";
+
+    // one in this many submissions is timed until its completion, see
+    // 'ring_statistics'
+    constexpr uint64_t IO_LATENCY_SAMPLE_INTERVAL = 64;
+
+    // access log: every worker appends to '<path>.<worker index>' with
+    // io_uring writes, an empty path disables it. The entries are formatted
+    // into one of two buffers of this size, the other one being written, and
+    // an entry is dropped when both are busy. With this many requests in
+    // flight only one in the sample interval is logged. SIGHUP reopens the
+    // files, e.g. after they were rotated.
+    constexpr char ACCESS_LOG_PATH[] = "access.log";
+
+    constexpr size_t ACCESS_LOG_BUFFER_SIZE = 262144;
+
+    constexpr size_t ACCESS_LOG_MAX_ENTRY_SIZE = 2048;
+
+    constexpr size_t ACCESS_LOG_OVERLOAD_THRESHOLD = 1024;
+
+    constexpr size_t ACCESS_LOG_OVERLOAD_SAMPLE_INTERVAL = 16;
+
+    // a 'Range' header with more ranges than this is ignored
+    constexpr size_t MAX_RANGE_COUNT = 16;
+
+    // large bodies are spliced in chunks of the default pipe capacity, and a
+    // stream yields to the other connections of its worker after each budget
+    constexpr size_t STREAM_CHUNK_SIZE = 65536;
+
+    constexpr size_t STREAM_TURN_BYTE_BUDGET = 262144;
+
+    // file metadata and validators are trusted for this long before the file
+    // is examined again, the cache is cleared once it holds the maximum size
+    constexpr std::chrono::milliseconds FILE_METADATA_CACHE_TTL{1000};
+
+    constexpr size_t MAX_FILE_METADATA_CACHE_SIZE = 4096;
+
+    // asset pack: when the path is set, static files are served from the pack
+    // instead of the file system. Bodies up to the inline size are sent from
+    // the mapping along with the head, larger ones are spliced from the pack.
+    constexpr char ASSET_PACK_PATH[] = "";
+
+    constexpr size_t ASSET_PACK_INLINE_BODY_SIZE = 16384;
+
+    constexpr size_t ASSET_PACK_BODY_ALIGNMENT = 4096;
+
+    // page cache warming: the files at or below the comma-separated paths are
+    // read ahead at startup and on SIGUSR1, with this many requests in flight
+    // and up to the budget in bytes, an empty path disables it. Files of at
+    // least the threshold are read ahead more aggressively while streamed.
+    constexpr char PAGE_CACHE_WARM_PATH[] = "";
+
+    constexpr unsigned int PAGE_CACHE_WARM_QUEUE_DEPTH = 64;
+
+    constexpr size_t PAGE_CACHE_WARM_BYTE_BUDGET = 1073741824;
+
+    constexpr uintmax_t SEQUENTIAL_READ_THRESHOLD = 1048576;
+
+    // reverse proxy: an upstream is considered down after consecutive failures
+    // and probed again after the retry interval, an idempotent request whose
+    // reused connection turns out to be closed is retried on a new one
+    constexpr std::chrono::milliseconds UPSTREAM_CONNECT_TIMEOUT{1000};
+
+    constexpr std::chrono::milliseconds UPSTREAM_RESPONSE_TIMEOUT{30000};
+
+    constexpr size_t UPSTREAM_RETRY_COUNT = 1;
+
+    constexpr size_t UPSTREAM_FAILURE_THRESHOLD = 3;
+
+    constexpr std::chrono::milliseconds UPSTREAM_RETRY_INTERVAL{5000};
+
+    constexpr size_t MAX_IDLE_UPSTREAM_CONNECTION_COUNT = 32;
+
+    constexpr size_t MAX_UPSTREAM_RESPONSE_HEAD_SIZE = 16384;
+
+    // HTTPS with kTLS, enabled when both files exist
+    constexpr char TLS_PORT[] = "8443";
+
+    constexpr char TLS_CERTIFICATE_PATH[] = "cert.pem";
+
+    constexpr char TLS_PRIVATE_KEY_PATH[] = "key.pem";
+
+    constexpr std::chrono::milliseconds TLS_HANDSHAKE_TIMEOUT{10000};
+
+    // h2c: the size of the HPACK dynamic table and of a decoded header list,
+    // the streams a client may open at once, the DATA frames gathered into a
+    // single send, and the queued frames other than DATA beyond which the
+    // connection stops reading, e.g. the acknowledgements of a PING flood
+    constexpr size_t HTTP2_HEADER_TABLE_SIZE = 4096;
+
+    constexpr size_t HTTP2_MAX_HEADER_LIST_SIZE = 16384;
+
+    constexpr uint32_t HTTP2_MAX_CONCURRENT_STREAMS = 128;
+
+    constexpr size_t HTTP2_SEND_BATCH_SIZE = 65536;
+
+    constexpr size_t HTTP2_MAX_CONTROL_BUFFER_SIZE = 65536;
+
+    // the handoff socket is created in '$XDG_RUNTIME_DIR', or else in a
+    // directory of the prefix and the user id, e.g. '/tmp/couringserver-1000'
+    constexpr char LISTENER_HANDOFF_SOCKET_NAME[] = "couringserver.sock";
+
+    constexpr char LISTENER_HANDOFF_DIRECTORY_PREFIX[] = "/tmp/couringserver-";
+
+    // SCM_MAX_FD, the number of file descriptors a single 'sendmsg' may carry
+    constexpr unsigned int MAX_HANDOFF_BATCH_SIZE = 253;
+
 } // namespace couringserver
 
 #endif
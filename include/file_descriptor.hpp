@@ -1,16 +1,21 @@
 #ifndef FILE_DESCRIPTOR_HPP
 #define FILE_DESCRIPTOR_HPP
 
+#include <sys/types.h>
 #include <unistd.h>
 
 #include <compare>
+#include <cstdint>
 #include <coroutine>
 #include <filesystem>
 #include <optional>
+#include <span>
+#include <system_error>
 #include <tuple>
 
+#include "cancellation.hpp"
 #include "io_uring.hpp"
-#include "task.hpp"
+#include "local_task.hpp"
 
 namespace couringserver
 {
@@ -49,32 +54,153 @@ protected:
 class splice_awaiter
 {
 public:
-    splice_awaiter(int raw_file_descriptor_in, int raw_file_descriptor_out, size_t length);
+    splice_awaiter(
+        int raw_file_descriptor_in, int64_t offset_in, int raw_file_descriptor_out, size_t length,
+        cancellation_token *cancellation_token = nullptr);
 
-    bool await_ready() const;
+    bool await_ready();
     
     // This function is called when the coroutine is suspended.
     void await_suspend(std::coroutine_handle<> coroutine);
-    ssize_t await_resume() const;
+    ssize_t await_resume();
 
 private:
     const int raw_file_descriptor_in_;
+    const int64_t offset_in_;
     const int raw_file_descriptor_out_;
     const size_t length_;
+    cancellation_token *cancellation_token_;
     sqe_data sqe_data_;
 };
 
-// Splice the data from one file descriptor to another.
-task<ssize_t> splice(
-    const file_descriptor &file_descriptor_in, const file_descriptor &file_descriptor_out,
-    const size_t length);
+/**
+ * @brief awaiter for read operation
+ * @details This class is the awaiter for the read operation. It is used to
+ * read from a file descriptor (e.g. an eventfd) asynchronously. A file is
+ * read at 'offset', which is ignored by descriptors that cannot seek.
+ */
+class read_awaiter
+{
+public:
+    read_awaiter(
+        int raw_file_descriptor, std::span<char> buffer, uint64_t offset = 0,
+        cancellation_token *cancellation_token = nullptr);
+
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> coroutine);
+    ssize_t await_resume();
+
+private:
+    const int raw_file_descriptor_;
+    const std::span<char> buffer_;
+    const uint64_t offset_;
+    cancellation_token *cancellation_token_;
+    sqe_data sqe_data_;
+};
+
+/**
+ * @brief awaiter for write operation
+ * @details This class is the awaiter for the write operation. It is used to
+ * write to a file without blocking the event loop. An offset of -1 writes at
+ * the current file position, which is the end of a file opened with
+ * 'O_APPEND'.
+ */
+class write_awaiter
+{
+public:
+    write_awaiter(
+        int raw_file_descriptor, std::span<const char> buffer, uint64_t offset,
+        cancellation_token *cancellation_token = nullptr);
+
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> coroutine);
+    ssize_t await_resume();
+
+private:
+    const int raw_file_descriptor_;
+    const std::span<const char> buffer_;
+    const uint64_t offset_;
+    cancellation_token *cancellation_token_;
+    sqe_data sqe_data_;
+};
+
+/**
+ * @brief awaiter for openat operation
+ * @details This class is the awaiter for the openat operation, relative to
+ * the working directory. It resumes the coroutine with the new file
+ * descriptor, or a negative error number. The path must outlive the awaiter.
+ */
+class openat_awaiter
+{
+public:
+    openat_awaiter(
+        const char *path, int flags, mode_t mode, cancellation_token *cancellation_token = nullptr);
+
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> coroutine);
+    int await_resume();
+
+private:
+    const char *path_;
+    const int flags_;
+    const mode_t mode_;
+    cancellation_token *cancellation_token_;
+    sqe_data sqe_data_;
+};
+
+/**
+ * @brief awaiter for poll operation
+ * @details This class is the awaiter for a single-shot poll request. It
+ * resumes the coroutine with the ready events once the file descriptor
+ * reports any of the events in the mask (e.g. 'POLLOUT' when a socket has
+ * room in its send buffer).
+ */
+class poll_awaiter
+{
+public:
+    poll_awaiter(
+        int raw_file_descriptor, unsigned int poll_mask,
+        cancellation_token *cancellation_token = nullptr);
+
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> coroutine);
+    int await_resume();
+
+private:
+    const int raw_file_descriptor_;
+    const unsigned int poll_mask_;
+    cancellation_token *cancellation_token_;
+    sqe_data sqe_data_;
+};
+
+// Splice the data from one file descriptor to another, starting at 'offset'
+// of the input, or at its current position if 'offset' is -1.
+local_task<ssize_t> splice(
+    const file_descriptor &file_descriptor_in, int64_t offset,
+    const file_descriptor &file_descriptor_out, const size_t length,
+    cancellation_token *cancellation_token = nullptr);
+
+// Splice through the given pipe instead of creating one, so that a stream of
+// chunks can reuse it. The pipe is empty again when the call succeeds.
+local_task<ssize_t> splice(
+    const file_descriptor &file_descriptor_in, int64_t offset,
+    const file_descriptor &file_descriptor_out, const size_t length,
+    const std::tuple<file_descriptor, file_descriptor> &pipe,
+    cancellation_token *cancellation_token = nullptr);
 
 // Create a pipe.
 std::tuple<file_descriptor, file_descriptor> pipe();
 
+// Create a pipe, or set 'error_code' and return empty file descriptors.
+std::tuple<file_descriptor, file_descriptor> pipe(std::error_code &error_code);
+
 // Open a file descriptor for a file.
 file_descriptor open(const std::filesystem::path &path);
 
+// Open a file descriptor for a file, or set 'error_code' and return an empty
+// one.
+file_descriptor open(const std::filesystem::path &path, std::error_code &error_code);
+
 } // namespace couringserver
 
 #endif
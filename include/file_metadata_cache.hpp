@@ -0,0 +1,59 @@
+#ifndef FILE_METADATA_CACHE_HPP
+#define FILE_METADATA_CACHE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+
+#include "http_message.hpp"
+
+namespace couringserver {
+// The metadata of a regular file, with its validators formatted up front.
+struct file_metadata
+{
+	uintmax_t size;
+	std::time_t modification_time;
+	std::string entity_tag;
+	std::string last_modified;
+	std::chrono::steady_clock::time_point expiration_time;
+};
+
+// Return true if the conditional headers of a 'GET' or 'HEAD' request are met
+// by the file, so that it is answered with '304 Not Modified'.
+// 'If-None-Match' takes precedence over 'If-Modified-Since'.
+bool is_not_modified(const http_request &http_request, const file_metadata &file_metadata);
+
+bool is_not_modified(const http_request &http_request, std::string_view entity_tag, std::time_t modification_time);
+
+/**
+ * @brief cache of file metadata and validators
+ * @details This class caches the result of 'stat()' along with the 'ETag' and
+ * 'Last-Modified' values derived from it, so that a revalidation hit is
+ * answered without any system call. An entry is trusted for
+ * 'FILE_METADATA_CACHE_TTL', after which the file is examined again. The
+ * cache is owned by a single 'thread_worker' and is not thread-safe.
+ */
+class file_metadata_cache
+{
+public:
+	// Return the metadata of the regular file at the path, or nullptr if there
+	// is no such file. The pointer is valid until the next call.
+	const file_metadata *get(const std::filesystem::path &path);
+
+	// Account for a file that was found but could not be opened, e.g. removed
+	// or made unreadable since its metadata was cached. A file that is gone is
+	// forgotten. Return the status of the response: '404', '403' without
+	// permission, or else '500'.
+	std::string_view report_open_error(const std::filesystem::path &path, std::error_code error_code);
+
+private:
+	std::unordered_map<std::string, file_metadata> file_metadata_map_;
+};
+} // namespace couringserver
+
+#endif
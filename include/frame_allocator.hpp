@@ -0,0 +1,87 @@
+#ifndef FRAME_ALLOCATOR_HPP
+#define FRAME_ALLOCATOR_HPP
+
+#include <array>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+#include "constant.hpp"
+
+namespace couringserver {
+/**
+ * @brief per-thread slab allocator of coroutine frames
+ * @details The frame size is rounded up to a multiple of the fundamental
+ * alignment, and a frame is taken from the free list of its size class. An
+ * empty list is refilled from a 'FRAME_SLAB_SIZE' slab, so the frames of the
+ * connections of a worker are packed together without the per-chunk overhead
+ * of 'malloc'. A freed frame goes to the free list of the freeing thread. The
+ * slabs are never returned, so a frame stays valid until it is freed, even by
+ * a 'thread_local' destructor that runs after the allocator of its thread is
+ * gone. Larger frames use the global allocator.
+ */
+class frame_allocator
+{
+public:
+	static void *allocate(const size_t size)
+	{
+		if (size > MAX_SLAB_FRAME_SIZE)
+		{
+			return ::operator new(size);
+		}
+
+		thread_state &thread_state = get_thread_state();
+		free_frame *&free_list = thread_state.free_list_list[get_size_class(size)];
+		if (free_list != nullptr)
+		{
+			return std::exchange(free_list, free_list->next);
+		}
+
+		const size_t frame_size = (get_size_class(size) + 1) * FRAME_ALIGNMENT;
+		if (static_cast<size_t>(thread_state.slab_end - thread_state.slab_position) < frame_size)
+		{
+			thread_state.slab_position = static_cast<char *>(::operator new(FRAME_SLAB_SIZE));
+			thread_state.slab_end = thread_state.slab_position + FRAME_SLAB_SIZE;
+		}
+		return std::exchange(thread_state.slab_position, thread_state.slab_position + frame_size);
+	}
+
+	static void deallocate(void *const frame, const size_t size) noexcept
+	{
+		if (size > MAX_SLAB_FRAME_SIZE)
+		{
+			::operator delete(frame);
+			return;
+		}
+
+		free_frame *&free_list = get_thread_state().free_list_list[get_size_class(size)];
+		free_list = ::new (frame) free_frame{free_list};
+	}
+
+private:
+	static constexpr size_t FRAME_ALIGNMENT = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+	struct free_frame
+	{
+		free_frame *next;
+	};
+
+	// trivially destructible, so that it outlives every frame of the thread
+	struct thread_state
+	{
+		std::array<free_frame *, MAX_SLAB_FRAME_SIZE / FRAME_ALIGNMENT> free_list_list{};
+		char *slab_position = nullptr;
+		char *slab_end = nullptr;
+	};
+
+	static size_t get_size_class(const size_t size) noexcept { return (size - 1) / FRAME_ALIGNMENT; }
+
+	static thread_state &get_thread_state() noexcept
+	{
+		static thread_local thread_state thread_state;
+		return thread_state;
+	}
+};
+} // namespace couringserver
+
+#endif
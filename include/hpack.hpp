@@ -0,0 +1,59 @@
+#ifndef HPACK_HPP
+#define HPACK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+namespace couringserver {
+using header_list_type = std::vector<std::tuple<std::string, std::string>>;
+
+/**
+ * @brief HPACK header block decoder
+ * @details This class decodes the header blocks of one HTTP/2 connection
+ * (RFC 7541), with the static table, a dynamic table bounded by
+ * 'HTTP2_HEADER_TABLE_SIZE' and Huffman-coded strings. The dynamic table
+ * carries over from one block to the next, so the blocks must be decoded in
+ * the order they are received.
+ */
+class hpack_decoder
+{
+public:
+	// Return std::nullopt on a compression error, the connection is unusable
+	// after that. The decoded list is limited to 'HTTP2_MAX_HEADER_LIST_SIZE'.
+	std::optional<header_list_type> decode(std::span<const uint8_t> header_block);
+
+private:
+	std::deque<std::tuple<std::string, std::string>> dynamic_table_;
+	size_t dynamic_table_size_ = 0;
+	size_t dynamic_table_capacity_;
+
+	std::optional<std::tuple<std::string, std::string>> get_entry(uint64_t index) const;
+	void add_entry(std::string name, std::string value);
+	void evict(size_t capacity);
+
+public:
+	hpack_decoder();
+};
+
+/**
+ * @brief HPACK header block encoder
+ * @details Response headers are encoded as literals that reference the static
+ * table for their names where possible, and are never added to the dynamic
+ * table, so the encoder keeps no state and the peer's table size is never
+ * exceeded.
+ */
+class hpack_encoder
+{
+public:
+	static void encode(std::string &header_block, std::string_view name, std::string_view value);
+};
+} // namespace couringserver
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef HTTP2_SESSION_HPP
+#define HTTP2_SESSION_HPP
+
+#include <sys/types.h>
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "file_descriptor.hpp"
+#include "hpack.hpp"
+#include "http_message.hpp"
+#include "local_task.hpp"
+#include "socket.hpp"
+
+namespace couringserver {
+class thread_worker;
+
+// Return true if the first bytes of a connection may be the HTTP/2 client
+// connection preface, i.e. the client speaks h2c with prior knowledge.
+bool is_http2_preface(std::string_view packet);
+
+// Return true if the request asks to upgrade to h2c with valid settings.
+bool is_http2_upgrade(const http_request &http_request);
+
+/**
+ * @brief cleartext HTTP/2 connection
+ * @details This class serves one h2c connection (RFC 9113), reached either
+ * with prior knowledge or through 'Upgrade: h2c'. A reader coroutine parses
+ * the frames and answers each request as soon as its headers are complete,
+ * while a writer coroutine gathers the pending frames into batches of up to
+ * 'HTTP2_SEND_BATCH_SIZE' bytes, taking one DATA frame at a time from each
+ * stream in turn within the flow control windows of the peer. Static files
+ * and the health check are served natively, other routes are answered with
+ * 'HTTP_1_1_REQUIRED' so that the client retries them over HTTP/1.1. A
+ * response holds a request slot of the worker until its stream is closed, a
+ * request finding none is refused. The reader waits while the frames other
+ * than DATA exceed 'HTTP2_MAX_CONTROL_BUFFER_SIZE', so that a peer which does
+ * not read cannot grow them with requests, PINGs or SETTINGS.
+ */
+class http2_session
+{
+public:
+	http2_session(
+		thread_worker &thread_worker, client_socket &client_socket, multishot_recv_guard &multishot_recv_guard);
+
+	// Serve the connection until either side closes it. 'received' holds the
+	// bytes already read from the connection, and 'upgrade_request' is the
+	// HTTP/1.1 request that upgraded it, which is answered on stream 1.
+	local_task<> serve(std::string received, const http_request *upgrade_request);
+
+private:
+	/**
+	 * @brief request slot of the worker held by a stream
+	 * @details The slot is given back when the stream is erased, whichever
+	 * way that happens.
+	 */
+	class request_slot
+	{
+	public:
+		request_slot() = default;
+		request_slot(request_slot &&other) noexcept;
+		request_slot &operator=(request_slot &&other) = delete;
+		~request_slot();
+
+		// Take a slot of the worker, return false if all are taken.
+		bool take(thread_worker &thread_worker);
+
+	private:
+		thread_worker *thread_worker_ = nullptr;
+	};
+
+	struct http2_stream
+	{
+		int64_t send_window = 0;
+		// The request headers, kept until the request is complete.
+		header_list_type header_list;
+		bool request_complete = false;
+
+		// The response body, read from 'body_file' at 'body_offset' or copied
+		// from 'body_mapping', e.g. of the asset pack, or from 'body_buffer'.
+		std::optional<file_descriptor> body_file;
+		std::span<const char> body_mapping;
+		std::string body_buffer;
+		uintmax_t body_offset = 0;
+		uintmax_t body_length = 0;
+		bool sending = false;
+		bool queued = false;
+		bool reset = false;
+		http2_session::request_slot request_slot;
+	};
+
+	thread_worker &thread_worker_;
+	client_socket &client_socket_;
+	multishot_recv_guard &multishot_recv_guard_;
+
+	hpack_decoder hpack_decoder_;
+	std::string input_buffer_;
+	bool preface_received_ = false;
+	bool settings_received_ = false;
+
+	// The header block of a HEADERS frame that is continued by CONTINUATION.
+	std::string header_block_;
+	uint32_t header_block_stream_id_ = 0;
+	bool header_block_end_stream_ = false;
+
+	std::unordered_map<uint32_t, http2_stream> stream_map_;
+	// Streams with response data to send, in round-robin order.
+	std::deque<uint32_t> send_queue_;
+	uint32_t last_stream_id_ = 0;
+
+	int64_t connection_send_window_;
+	int64_t peer_initial_window_size_;
+	size_t peer_max_frame_size_;
+
+	// Frames other than DATA, sent ahead of the data of the next batch.
+	std::string control_buffer_;
+	std::string send_buffer_;
+
+	bool reader_waiting_ = false;
+	bool reader_done_ = false;
+	bool writer_done_ = false;
+	bool goaway_sent_ = false;
+	bool goaway_received_ = false;
+	std::coroutine_handle<> writer_coroutine_;
+	std::coroutine_handle<> reader_coroutine_;
+
+	/**
+	 * @brief awaiter that parks the reader or the writer
+	 * @details The reader resumes the writer with 'notify_writer()' after it
+	 * has processed a packet, so the frames of a packet share a batch. The
+	 * writer resumes the reader with 'notify_reader()' once it has sent the
+	 * control frames that were over their limit.
+	 */
+	class park_awaiter
+	{
+	public:
+		explicit park_awaiter(std::coroutine_handle<> &parked_coroutine);
+
+		bool await_ready() const noexcept;
+		void await_suspend(std::coroutine_handle<> coroutine) const noexcept;
+		void await_resume() const noexcept;
+
+	private:
+		std::coroutine_handle<> &parked_coroutine_;
+	};
+
+	local_task<> read_loop(std::string received);
+	local_task<> write_loop();
+	void notify_writer();
+	void notify_reader();
+
+	// Process the complete frames of the input buffer, return false on a
+	// connection error, after which a GOAWAY is queued.
+	bool process_input();
+	bool process_frame(uint8_t type, uint8_t flags, uint32_t stream_id, std::span<const uint8_t> payload);
+	bool process_headers(uint32_t stream_id, bool end_stream);
+	bool process_data(uint8_t flags, uint32_t stream_id, std::span<const uint8_t> payload);
+	bool process_settings(uint8_t flags, uint32_t stream_id, std::span<const uint8_t> payload);
+	bool process_window_update(uint32_t stream_id, std::span<const uint8_t> payload);
+
+	// Apply the SETTINGS parameters of the peer, return the error code or 0.
+	uint32_t apply_settings(std::span<const uint8_t> payload);
+
+	// Answer the complete request of a stream.
+	void respond(uint32_t stream_id, const http_request &http_request);
+	void send_headers(uint32_t stream_id, const http_response &http_response, bool end_stream);
+	void reset_stream(uint32_t stream_id, uint32_t error_code);
+	void close_stream(uint32_t stream_id);
+	void send_goaway(uint32_t error_code);
+
+	// Queue a stream that has data to send and room in its window.
+	void schedule_stream(uint32_t stream_id, http2_stream &http2_stream);
+
+	// Append the DATA frames of the next batch to the send buffer, return
+	// the reads that fill them.
+	std::vector<local_task<ssize_t>> build_batch(std::vector<size_t> &read_length_list);
+
+	void update_idle();
+};
+} // namespace couringserver
+
+#endif
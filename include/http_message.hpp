@@ -1,7 +1,11 @@
 #ifndef HTTP_MESSAGE_HPP
 #define HTTP_MESSAGE_HPP
 
+#include <cstdint>
+#include <ctime>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <vector>
 
@@ -14,6 +18,13 @@ public:
 	std::string url;
 	std::string version;
 	std::vector<std::tuple<std::string, std::string>> header_list;
+	// The start of the 'content-length' body that arrived with the head, the
+	// rest is still to be received from the socket.
+	std::string body;
+	uintmax_t unread_body_size = 0;
+
+	// Look up a header by its case-insensitive name.
+	std::optional<std::string_view> get_header(std::string_view name) const;
 };
 
 class http_response
@@ -23,9 +34,28 @@ public:
 	std::string status;
 	std::string status_text;
 	std::vector<std::tuple<std::string, std::string>> header_list;
+	// preformatted header lines after the list, each ending with CRLF, e.g.
+	// of an asset pack
+	std::string_view header_block;
+
+	// Look up a header by its case-insensitive name, in the list and then in
+	// the block.
+	std::optional<std::string_view> get_header(std::string_view name) const;
 
 	std::string serialize() const;
 };
 
+// Format a time as an IMF-fixdate, e.g. 'Sun, 06 Nov 1994 08:49:37 GMT'.
+std::string format_http_date(std::time_t time);
+
+// Parse an IMF-fixdate, the obsolete HTTP-date formats are not accepted.
+std::optional<std::time_t> parse_http_date(std::string_view http_date);
+
+// Return true if the entity-tag is in the comma-separated list of an
+// 'If-None-Match' or 'If-Range' value, where '*' matches any entity-tag. The
+// weak comparison ignores the 'W/' prefix, the strong comparison never
+// matches a weak entity-tag.
+bool match_entity_tag(std::string_view entity_tag_list, std::string_view entity_tag, bool weak_comparison);
+
 } // namespace couringserver
 #endif
@@ -1,20 +1,85 @@
 #ifndef HTTP_PARSER_HPP
 #define HTTP_PARSER_HPP
 
+#include <cstddef>
 #include <optional>
 #include <span>
 #include <string>
+#include <string_view>
+
+#include "constant.hpp"
 
 namespace couringserver {
 class http_request;
 
+struct http_parser_limits
+{
+	size_t max_request_line_size = MAX_REQUEST_LINE_SIZE;
+	size_t max_header_count = MAX_HEADER_COUNT;
+	// the header lines, without the request line
+	size_t max_header_size = MAX_HEADER_SIZE;
+};
+
+inline constexpr http_parser_limits DEFAULT_HTTP_PARSER_LIMITS{};
+
+enum class http_parse_error
+{
+	// '400 Bad Request'
+	bad_request,
+	// '414 URI Too Long'
+	request_line_too_long,
+	// '431 Request Header Fields Too Large'
+	header_too_large,
+};
+
+/**
+ * @brief incremental parser of HTTP/1.1 request heads
+ * @details A packet that starts a request is parsed in place, only the bytes
+ * of a partial head and those following a complete request are copied into
+ * the buffer, so that a pipelined request is parsed by the next 'parse()'.
+ * The bytes of a 'content-length' body that came with the head are moved into
+ * the request. The head is checked against the limits while it is buffered,
+ * so a client cannot make the buffer grow beyond them, and the first error
+ * sticks: the connection is answered and closed.
+ */
 class http_parser
 {
 public:
-	std::optional<http_request> parse_packet(std::span<char> packet);
+	// The limits must outlive the parser.
+	explicit http_parser(const http_parser_limits &http_parser_limits = DEFAULT_HTTP_PARSER_LIMITS);
+
+	// Parse the buffered bytes followed by the packet.
+	std::optional<http_request> parse_packet(std::span<const char> packet);
+
+	// Parse the buffered bytes, e.g. a pipelined request.
+	std::optional<http_request> parse();
+
+	std::optional<http_parse_error> get_error() const noexcept;
+
+	// Whether no partial request is buffered.
+	bool empty() const noexcept;
+
+	// Bytes allocated for the buffer.
+	size_t get_memory_size() const noexcept;
+
+	// Discard the buffered bytes and release the buffer, e.g. when the
+	// connection goes idle.
+	void reset() noexcept;
+
+	// Hand over the buffered bytes, e.g. to the protocol the connection
+	// switches to.
+	std::string take_buffer() noexcept;
 
 private:
-	std::string raw_http_request_;
+	// Parse a request at the start of 'data'. On success 'consumed_size' is
+	// set to the size of its head and of the body bytes moved into it.
+	std::optional<http_request> parse_request(std::string_view data, size_t &consumed_size);
+
+	const http_parser_limits &http_parser_limits_;
+	std::string buffer_;
+	// the buffer size at which the last parse found the head incomplete
+	size_t scanned_size_ = 0;
+	std::optional<http_parse_error> error_;
 };
 } // namespace couringserver
 
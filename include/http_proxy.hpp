@@ -0,0 +1,21 @@
+#ifndef HTTP_PROXY_HPP
+#define HTTP_PROXY_HPP
+
+#include "http_message.hpp"
+#include "local_task.hpp"
+#include "socket.hpp"
+#include "upstream_pool.hpp"
+
+namespace couringserver {
+// Forward the request to the upstream and relay its response to the client.
+// The request is sent as HTTP/1.0 with 'connection: keep-alive', so that the
+// response body is either length-delimited, and the connection goes back to
+// the pool, or delimited by the upstream closing. Request and response bodies
+// are spliced between the sockets and never copied into user space, except
+// for the start of the response body received along with its head.
+local_task<> forward_request(
+	upstream_pool &upstream_pool, const upstream_address &upstream_address,
+	client_socket &client_socket, const http_request &http_request, http_response &http_response);
+} // namespace couringserver
+
+#endif
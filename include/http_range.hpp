@@ -0,0 +1,28 @@
+#ifndef HTTP_RANGE_HPP
+#define HTTP_RANGE_HPP
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace couringserver {
+// A satisfiable byte range, resolved against the size of the representation.
+struct byte_range
+{
+	uintmax_t offset;
+	uintmax_t length;
+};
+
+// Parse the value of a 'Range' header. Return 'std::nullopt' if the header
+// should be ignored (not a byte range, malformed, or too many ranges), and an
+// empty list if none of the ranges is satisfiable. Overlapping and adjacent
+// ranges are coalesced.
+std::optional<std::vector<byte_range>> parse_range(std::string_view value, uintmax_t size);
+
+// Format the value of a 'Content-Range' header.
+std::string format_content_range(const byte_range &byte_range, uintmax_t size);
+} // namespace couringserver
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef HTTP_ROUTE_HPP
+#define HTTP_ROUTE_HPP
+
+#include <string_view>
+
+#include "http_message.hpp"
+#include "local_task.hpp"
+#include "route_table.hpp"
+#include "socket.hpp"
+#include "upstream_pool.hpp"
+
+namespace couringserver {
+class thread_worker;
+
+// A handler sends the whole response for the request, it is given the
+// response with the version and the connection headers already set.
+using http_handler = local_task<> (*)(
+	thread_worker &thread_worker, client_socket &client_socket, const http_request &http_request,
+	http_response &http_response);
+
+// Cut the response short when the client is gone, the connection is closed
+// once the request has been recorded.
+void abort_response(http_response &http_response);
+
+// Send the response with a body of 'content-length' bytes. Return false if the
+// client is gone, the response is then aborted.
+local_task<bool> send_response(
+	client_socket &client_socket, http_response &http_response, std::string_view body = {});
+
+// Answer '200 OK' while the worker is serving.
+local_task<> serve_health(
+	thread_worker &thread_worker, client_socket &client_socket, const http_request &http_request,
+	http_response &http_response);
+
+// Answer with the metrics of all the workers in the Prometheus text format.
+local_task<> serve_metrics(
+	thread_worker &thread_worker, client_socket &client_socket, const http_request &http_request,
+	http_response &http_response);
+
+// Answer with the SQE/CQE trace of all the workers as Chrome trace JSON, which
+// is empty unless 'IO_TRACE' is set.
+local_task<> serve_trace(
+	thread_worker &thread_worker, client_socket &client_socket, const http_request &http_request,
+	http_response &http_response);
+
+// Serve the file named by the request URL.
+local_task<> serve_static_file(
+	thread_worker &thread_worker, client_socket &client_socket, const http_request &http_request,
+	http_response &http_response);
+
+// Forward the request through the upstream pool of the worker, see
+// 'forward_request()' in 'http_proxy.hpp'.
+local_task<> serve_proxy(
+	const upstream_address &upstream_address, thread_worker &thread_worker,
+	client_socket &client_socket, const http_request &http_request, http_response &http_response);
+
+template <const upstream_address &upstream_address>
+local_task<> proxy_request(
+	thread_worker &thread_worker, client_socket &client_socket, const http_request &http_request,
+	http_response &http_response)
+{
+	return serve_proxy(upstream_address, thread_worker, client_socket, http_request, http_response);
+}
+
+// Routes are matched by method and path, the query string is not part of the
+// path. Add dynamic endpoints here, ahead of the static file prefix. No
+// upstream is proxied by default, e.g. an application server behind '/app/'
+// is routed with
+//
+//   inline constexpr upstream_address APP_UPSTREAM{"127.0.0.1", 8081};
+//
+//   {"*", "/app/*", proxy_request<APP_UPSTREAM>},
+inline constexpr auto HTTP_ROUTE_TABLE = make_route_table<http_handler>({
+	{"GET", "/healthz", serve_health},
+	{"GET", "/metrics", serve_metrics},
+	{"GET", "/debug/trace", serve_trace},
+	{"GET", "/*", serve_static_file},
+	{"HEAD", "/*", serve_static_file},
+});
+} // namespace couringserver
+
+#endif
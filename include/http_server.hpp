@@ -1,38 +1,289 @@
 #ifndef HTTP_SERVER_HPP
 #define HTTP_SERVER_HPP
 
+#include <atomic>
+#include <chrono>
+#include <coroutine>
 #include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
 #include <thread>
+#include <tuple>
+#include <vector>
 
+#include "access_log.hpp"
+#include "asset_pack.hpp"
+#include "file_descriptor.hpp"
+#include "file_metadata_cache.hpp"
+#include "http_message.hpp"
+#include "http_parser.hpp"
+#include "http_range.hpp"
+#include "listener_handoff.hpp"
+#include "local_task.hpp"
+#include "metrics.hpp"
+#include "server_config.hpp"
 #include "socket.hpp"
 #include "task.hpp"
 #include "thread_pool.hpp"
+#include "tls_context.hpp"
+#include "upstream_pool.hpp"
 
 namespace couringserver {
 class thread_worker
 {
 public:
-	explicit thread_worker(const char *port);
+	// 'tls_context' is required if any of the listening sockets is for TLS,
+	// static files are served from 'asset_pack' unless it is null. The worker
+	// records into 'worker_metrics', which is part of 'server_metrics', and
+	// logs the requests to 'access_log_path' unless it is empty. The
+	// 'server_config' must outlive the worker.
+	thread_worker(
+		const server_config &server_config, std::vector<server_socket> server_socket_list,
+		const tls_context *tls_context, const asset_pack *asset_pack, int raw_drain_event_descriptor,
+		worker_metrics &worker_metrics, const server_metrics &server_metrics,
+		const std::filesystem::path &access_log_path, const std::atomic<uint64_t> &access_log_generation);
 
-	task<> accept_client();
+	local_task<> accept_client(server_socket &server_socket);
 
-	task<> handle_client(client_socket client_socket);
+	// Serve the requests of a client, after the TLS handshake if 'tls' is set.
+	local_task<> handle_client(client_socket client_socket, bool tls);
 
-	task<> event_loop();
+	// Wait for the drain event, then stop accepting and close idle connections.
+	// The connections still open after 'drain_grace_period' are shut down.
+	local_task<> watch_drain(int raw_drain_event_descriptor);
+
+	// Process completions until the worker is drained.
+	local_task<> event_loop();
+
+	upstream_pool &get_upstream_pool() noexcept;
+
+	file_metadata_cache &get_file_metadata_cache() noexcept;
+
+	// The pack the static files are served from, or nullptr.
+	const asset_pack *get_asset_pack() const noexcept;
+
+	worker_metrics &get_worker_metrics() noexcept;
+
+	const server_metrics &get_server_metrics() const noexcept;
+
+	bool is_draining() const noexcept;
+
+	// Take a request slot without waiting, for an HTTP/2 stream, which is
+	// refused rather than queued. Return false if all the slots are taken.
+	bool try_take_request_slot() noexcept;
+
+	// Hand the slot over to the oldest queued request, if any.
+	void release_request_slot();
+
+	// An idle connection has its read side shut down when the worker drains,
+	// so that its pending 'recv' completes.
+	void set_idle(int raw_file_descriptor, bool idle);
+
+	// Respond with the file named by the request, honoring the conditional
+	// and 'Range' headers. The body is omitted for 'HEAD'. With an asset pack
+	// the file is looked up in the pack instead, see 'serve_asset()'.
+	local_task<> serve_file(
+		client_socket &client_socket, const http_request &http_request, http_response &http_response);
 
 private:
-	server_socket server_socket_;
+	const server_config &server_config_;
+	std::vector<server_socket> server_socket_list_;
+	const tls_context *tls_context_;
+	const asset_pack *asset_pack_;
+	const http_parser_limits http_parser_limits_;
+	const socket_options socket_options_;
+
+	enum class connection_state : uint8_t
+	{
+		closed,
+		busy,
+		idle,
+	};
+
+	bool draining_ = false;
+	size_t connection_count_ = 0;
+	// indexed by the file descriptor of the connection
+	std::vector<connection_state> connection_state_list_;
+
+	bool accept_paused_ = false;
+	size_t inflight_request_count_ = 0;
+	std::deque<std::coroutine_handle<>> request_slot_queue_;
+	// bytes held by the request parsers of the connections
+	size_t parser_memory_size_ = 0;
+
+	file_metadata_cache file_metadata_cache_;
+	upstream_pool upstream_pool_;
+	std::mt19937_64 random_engine_{std::random_device{}()};
+
+	worker_metrics &worker_metrics_;
+	const server_metrics &server_metrics_;
+	access_log access_log_;
+	uint64_t access_log_sample_count_ = 0;
+
+	// Streams that spent their byte budget, resumed after the completions of
+	// the current event loop turn.
+	std::deque<std::coroutine_handle<>> yield_queue_;
+
+	/**
+	 * @brief awaiter that parks the calling coroutine in a queue
+	 * @details The calling coroutine is queued until its owner resumes it, e.g.
+	 * when a running request releases its slot or the event loop finishes the
+	 * current turn.
+	 */
+	class queue_awaiter
+	{
+	public:
+		explicit queue_awaiter(std::deque<std::coroutine_handle<>> &queue);
+
+		bool await_ready() const noexcept;
+		void await_suspend(std::coroutine_handle<> coroutine) const;
+		void await_resume() const noexcept;
+
+	private:
+		std::deque<std::coroutine_handle<>> &queue_;
+	};
+
+	/**
+	 * @brief state of a connection between its packets
+	 * @details This is all that a connection holds while it is idle, kept in
+	 * the frame of 'handle_client()', which comes from the slabs of the
+	 * worker's thread. The parser buffer is released when the connection goes
+	 * idle, and a receive buffer is only taken once a packet has arrived.
+	 */
+	struct connection
+	{
+		connection(
+			couringserver::client_socket client_socket, const http_parser_limits &http_parser_limits,
+			std::string peer_address, bool tls);
+
+		couringserver::client_socket client_socket;
+		couringserver::multishot_recv_guard multishot_recv_guard;
+		couringserver::http_parser http_parser;
+		// empty unless the access log is enabled
+		std::string peer_address;
+		const bool tls;
+		bool first_packet = true;
+		// the first packet of the current request, and the time spent parsing it
+		metrics_clock::time_point request_start;
+		std::chrono::nanoseconds parse_duration{0};
+		// the parser memory accounted for the connection
+		size_t parser_memory_size = 0;
+	};
+
+	// Parse a packet and serve the complete requests, return false if the
+	// connection is to be closed.
+	local_task<bool> handle_packet(connection &connection, unsigned int recv_buffer_id, size_t recv_buffer_size);
+
+	// Serve a parsed request, return false if the connection is to be closed.
+	local_task<bool> serve_request(connection &connection, const http_request &http_request);
+
+	// Serve the connection as HTTP/2, after the bytes already received or
+	// after the 'Upgrade: h2c' request. The session is kept in a frame of its
+	// own, so that it does not weigh on every HTTP/1.1 packet.
+	local_task<> serve_http2(connection &connection, std::string received, const http_request *upgrade_request);
+
+	// Answer a request for a file that could not be opened, see
+	// 'file_metadata_cache::report_open_error()'. The connection is closed
+	// after an unexpected error.
+	local_task<> serve_open_error(
+		client_socket &client_socket, const std::filesystem::path &file_path, std::error_code error_code,
+		http_response &http_response);
+
+	// Respond with the asset of the request path, without the query. The
+	// variant is chosen by 'Accept-Encoding', except for a 'Range' request,
+	// which is served from the original.
+	local_task<> serve_asset(
+		client_socket &client_socket, const http_request &http_request, http_response &http_response);
+
+	// Respond with the ranges of a body at an offset of the file, or with
+	// '416 Range Not Satisfiable' if there are none, when 'file_descriptor'
+	// may be empty.
+	local_task<> serve_range(
+		client_socket &client_socket, http_response &http_response, const file_descriptor &file_descriptor,
+		uintmax_t body_offset, uintmax_t body_size, const std::vector<byte_range> &byte_range_list);
+
+	// Send a range of the file in chunks of 'STREAM_CHUNK_SIZE'. After each
+	// 'STREAM_TURN_BYTE_BUDGET' bytes the stream yields to the other
+	// connections, and every chunk after the first waits for room in the
+	// socket send buffer. Return the number of bytes sent, or -1.
+	local_task<ssize_t> stream_file(
+		client_socket &client_socket, const file_descriptor &file_descriptor_in,
+		const std::tuple<file_descriptor, file_descriptor> &pipe, const byte_range &byte_range);
+
+	// Resume a coroutine of the event loop, timing it when 'IO_TRACE' is set.
+	void resume(std::coroutine_handle<> coroutine);
+
+	void set_connection_state(int raw_file_descriptor, connection_state connection_state);
+
+	void add_connection();
+	void remove_connection();
+
+	// Count the response, record the latency of the request, which started
+	// with a packet received at 'request_start' of the connection, and log it.
+	// Under overload only one in 'access_log_overload_sample_interval' requests
+	// is logged.
+	void record_response(
+		const connection &connection, const http_request &http_request, const http_response &http_response);
+
+	// Account for the buffer of a connection's parser, 'parser_memory_size' is
+	// the size accounted for it so far. Return false if the worker is over its
+	// parser memory budget.
+	bool update_parser_memory(size_t &parser_memory_size, const http_parser &http_parser);
+
+	// Answer with the status without a body, close the connection afterwards
+	// and record the response. 'http_request' is null if the head could not
+	// be parsed. A '503' asks the client to retry after a second.
+	local_task<> close_with_error(
+		connection &connection, const http_request *http_request, std::string_view status,
+		std::string_view status_text);
+
+	bool is_drained() const noexcept;
 };
 
 class http_server
 {
 public:
-	explicit http_server(size_t thread_count = std::thread::hardware_concurrency());
+	// The workers are limited and sized by 'server_config', the rings must be
+	// configured before, see 'io_uring::configure()'.
+	explicit http_server(const server_config &server_config);
 
-	void listen(const char *port);
+	// Also accept HTTPS clients on the port, must be called before 'listen()'.
+	void enable_tls(
+		const char *port, const std::filesystem::path &certificate_path,
+		const std::filesystem::path &private_key_path);
+
+	// Serve until drained. When 'take_over' is set, the listening sockets are
+	// inherited from the running server instead of being bound again.
+	void listen(const char *port, bool take_over = false);
+
+	// Stop accepting, finish in-flight responses and close idle connections.
+	// This function is thread-safe and makes 'listen()' return once drained.
+	void drain();
+
+	// Make the workers reopen their access logs before the next write, e.g.
+	// after the files were rotated. This function is thread-safe.
+	void reopen_access_log() noexcept;
 
 private:
+	const server_config server_config_;
 	thread_pool thread_pool_;
+	std::vector<file_descriptor> drain_event_list_;
+	server_metrics server_metrics_;
+	std::atomic<uint64_t> access_log_generation_ = 0;
+
+	const char *tls_port_ = nullptr;
+	std::optional<tls_context> tls_context_;
+	// shared by the workers, never written
+	std::optional<asset_pack> asset_pack_;
+
+	std::mutex handoff_mutex_;
+	std::optional<listener_handoff> listener_handoff_;
 };
 } // namespace couringserver
 
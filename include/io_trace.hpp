@@ -0,0 +1,88 @@
+#ifndef IO_TRACE_HPP
+#define IO_TRACE_HPP
+
+#include <sys/types.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include "constant.hpp"
+
+namespace couringserver {
+/**
+ * @brief ring of the latest io_uring events of a thread
+ * @details This class records the submitted SQEs, the reaped CQEs, the calls
+ * to 'io_uring_enter' and the coroutine resumptions of the thread that owns
+ * it, overwriting the oldest events once 'IO_TRACE_EVENT_COUNT' are kept.
+ * Only the owning thread writes, with relaxed stores ordered by fences, so
+ * recording takes no lock and no atomic read-modify-write. Every ring
+ * registers itself, so that another thread can copy the rings of all the
+ * threads and render them as a Chrome trace.
+ */
+class io_trace
+{
+public:
+	io_trace();
+	~io_trace();
+
+	io_trace(io_trace &&other) = delete;
+	io_trace &operator=(io_trace &&other) = delete;
+	io_trace(const io_trace &other) = delete;
+	io_trace &operator=(const io_trace &other) = delete;
+
+	// The clock of the events, in nanoseconds of 'CLOCK_MONOTONIC'.
+	static uint64_t now() noexcept;
+
+	void record_submit(uint8_t opcode, int raw_file_descriptor, uint64_t user_data) noexcept;
+	void record_completion(uint64_t user_data, int result, uint32_t flags) noexcept;
+	// Record a call to 'io_uring_enter' that began at 'start'.
+	void record_enter(uint64_t start, int submitted_count) noexcept;
+	// Record a resumption of the coroutine that began at 'start'.
+	void record_resume(const void *coroutine_address, uint64_t start) noexcept;
+
+	// Render the events of every ring in the Chrome trace event format. This
+	// function is thread-safe.
+	static std::string serialize_all();
+
+	// Write 'serialize_all()' to the file, return false on failure.
+	static bool dump_all(const std::filesystem::path &path);
+
+private:
+	enum class event_type : uint8_t
+	{
+		submit,
+		completion,
+		enter,
+		resume,
+	};
+
+	// The fields are atomic only so that a concurrent copy is well-defined.
+	struct event
+	{
+		std::atomic<uint64_t> time = 0;
+		std::atomic<uint64_t> user_data = 0;
+		// the type, the opcode and the CQE flags
+		std::atomic<uint64_t> kind = 0;
+		// the file descriptor, the result or the duration
+		std::atomic<int64_t> value = 0;
+	};
+
+	static_assert((IO_TRACE_EVENT_COUNT & (IO_TRACE_EVENT_COUNT - 1)) == 0);
+
+	void record(
+		event_type event_type, uint8_t opcode, uint32_t flags, uint64_t time, uint64_t user_data,
+		int64_t value) noexcept;
+
+	void append_chrome_trace(std::string &buffer, bool &first) const;
+
+	const pid_t thread_id_;
+	std::array<event, IO_TRACE_EVENT_COUNT> event_list_;
+	std::atomic<uint64_t> started_count_ = 0;
+	std::atomic<uint64_t> recorded_count_ = 0;
+};
+} // namespace couringserver
+
+#endif
@@ -2,26 +2,152 @@
 #define IO_URING_HPP
 
 #include <liburing.h>
+#include <liburing/io_uring.h>
 #include <sys/socket.h>
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <memory>
 #include <span>
+#include <string_view>
 #include <vector>
+
+#include "io_trace.hpp"
+#include "metrics.hpp"
+
 struct io_uring_buf_ring;
 struct io_uring_cqe;
 
 namespace couringserver {
+class completion_handler;
+
 struct sqe_data
 {
 	void *coroutine = nullptr;
 	int cqe_res = 0;
 	unsigned int cqe_flags = 0;
+	// set on submission for 'ring_statistics', the time only if it is sampled
+	uint8_t opcode = 0;
+	uint64_t submit_time = 0;
+	// takes the completions instead of 'coroutine' if set
+	couringserver::completion_handler *completion_handler = nullptr;
+};
+
+/**
+ * @brief receiver of the completions of a request that has several
+ * @details The event loop stores each completion in the 'sqe_data' of the
+ * request as usual, then hands it to the handler instead of resuming the
+ * coroutine, e.g. for a multishot receive whose packets may arrive while its
+ * connection is busy, or a zero-copy send that completes twice.
+ */
+class completion_handler
+{
+public:
+	// Return the coroutine to resume, if any.
+	virtual std::coroutine_handle<> handle_completion(sqe_data &sqe_data) = 0;
+
+protected:
+	~completion_handler() = default;
 };
 
+/**
+ * @brief time the event loop spends waiting for completions
+ * @details The counters are written by the thread of the io_uring only, with
+ * relaxed stores, so that other threads can read them without a lock.
+ */
+struct event_loop_statistics
+{
+	// time spent polling the completion queue in userspace
+	std::atomic<uint64_t> spin_nanoseconds = 0;
+	// time spent blocked in 'io_uring_enter'
+	std::atomic<uint64_t> sleep_nanoseconds = 0;
+	// waits satisfied by polling
+	std::atomic<uint64_t> spin_count = 0;
+	// waits that had to block
+	std::atomic<uint64_t> sleep_count = 0;
+};
+
+/**
+ * @brief health of the submission and completion queues
+ * @details Like 'event_loop_statistics', the statistics are written by the
+ * thread of the io_uring only. Requests submitted without a 'sqe_data' are
+ * counted as submitted but never as in flight. The latency from submission
+ * to the final completion is sampled once every 'IO_LATENCY_SAMPLE_INTERVAL'
+ * submissions of each opcode.
+ */
+struct ring_statistics
+{
+	std::atomic<uint64_t> submitted_count = 0;
+	std::atomic<uint64_t> completed_count = 0;
+	// submissions that found the submission queue full and flushed it first
+	std::atomic<uint64_t> sq_full_count = 0;
+	// the most SQEs handed to the kernel at once
+	std::atomic<uint64_t> max_sq_ready_count = 0;
+	// the most CQEs waiting to be processed at once
+	std::atomic<uint64_t> max_cq_ready_count = 0;
+	// completions the kernel could not post to a full completion queue
+	std::atomic<uint64_t> cq_overflow_count = 0;
+	std::array<std::atomic<uint64_t>, IORING_OP_LAST> submitted_count_list{};
+	std::array<std::atomic<uint64_t>, IORING_OP_LAST> inflight_count_list{};
+	std::array<latency_histogram, IORING_OP_LAST> latency_list;
+};
+
+/**
+ * @brief optional io_uring features of the kernel
+ * @details 'io_uring::probe()' reports what the running kernel supports and
+ * 'io_uring::configure()' selects what the rings use, so that one binary
+ * runs on older kernels through slower paths. The default values are what
+ * the server assumed before the kernel was probed.
+ */
+struct io_uring_features
+{
+	// 'IORING_SETUP_DEFER_TASKRUN' (6.1): completions are only posted when the
+	// worker enters the kernel, instead of interrupting it
+	bool defer_taskrun = false;
+	// 'IORING_SETUP_COOP_TASKRUN' (5.19), the fallback that still avoids the
+	// interrupts
+	bool coop_taskrun = false;
+	// registered buffer rings (5.19), otherwise the receive buffers are handed
+	// over with 'IORING_OP_PROVIDE_BUFFERS'
+	bool buffer_ring = true;
+	// multishot accept (5.19), otherwise an accept request per client
+	bool multishot_accept = true;
+	// 'SOCKET_URING_OP_SETSOCKOPT' commands (6.7), otherwise socket options
+	// are set with 'setsockopt'
+	bool socket_command = false;
+	// NAPI busy polling of the network queues while waiting (6.9 and liburing
+	// 2.6), selected by a nonzero 'napi_busy_poll_timeout'
+	bool napi = false;
+	// multishot receive (6.0) of the client connections, otherwise a receive
+	// request per packet
+	bool multishot_recv = false;
+	// 'IORING_OP_SEND_ZC' (6.0) for the sends of at least 'send_zc_threshold'
+	// bytes, selected by a nonzero threshold, otherwise the data is copied
+	bool send_zc = false;
+};
+
+// Return the name of an opcode used by the server, or "sqe" for the others.
+std::string_view get_opcode_name(uint8_t opcode);
+
 class io_uring
 {
 public:
 	static io_uring &get_instance() noexcept;
 
+	// Probe the kernel with temporary rings.
+	static io_uring_features probe();
+
+	// Set up the rings created from now on with the queue size and the
+	// features, which the kernel must support. This function must be called
+	// before the worker threads start.
+	static void configure(unsigned int queue_size, const io_uring_features &io_uring_features);
+
+	// Return the features configured for the rings.
+	static const io_uring_features &get_features() noexcept;
+
 	io_uring();
 	~io_uring();
 
@@ -52,16 +178,68 @@ public:
 	cqe_iterator end();
 
 	void cqe_seen(io_uring_cqe *const cqe);
+	// Account for a completion before its coroutine is resumed.
+	void record_completion(const io_uring_cqe *cqe) noexcept;
 	int submit_and_wait(int wait_nr);
 
-	void submit_multishot_accept_request(
+	// Wait for at least one completion. The completion queue is polled for up
+	// to 'spin_budget' before blocking in the kernel.
+	void wait_for_completion(std::chrono::nanoseconds spin_budget);
+
+	// Register NAPI busy polling, return false if liburing or the kernel
+	// refuses it.
+	bool register_napi(std::chrono::microseconds busy_poll_timeout);
+
+	const event_loop_statistics &get_event_loop_statistics() const noexcept;
+
+	const ring_statistics &get_ring_statistics() const noexcept;
+
+	// The trace of this thread, only present when 'IO_TRACE' is set.
+	io_trace &get_trace() noexcept;
+
+	// The accept request is multishot if the feature is selected. Otherwise
+	// its completion lacks 'IORING_CQE_F_MORE', as if a multishot request
+	// ended, and it has to be submitted again for the next client.
+	void submit_accept_request(
 		sqe_data *sqe_data, int raw_file_descriptor, sockaddr *client_addr, socklen_t *client_len);
+	void submit_connect_request(
+		sqe_data *sqe_data, int raw_file_descriptor, const sockaddr *address, socklen_t address_size);
 	void submit_recv_request(sqe_data *sqe_data, int raw_file_descriptor, size_t length);
+	// The receive request is multishot if the feature is selected, otherwise
+	// it ends after one packet of up to 'length' bytes, like
+	// 'submit_accept_request()'.
+	void submit_multishot_recv_request(sqe_data *sqe_data, int raw_file_descriptor, size_t length);
+	void submit_read_request(
+		sqe_data *sqe_data, int raw_file_descriptor, std::span<char> buffer, uint64_t offset);
+	// The zero-copy send completes twice, see 'client_socket::send_zc_awaiter'.
+	void submit_send_zc_request(
+		sqe_data *sqe_data, int raw_file_descriptor, const std::span<char> &buffer, size_t length);
 	void submit_send_request(
 		sqe_data *sqe_data, int raw_file_descriptor, const std::span<char> &buffer, size_t length);
+	// An offset of -1 writes at the current file position.
+	void submit_write_request(
+		sqe_data *sqe_data, int raw_file_descriptor, std::span<const char> buffer, uint64_t offset);
+	// The path must stay valid until the request completes.
+	void submit_openat_request(sqe_data *sqe_data, const char *path, int flags, mode_t mode);
+	// An offset of -1 splices from the current file position.
 	void submit_splice_request(
-		sqe_data *sqe_data, int raw_file_descriptor_in, int raw_file_descriptor_out, size_t length);
-	void submit_cancel_request(sqe_data *sqe_data);
+		sqe_data *sqe_data, int raw_file_descriptor_in, int64_t offset_in, int raw_file_descriptor_out,
+		size_t length);
+	// Wait until the file descriptor reports any of the events in 'poll_mask'.
+	void submit_poll_request(sqe_data *sqe_data, int raw_file_descriptor, unsigned int poll_mask);
+	void submit_timeout_request(sqe_data *sqe_data, __kernel_timespec *timespec);
+
+	// Advise the kernel about the access to a range of the file, a length of 0
+	// extends to the end. 'sqe_data' may be null to ignore the completion.
+	void submit_fadvise_request(
+		sqe_data *sqe_data, int raw_file_descriptor, uint64_t offset, uint32_t length, int advice);
+	// Set a socket option without waiting for it, its completion is ignored.
+	// The value must stay valid until the request completes. Without the
+	// 'socket_command' feature the option is set with 'setsockopt' instead.
+	void submit_setsockopt_request(int raw_file_descriptor, int level, int option_name, const int *option_value);
+	// Cancel the request of 'target_sqe_data'. The completion of the cancel
+	// request itself is reported to 'sqe_data', which may be null to ignore it.
+	void submit_cancel_request(sqe_data *sqe_data, const struct sqe_data *target_sqe_data);
 
 	void setup_buffer_ring(
 		io_uring_buf_ring *buffer_ring, std::span<std::vector<char>> buffer_list,
@@ -72,7 +250,16 @@ public:
 		unsigned int buffer_ring_size);
 
 private:
+	// Return a submission entry, flushing the submission queue if it is full.
+	io_uring_sqe *get_sqe();
+	void record_submit(const io_uring_sqe *sqe) noexcept;
+	// Hand a receive buffer to the kernel without a buffer ring.
+	void provide_buffer(std::span<char> buffer, unsigned int buffer_id);
+
 	::io_uring io_uring_;
+	event_loop_statistics event_loop_statistics_;
+	ring_statistics ring_statistics_;
+	std::unique_ptr<io_trace> io_trace_;
 };
 } // namespace couringserver
 
@@ -0,0 +1,42 @@
+#ifndef LISTENER_HANDOFF_HPP
+#define LISTENER_HANDOFF_HPP
+
+#include <span>
+#include <vector>
+
+#include "file_descriptor.hpp"
+#include "socket.hpp"
+
+namespace couringserver {
+/**
+ * @brief hand the listening sockets over to a successor process
+ * @details This class listens on a Unix domain socket. When a new server
+ * process connects to it, the listening sockets are passed to the new process
+ * with `SCM_RIGHTS`, so that the kernel accept queues survive the restart and
+ * no client connection is reset. The socket is created in a directory private
+ * to the user, and the listening sockets are only passed to a process of the
+ * same user.
+ */
+class listener_handoff
+{
+public:
+	explicit listener_handoff(const char *path);
+
+	// Block until a successor of the same user connects, then pass the
+	// listening sockets to it.
+	// Return false if the handoff socket was closed before a successor arrived.
+	bool serve(std::span<const int> raw_file_descriptor_list);
+
+	// Wake up and stop a blocking 'serve()' call.
+	void close();
+
+	// Connect to the handoff socket of the running server and receive its
+	// listening sockets.
+	static std::vector<server_socket> take_over(const char *path);
+
+private:
+	file_descriptor unix_socket_;
+};
+} // namespace couringserver
+
+#endif
@@ -0,0 +1,210 @@
+#ifndef LOCAL_TASK_HPP
+#define LOCAL_TASK_HPP
+
+#include <coroutine>
+#include <cstddef>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "frame_allocator.hpp"
+
+namespace couringserver {
+template <typename T>
+class local_task_promise;
+
+/**
+ * @brief wrapper for a thread-affine coroutine
+ * @details This class is a variant of 'task' for coroutines that never leave
+ * the thread they were started on, such as the connection coroutines of a
+ * 'thread_worker'. The detached state is a plain flag instead of an atomic,
+ * and the calling coroutine defaults to 'std::noop_coroutine()' so that the
+ * final awaiter transfers control without a branch on an optional. Use 'task'
+ * for coroutines that are scheduled across threads.
+ * @tparam T type of the return value of the coroutine
+ */
+template <typename T = void>
+class local_task
+{
+public:
+	using promise_type = local_task_promise<T>;
+
+	explicit local_task(std::coroutine_handle<local_task_promise<T>> coroutine_handle) noexcept
+		: coroutine_(coroutine_handle) {}
+
+	~local_task() noexcept
+	{
+		if (coroutine_)
+		{
+			if (coroutine_.done())
+			{
+				coroutine_.destroy();
+			}
+			else
+			{
+				coroutine_.promise().set_detached();
+			}
+		}
+	}
+
+	local_task(local_task &&other) noexcept : coroutine_{std::exchange(other.coroutine_, nullptr)} {}
+	local_task &operator=(local_task &&other) noexcept = delete;
+	local_task(const local_task &other) = delete;
+	local_task &operator=(const local_task &other) = delete;
+
+	/**
+	 * @brief awaiter for local_task
+	 * @details This class is the awaiter for the local_task. It suspends the
+	 * calling coroutine and transfers control to the awaited coroutine.
+	 */
+	class local_task_awaiter
+	{
+	public:
+		explicit local_task_awaiter(std::coroutine_handle<local_task_promise<T>> coroutine) noexcept
+			: coroutine_{coroutine} {}
+
+		bool await_ready() const noexcept { return coroutine_.done(); }
+
+		// return the result by value, the frame is destroyed with the local_task.
+		T await_resume() const noexcept
+		{
+			if constexpr (!std::is_same_v<T, void>)
+			{
+				return std::move(coroutine_.promise()).get_return_value();
+			}
+		}
+
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> calling_coroutine) const noexcept
+		{
+			coroutine_.promise().set_calling_coroutine(calling_coroutine);
+			return coroutine_;
+		}
+
+	private:
+		std::coroutine_handle<local_task_promise<T>> coroutine_;
+	};
+
+	local_task_awaiter operator co_await() noexcept { return local_task_awaiter(coroutine_); }
+
+	// resume the coroutine.
+	void resume() const noexcept
+	{
+		if (coroutine_ == nullptr || coroutine_.done())
+		{
+			return;
+		}
+		coroutine_.resume();
+	}
+
+	// detach the coroutine, its frame is destroyed when it completes.
+	void detach() noexcept
+	{
+		if (coroutine_.done())
+		{
+			coroutine_.destroy();
+		}
+		else
+		{
+			coroutine_.promise().set_detached();
+		}
+		coroutine_ = nullptr;
+	}
+
+private:
+	std::coroutine_handle<local_task_promise<T>> coroutine_ = nullptr;
+};
+
+/**
+ * @brief promise for a thread-affine coroutine
+ * @details This class is the promise for a local_task. It is used to control
+ * the coroutine's execution without any synchronization.
+ * @tparam T type of the return value of the coroutine
+ */
+template <typename T>
+class local_task_promise_base
+{
+public:
+	class final_awaiter
+	{
+	public:
+		bool await_ready() const noexcept { return false; }
+
+		void await_resume() const noexcept {}
+
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<local_task_promise<T>> coroutine) const noexcept
+		{
+			local_task_promise_base &promise = coroutine.promise();
+			if (promise.detached_)
+			{
+				coroutine.destroy();
+				return std::noop_coroutine();
+			}
+			return promise.calling_coroutine_;
+		}
+	};
+
+	std::suspend_always initial_suspend() const noexcept { return {}; }
+
+	// return to the calling coroutine when local_task is completed
+	final_awaiter final_suspend() const noexcept { return final_awaiter{}; }
+
+	void unhandled_exception() const noexcept { std::terminate(); }
+
+	// The frames are taken from the slabs of the thread, see 'frame_allocator'.
+	static void *operator new(const size_t size) { return frame_allocator::allocate(size); }
+
+	static void operator delete(void *const frame, const size_t size) noexcept
+	{
+		frame_allocator::deallocate(frame, size);
+	}
+
+	void set_calling_coroutine(std::coroutine_handle<> calling_coroutine) noexcept
+	{
+		calling_coroutine_ = calling_coroutine;
+	}
+
+	void set_detached() noexcept { detached_ = true; }
+
+private:
+	std::coroutine_handle<> calling_coroutine_ = std::noop_coroutine();
+	bool detached_ = false;
+};
+
+template <typename T>
+class local_task_promise final : public local_task_promise_base<T>
+{
+public:
+	local_task<T> get_return_object() noexcept
+	{
+		return local_task<T>{std::coroutine_handle<local_task_promise<T>>::from_promise(*this)};
+	}
+
+	template <typename U>
+		requires std::convertible_to<U &&, T>
+	void return_value(U &&return_value) noexcept(std::is_nothrow_constructible_v<T, U &&>)
+	{
+		return_value_.emplace(std::forward<U>(return_value));
+	}
+
+	T &get_return_value() & noexcept { return *return_value_; }
+
+	T &&get_return_value() && noexcept { return std::move(*return_value_); }
+
+private:
+	std::optional<T> return_value_;
+};
+
+template <>
+class local_task_promise<void> final : public local_task_promise_base<void>
+{
+public:
+	local_task<void> get_return_object() noexcept
+	{
+		return local_task<void>{std::coroutine_handle<local_task_promise>::from_promise(*this)};
+	}
+
+	void return_void() const noexcept {}
+};
+} // namespace couringserver
+
+#endif
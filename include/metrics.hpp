@@ -0,0 +1,180 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace couringserver {
+struct event_loop_statistics;
+struct ring_statistics;
+struct buffer_ring_statistics;
+
+using metrics_clock = std::chrono::steady_clock;
+
+/**
+ * @brief log-linear histogram of durations
+ * @details This class counts durations in buckets that split every power of
+ * two into 'SUB_BUCKET_COUNT' equal parts, as in an HDR histogram, from
+ * 2^'MIN_SHIFT' to 2^'MAX_SHIFT' nanoseconds. Shorter durations fall in the
+ * first bucket and longer ones in the last. Like 'event_loop_statistics', it
+ * is written by a single thread with relaxed stores, so recording costs no
+ * atomic read-modify-write and other threads can read it without a lock.
+ */
+class latency_histogram
+{
+public:
+	static constexpr unsigned int SUB_BUCKET_BITS = 2;
+	static constexpr unsigned int SUB_BUCKET_COUNT = 1U << SUB_BUCKET_BITS;
+	// 1.024 us to 34.4 s
+	static constexpr unsigned int MIN_SHIFT = 10;
+	static constexpr unsigned int MAX_SHIFT = 35;
+	static constexpr size_t BUCKET_COUNT = ((MAX_SHIFT - MIN_SHIFT) << SUB_BUCKET_BITS) + 2;
+
+	void record(std::chrono::nanoseconds duration) noexcept;
+
+	uint64_t get_bucket_count(size_t index) const noexcept;
+	uint64_t get_count() const noexcept;
+	uint64_t get_sum_nanoseconds() const noexcept;
+
+	// Return the exclusive upper bound of the bucket in nanoseconds, or 0 for
+	// the last bucket, which is unbounded.
+	static uint64_t get_bucket_bound(size_t index) noexcept;
+
+	// Return the upper bound of the bucket that holds the quantile, or 0 if
+	// nothing was recorded. The last bucket reports 2^'MAX_SHIFT'.
+	uint64_t get_quantile_bound(double quantile) const noexcept;
+
+private:
+	std::array<std::atomic<uint64_t>, BUCKET_COUNT> bucket_list_{};
+	std::atomic<uint64_t> count_ = 0;
+	std::atomic<uint64_t> sum_nanoseconds_ = 0;
+};
+
+// The stages of a request that are timed separately.
+enum class request_phase : size_t
+{
+	// from the first packet of the request until the request is complete
+	recv,
+	// 'parse_packet()' for the packets of the request
+	parse,
+	// the metadata lookup of a static file
+	file_lookup,
+	// sending the response head of a static file
+	send,
+	// splicing the body of a static file
+	splice,
+	count,
+};
+
+/**
+ * @brief counters of a single worker
+ * @details This struct is written by the thread of its 'thread_worker' only,
+ * see 'latency_histogram'. The counters are summed over the workers when they
+ * are read, so the event loops never wait on each other.
+ */
+struct worker_metrics
+{
+	static constexpr size_t MIN_STATUS = 100;
+	static constexpr size_t MAX_STATUS = 599;
+
+	std::array<std::atomic<uint64_t>, MAX_STATUS - MIN_STATUS + 1> status_count_list{};
+	std::atomic<uint64_t> received_byte_count = 0;
+	// the 'content-length' of the responses that carry a body
+	std::atomic<uint64_t> sent_body_byte_count = 0;
+	std::atomic<uint64_t> connection_count = 0;
+	// access log entries lost to full buffers or failed writes, and entries
+	// left out by the sampling under overload
+	std::atomic<uint64_t> access_log_dropped_count = 0;
+	std::atomic<uint64_t> access_log_skipped_count = 0;
+	// connections shed over the parser memory budget, and the bytes held by
+	// the request parsers
+	std::atomic<uint64_t> shed_connection_count = 0;
+	std::atomic<uint64_t> parser_memory_size = 0;
+
+	latency_histogram request_latency;
+	latency_histogram first_byte_latency;
+	std::array<latency_histogram, static_cast<size_t>(request_phase::count)> phase_latency_list;
+
+	// set by the worker thread once its io_uring and buffer ring exist
+	std::atomic<const couringserver::event_loop_statistics *> event_loop_statistics = nullptr;
+	std::atomic<const couringserver::ring_statistics *> ring_statistics = nullptr;
+	std::atomic<const couringserver::buffer_ring_statistics *> buffer_ring_statistics = nullptr;
+
+	void add_response(std::string_view status, uint64_t body_size) noexcept;
+	void add_received_bytes(uint64_t byte_count) noexcept;
+	void add_connection(int64_t delta) noexcept;
+	void add_access_log_dropped(uint64_t entry_count) noexcept;
+	void add_access_log_skipped() noexcept;
+	void add_shed_connection() noexcept;
+	void set_parser_memory_size(uint64_t memory_size) noexcept;
+
+	void record(request_phase request_phase, std::chrono::nanoseconds duration) noexcept;
+	// Record the time elapsed since 'start'.
+	void record(request_phase request_phase, metrics_clock::time_point start) noexcept;
+};
+
+// The in-flight requests and the sampled latency of an opcode.
+struct opcode_snapshot
+{
+	uint8_t opcode;
+	uint64_t submitted_count;
+	uint64_t inflight_count;
+	uint64_t sample_count;
+	// upper bounds of the latency percentiles in nanoseconds
+	uint64_t p50_nanoseconds;
+	uint64_t p99_nanoseconds;
+	uint64_t max_nanoseconds;
+};
+
+// A copy of the 'ring_statistics' and 'buffer_ring_statistics' of a worker.
+struct ring_snapshot
+{
+	uint64_t submitted_count;
+	uint64_t completed_count;
+	uint64_t sq_full_count;
+	uint64_t max_sq_ready_count;
+	uint64_t max_cq_ready_count;
+	uint64_t cq_overflow_count;
+	uint64_t borrowed_buffer_count;
+	uint64_t max_borrowed_buffer_count;
+	uint64_t no_buffer_count;
+	// the opcodes that were submitted
+	std::vector<opcode_snapshot> opcode_snapshot_list;
+};
+
+/**
+ * @brief metrics of all the workers of a server
+ * @details This class owns one 'worker_metrics' per worker and renders their
+ * sum in the Prometheus text format. It is created before the workers start
+ * and outlives them.
+ */
+class server_metrics
+{
+public:
+	explicit server_metrics(size_t worker_count);
+
+	worker_metrics &get_worker_metrics(size_t index) noexcept;
+
+	size_t get_worker_count() const noexcept;
+
+	// Copy the ring statistics of a worker, or return 'std::nullopt' if the
+	// worker has not started. This function is thread-safe.
+	std::optional<ring_snapshot> get_ring_snapshot(size_t index) const;
+
+	// Render the metrics in the Prometheus text exposition format. This
+	// function is thread-safe.
+	std::string serialize() const;
+
+private:
+	std::vector<worker_metrics> worker_metrics_list_;
+};
+} // namespace couringserver
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef PAGE_CACHE_HPP
+#define PAGE_CACHE_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+
+namespace couringserver {
+// The files and bytes that read-ahead was requested for, the kernel may still
+// be reading them when the report is made.
+struct page_cache_warm_report
+{
+	size_t file_count = 0;
+	uintmax_t byte_count = 0;
+	// files that could not be opened or advised, or that exceed the budget
+	size_t skipped_count = 0;
+	std::chrono::nanoseconds duration{0};
+};
+
+// Ask the kernel to read the regular files at or below the paths into the
+// page cache with 'IORING_OP_FADVISE' ('POSIX_FADV_WILLNEED'), at most
+// 'queue_depth' files at a time and 'byte_budget' bytes in total. The
+// requests go through the ring of the calling thread, which must not run an
+// event loop. The readahead is started, not awaited, so that the pass takes
+// about as long as walking the directories.
+page_cache_warm_report warm_page_cache(
+	std::span<const std::filesystem::path> path_list, size_t queue_depth, uintmax_t byte_budget);
+
+std::string format_page_cache_warm_report(const page_cache_warm_report &page_cache_warm_report);
+} // namespace couringserver
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef ROUTE_TABLE_HPP
+#define ROUTE_TABLE_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+
+namespace couringserver {
+template <typename handler_type>
+struct route
+{
+	// A method, or '*' for any method on a prefix route.
+	std::string_view method;
+	// An exact path, or a path prefix when the pattern ends with '*'.
+	std::string_view pattern;
+	handler_type handler;
+};
+
+/**
+ * @brief route table built at compile time
+ * @details The exact routes are placed in an open-addressing hash table keyed
+ * by method and path, and the prefix routes are kept ordered from the longest
+ * prefix to the shortest. Both are computed by the consteval constructor, so
+ * a lookup only hashes the request line and compares a few strings. An
+ * invalid or duplicate route fails the compilation.
+ */
+template <typename handler_type, size_t route_count>
+class route_table
+{
+public:
+	consteval explicit route_table(const std::array<route<handler_type>, route_count> &route_list)
+		: route_list_{route_list}
+	{
+		slot_list_.fill(EMPTY_SLOT);
+		for (size_t index = 0; index < route_count; ++index)
+		{
+			const route<handler_type> &route = route_list_[index];
+			if (!route.pattern.starts_with('/'))
+			{
+				throw std::invalid_argument("route pattern must start with '/'");
+			}
+			if (route.method == "*" && !route.pattern.ends_with('*'))
+			{
+				throw std::invalid_argument("only a prefix route may match any method");
+			}
+			if (route.pattern.ends_with('*'))
+			{
+				for (size_t prefix_index = 0; prefix_index < prefix_count_; ++prefix_index)
+				{
+					const auto &other = route_list_[prefix_list_[prefix_index]];
+					if (other.method == route.method && other.pattern == route.pattern)
+					{
+						throw std::invalid_argument("duplicate route");
+					}
+				}
+				prefix_list_[prefix_count_++] = index;
+				continue;
+			}
+
+			const uint64_t hash = hash_route(route.method, route.pattern);
+			size_t slot = hash & (SLOT_COUNT - 1);
+			while (slot_list_[slot] != EMPTY_SLOT)
+			{
+				const auto &other = route_list_[slot_list_[slot]];
+				if (other.method == route.method && other.pattern == route.pattern)
+				{
+					throw std::invalid_argument("duplicate route");
+				}
+				slot = (slot + 1) & (SLOT_COUNT - 1);
+			}
+			slot_list_[slot] = index;
+			slot_hash_list_[slot] = hash;
+		}
+
+		std::sort(
+			prefix_list_.begin(), prefix_list_.begin() + prefix_count_,
+			[this](const size_t left, const size_t right)
+			{ return route_list_[left].pattern.size() > route_list_[right].pattern.size(); });
+	}
+
+	// Return the handler of the exact route, or else of the longest matching
+	// prefix route, or nullptr if no route matches.
+	constexpr const handler_type *find(
+		const std::string_view method, const std::string_view path) const noexcept
+	{
+		const uint64_t hash = hash_route(method, path);
+		for (size_t slot = hash & (SLOT_COUNT - 1); slot_list_[slot] != EMPTY_SLOT;
+			 slot = (slot + 1) & (SLOT_COUNT - 1))
+		{
+			const route<handler_type> &route = route_list_[slot_list_[slot]];
+			if (slot_hash_list_[slot] == hash && route.method == method && route.pattern == path)
+			{
+				return &route.handler;
+			}
+		}
+
+		for (size_t prefix_index = 0; prefix_index < prefix_count_; ++prefix_index)
+		{
+			const route<handler_type> &route = route_list_[prefix_list_[prefix_index]];
+			if ((route.method == method || route.method == "*") &&
+				path.starts_with(route.pattern.substr(0, route.pattern.size() - 1)))
+			{
+				return &route.handler;
+			}
+		}
+		return nullptr;
+	}
+
+private:
+	// Keep the load factor at or below one half, so that probes stay short.
+	static constexpr size_t SLOT_COUNT = std::bit_ceil(route_count * 2);
+	static constexpr size_t EMPTY_SLOT = route_count;
+
+	// FNV-1a over the method, a separator and the path.
+	static constexpr uint64_t hash_route(const std::string_view method, const std::string_view path) noexcept
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		const auto update = [&hash](const char character)
+		{
+			hash ^= static_cast<unsigned char>(character);
+			hash *= 1099511628211ULL;
+		};
+		std::ranges::for_each(method, update);
+		update(' ');
+		std::ranges::for_each(path, update);
+		return hash;
+	}
+
+	std::array<route<handler_type>, route_count> route_list_;
+	std::array<size_t, SLOT_COUNT> slot_list_{};
+	std::array<uint64_t, SLOT_COUNT> slot_hash_list_{};
+	std::array<size_t, route_count> prefix_list_{};
+	size_t prefix_count_ = 0;
+};
+
+template <typename handler_type, size_t route_count>
+consteval route_table<handler_type, route_count> make_route_table(
+	const route<handler_type> (&route_list)[route_count])
+{
+	return route_table<handler_type, route_count>{std::to_array(route_list)};
+}
+} // namespace couringserver
+
+#endif
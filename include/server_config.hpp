@@ -0,0 +1,121 @@
+#ifndef SERVER_CONFIG_HPP
+#define SERVER_CONFIG_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "constant.hpp"
+#include "io_uring.hpp"
+#include "socket.hpp"
+
+namespace couringserver {
+// The handoff socket in the runtime directory of the user, see
+// 'LISTENER_HANDOFF_SOCKET_NAME'.
+std::string get_default_listener_handoff_path();
+
+/**
+ * @brief settings chosen at startup
+ * @details The defaults come from 'constant.hpp'. They are overridden by
+ * configuration files and by the command line, with the same keys, so that a
+ * server can be tuned for its machine and kernel without recompiling. The
+ * feature switches only take effect when the kernel supports the feature.
+ */
+struct server_config
+{
+	// comma-separated listen addresses, see 'resolve_listen_address_list()'
+	std::string port = "8080";
+	std::string tls_port = TLS_PORT;
+	std::string tls_certificate_path = TLS_CERTIFICATE_PATH;
+	std::string tls_private_key_path = TLS_PRIVATE_KEY_PATH;
+	// inherit the listening sockets of the running server through the handoff
+	// socket, which must be in a directory private to the user
+	bool take_over = false;
+	std::string listener_handoff_path = get_default_listener_handoff_path();
+
+	size_t thread_count = std::max(1U, std::thread::hardware_concurrency());
+	unsigned int io_uring_queue_size = IO_URING_QUEUE_SIZE;
+	unsigned int buffer_ring_size = BUFFER_RING_SIZE;
+	size_t buffer_size = BUFFER_SIZE;
+
+	size_t max_connection_count = MAX_CONNECTION_COUNT;
+	size_t connection_low_watermark = CONNECTION_LOW_WATERMARK;
+	size_t max_inflight_request_count = MAX_INFLIGHT_REQUEST_COUNT;
+	bool reject_on_overload = REJECT_ON_OVERLOAD;
+	unsigned int drain_grace_period = DRAIN_GRACE_PERIOD;
+
+	size_t max_request_line_size = MAX_REQUEST_LINE_SIZE;
+	size_t max_header_count = MAX_HEADER_COUNT;
+	size_t max_header_size = MAX_HEADER_SIZE;
+	size_t parser_memory_budget = PARSER_MEMORY_BUDGET;
+
+	unsigned int listen_backlog = SOCKET_LISTEN_QUEUE_SIZE;
+	unsigned int tcp_defer_accept = TCP_DEFER_ACCEPT_TIMEOUT;
+	unsigned int tcp_fastopen = TCP_FASTOPEN_QUEUE_SIZE;
+	bool tcp_nodelay = true;
+	bool tcp_quickack = false;
+	unsigned int socket_send_buffer_size = SOCKET_SEND_BUFFER_SIZE;
+	unsigned int socket_receive_buffer_size = SOCKET_RECEIVE_BUFFER_SIZE;
+	unsigned int tcp_notsent_lowat = TCP_NOTSENT_LOW_WATERMARK;
+	unsigned int send_zc_threshold = SEND_ZC_THRESHOLD;
+
+	// busy polling in microseconds, 0 to disable
+	unsigned int event_loop_spin_budget = EVENT_LOOP_SPIN_BUDGET;
+	unsigned int napi_busy_poll_timeout = NAPI_BUSY_POLL_TIMEOUT;
+	unsigned int socket_busy_poll_timeout = SOCKET_BUSY_POLL_TIMEOUT;
+
+	std::string access_log_path = ACCESS_LOG_PATH;
+	// with this many requests in flight only one in the interval is logged
+	size_t access_log_overload_threshold = ACCESS_LOG_OVERLOAD_THRESHOLD;
+	size_t access_log_overload_sample_interval = ACCESS_LOG_OVERLOAD_SAMPLE_INTERVAL;
+
+	// serve the static files from this pack instead of the file system
+	std::string asset_pack_path = ASSET_PACK_PATH;
+	bool asset_pack_populate = false;
+	bool asset_pack_huge_pages = false;
+
+	// comma-separated files and directories, e.g. the document root or the
+	// asset pack
+	std::string page_cache_warm_path = PAGE_CACHE_WARM_PATH;
+	unsigned int page_cache_warm_queue_depth = PAGE_CACHE_WARM_QUEUE_DEPTH;
+	size_t page_cache_warm_budget = PAGE_CACHE_WARM_BYTE_BUDGET;
+
+	bool defer_taskrun = true;
+	bool coop_taskrun = true;
+	bool buffer_ring = true;
+	bool multishot_accept = true;
+	bool multishot_recv = true;
+	bool socket_command = true;
+};
+
+// Apply a configuration file of 'key = value' lines, where '#' starts a
+// comment. Throw 'std::runtime_error' on an invalid line.
+void load_config_file(server_config &server_config, const std::filesystem::path &path);
+
+// Apply the command line in order: '--config <path>' loads a file, and
+// '--<key>=<value>' or '--<key> <value>' sets a key, where a switch may
+// omit the value. Return false if '--help' is given. Throw
+// 'std::runtime_error' on an invalid argument or setting.
+bool parse_command_line(server_config &server_config, int argc, char *argv[]);
+
+// Describe the options with their current values.
+std::string format_usage(const server_config &server_config);
+
+socket_options get_socket_options(const server_config &server_config);
+
+// Split 'page_cache_warm_path' into its paths.
+std::vector<std::filesystem::path> get_page_cache_warm_path_list(const server_config &server_config);
+
+// Select the features that are both enabled and supported.
+io_uring_features select_features(const server_config &server_config, const io_uring_features &supported_features);
+
+// Describe the features the kernel supports and the ones selected.
+std::string format_feature_report(
+	const io_uring_features &supported_features, const io_uring_features &selected_features);
+} // namespace couringserver
+
+#endif
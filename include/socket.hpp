@@ -3,25 +3,98 @@
 
 #include <sys/socket.h>
 
+#include <chrono>
 #include <coroutine>
+#include <cstdint>
 #include <optional>
 #include <span>
+#include <string>
+#include <string_view>
 #include <tuple>
+#include <vector>
 
+#include "cancellation.hpp"
+#include "constant.hpp"
 #include "file_descriptor.hpp"
 #include "io_uring.hpp"
-#include "task.hpp"
+#include "local_task.hpp"
 
 namespace couringserver {
 
+/**
+ * @brief socket options of the listeners and of the clients they accept
+ * @details The listener options and the client options that an accepted
+ * socket inherits from its listener, 'TCP_NODELAY', the buffer sizes and
+ * 'TCP_NOTSENT_LOWAT', are set once on the listener, so that accepting costs
+ * no extra system call. 'TCP_QUICKACK' is not inherited and only lasts until
+ * the kernel leaves quick acknowledgement mode again, so it is set on every
+ * client, through io_uring where possible. A value of 0 disables an option or
+ * leaves the kernel default.
+ */
+struct socket_options
+{
+	unsigned int listen_backlog = SOCKET_LISTEN_QUEUE_SIZE;
+	// Linux completes the handshake of a client that sent nothing once the
+	// timeout expired, so such a client is accepted late rather than never.
+	// Until then it is not counted against the connection cap.
+	unsigned int defer_accept_timeout = TCP_DEFER_ACCEPT_TIMEOUT;
+	unsigned int fastopen_queue_size = TCP_FASTOPEN_QUEUE_SIZE;
+	bool no_delay = true;
+	bool quick_ack = false;
+	unsigned int send_buffer_size = SOCKET_SEND_BUFFER_SIZE;
+	unsigned int receive_buffer_size = SOCKET_RECEIVE_BUFFER_SIZE;
+	unsigned int notsent_low_watermark = TCP_NOTSENT_LOW_WATERMARK;
+	// Only used with the 'send_zc' feature. A zero-copy send completes once
+	// the peer acknowledged the data, so it pays off for large sends only.
+	unsigned int send_zc_threshold = SEND_ZC_THRESHOLD;
+};
+
+/**
+ * @brief address of a listening socket
+ * @details The addresses are compared byte-wise, so that a listener inherited
+ * from another process is recognized by the address it is bound to.
+ */
+struct socket_address
+{
+	sockaddr_storage storage{};
+	socklen_t size = 0;
+
+	bool operator==(const socket_address &other) const noexcept;
+
+	int get_family() const noexcept;
+};
+
+// Resolve a comma-separated list of listen addresses to the addresses to bind.
+// A port alone is bound on every address family, e.g. '0.0.0.0' and '::',
+// 'host:port' and '[host]:port' on the addresses of the host, and 'unix:path'
+// on a Unix domain socket. Throw 'std::runtime_error' if an address does not
+// resolve.
+std::vector<socket_address> resolve_listen_address_list(std::string_view listen_address_list);
+
 class server_socket : public file_descriptor
 {
 public:
 	server_socket();
+	// Adopt a listening socket inherited from another process.
+	explicit server_socket(int raw_file_descriptor);
 
-	void bind(const char *port);
+	// An IPv6 socket only takes IPv6 clients, so that it can share its port
+	// with an IPv4 socket. A stale Unix domain socket at the path is replaced.
+	void bind(const socket_address &socket_address);
 
-	void listen() const;
+	// Another descriptor of the listener, for the workers to share a listener
+	// that cannot be bound once per worker with 'SO_REUSEPORT', such as a Unix
+	// domain socket.
+	server_socket duplicate() const;
+
+	// Set the listener options and the inherited client options, before
+	// 'listen()' so that the first clients get them too. The options are
+	// those of TCP, a Unix domain socket keeps the kernel defaults.
+	void set_options(const socket_options &socket_options);
+
+	// Listen with the backlog of the options. A listening socket, e.g. an
+	// inherited one, only has its backlog updated.
+	void listen(const socket_options &socket_options) const;
 
 	class multishot_accept_guard
 	{
@@ -34,18 +107,69 @@ public:
 		void await_suspend(std::coroutine_handle<> coroutine);
 		int await_resume();
 
+		// Stop the multishot accept request, clients stay in the kernel backlog.
+		void pause();
+		// Submit the multishot accept request again after 'pause()'.
+		void resume();
+		// Cancel the multishot accept request so that no more clients are accepted.
+		void cancel();
+		// Whether a multishot accept request is still pending in io_uring.
+		bool is_armed() const noexcept;
+
 	private:
 		bool initial_await_ = true;
+		bool armed_ = false;
+		bool paused_ = false;
+		bool cancelled_ = false;
 		const int raw_file_descriptor_;
 		sockaddr_storage *client_address_;
 		socklen_t *client_address_size_;
 		sqe_data sqe_data_;
 	};
 
-	multishot_accept_guard& accept(sockaddr_storage *client_address = nullptr, socklen_t *client_address_size = nullptr);
+	/**
+	 * @brief awaiter for the next client of the multishot accept request
+	 * @details The request is owned by the guard of the socket, the awaiter
+	 * only refers to it, so a copy of the awaiter made by the compiler does
+	 * not submit or cancel a request of its own.
+	 */
+	class accept_awaiter
+	{
+	public:
+		explicit accept_awaiter(multishot_accept_guard &multishot_accept_guard);
+
+		bool await_ready() const;
+		void await_suspend(std::coroutine_handle<> coroutine);
+		int await_resume();
+
+	private:
+		multishot_accept_guard &multishot_accept_guard_;
+	};
+
+	accept_awaiter accept(sockaddr_storage *client_address = nullptr, socklen_t *client_address_size = nullptr);
+
+	// Temporarily stop accepting new clients.
+	void pause_accept();
+	void resume_accept();
+
+	// Stop accepting new clients; the listening socket itself stays open.
+	void cancel_accept();
+
+	bool is_accepting() const noexcept;
+
+	// The local address, used to recognize inherited listening sockets.
+	socket_address get_address() const;
+
+	int get_family() const noexcept;
+
+	// Whether the accepted clients start with a TLS handshake.
+	void set_tls(bool tls) noexcept;
+	bool is_tls() const noexcept;
 
 private:
 	std::optional<multishot_accept_guard> multishot_accept_guard_;
+	int family_ = AF_UNSPEC;
+	bool tls_ = false;
 };
 
 class client_socket : public file_descriptor
@@ -53,40 +177,214 @@ class client_socket : public file_descriptor
 public:
 	explicit client_socket(int raw_file_descriptor);
 
+	// Disable Nagle's algorithm, return false if the kernel refuses it.
+	bool set_no_delay();
+
+	// Set the client options that are not inherited from the listener.
+	void set_options(const socket_options &socket_options);
+
+	// Set 'SO_BUSY_POLL', return false if the kernel refuses it.
+	bool set_busy_poll(std::chrono::microseconds timeout);
+
+	// The numeric address of the peer, or '-' if it is unknown.
+	std::string get_peer_address() const;
+
 	class recv_awaiter
 	{
 	public:
-		recv_awaiter(int raw_file_descriptor, size_t length);
+		recv_awaiter(
+			int raw_file_descriptor, size_t length, cancellation_token *cancellation_token = nullptr);
 
-		bool await_ready() const;
+		bool await_ready();
 		void await_suspend(std::coroutine_handle<> coroutine);
 		std::tuple<unsigned int, ssize_t> await_resume();
 
 	private:
 		const int raw_file_descriptor_;
 		const size_t length_;
+		cancellation_token *cancellation_token_;
 		sqe_data sqe_data_;
 	};
 
-	recv_awaiter recv(size_t length);
+	recv_awaiter recv(size_t length, cancellation_token *cancellation_token = nullptr);
 
 	class send_awaiter
 	{
 	public:
-		send_awaiter(int raw_file_descriptor, const std::span<char> &buffer, size_t length);
+		send_awaiter(
+			int raw_file_descriptor, const std::span<char> &buffer, size_t length,
+			cancellation_token *cancellation_token = nullptr);
 
-		bool await_ready() const;
+		bool await_ready();
 		void await_suspend(std::coroutine_handle<> coroutine);
-		ssize_t await_resume() const;
+		ssize_t await_resume();
 
 	private:
 		const int raw_file_descriptor_;
 		const size_t length_;
-		const std::span<char> &buffer_;
+		const std::span<char> buffer_;
+		cancellation_token *cancellation_token_;
 		sqe_data sqe_data_;
 	};
 
-	task<ssize_t> send(const std::span<char> &buffer, size_t length);
+	/**
+	 * @brief awaiter for a zero-copy send
+	 * @details The result of 'IORING_OP_SEND_ZC' is followed by a notification
+	 * once the kernel no longer refers to the buffer, the coroutine is only
+	 * resumed then, so that the buffer stays untouched until it is sent.
+	 */
+	class send_zc_awaiter : public completion_handler
+	{
+	public:
+		send_zc_awaiter(
+			int raw_file_descriptor, const std::span<char> &buffer, size_t length,
+			cancellation_token *cancellation_token = nullptr);
+
+		bool await_ready();
+		void await_suspend(std::coroutine_handle<> coroutine);
+		ssize_t await_resume();
+
+		std::coroutine_handle<> handle_completion(sqe_data &sqe_data) override;
+
+	private:
+		const int raw_file_descriptor_;
+		const size_t length_;
+		const std::span<char> buffer_;
+		cancellation_token *cancellation_token_;
+		sqe_data sqe_data_;
+		int result_ = 0;
+	};
+
+	// Sends of at least the 'send_zc_threshold' of the options are zero-copy,
+	// unless the socket refuses them, e.g. with kTLS, in which case it falls
+	// back to copying for good.
+	local_task<ssize_t> send(
+		std::span<char> buffer, size_t length, cancellation_token *cancellation_token = nullptr);
+
+	// The completion time of the first 'send()' since the last reset, used to
+	// measure the time to first byte of a response.
+	void reset_first_send_time() noexcept;
+	std::optional<std::chrono::steady_clock::time_point> get_first_send_time() const noexcept;
+
+private:
+	std::optional<std::chrono::steady_clock::time_point> first_send_time_;
+	// 0 unless the 'send_zc' feature is selected and the options set
+	unsigned int send_zc_threshold_ = 0;
+};
+
+/**
+ * @brief receive request of a connection that stays armed between packets
+ * @details With the 'multishot_recv' feature a single request receives every
+ * packet of the connection into the buffers of the ring. The packets that
+ * arrive while the connection is busy, e.g. sending a response, are queued,
+ * and at 'MULTISHOT_RECV_QUEUE_SIZE' of them the request is cancelled; the
+ * kernel may still receive what the socket holds until the cancellation is
+ * processed, so the queue is bounded by the socket receive buffer rather than
+ * exactly. Running out of buffers with packets queued pauses the connection
+ * instead of failing it, and the request is submitted again once the queue is
+ * empty. Without the feature every receive submits a request of its own. The
+ * guard must not move while a request is in flight, 'stop()' has to be
+ * awaited before it is destroyed or the socket is read otherwise.
+ */
+class multishot_recv_guard : public completion_handler
+{
+public:
+	explicit multishot_recv_guard(int raw_file_descriptor);
+
+	multishot_recv_guard(const multishot_recv_guard &) = delete;
+	multishot_recv_guard &operator=(const multishot_recv_guard &) = delete;
+
+	/**
+	 * @brief awaiter for the next packet
+	 * @details The result is the buffer id and size as for
+	 * 'client_socket::recv()', 0 at the end of the stream or a negative error.
+	 */
+	class recv_awaiter
+	{
+	public:
+		explicit recv_awaiter(multishot_recv_guard &multishot_recv_guard);
+
+		bool await_ready() const noexcept;
+		void await_suspend(std::coroutine_handle<> coroutine);
+		std::tuple<unsigned int, ssize_t> await_resume();
+
+	private:
+		multishot_recv_guard &multishot_recv_guard_;
+	};
+
+	/**
+	 * @brief awaiter that ends the receive request
+	 * @details The queued packets are kept for 'take_packet()'.
+	 */
+	class stop_awaiter
+	{
+	public:
+		explicit stop_awaiter(multishot_recv_guard &multishot_recv_guard);
+
+		bool await_ready() const noexcept;
+		void await_suspend(std::coroutine_handle<> coroutine);
+		void await_resume() const noexcept;
+
+	private:
+		multishot_recv_guard &multishot_recv_guard_;
+	};
+
+	recv_awaiter recv();
+	stop_awaiter stop();
+
+	// Take the oldest queued packet, return false if there is none. After
+	// 'stop()' these are the bytes the socket received before it stopped.
+	bool take_packet(unsigned int &buffer_id, ssize_t &size);
+
+	// Give the buffers of the queued packets back to the ring.
+	void clear();
+
+	std::coroutine_handle<> handle_completion(sqe_data &sqe_data) override;
+
+private:
+	struct packet
+	{
+		unsigned int buffer_id;
+		ssize_t size;
+	};
+
+	const int raw_file_descriptor_;
+	// the queue starts at 'packet_index_', the capacity is kept when it empties
+	std::vector<packet> packet_list_;
+	size_t packet_index_ = 0;
+	std::coroutine_handle<> waiting_coroutine_;
+	bool armed_ = false;
+	bool cancelling_ = false;
+	bool stopping_ = false;
+	sqe_data sqe_data_;
+
+	void submit();
+	void cancel();
+};
+
+/**
+ * @brief awaiter for connect operation
+ * @details This class is the awaiter for an 'IORING_OP_CONNECT' request, used
+ * to connect an outgoing socket (e.g. to an upstream server). The address
+ * must stay valid until the request completes.
+ */
+class connect_awaiter
+{
+public:
+	connect_awaiter(
+		int raw_file_descriptor, const sockaddr *address, socklen_t address_size,
+		cancellation_token *cancellation_token = nullptr);
+
+	bool await_ready();
+	void await_suspend(std::coroutine_handle<> coroutine);
+	int await_resume();
+
+private:
+	const int raw_file_descriptor_;
+	const sockaddr *address_;
+	const socklen_t address_size_;
+	cancellation_token *cancellation_token_;
+	sqe_data sqe_data_;
 };
 
 } // namespace couringserver
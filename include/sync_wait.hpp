@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <atomic>
 #include <optional>
+#include <utility>
 #include <vector>
 
 #include "task.hpp"
@@ -29,6 +30,11 @@ public:
 		}
 	}
 
+	sync_wait_task(sync_wait_task &&other) noexcept : coroutine_{std::exchange(other.coroutine_, nullptr)} {}
+	sync_wait_task &operator=(sync_wait_task &&other) noexcept = delete;
+	sync_wait_task(const sync_wait_task &other) = delete;
+	sync_wait_task &operator=(const sync_wait_task &other) = delete;
+
 	T get_return_value() const noexcept
 	{
 		return coroutine_.promise().get_return_value();
@@ -136,14 +142,25 @@ T sync_wait(task<T> &&task)
 	}
 }
 
+// Start every task before waiting for any of them, so that tasks which
+// hand themselves over to other threads run concurrently. The tasks must not
+// have been started already, since awaiting a started task resumes it again.
 template <typename T>
 std::conditional_t<std::is_same_v<T, void>, void, std::vector<T>> sync_wait_all(std::vector<task<T>> &task_list)
 {
+	std::vector<sync_wait_task<T>> sync_wait_task_list;
+	sync_wait_task_list.reserve(task_list.size());
+	for (auto &task : task_list)
+	{
+		sync_wait_task_list.emplace_back(([&]() -> sync_wait_task<T>
+										  { co_return co_await task; })());
+	}
+
 	if constexpr (std::is_same_v<T, void>)
 	{
-		for (auto &task : task_list)
+		for (const auto &sync_wait_task_handle : sync_wait_task_list)
 		{
-			sync_wait(task);
+			sync_wait_task_handle.wait();
 		}
 	}
 	else
@@ -152,9 +169,12 @@ std::conditional_t<std::is_same_v<T, void>, void, std::vector<T>> sync_wait_all(
 		return_value_list.reserve(task_list.size());
 
 		std::transform(
-			task_list.begin(), task_list.end(), std::back_inserter(return_value_list),
-			[](task<T> &task) -> T
-			{ return sync_wait(task); });
+			sync_wait_task_list.begin(), sync_wait_task_list.end(), std::back_inserter(return_value_list),
+			[](const sync_wait_task<T> &sync_wait_task_handle) -> T
+			{
+				sync_wait_task_handle.wait();
+				return sync_wait_task_handle.get_return_value();
+			});
 		return return_value_list;
 	}
 }
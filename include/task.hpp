@@ -99,7 +99,14 @@ public:
 	// detach the coroutine.
 	void detach() noexcept
 	{
-		coroutine_.promise().get_detached_flag().test_and_set(std::memory_order_relaxed);
+		if (coroutine_.done())
+		{
+			coroutine_.destroy();
+		}
+		else
+		{
+			coroutine_.promise().get_detached_flag().test_and_set(std::memory_order_relaxed);
+		}
 		coroutine_ = nullptr;
 	}
 
@@ -129,6 +136,7 @@ public:
 			if (coroutine.promise().get_detached_flag().test(std::memory_order_relaxed))
 			{
 				coroutine.destroy();
+				return std::noop_coroutine();
 			}
 			return coroutine.promise().get_calling_coroutine().value_or(std::noop_coroutine());
 		}
@@ -0,0 +1,39 @@
+#ifndef TLS_CONTEXT_HPP
+#define TLS_CONTEXT_HPP
+
+#include <openssl/ssl.h>
+
+#include <filesystem>
+#include <memory>
+
+#include "local_task.hpp"
+#include "socket.hpp"
+
+namespace couringserver {
+/**
+ * @brief TLS termination with kernel TLS offload
+ * @details The handshake runs in user space with OpenSSL, driven by io_uring
+ * poll requests. Once it completes, OpenSSL installs the session keys on the
+ * socket with 'TCP_ULP tls', and from then on the kernel encrypts and
+ * decrypts the records. The connection is then used like a cleartext one:
+ * 'client_socket::send()', 'client_socket::recv()' and the 'splice' body path
+ * stay zero-copy. A connection whose cipher cannot be offloaded in both
+ * directions is refused. The context is shared by all the threads.
+ */
+class tls_context
+{
+public:
+	tls_context(
+		const std::filesystem::path &certificate_path, const std::filesystem::path &private_key_path);
+
+	// Run the server side of the handshake within 'TLS_HANDSHAKE_TIMEOUT'.
+	// Return false if it fails or kTLS could not be enabled in both
+	// directions, the connection must be closed then.
+	local_task<bool> accept(client_socket &client_socket) const;
+
+private:
+	std::unique_ptr<SSL_CTX, decltype(&SSL_CTX_free)> ssl_context_;
+};
+} // namespace couringserver
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef UPSTREAM_POOL_HPP
+#define UPSTREAM_POOL_HPP
+
+#include <sys/socket.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "local_task.hpp"
+#include "socket.hpp"
+
+namespace couringserver {
+// An upstream server, given by an IPv4 or IPv6 address literal and a port.
+// Upstreams are identified by the address of this object, so it is declared
+// once with static storage (e.g. 'inline constexpr').
+struct upstream_address
+{
+	std::string_view host;
+	uint16_t port;
+};
+
+/**
+ * @brief per-worker pool of keep-alive upstream connections
+ * @details Connections are established with 'IORING_OP_CONNECT' and given back
+ * to the pool after a response that leaves them reusable. After
+ * 'UPSTREAM_FAILURE_THRESHOLD' consecutive failures an upstream is considered
+ * down, and requests fail fast except for a single probe per
+ * 'UPSTREAM_RETRY_INTERVAL', until one of them succeeds. The pool is owned by
+ * a single 'thread_worker' and is not thread-safe.
+ */
+class upstream_pool
+{
+public:
+	// Whether a request should be sent to the upstream at all. While it is
+	// down, a 'true' admits the request as the probe of the interval.
+	bool is_available(const upstream_address &upstream_address);
+
+	// Take an idle connection, or connect a new one within
+	// 'UPSTREAM_CONNECT_TIMEOUT'. The flag is set if the connection was reused.
+	// Return std::nullopt if the connection fails, the failure is reported, or
+	// if no socket can be created, e.g. at the file descriptor limit.
+	local_task<std::optional<std::tuple<client_socket, bool>>> acquire(
+		const upstream_address &upstream_address);
+
+	// Give a connection back after a complete response, it may be reused.
+	void release(const upstream_address &upstream_address, client_socket upstream_socket);
+
+	void report_success(const upstream_address &upstream_address);
+	void report_failure(const upstream_address &upstream_address);
+
+private:
+	struct upstream_state
+	{
+		sockaddr_storage address;
+		socklen_t address_size;
+		std::vector<client_socket> idle_connection_list;
+		size_t consecutive_failure_count = 0;
+		std::chrono::steady_clock::time_point retry_time;
+	};
+
+	upstream_state &get_upstream_state(const upstream_address &upstream_address);
+
+	std::unordered_map<const upstream_address *, upstream_state> upstream_state_map_;
+};
+} // namespace couringserver
+
+#endif
@@ -0,0 +1,315 @@
+#ifndef WHEN_ALL_HPP
+#define WHEN_ALL_HPP
+
+#include <coroutine>
+#include <cstddef>
+#include <limits>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "cancellation.hpp"
+#include "local_task.hpp"
+
+namespace couringserver {
+namespace detail {
+template <typename awaitable_type>
+decltype(auto) get_awaiter(awaitable_type &&awaitable)
+{
+	if constexpr (requires { std::forward<awaitable_type>(awaitable).operator co_await(); })
+	{
+		return std::forward<awaitable_type>(awaitable).operator co_await();
+	}
+	else
+	{
+		return std::forward<awaitable_type>(awaitable);
+	}
+}
+
+// The result of 'co_await' on the awaitable, with 'void' mapped to 'std::monostate'
+// so that it can be stored in a tuple.
+template <typename awaitable_type>
+using awaitable_result_t = std::remove_cvref_t<
+	decltype(get_awaiter(std::declval<awaitable_type>()).await_resume())>;
+
+template <typename awaitable_type>
+using when_all_result_t = std::conditional_t<
+	std::is_void_v<awaitable_result_t<awaitable_type>>, std::monostate,
+	awaitable_result_t<awaitable_type>>;
+
+/**
+ * @brief completion counter of the children of 'when_all'
+ * @details The counter starts at the number of children plus one, the extra
+ * arrival belongs to the parent once it has started all children. The last
+ * arrival transfers control to the parent, so a child that completes while the
+ * children are still being started cannot resume the parent early.
+ */
+class when_all_counter
+{
+public:
+	explicit when_all_counter(const size_t count) noexcept : remaining_count_{count + 1} {}
+
+	std::coroutine_handle<> arrive() noexcept
+	{
+		return --remaining_count_ == 0 ? continuation_ : std::noop_coroutine();
+	}
+
+	// Return false if every child has completed and the parent should not suspend.
+	bool try_await(std::coroutine_handle<> continuation) noexcept
+	{
+		continuation_ = continuation;
+		return --remaining_count_ != 0;
+	}
+
+private:
+	size_t remaining_count_;
+	std::coroutine_handle<> continuation_ = std::noop_coroutine();
+};
+
+template <typename T>
+class when_all_task_promise;
+
+/**
+ * @brief child coroutine of 'when_all'
+ * @details This class wraps one awaitable of 'when_all'. Its final awaiter
+ * arrives at the counter instead of resuming a calling coroutine, and the
+ * parent destroys the frame after every child has completed.
+ */
+template <typename T>
+class when_all_task
+{
+public:
+	using promise_type = when_all_task_promise<T>;
+
+	explicit when_all_task(std::coroutine_handle<when_all_task_promise<T>> coroutine_handle) noexcept
+		: coroutine_(coroutine_handle) {}
+
+	~when_all_task() noexcept
+	{
+		if (coroutine_)
+		{
+			coroutine_.destroy();
+		}
+	}
+
+	when_all_task(when_all_task &&other) noexcept : coroutine_{std::exchange(other.coroutine_, nullptr)} {}
+	when_all_task &operator=(when_all_task &&other) noexcept = delete;
+	when_all_task(const when_all_task &other) = delete;
+	when_all_task &operator=(const when_all_task &other) = delete;
+
+	void start(when_all_counter &counter) const noexcept
+	{
+		coroutine_.promise().set_counter(counter);
+		coroutine_.resume();
+	}
+
+	T &&get_return_value() const noexcept { return std::move(coroutine_.promise()).get_return_value(); }
+
+private:
+	std::coroutine_handle<when_all_task_promise<T>> coroutine_;
+};
+
+template <typename T>
+class when_all_task_promise
+{
+public:
+	class final_awaiter
+	{
+	public:
+		bool await_ready() const noexcept { return false; }
+
+		void await_resume() const noexcept {}
+
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<when_all_task_promise> coroutine) const noexcept
+		{
+			return coroutine.promise().counter_->arrive();
+		}
+	};
+
+	when_all_task<T> get_return_object() noexcept
+	{
+		return when_all_task<T>{std::coroutine_handle<when_all_task_promise>::from_promise(*this)};
+	}
+
+	std::suspend_always initial_suspend() const noexcept { return {}; }
+
+	final_awaiter final_suspend() const noexcept { return final_awaiter{}; }
+
+	void unhandled_exception() const noexcept { std::terminate(); }
+
+	template <typename U>
+		requires std::convertible_to<U &&, T>
+	void return_value(U &&return_value) noexcept(std::is_nothrow_constructible_v<T, U &&>)
+	{
+		return_value_.emplace(std::forward<U>(return_value));
+	}
+
+	T &&get_return_value() && noexcept { return std::move(*return_value_); }
+
+	void set_counter(when_all_counter &counter) noexcept { counter_ = &counter; }
+
+private:
+	when_all_counter *counter_ = nullptr;
+	std::optional<T> return_value_;
+};
+
+/**
+ * @brief awaiter that starts the children of 'when_all'
+ * @details The parent is suspended until the last child arrives at the counter.
+ */
+template <typename start_function_type>
+class when_all_awaiter
+{
+public:
+	when_all_awaiter(when_all_counter &counter, start_function_type start_function)
+		: counter_{counter}, start_function_{std::move(start_function)} {}
+
+	bool await_ready() const noexcept { return false; }
+
+	bool await_suspend(std::coroutine_handle<> coroutine)
+	{
+		start_function_();
+		return counter_.try_await(coroutine);
+	}
+
+	void await_resume() const noexcept {}
+
+private:
+	when_all_counter &counter_;
+	start_function_type start_function_;
+};
+
+template <typename awaitable_type>
+when_all_task<when_all_result_t<awaitable_type>> make_when_all_task(awaitable_type awaitable)
+{
+	if constexpr (std::is_void_v<awaitable_result_t<awaitable_type>>)
+	{
+		co_await std::move(awaitable);
+		co_return std::monostate{};
+	}
+	else
+	{
+		co_return co_await std::move(awaitable);
+	}
+}
+
+// The first child to complete cancels the others through the token.
+template <typename awaitable_type>
+when_all_task<when_all_result_t<awaitable_type>> make_when_any_task(
+	awaitable_type awaitable, const size_t index, size_t &winner_index,
+	cancellation_token &cancellation_token)
+{
+	when_all_result_t<awaitable_type> result;
+	if constexpr (std::is_void_v<awaitable_result_t<awaitable_type>>)
+	{
+		co_await std::move(awaitable);
+	}
+	else
+	{
+		result = co_await std::move(awaitable);
+	}
+
+	if (winner_index == std::numeric_limits<size_t>::max())
+	{
+		winner_index = index;
+		co_await cancellation_token.cancel();
+	}
+	co_return std::move(result);
+}
+
+template <size_t... index, typename... awaitable_type>
+local_task<std::tuple<when_all_result_t<awaitable_type>...>> when_all(
+	std::index_sequence<index...>, awaitable_type... awaitable)
+{
+	std::tuple<when_all_task<when_all_result_t<awaitable_type>>...> task_list{
+		make_when_all_task(std::move(awaitable))...};
+
+	when_all_counter counter{sizeof...(awaitable_type)};
+	co_await when_all_awaiter(counter, [&]()
+							  { (std::get<index>(task_list).start(counter), ...); });
+
+	co_return std::tuple<when_all_result_t<awaitable_type>...>{
+		std::get<index>(task_list).get_return_value()...};
+}
+
+template <size_t... index, typename... awaitable_type>
+local_task<std::tuple<size_t, std::tuple<when_all_result_t<awaitable_type>...>>> when_any(
+	std::index_sequence<index...>, cancellation_token &cancellation_token,
+	awaitable_type... awaitable)
+{
+	size_t winner_index = std::numeric_limits<size_t>::max();
+	std::tuple<when_all_task<when_all_result_t<awaitable_type>>...> task_list{make_when_any_task(
+		std::move(awaitable), index, winner_index, cancellation_token)...};
+
+	when_all_counter counter{sizeof...(awaitable_type)};
+	co_await when_all_awaiter(counter, [&]()
+							  { (std::get<index>(task_list).start(counter), ...); });
+
+	co_return std::tuple<size_t, std::tuple<when_all_result_t<awaitable_type>...>>{
+		winner_index,
+		std::tuple<when_all_result_t<awaitable_type>...>{
+			std::get<index>(task_list).get_return_value()...}};
+}
+} // namespace detail
+
+// Run the awaitables concurrently and return all of their results.
+template <typename... awaitable_type>
+local_task<std::tuple<detail::when_all_result_t<awaitable_type>...>> when_all(
+	awaitable_type... awaitable)
+{
+	return detail::when_all(std::index_sequence_for<awaitable_type...>{}, std::move(awaitable)...);
+}
+
+// Run the tasks concurrently and return all of their results.
+template <typename T>
+local_task<std::vector<detail::when_all_result_t<local_task<T>>>> when_all(
+	std::vector<local_task<T>> task_list)
+{
+	using result_type = detail::when_all_result_t<local_task<T>>;
+
+	std::vector<detail::when_all_task<result_type>> when_all_task_list;
+	when_all_task_list.reserve(task_list.size());
+	for (local_task<T> &task : task_list)
+	{
+		when_all_task_list.emplace_back(detail::make_when_all_task(std::move(task)));
+	}
+
+	detail::when_all_counter counter{when_all_task_list.size()};
+	co_await detail::when_all_awaiter(counter, [&]()
+									  {
+		for (const detail::when_all_task<result_type> &when_all_task : when_all_task_list)
+		{
+			when_all_task.start(counter);
+		} });
+
+	std::vector<result_type> result_list;
+	result_list.reserve(when_all_task_list.size());
+	for (const detail::when_all_task<result_type> &when_all_task : when_all_task_list)
+	{
+		result_list.emplace_back(when_all_task.get_return_value());
+	}
+	co_return result_list;
+}
+
+/**
+ * @brief race the awaitables against each other
+ * @details The awaitables run concurrently. When the first one completes, the
+ * token cancels the requests of the others with 'IORING_OP_ASYNC_CANCEL'.
+ * The result is only returned after every awaitable has completed, so no
+ * 'sqe_data' of a loser is left in the ring. The awaitables must be created
+ * with the same token.
+ * @return the index of the first awaitable to complete and all of the results
+ */
+template <typename... awaitable_type>
+local_task<std::tuple<size_t, std::tuple<detail::when_all_result_t<awaitable_type>...>>> when_any(
+	cancellation_token &cancellation_token, awaitable_type... awaitable)
+{
+	return detail::when_any(
+		std::index_sequence_for<awaitable_type...>{}, cancellation_token, std::move(awaitable)...);
+}
+} // namespace couringserver
+
+#endif
@@ -0,0 +1,234 @@
+#include "access_log.hpp"
+
+#include <fcntl.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+#include "file_descriptor.hpp"
+
+namespace couringserver {
+namespace {
+constexpr int ACCESS_LOG_OPEN_FLAGS = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+
+constexpr mode_t ACCESS_LOG_MODE = 0644;
+
+/**
+ * @brief bounded writer of a single entry
+ * @details The appends stop at the end of the entry, so a long field
+ * truncates the entry instead of overflowing the buffer.
+ */
+class entry_writer
+{
+public:
+	entry_writer(char *begin, char *end) noexcept : position_{begin}, end_{end} {}
+
+	void append(const std::string_view string) noexcept
+	{
+		const size_t length = std::min<size_t>(string.size(), end_ - position_);
+		position_ = std::copy_n(string.data(), length, position_);
+	}
+
+	// Control characters, quotes and backslashes are written as '\xHH', so
+	// that a client cannot forge an entry.
+	void append_escaped(const std::string_view string) noexcept
+	{
+		constexpr std::string_view HEX_DIGIT_LIST = "0123456789ABCDEF";
+		for (const char character : string)
+		{
+			const auto byte = static_cast<unsigned char>(character);
+			if (byte >= 0x20 && byte < 0x7f && byte != '"' && byte != '\\')
+			{
+				if (position_ == end_)
+				{
+					return;
+				}
+				*position_++ = character;
+				continue;
+			}
+			if (end_ - position_ < 4)
+			{
+				return;
+			}
+			*position_++ = '\\';
+			*position_++ = 'x';
+			*position_++ = HEX_DIGIT_LIST[byte >> 4];
+			*position_++ = HEX_DIGIT_LIST[byte & 0xf];
+		}
+	}
+
+	void append_optional(const std::optional<std::string_view> &string) noexcept
+	{
+		if (string.has_value())
+		{
+			append_escaped(string.value());
+		}
+		else
+		{
+			append("-");
+		}
+	}
+
+	void append_number(const uint64_t number) noexcept
+	{
+		position_ = std::to_chars(position_, end_, number).ptr;
+	}
+
+	void append_seconds(const std::chrono::nanoseconds duration) noexcept
+	{
+		const double seconds = std::chrono::duration<double>(duration).count();
+		position_ = std::to_chars(position_, end_, seconds, std::chars_format::fixed, 6).ptr;
+	}
+
+	char *get_position() const noexcept { return position_; }
+
+private:
+	char *position_;
+	char *const end_;
+};
+} // namespace
+
+access_log::access_log(
+	std::filesystem::path path, const std::atomic<uint64_t> &reopen_generation,
+	worker_metrics &worker_metrics)
+	: path_{std::move(path)}, reopen_generation_{reopen_generation},
+	  generation_{reopen_generation.load(std::memory_order_relaxed)}, worker_metrics_{worker_metrics}
+{
+	if (path_.empty())
+	{
+		return;
+	}
+
+	const int raw_file_descriptor = ::open(path_.c_str(), ACCESS_LOG_OPEN_FLAGS, ACCESS_LOG_MODE);
+	if (raw_file_descriptor == -1)
+	{
+		throw std::runtime_error("failed to invoke 'open'");
+	}
+	file_descriptor_ = file_descriptor{raw_file_descriptor};
+	for (std::unique_ptr<char[]> &buffer : buffer_list_)
+	{
+		buffer = std::make_unique_for_overwrite<char[]>(ACCESS_LOG_BUFFER_SIZE);
+	}
+}
+
+bool access_log::is_enabled() const noexcept { return !path_.empty(); }
+
+void access_log::append(
+	const std::string_view peer_address, const http_request &http_request, const http_response &http_response,
+	const uint64_t body_size, const std::chrono::nanoseconds duration)
+{
+	// The active buffer is written right away when it is full, the entry is
+	// only dropped if the other buffer is still being written.
+	if (ACCESS_LOG_BUFFER_SIZE - active_size_ < ACCESS_LOG_MAX_ENTRY_SIZE)
+	{
+		flush();
+		if (ACCESS_LOG_BUFFER_SIZE - active_size_ < ACCESS_LOG_MAX_ENTRY_SIZE)
+		{
+			worker_metrics_.add_access_log_dropped(1);
+			return;
+		}
+	}
+
+	const std::time_t time = std::time(nullptr);
+	if (time != cached_time_)
+	{
+		std::tm tm;
+		gmtime_r(&time, &tm);
+		time_size_ = std::strftime(time_buffer_.data(), time_buffer_.size(), "[%d/%b/%Y:%H:%M:%S +0000]", &tm);
+		cached_time_ = time;
+	}
+
+	// One byte is kept for the newline, which ends even a truncated entry.
+	char *const entry_begin = buffer_list_[active_index_].get() + active_size_;
+	entry_writer entry_writer(entry_begin, entry_begin + ACCESS_LOG_MAX_ENTRY_SIZE - 1);
+	entry_writer.append_escaped(peer_address);
+	entry_writer.append(" - - ");
+	entry_writer.append({time_buffer_.data(), time_size_});
+	entry_writer.append(" \"");
+	entry_writer.append_escaped(http_request.method);
+	entry_writer.append(" ");
+	entry_writer.append_escaped(http_request.url);
+	entry_writer.append(" ");
+	entry_writer.append_escaped(http_request.version);
+	entry_writer.append("\" ");
+	entry_writer.append_escaped(http_response.status);
+	entry_writer.append(" ");
+	entry_writer.append_number(body_size);
+	entry_writer.append(" \"");
+	entry_writer.append_optional(http_request.get_header("referer"));
+	entry_writer.append("\" \"");
+	entry_writer.append_optional(http_request.get_header("user-agent"));
+	entry_writer.append("\" ");
+	entry_writer.append_seconds(duration);
+
+	char *const entry_end = entry_writer.get_position();
+	*entry_end = '\n';
+	active_size_ += entry_end + 1 - entry_begin;
+	++active_entry_count_;
+}
+
+void access_log::flush()
+{
+	if (writing_ || active_size_ == 0)
+	{
+		return;
+	}
+
+	local_task<> write_loop_task = write_loop();
+	write_loop_task.resume();
+	write_loop_task.detach();
+}
+
+bool access_log::is_idle() const noexcept { return !writing_ && active_size_ == 0; }
+
+local_task<> access_log::write_loop()
+{
+	writing_ = true;
+	while (active_size_ != 0)
+	{
+		// The entries appended meanwhile go to the other buffer.
+		const std::span<const char> batch(buffer_list_[active_index_].get(), active_size_);
+		const uint64_t entry_count = std::exchange(active_entry_count_, 0);
+		active_index_ ^= 1;
+		active_size_ = 0;
+
+		// A failed reopen keeps the current file.
+		const uint64_t generation = reopen_generation_.load(std::memory_order_relaxed);
+		if (generation != generation_)
+		{
+			generation_ = generation;
+			const int raw_file_descriptor =
+				co_await openat_awaiter(path_.c_str(), ACCESS_LOG_OPEN_FLAGS, ACCESS_LOG_MODE);
+			if (raw_file_descriptor >= 0)
+			{
+				file_descriptor_ = file_descriptor{raw_file_descriptor};
+			}
+		}
+
+		// The file is opened with 'O_APPEND', so the writes need no offset.
+		size_t written_size = 0;
+		while (written_size < batch.size())
+		{
+			const ssize_t write_size = co_await write_awaiter(
+				file_descriptor_.get_raw_file_descriptor(), batch.subspan(written_size), static_cast<uint64_t>(-1));
+			if (write_size <= 0)
+			{
+				worker_metrics_.add_access_log_dropped(entry_count);
+				break;
+			}
+			written_size += write_size;
+		}
+	}
+	writing_ = false;
+}
+} // namespace couringserver
@@ -0,0 +1,587 @@
+#include "asset_pack.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "constant.hpp"
+#include "file_descriptor.hpp"
+#include "http_message.hpp"
+
+namespace couringserver {
+namespace {
+// seeds tried for a bucket before the table is made larger
+constexpr uint32_t MAX_SEED_ATTEMPT_COUNT = 65536;
+
+// average number of paths per bucket
+constexpr size_t BUCKET_LOAD = 4;
+
+struct content_type
+{
+	std::string_view extension;
+	std::string_view type;
+};
+
+constexpr auto CONTENT_TYPE_LIST = std::to_array<content_type>({
+	{".html", "text/html; charset=utf-8"},
+	{".htm", "text/html; charset=utf-8"},
+	{".css", "text/css; charset=utf-8"},
+	{".js", "text/javascript; charset=utf-8"},
+	{".mjs", "text/javascript; charset=utf-8"},
+	{".json", "application/json"},
+	{".map", "application/json"},
+	{".txt", "text/plain; charset=utf-8"},
+	{".xml", "application/xml"},
+	{".svg", "image/svg+xml"},
+	{".png", "image/png"},
+	{".jpg", "image/jpeg"},
+	{".jpeg", "image/jpeg"},
+	{".gif", "image/gif"},
+	{".webp", "image/webp"},
+	{".avif", "image/avif"},
+	{".ico", "image/x-icon"},
+	{".woff", "font/woff"},
+	{".woff2", "font/woff2"},
+	{".wasm", "application/wasm"},
+	{".pdf", "application/pdf"},
+	{".mp4", "video/mp4"},
+	{".webm", "video/webm"},
+});
+
+// the file name suffix and the token of each 'asset_encoding'
+constexpr std::array<std::string_view, ASSET_ENCODING_COUNT> ENCODING_SUFFIX_LIST{".br", ".gz", ""};
+constexpr std::array<std::string_view, ASSET_ENCODING_COUNT> ENCODING_NAME_LIST{"br", "gzip", "identity"};
+
+uint64_t hash_bytes(const std::string_view bytes, const uint64_t seed) noexcept
+{
+	// FNV-1a, with a final mix so that the low bits depend on every byte
+	uint64_t hash = 0xcbf29ce484222325 ^ (seed * 0x9e3779b97f4a7c15);
+	for (const char character : bytes)
+	{
+		hash ^= static_cast<unsigned char>(character);
+		hash *= 0x100000001b3;
+	}
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccd;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+std::string_view get_content_type(const std::filesystem::path &path)
+{
+	const std::string extension = path.extension().string();
+	const auto content_type_iterator = std::ranges::find_if(
+		CONTENT_TYPE_LIST, [&extension](const content_type &content_type)
+		{ return std::ranges::equal(extension, content_type.extension, [](const char left, const char right)
+									{ return std::tolower(static_cast<unsigned char>(left)) == right; }); });
+	return content_type_iterator == CONTENT_TYPE_LIST.end() ? "application/octet-stream"
+															: content_type_iterator->type;
+}
+
+std::string read_file(const std::filesystem::path &path)
+{
+	std::ifstream file_stream(path, std::ios::binary);
+	if (!file_stream.is_open())
+	{
+		throw std::runtime_error("failed to open '" + path.string() + "'");
+	}
+	return {std::istreambuf_iterator<char>(file_stream), std::istreambuf_iterator<char>()};
+}
+
+uint64_t align_up(const uint64_t offset, const uint64_t alignment) { return (offset + alignment - 1) / alignment * alignment; }
+
+void append_hex(std::string &string, const uint64_t number)
+{
+	std::array<char, 16> hex;
+	const auto [hex_end, _] = std::to_chars(hex.data(), hex.data() + hex.size(), number, 16);
+	string.append(hex.data(), hex_end);
+}
+
+// an asset being packed, with the files of its variants
+struct asset_source
+{
+	std::string path;
+	std::array<std::filesystem::path, ASSET_ENCODING_COUNT> file_path_list;
+	std::time_t modification_time = 0;
+	// the asset whose variants are served for this path, e.g. the
+	// 'index.html' of a directory
+	std::optional<size_t> alias_index;
+};
+
+// Find a seed for every bucket that sends its paths to free slots, the
+// largest buckets first while most slots are free. Return false if a bucket
+// finds none, so that the table has to grow.
+bool place_paths(
+	const std::vector<asset_source> &asset_source_list, std::vector<uint32_t> &seed_list,
+	std::vector<size_t> &slot_index_list)
+{
+	const size_t slot_count = slot_index_list.size();
+	std::vector<std::vector<size_t>> bucket_list(seed_list.size());
+	for (size_t index = 0; index < asset_source_list.size(); ++index)
+	{
+		bucket_list[hash_asset_path(asset_source_list[index].path, 0) % bucket_list.size()].push_back(index);
+	}
+	std::vector<size_t> bucket_order(bucket_list.size());
+	std::iota(bucket_order.begin(), bucket_order.end(), 0);
+	std::ranges::stable_sort(
+		bucket_order, [&bucket_list](const size_t left, const size_t right)
+		{ return bucket_list[left].size() > bucket_list[right].size(); });
+
+	std::ranges::fill(slot_index_list, SIZE_MAX);
+	std::vector<size_t> candidate_slot_list;
+	for (const size_t bucket : bucket_order)
+	{
+		if (bucket_list[bucket].empty())
+		{
+			break;
+		}
+		bool placed = false;
+		for (uint32_t seed = 1; seed <= MAX_SEED_ATTEMPT_COUNT && !placed; ++seed)
+		{
+			candidate_slot_list.clear();
+			placed = true;
+			for (const size_t index : bucket_list[bucket])
+			{
+				const size_t slot = hash_asset_path(asset_source_list[index].path, seed) % slot_count;
+				if (slot_index_list[slot] != SIZE_MAX || std::ranges::find(candidate_slot_list, slot) !=
+															 candidate_slot_list.end())
+				{
+					placed = false;
+					break;
+				}
+				candidate_slot_list.push_back(slot);
+			}
+			if (placed)
+			{
+				seed_list[bucket] = seed;
+				for (size_t position = 0; position < candidate_slot_list.size(); ++position)
+				{
+					slot_index_list[candidate_slot_list[position]] = bucket_list[bucket][position];
+				}
+			}
+		}
+		if (!placed)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+std::vector<asset_source> collect_assets(const std::filesystem::path &directory)
+{
+	std::vector<asset_source> asset_source_list;
+	std::vector<std::filesystem::path> file_path_list;
+	for (const std::filesystem::directory_entry &directory_entry :
+		 std::filesystem::recursive_directory_iterator(directory))
+	{
+		if (directory_entry.is_regular_file())
+		{
+			file_path_list.push_back(directory_entry.path());
+		}
+	}
+	// The order of the directory is not stable, the pack should be.
+	std::ranges::sort(file_path_list);
+
+	const auto is_packed = [&file_path_list](const std::filesystem::path &file_path)
+	{ return std::ranges::binary_search(file_path_list, file_path); };
+	for (const std::filesystem::path &file_path : file_path_list)
+	{
+		// A compressed file next to its original is a variant of it.
+		const std::string file_name = file_path.filename().string();
+		const bool variant = std::ranges::any_of(
+			ENCODING_SUFFIX_LIST, [&](const std::string_view suffix)
+			{ return !suffix.empty() && file_name.ends_with(suffix) &&
+					 is_packed(file_path.parent_path() / file_name.substr(0, file_name.size() - suffix.size())); });
+		if (variant)
+		{
+			continue;
+		}
+
+		asset_source &asset_source = asset_source_list.emplace_back();
+		const std::string relative_path = file_path.lexically_relative(directory).generic_string();
+		asset_source.path.reserve(relative_path.size() + 1);
+		asset_source.path.append(1, '/').append(relative_path);
+		for (size_t encoding = 0; encoding < ASSET_ENCODING_COUNT; ++encoding)
+		{
+			std::filesystem::path variant_path = file_path;
+			variant_path += ENCODING_SUFFIX_LIST[encoding];
+			if (is_packed(variant_path))
+			{
+				asset_source.file_path_list[encoding] = std::move(variant_path);
+			}
+		}
+		struct stat file_status;
+		if (::stat(file_path.c_str(), &file_status) == -1)
+		{
+			throw std::runtime_error("failed to invoke 'stat'");
+		}
+		asset_source.modification_time = file_status.st_mtim.tv_sec;
+	}
+
+	const size_t file_asset_count = asset_source_list.size();
+	for (size_t index = 0; index < file_asset_count; ++index)
+	{
+		// The alias keeps the slash, and its path is taken before the list
+		// grows.
+		constexpr std::string_view INDEX_SUFFIX = "/index.html";
+		const std::string_view path = asset_source_list[index].path;
+		if (path.ends_with(INDEX_SUFFIX))
+		{
+			std::string alias_path;
+			alias_path.reserve(path.size() - INDEX_SUFFIX.size() + 1);
+			alias_path.append(path.substr(0, path.size() - INDEX_SUFFIX.size() + 1));
+			asset_source &asset_source = asset_source_list.emplace_back();
+			asset_source.path = std::move(alias_path);
+			asset_source.alias_index = index;
+		}
+	}
+	return asset_source_list;
+}
+} // namespace
+
+uint64_t hash_asset_path(const std::string_view path, const uint32_t seed) noexcept { return hash_bytes(path, seed); }
+
+asset_pack_summary build_asset_pack(const std::filesystem::path &directory, const std::filesystem::path &pack_path)
+{
+	const std::vector<asset_source> asset_source_list = collect_assets(directory);
+	if (asset_source_list.size() > UINT32_MAX)
+	{
+		throw std::runtime_error("too many assets in '" + directory.string() + "'");
+	}
+
+	std::vector<uint32_t> seed_list(std::max<size_t>(1, (asset_source_list.size() + BUCKET_LOAD - 1) / BUCKET_LOAD));
+	std::vector<size_t> slot_index_list(asset_source_list.size() + asset_source_list.size() / 8 + 1);
+	while (!place_paths(asset_source_list, seed_list, slot_index_list))
+	{
+		slot_index_list.resize(slot_index_list.size() + slot_index_list.size() / 8 + 1);
+	}
+
+	asset_pack_header asset_pack_header{};
+	asset_pack_header.magic = ASSET_PACK_MAGIC;
+	asset_pack_header.byte_order = ASSET_PACK_BYTE_ORDER;
+	asset_pack_header.version = ASSET_PACK_VERSION;
+	asset_pack_header.asset_count = asset_source_list.size();
+	asset_pack_header.bucket_count = seed_list.size();
+	asset_pack_header.slot_count = slot_index_list.size();
+	asset_pack_header.seed_list_offset = align_up(sizeof(asset_pack_header), alignof(uint32_t));
+	asset_pack_header.slot_list_offset =
+		align_up(asset_pack_header.seed_list_offset + seed_list.size() * sizeof(uint32_t), alignof(asset_pack_slot));
+	const uint64_t string_area_offset =
+		asset_pack_header.slot_list_offset + slot_index_list.size() * sizeof(asset_pack_slot);
+
+	// The strings and the slots of the assets, the bodies follow the strings.
+	std::string string_area;
+	const auto add_string = [&](const std::string_view string)
+	{
+		const asset_pack_string asset_pack_string{string_area_offset + string_area.size(), string.size()};
+		string_area.append(string);
+		return asset_pack_string;
+	};
+	asset_pack_summary asset_pack_summary;
+	std::vector<asset_pack_slot> asset_slot_list(asset_source_list.size());
+	// the body of each variant of each asset, in order
+	std::vector<std::filesystem::path> body_path_list;
+	uint64_t body_area_size = 0;
+	for (size_t index = 0; index < asset_source_list.size(); ++index)
+	{
+		const asset_source &asset_source = asset_source_list[index];
+		asset_pack_slot &asset_pack_slot = asset_slot_list[index];
+		asset_pack_slot.path = add_string(asset_source.path);
+		if (asset_source.alias_index.has_value())
+		{
+			// The alias refers to the strings and bodies of its asset, which
+			// comes first.
+			const couringserver::asset_pack_slot &target_slot = asset_slot_list[asset_source.alias_index.value()];
+			asset_pack_slot.last_modified = target_slot.last_modified;
+			asset_pack_slot.modification_time = target_slot.modification_time;
+			asset_pack_slot.variant_mask = target_slot.variant_mask;
+			asset_pack_slot.variant_list = target_slot.variant_list;
+			++asset_pack_summary.index_count;
+			continue;
+		}
+
+		const std::string last_modified = format_http_date(asset_source.modification_time);
+		asset_pack_slot.last_modified = add_string(last_modified);
+		asset_pack_slot.modification_time = asset_source.modification_time;
+		const std::string_view content_type = get_content_type(asset_source.path);
+		const bool compressed = std::ranges::count_if(
+									asset_source.file_path_list, [](const std::filesystem::path &file_path)
+									{ return !file_path.empty(); }) > 1;
+		for (size_t encoding = 0; encoding < ASSET_ENCODING_COUNT; ++encoding)
+		{
+			const std::filesystem::path &file_path = asset_source.file_path_list[encoding];
+			if (file_path.empty())
+			{
+				continue;
+			}
+			// The entity-tag is derived from the content, so that it stays
+			// the same for the same bytes across releases.
+			const std::string body = read_file(file_path);
+			std::string entity_tag = "\"";
+			append_hex(entity_tag, hash_bytes(body, 0));
+			entity_tag += '-';
+			append_hex(entity_tag, body.size());
+			entity_tag += '"';
+
+			std::string header_block;
+			header_block.append("content-type:").append(content_type).append("\r\n");
+			header_block.append("content-length:").append(std::to_string(body.size())).append("\r\n");
+			header_block.append("etag:").append(entity_tag).append("\r\n");
+			header_block.append("last-modified:").append(last_modified).append("\r\n");
+			// Ranges are only served from the original.
+			if (static_cast<asset_encoding>(encoding) == asset_encoding::identity)
+			{
+				header_block.append("accept-ranges:bytes\r\n");
+			}
+			else
+			{
+				header_block.append("content-encoding:").append(ENCODING_NAME_LIST[encoding]).append("\r\n");
+				++asset_pack_summary.variant_count;
+			}
+			if (compressed)
+			{
+				header_block.append("vary:accept-encoding\r\n");
+			}
+
+			asset_pack_variant &asset_pack_variant = asset_pack_slot.variant_list[encoding];
+			asset_pack_variant.header_block = add_string(header_block);
+			asset_pack_variant.entity_tag = add_string(entity_tag);
+			// relative to the body area until its offset is known
+			asset_pack_variant.body_offset = body_area_size;
+			asset_pack_variant.body_size = body.size();
+			asset_pack_slot.variant_mask |= 1U << encoding;
+			body_area_size = align_up(body_area_size + body.size(), ASSET_PACK_BODY_ALIGNMENT);
+			body_path_list.push_back(file_path);
+			asset_pack_summary.body_size += body.size();
+		}
+	}
+
+	const uint64_t body_area_offset = align_up(string_area_offset + string_area.size(), ASSET_PACK_BODY_ALIGNMENT);
+	for (size_t index = 0; index < asset_source_list.size(); ++index)
+	{
+		for (size_t encoding = 0; encoding < ASSET_ENCODING_COUNT; ++encoding)
+		{
+			if ((asset_slot_list[index].variant_mask & (1U << encoding)) != 0)
+			{
+				asset_slot_list[index].variant_list[encoding].body_offset += body_area_offset;
+			}
+		}
+	}
+	asset_pack_header.file_size = body_area_offset + body_area_size;
+
+	std::vector<asset_pack_slot> slot_list(slot_index_list.size());
+	for (size_t slot = 0; slot < slot_index_list.size(); ++slot)
+	{
+		if (slot_index_list[slot] != SIZE_MAX)
+		{
+			slot_list[slot] = asset_slot_list[slot_index_list[slot]];
+		}
+	}
+
+	std::ofstream pack_stream(pack_path, std::ios::binary | std::ios::trunc);
+	if (!pack_stream.is_open())
+	{
+		throw std::runtime_error("failed to open '" + pack_path.string() + "'");
+	}
+	const auto write_at = [&pack_stream](const uint64_t offset, const void *data, const size_t size)
+	{
+		pack_stream.seekp(offset);
+		pack_stream.write(static_cast<const char *>(data), size);
+	};
+	write_at(0, &asset_pack_header, sizeof(asset_pack_header));
+	write_at(asset_pack_header.seed_list_offset, seed_list.data(), seed_list.size() * sizeof(uint32_t));
+	write_at(asset_pack_header.slot_list_offset, slot_list.data(), slot_list.size() * sizeof(asset_pack_slot));
+	write_at(string_area_offset, string_area.data(), string_area.size());
+	uint64_t body_offset = body_area_offset;
+	for (const std::filesystem::path &body_path : body_path_list)
+	{
+		const std::string body = read_file(body_path);
+		write_at(body_offset, body.data(), body.size());
+		body_offset = align_up(body_offset + body.size(), ASSET_PACK_BODY_ALIGNMENT);
+	}
+	pack_stream.close();
+	if (!pack_stream)
+	{
+		throw std::runtime_error("failed to write '" + pack_path.string() + "'");
+	}
+	// The padding after the last body is part of the pack.
+	std::filesystem::resize_file(pack_path, asset_pack_header.file_size);
+
+	asset_pack_summary.asset_count = asset_source_list.size();
+	asset_pack_summary.pack_size = asset_pack_header.file_size;
+	return asset_pack_summary;
+}
+
+asset_pack::asset_pack(const std::filesystem::path &pack_path, const bool populate, const bool huge_pages)
+{
+	const int raw_file_descriptor = ::open(pack_path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (raw_file_descriptor == -1)
+	{
+		throw std::runtime_error("failed to open '" + pack_path.string() + "'");
+	}
+	file_descriptor_ = file_descriptor{raw_file_descriptor};
+
+	struct stat file_status;
+	if (fstat(raw_file_descriptor, &file_status) == -1)
+	{
+		throw std::runtime_error("failed to invoke 'fstat'");
+	}
+	mapping_size_ = file_status.st_size;
+	if (mapping_size_ < sizeof(asset_pack_header))
+	{
+		throw std::runtime_error("invalid asset pack '" + pack_path.string() + "'");
+	}
+	void *const mapping =
+		mmap(nullptr, mapping_size_, PROT_READ, MAP_SHARED | (populate ? MAP_POPULATE : 0), raw_file_descriptor, 0);
+	if (mapping == MAP_FAILED)
+	{
+		throw std::runtime_error("failed to invoke 'mmap'");
+	}
+	mapping_ = static_cast<const char *>(mapping);
+	if (huge_pages)
+	{
+		// Only some file systems back a file mapping with huge pages.
+		madvise(mapping, mapping_size_, MADV_HUGEPAGE);
+	}
+
+	header_ = reinterpret_cast<const asset_pack_header *>(mapping_);
+	const bool valid_header =
+		header_->magic == ASSET_PACK_MAGIC && header_->byte_order == ASSET_PACK_BYTE_ORDER &&
+		header_->version == ASSET_PACK_VERSION && header_->file_size == mapping_size_ && header_->bucket_count != 0 &&
+		header_->slot_count != 0 && header_->seed_list_offset % alignof(uint32_t) == 0 &&
+		header_->slot_list_offset % alignof(asset_pack_slot) == 0 && header_->seed_list_offset <= mapping_size_ &&
+		header_->bucket_count <= (mapping_size_ - header_->seed_list_offset) / sizeof(uint32_t) &&
+		header_->slot_list_offset <= mapping_size_ &&
+		header_->slot_count <= (mapping_size_ - header_->slot_list_offset) / sizeof(asset_pack_slot);
+	if (!valid_header)
+	{
+		munmap(mapping, mapping_size_);
+		throw std::runtime_error("invalid asset pack '" + pack_path.string() + "'");
+	}
+	seed_list_ = {reinterpret_cast<const uint32_t *>(mapping_ + header_->seed_list_offset), header_->bucket_count};
+	slot_list_ = {
+		reinterpret_cast<const asset_pack_slot *>(mapping_ + header_->slot_list_offset),
+		static_cast<size_t>(header_->slot_count)};
+}
+
+asset_pack::~asset_pack() { munmap(const_cast<char *>(mapping_), mapping_size_); }
+
+const asset_pack_slot *asset_pack::find(const std::string_view path) const noexcept
+{
+	const uint32_t seed = seed_list_[hash_asset_path(path, 0) % seed_list_.size()];
+	const asset_pack_slot &slot = slot_list_[hash_asset_path(path, seed) % slot_list_.size()];
+	if (slot.path.size != path.size() || !is_valid(slot) || get_string(slot.path) != path)
+	{
+		return nullptr;
+	}
+	return &slot;
+}
+
+asset_encoding asset_pack::select_encoding(
+	const asset_pack_slot &slot, const std::optional<std::string_view> accept_encoding)
+{
+	if (!accept_encoding.has_value())
+	{
+		return asset_encoding::identity;
+	}
+
+	// A coding is acceptable if it is listed, or '*' is, without 'q=0'.
+	const auto is_acceptable = [&accept_encoding](const std::string_view name)
+	{
+		bool acceptable = false;
+		for (size_t start = 0; start < accept_encoding->size();)
+		{
+			const size_t end = std::min(accept_encoding->find(',', start), accept_encoding->size());
+			std::string_view element = accept_encoding->substr(start, end - start);
+			start = end + 1;
+
+			const size_t parameter_start = std::min(element.find(';'), element.size());
+			std::string_view coding = element.substr(0, parameter_start);
+			coding.remove_prefix(std::min(coding.find_first_not_of(" \t"), coding.size()));
+			coding.remove_suffix(coding.size() - std::min(coding.find_last_not_of(" \t") + 1, coding.size()));
+			const bool matches_name =
+				std::ranges::equal(coding, name, [](const char left, const char right)
+								   { return std::tolower(static_cast<unsigned char>(left)) == right; });
+			if (!matches_name && coding != "*")
+			{
+				continue;
+			}
+			// 'q=0', 'q=0.' or 'q=0.000' refuses the coding.
+			const std::string_view parameter_list = element.substr(parameter_start);
+			const size_t q_position = parameter_list.find("q=");
+			const bool refused =
+				q_position != std::string_view::npos &&
+				parameter_list.substr(q_position + 2).find_first_not_of("0.") >= parameter_list.size() - q_position - 2;
+			if (matches_name)
+			{
+				return !refused;
+			}
+			acceptable = !refused;
+		}
+		return acceptable;
+	};
+	for (size_t encoding = 0; encoding < ASSET_ENCODING_COUNT; ++encoding)
+	{
+		if ((slot.variant_mask & (1U << encoding)) != 0 &&
+			static_cast<asset_encoding>(encoding) != asset_encoding::identity && is_acceptable(ENCODING_NAME_LIST[encoding]))
+		{
+			return static_cast<asset_encoding>(encoding);
+		}
+	}
+	return asset_encoding::identity;
+}
+
+std::string_view asset_pack::get_string(const asset_pack_string &string) const noexcept
+{
+	return {mapping_ + string.offset, static_cast<size_t>(string.size)};
+}
+
+std::span<const char> asset_pack::get_body(const asset_pack_variant &variant) const noexcept
+{
+	return {mapping_ + variant.body_offset, static_cast<size_t>(variant.body_size)};
+}
+
+const file_descriptor &asset_pack::get_file_descriptor() const noexcept { return file_descriptor_; }
+
+size_t asset_pack::get_asset_count() const noexcept { return header_->asset_count; }
+
+bool asset_pack::is_valid(const asset_pack_slot &slot) const noexcept
+{
+	const auto fits = [this](const uint64_t offset, const uint64_t size)
+	{ return offset <= mapping_size_ && size <= mapping_size_ - offset; };
+	if (!fits(slot.path.offset, slot.path.size) || !fits(slot.last_modified.offset, slot.last_modified.size) ||
+		(slot.variant_mask & (1U << static_cast<uint32_t>(asset_encoding::identity))) == 0)
+	{
+		return false;
+	}
+	for (size_t encoding = 0; encoding < ASSET_ENCODING_COUNT; ++encoding)
+	{
+		const asset_pack_variant &variant = slot.variant_list[encoding];
+		if ((slot.variant_mask & (1U << encoding)) != 0 &&
+			(!fits(variant.header_block.offset, variant.header_block.size) ||
+			 !fits(variant.entity_tag.offset, variant.entity_tag.size) || !fits(variant.body_offset, variant.body_size)))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+} // namespace couringserver
@@ -35,15 +35,42 @@ void buffer_ring::register_buffer_ring(const unsigned int buffer_ring_size, cons
 // Borrow a buffer from the buffer ring.
 std::span<char> buffer_ring::borrow_buffer(const unsigned int buffer_id, const size_t size)
 {
-	borrowed_buffer_set_[buffer_id] = true;
+	if (!borrowed_buffer_set_[buffer_id])
+	{
+		borrowed_buffer_set_[buffer_id] = true;
+		const uint64_t borrowed_count = buffer_ring_statistics_.borrowed_count.load(std::memory_order_relaxed) + 1;
+		buffer_ring_statistics_.borrowed_count.store(borrowed_count, std::memory_order_relaxed);
+		if (borrowed_count > buffer_ring_statistics_.max_borrowed_count.load(std::memory_order_relaxed))
+		{
+			buffer_ring_statistics_.max_borrowed_count.store(borrowed_count, std::memory_order_relaxed);
+		}
+	}
 	return {buffer_list_[buffer_id].data(), size};
 }
 
 // Return the buffer to the buffer ring.
 void buffer_ring::return_buffer(const unsigned int buffer_id)
 {
-	borrowed_buffer_set_[buffer_id] = false;
+	if (borrowed_buffer_set_[buffer_id])
+	{
+		borrowed_buffer_set_[buffer_id] = false;
+		buffer_ring_statistics_.borrowed_count.store(
+			buffer_ring_statistics_.borrowed_count.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+	}
 	io_uring::get_instance().add_buffer(
 		buffer_ring_.get(), buffer_list_[buffer_id], buffer_id, buffer_list_.size());
 }
+
+void buffer_ring::record_no_buffer() noexcept
+{
+	buffer_ring_statistics_.no_buffer_count.store(
+		buffer_ring_statistics_.no_buffer_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+size_t buffer_ring::get_buffer_size() const noexcept
+{
+	return buffer_list_.empty() ? 0 : buffer_list_.front().size();
+}
+
+const buffer_ring_statistics &buffer_ring::get_statistics() const noexcept { return buffer_ring_statistics_; }
 } // namespace couringserver
@@ -0,0 +1,95 @@
+#include "cancellation.hpp"
+
+#include <algorithm>
+#include <cerrno>
+
+#include "when_all.hpp"
+
+namespace couringserver {
+namespace {
+local_task<int> cancel_request(const sqe_data *target_sqe_data)
+{
+	co_return co_await cancel_awaiter(target_sqe_data);
+}
+} // namespace
+
+bool cancellation_token::is_cancelled() const noexcept { return cancelled_; }
+
+local_task<> cancellation_token::cancel()
+{
+	cancelled_ = true;
+
+	std::vector<local_task<int>> cancel_task_list;
+	cancel_task_list.reserve(request_list_.size());
+	for (const sqe_data *sqe_data : request_list_)
+	{
+		cancel_task_list.emplace_back(cancel_request(sqe_data));
+	}
+	co_await when_all(std::move(cancel_task_list));
+}
+
+void cancellation_token::register_request(sqe_data *sqe_data) { request_list_.emplace_back(sqe_data); }
+
+void cancellation_token::unregister_request(sqe_data *sqe_data)
+{
+	const auto iterator = std::find(request_list_.begin(), request_list_.end(), sqe_data);
+	if (iterator != request_list_.end())
+	{
+		request_list_.erase(iterator);
+	}
+}
+
+bool skip_cancelled_request(const cancellation_token *cancellation_token, sqe_data &sqe_data)
+{
+	if (cancellation_token == nullptr || !cancellation_token->is_cancelled())
+	{
+		return false;
+	}
+	sqe_data.cqe_res = -ECANCELED;
+	sqe_data.cqe_flags = 0;
+	return true;
+}
+
+cancel_awaiter::cancel_awaiter(const sqe_data *target_sqe_data) : target_sqe_data_{target_sqe_data} {}
+
+bool cancel_awaiter::await_ready() const { return false; }
+
+void cancel_awaiter::await_suspend(std::coroutine_handle<> coroutine)
+{
+	sqe_data_.coroutine = coroutine.address();
+
+	io_uring::get_instance().submit_cancel_request(&sqe_data_, target_sqe_data_);
+}
+
+int cancel_awaiter::await_resume() const { return sqe_data_.cqe_res; }
+
+timeout_awaiter::timeout_awaiter(
+	const std::chrono::nanoseconds duration, cancellation_token *cancellation_token)
+	: timespec_{
+		  .tv_sec = std::chrono::duration_cast<std::chrono::seconds>(duration).count(),
+		  .tv_nsec = (duration % std::chrono::seconds{1}).count(),
+	  },
+	  cancellation_token_{cancellation_token} {}
+
+bool timeout_awaiter::await_ready() { return skip_cancelled_request(cancellation_token_, sqe_data_); }
+
+void timeout_awaiter::await_suspend(std::coroutine_handle<> coroutine)
+{
+	sqe_data_.coroutine = coroutine.address();
+	if (cancellation_token_ != nullptr)
+	{
+		cancellation_token_->register_request(&sqe_data_);
+	}
+
+	io_uring::get_instance().submit_timeout_request(&sqe_data_, &timespec_);
+}
+
+int timeout_awaiter::await_resume()
+{
+	if (cancellation_token_ != nullptr)
+	{
+		cancellation_token_->unregister_request(&sqe_data_);
+	}
+	return sqe_data_.cqe_res;
+}
+} // namespace couringserver
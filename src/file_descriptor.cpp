@@ -4,8 +4,10 @@
 #include <unistd.h>
 
 #include <array>
+#include <cerrno>
 #include <optional>
 #include <stdexcept>
+#include <system_error>
 #include <utility>
 
 namespace couringserver
@@ -50,21 +52,144 @@ int file_descriptor::get_raw_file_descriptor() const
 }
 
 splice_awaiter::splice_awaiter(
-	const int raw_file_descriptor_in, const int raw_file_descriptor_out, const size_t length)
-	: raw_file_descriptor_in_{raw_file_descriptor_in},
-	  raw_file_descriptor_out_{raw_file_descriptor_out}, length_{length} {}
+	const int raw_file_descriptor_in, const int64_t offset_in, const int raw_file_descriptor_out,
+	const size_t length, cancellation_token *cancellation_token)
+	: raw_file_descriptor_in_{raw_file_descriptor_in}, offset_in_{offset_in},
+	  raw_file_descriptor_out_{raw_file_descriptor_out}, length_{length},
+	  cancellation_token_{cancellation_token} {}
 
-bool splice_awaiter::await_ready() const { return false; }
+bool splice_awaiter::await_ready() { return skip_cancelled_request(cancellation_token_, sqe_data_); }
 
 void splice_awaiter::await_suspend(std::coroutine_handle<> coroutine)
 {
 	sqe_data_.coroutine = coroutine.address();
+	if (cancellation_token_ != nullptr)
+	{
+		cancellation_token_->register_request(&sqe_data_);
+	}
 
 	io_uring::get_instance().submit_splice_request(
-		&sqe_data_, raw_file_descriptor_in_, raw_file_descriptor_out_, length_);
+		&sqe_data_, raw_file_descriptor_in_, offset_in_, raw_file_descriptor_out_, length_);
+}
+
+ssize_t splice_awaiter::await_resume()
+{
+	if (cancellation_token_ != nullptr)
+	{
+		cancellation_token_->unregister_request(&sqe_data_);
+	}
+	return sqe_data_.cqe_res;
+}
+
+read_awaiter::read_awaiter(
+	const int raw_file_descriptor, const std::span<char> buffer, const uint64_t offset,
+	cancellation_token *cancellation_token)
+	: raw_file_descriptor_{raw_file_descriptor}, buffer_{buffer}, offset_{offset},
+	  cancellation_token_{cancellation_token} {}
+
+bool read_awaiter::await_ready() { return skip_cancelled_request(cancellation_token_, sqe_data_); }
+
+void read_awaiter::await_suspend(std::coroutine_handle<> coroutine)
+{
+	sqe_data_.coroutine = coroutine.address();
+	if (cancellation_token_ != nullptr)
+	{
+		cancellation_token_->register_request(&sqe_data_);
+	}
+
+	io_uring::get_instance().submit_read_request(&sqe_data_, raw_file_descriptor_, buffer_, offset_);
+}
+
+ssize_t read_awaiter::await_resume()
+{
+	if (cancellation_token_ != nullptr)
+	{
+		cancellation_token_->unregister_request(&sqe_data_);
+	}
+	return sqe_data_.cqe_res;
+}
+
+write_awaiter::write_awaiter(
+	const int raw_file_descriptor, const std::span<const char> buffer, const uint64_t offset,
+	cancellation_token *cancellation_token)
+	: raw_file_descriptor_{raw_file_descriptor}, buffer_{buffer}, offset_{offset},
+	  cancellation_token_{cancellation_token} {}
+
+bool write_awaiter::await_ready() { return skip_cancelled_request(cancellation_token_, sqe_data_); }
+
+void write_awaiter::await_suspend(std::coroutine_handle<> coroutine)
+{
+	sqe_data_.coroutine = coroutine.address();
+	if (cancellation_token_ != nullptr)
+	{
+		cancellation_token_->register_request(&sqe_data_);
+	}
+
+	io_uring::get_instance().submit_write_request(&sqe_data_, raw_file_descriptor_, buffer_, offset_);
+}
+
+ssize_t write_awaiter::await_resume()
+{
+	if (cancellation_token_ != nullptr)
+	{
+		cancellation_token_->unregister_request(&sqe_data_);
+	}
+	return sqe_data_.cqe_res;
 }
 
-ssize_t splice_awaiter::await_resume() const { return sqe_data_.cqe_res; }
+openat_awaiter::openat_awaiter(
+	const char *path, const int flags, const mode_t mode, cancellation_token *cancellation_token)
+	: path_{path}, flags_{flags}, mode_{mode}, cancellation_token_{cancellation_token} {}
+
+bool openat_awaiter::await_ready() { return skip_cancelled_request(cancellation_token_, sqe_data_); }
+
+void openat_awaiter::await_suspend(std::coroutine_handle<> coroutine)
+{
+	sqe_data_.coroutine = coroutine.address();
+	if (cancellation_token_ != nullptr)
+	{
+		cancellation_token_->register_request(&sqe_data_);
+	}
+
+	io_uring::get_instance().submit_openat_request(&sqe_data_, path_, flags_, mode_);
+}
+
+int openat_awaiter::await_resume()
+{
+	if (cancellation_token_ != nullptr)
+	{
+		cancellation_token_->unregister_request(&sqe_data_);
+	}
+	return sqe_data_.cqe_res;
+}
+
+poll_awaiter::poll_awaiter(
+	const int raw_file_descriptor, const unsigned int poll_mask,
+	cancellation_token *cancellation_token)
+	: raw_file_descriptor_{raw_file_descriptor}, poll_mask_{poll_mask},
+	  cancellation_token_{cancellation_token} {}
+
+bool poll_awaiter::await_ready() { return skip_cancelled_request(cancellation_token_, sqe_data_); }
+
+void poll_awaiter::await_suspend(std::coroutine_handle<> coroutine)
+{
+	sqe_data_.coroutine = coroutine.address();
+	if (cancellation_token_ != nullptr)
+	{
+		cancellation_token_->register_request(&sqe_data_);
+	}
+
+	io_uring::get_instance().submit_poll_request(&sqe_data_, raw_file_descriptor_, poll_mask_);
+}
+
+int poll_awaiter::await_resume()
+{
+	if (cancellation_token_ != nullptr)
+	{
+		cancellation_token_->unregister_request(&sqe_data_);
+	}
+	return sqe_data_.cqe_res;
+}
 
 // Create a pipe.
 std::tuple<file_descriptor, file_descriptor> pipe()
@@ -77,31 +202,66 @@ std::tuple<file_descriptor, file_descriptor> pipe()
 	return {file_descriptor{fd[0]}, file_descriptor{fd[1]}};
 };
 
-// Splice data from one file descriptor to another.
-task<ssize_t> splice(
-	const file_descriptor &file_descriptor_in, const file_descriptor &file_descriptor_out,
-	const size_t length)
+std::tuple<file_descriptor, file_descriptor> pipe(std::error_code &error_code)
 {
-	const auto [read_pipe, write_pipe] = pipe();
+	std::array<int, 2> fd;
+	if (::pipe(fd.data()) == -1)
+	{
+		error_code.assign(errno, std::generic_category());
+		return {};
+	}
+	error_code.clear();
+	return {file_descriptor{fd[0]}, file_descriptor{fd[1]}};
+}
+
+// Splice data from one file descriptor to another through a pipe.
+local_task<ssize_t> splice(
+	const file_descriptor &file_descriptor_in, const int64_t offset,
+	const file_descriptor &file_descriptor_out, const size_t length,
+	cancellation_token *cancellation_token)
+{
+	// Running out of file descriptors fails the splice like any other error.
+	std::error_code error_code;
+	const std::tuple<file_descriptor, file_descriptor> splice_pipe = pipe(error_code);
+	if (error_code)
+	{
+		co_return -1;
+	}
+	co_return co_await splice(
+		file_descriptor_in, offset, file_descriptor_out, length, splice_pipe, cancellation_token);
+}
+
+// Every chunk moved into the pipe is drained to the output before the next
+// one, so a partial write to the output never loses data.
+local_task<ssize_t> splice(
+	const file_descriptor &file_descriptor_in, const int64_t offset,
+	const file_descriptor &file_descriptor_out, const size_t length,
+	const std::tuple<file_descriptor, file_descriptor> &pipe, cancellation_token *cancellation_token)
+{
+	const auto &[read_pipe, write_pipe] = pipe;
 
 	size_t bytes_sent = 0;
 	while (bytes_sent < length)
 	{
+		const ssize_t bytes_read = co_await splice_awaiter(
+			file_descriptor_in.get_raw_file_descriptor(), offset < 0 ? -1 : offset + bytes_sent,
+			write_pipe.get_raw_file_descriptor(), length - bytes_sent, cancellation_token);
+		if (bytes_read <= 0)
 		{
-			ssize_t result = co_await splice_awaiter(
-				file_descriptor_in.get_raw_file_descriptor(), write_pipe.get_raw_file_descriptor(), length);
-			if (result < 0)
-			{
-				co_return -1;
-			}
+			co_return -1;
 		}
+
+		size_t bytes_in_pipe = bytes_read;
+		while (bytes_in_pipe > 0)
 		{
-			ssize_t result = co_await splice_awaiter(
-				read_pipe.get_raw_file_descriptor(), file_descriptor_out.get_raw_file_descriptor(), length);
-			if (result < 0)
+			const ssize_t result = co_await splice_awaiter(
+				read_pipe.get_raw_file_descriptor(), -1, file_descriptor_out.get_raw_file_descriptor(),
+				bytes_in_pipe, cancellation_token);
+			if (result <= 0)
 			{
 				co_return -1;
 			}
+			bytes_in_pipe -= result;
 			bytes_sent += result;
 		}
 	}
@@ -118,4 +278,16 @@ file_descriptor open(const std::filesystem::path &path)
 	}
 	return file_descriptor{raw_file_descriptor};
 }
+
+file_descriptor open(const std::filesystem::path &path, std::error_code &error_code)
+{
+	const int raw_file_descriptor = ::open(path.c_str(), O_RDONLY);
+	if (raw_file_descriptor == -1)
+	{
+		error_code.assign(errno, std::generic_category());
+		return {};
+	}
+	error_code.clear();
+	return file_descriptor{raw_file_descriptor};
+}
 } // namespace couringserver
@@ -0,0 +1,127 @@
+#include "file_metadata_cache.hpp"
+
+#include <sys/stat.h>
+
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "constant.hpp"
+#include "http_message.hpp"
+
+namespace couringserver {
+namespace {
+void append_hex(std::string &string, const uintmax_t number)
+{
+	std::array<char, 16> hex;
+	const auto [hex_end, _] = std::to_chars(hex.data(), hex.data() + hex.size(), number, 16);
+	string.append(hex.data(), hex_end);
+}
+
+// Build the entity-tag from the inode, size and modification time. A file
+// modified within the last second may change again without its timestamp
+// moving, so its entity-tag is weak until the timestamp is old enough.
+std::string make_entity_tag(const struct stat &file_status)
+{
+	std::string entity_tag;
+	if (file_status.st_mtim.tv_sec >= std::time(nullptr) - 1)
+	{
+		entity_tag = "W/";
+	}
+	entity_tag += '"';
+	append_hex(entity_tag, file_status.st_ino);
+	entity_tag += '-';
+	append_hex(entity_tag, file_status.st_size);
+	entity_tag += '-';
+	append_hex(entity_tag, file_status.st_mtim.tv_sec * 1'000'000'000ULL + file_status.st_mtim.tv_nsec);
+	entity_tag += '"';
+	return entity_tag;
+}
+} // namespace
+
+const file_metadata *file_metadata_cache::get(const std::filesystem::path &path)
+{
+	const auto now = std::chrono::steady_clock::now();
+	if (const auto iterator = file_metadata_map_.find(path.native());
+		iterator != file_metadata_map_.end())
+	{
+		if (iterator->second.expiration_time > now)
+		{
+			return &iterator->second;
+		}
+		file_metadata_map_.erase(iterator);
+	}
+
+	struct stat file_status;
+	if (::stat(path.c_str(), &file_status) == -1 || !S_ISREG(file_status.st_mode))
+	{
+		return nullptr;
+	}
+
+	if (file_metadata_map_.size() >= MAX_FILE_METADATA_CACHE_SIZE)
+	{
+		file_metadata_map_.clear();
+	}
+	const std::string entity_tag = make_entity_tag(file_status);
+	// A weak entity-tag is only kept until the file can be examined again.
+	const auto expiration_time = entity_tag.starts_with("W/") ? now : now + FILE_METADATA_CACHE_TTL;
+	const auto [iterator, _] = file_metadata_map_.insert_or_assign(
+		path.native(),
+		file_metadata{
+			.size = static_cast<uintmax_t>(file_status.st_size),
+			.modification_time = file_status.st_mtim.tv_sec,
+			.entity_tag = entity_tag,
+			.last_modified = format_http_date(file_status.st_mtim.tv_sec),
+			.expiration_time = expiration_time,
+		});
+	return &iterator->second;
+}
+
+std::string_view file_metadata_cache::report_open_error(
+	const std::filesystem::path &path, const std::error_code error_code)
+{
+	switch (error_code.value())
+	{
+	case ENOENT:
+	case ENOTDIR:
+		file_metadata_map_.erase(path.native());
+		return "404";
+	case EACCES:
+	case EPERM:
+		return "403";
+	default:
+		return "500";
+	}
+}
+
+bool is_not_modified(const http_request &http_request, const file_metadata &file_metadata)
+{
+	return is_not_modified(http_request, file_metadata.entity_tag, file_metadata.modification_time);
+}
+
+bool is_not_modified(
+	const http_request &http_request, const std::string_view entity_tag, const std::time_t modification_time)
+{
+	if (http_request.method != "GET" && http_request.method != "HEAD")
+	{
+		return false;
+	}
+	if (const std::optional<std::string_view> if_none_match = http_request.get_header("if-none-match"))
+	{
+		return match_entity_tag(if_none_match.value(), entity_tag, true);
+	}
+	if (const std::optional<std::string_view> if_modified_since = http_request.get_header("if-modified-since"))
+	{
+		const std::optional<std::time_t> modified_since = parse_http_date(if_modified_since.value());
+		return modified_since.has_value() && modification_time <= modified_since.value();
+	}
+	return false;
+}
+} // namespace couringserver
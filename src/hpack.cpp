@@ -0,0 +1,399 @@
+#include "hpack.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+
+#include "constant.hpp"
+
+namespace couringserver {
+namespace {
+constexpr std::array<std::tuple<std::string_view, std::string_view>, 61> STATIC_TABLE{{
+	{":authority", ""}, {":method", "GET"}, {":method", "POST"},
+	{":path", "/"}, {":path", "/index.html"}, {":scheme", "http"},
+	{":scheme", "https"}, {":status", "200"}, {":status", "204"},
+	{":status", "206"}, {":status", "304"}, {":status", "400"},
+	{":status", "404"}, {":status", "500"}, {"accept-charset", ""},
+	{"accept-encoding", "gzip, deflate"}, {"accept-language", ""}, {"accept-ranges", ""},
+	{"accept", ""}, {"access-control-allow-origin", ""}, {"age", ""},
+	{"allow", ""}, {"authorization", ""}, {"cache-control", ""},
+	{"content-disposition", ""}, {"content-encoding", ""}, {"content-language", ""},
+	{"content-length", ""}, {"content-location", ""}, {"content-range", ""},
+	{"content-type", ""}, {"cookie", ""}, {"date", ""},
+	{"etag", ""}, {"expect", ""}, {"expires", ""},
+	{"from", ""}, {"host", ""}, {"if-match", ""},
+	{"if-modified-since", ""}, {"if-none-match", ""}, {"if-range", ""},
+	{"if-unmodified-since", ""}, {"last-modified", ""}, {"link", ""},
+	{"location", ""}, {"max-forwards", ""}, {"proxy-authenticate", ""},
+	{"proxy-authorization", ""}, {"range", ""}, {"referer", ""},
+	{"refresh", ""}, {"retry-after", ""}, {"server", ""},
+	{"set-cookie", ""}, {"strict-transport-security", ""}, {"transfer-encoding", ""},
+	{"user-agent", ""}, {"vary", ""}, {"via", ""},
+	{"www-authenticate", ""},
+}};
+
+struct huffman_code
+{
+	uint32_t code;
+	uint8_t length;
+};
+
+// The code of every symbol, the last one being EOS (RFC 7541, Appendix B).
+constexpr std::array<huffman_code, 257> HUFFMAN_CODE_LIST{{
+	{0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28}, {0xfffffe5, 28},
+	{0xfffffe6, 28}, {0xfffffe7, 28}, {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+	{0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28}, {0xfffffed, 28}, {0xfffffee, 28},
+	{0xfffffef, 28}, {0xffffff0, 28}, {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+	{0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28},
+	{0xffffffa, 28}, {0xffffffb, 28}, {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+	{0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10},
+	{0xf9, 8}, {0x7fb, 11}, {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+	{0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6}, {0x1a, 6}, {0x1b, 6},
+	{0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+	{0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6},
+	{0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+	{0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7}, {0x68, 7},
+	{0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+	{0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7},
+	{0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+	{0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5},
+	{0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+	{0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7},
+	{0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+	{0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14},
+	{0x1ffd, 13}, {0xffffffc, 28}, {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+	{0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23},
+	{0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+	{0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23},
+	{0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+	{0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22}, {0x1fffdd, 21},
+	{0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+	{0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22},
+	{0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+	{0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22},
+	{0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+	{0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23},
+	{0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+	{0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21},
+	{0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+	{0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28}, {0x7ffffe3, 27},
+	{0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+	{0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22}, {0x3fffeb, 22},
+	{0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+	{0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27},
+	{0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+	{0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30},
+}};
+
+// A binary tree over the code bits. A child is the index of an inner node,
+// or the bitwise complement of a symbol for a leaf.
+struct huffman_tree
+{
+	std::array<std::array<int16_t, 2>, 256> node_list{};
+};
+
+consteval huffman_tree make_huffman_tree()
+{
+	huffman_tree huffman_tree;
+	int16_t node_count = 1;
+	for (int16_t symbol = 0; symbol < static_cast<int16_t>(HUFFMAN_CODE_LIST.size()); ++symbol)
+	{
+		const auto [code, length] = HUFFMAN_CODE_LIST[symbol];
+		int16_t node = 0;
+		for (int bit_index = length - 1; bit_index > 0; --bit_index)
+		{
+			int16_t &child = huffman_tree.node_list[node][(code >> bit_index) & 1];
+			if (child == 0)
+			{
+				child = node_count++;
+			}
+			node = child;
+		}
+		huffman_tree.node_list[node][code & 1] = static_cast<int16_t>(~symbol);
+	}
+	return huffman_tree;
+}
+
+constexpr huffman_tree HUFFMAN_TREE = make_huffman_tree();
+
+// Decode a string, the padding must be a prefix of EOS shorter than a byte.
+std::optional<std::string> decode_huffman(std::span<const uint8_t> encoded)
+{
+	std::string decoded;
+	int16_t node = 0;
+	size_t padding_length = 0;
+	bool padding_ones = true;
+	for (const uint8_t byte : encoded)
+	{
+		for (int bit_index = 7; bit_index >= 0; --bit_index)
+		{
+			const int bit = (byte >> bit_index) & 1;
+			++padding_length;
+			padding_ones = padding_ones && bit == 1;
+
+			const int16_t child = HUFFMAN_TREE.node_list[node][bit];
+			if (child >= 0)
+			{
+				node = child;
+				continue;
+			}
+			const int16_t symbol = ~child;
+			if (symbol == 256)
+			{
+				return std::nullopt;
+			}
+			decoded += static_cast<char>(symbol);
+			node = 0;
+			padding_length = 0;
+			padding_ones = true;
+		}
+	}
+	if (padding_length > 7 || !padding_ones)
+	{
+		return std::nullopt;
+	}
+	return decoded;
+}
+
+// Decode an integer with an N-bit prefix (RFC 7541, Section 5.1).
+std::optional<uint64_t> decode_integer(std::span<const uint8_t> &input, const int prefix_length)
+{
+	if (input.empty())
+	{
+		return std::nullopt;
+	}
+	const uint8_t prefix_mask = (1 << prefix_length) - 1;
+	uint64_t value = input.front() & prefix_mask;
+	input = input.subspan(1);
+	if (value < prefix_mask)
+	{
+		return value;
+	}
+
+	for (int shift = 0; shift <= 56; shift += 7)
+	{
+		if (input.empty())
+		{
+			return std::nullopt;
+		}
+		const uint8_t byte = input.front();
+		input = input.subspan(1);
+		value += static_cast<uint64_t>(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			return value;
+		}
+	}
+	return std::nullopt;
+}
+
+std::optional<std::string> decode_string(std::span<const uint8_t> &input)
+{
+	if (input.empty())
+	{
+		return std::nullopt;
+	}
+	const bool huffman = (input.front() & 0x80) != 0;
+	const std::optional<uint64_t> length = decode_integer(input, 7);
+	if (!length.has_value() || length.value() > input.size())
+	{
+		return std::nullopt;
+	}
+	const std::span<const uint8_t> encoded = input.first(length.value());
+	input = input.subspan(length.value());
+	if (huffman)
+	{
+		return decode_huffman(encoded);
+	}
+	return std::string(encoded.begin(), encoded.end());
+}
+
+void encode_integer(std::string &output, const uint8_t first_byte, const int prefix_length, uint64_t value)
+{
+	const uint8_t prefix_mask = (1 << prefix_length) - 1;
+	if (value < prefix_mask)
+	{
+		output += static_cast<char>(first_byte | value);
+		return;
+	}
+	output += static_cast<char>(first_byte | prefix_mask);
+	value -= prefix_mask;
+	while (value >= 0x80)
+	{
+		output += static_cast<char>((value & 0x7f) | 0x80);
+		value >>= 7;
+	}
+	output += static_cast<char>(value);
+}
+
+void encode_string(std::string &output, const std::string_view string)
+{
+	encode_integer(output, 0, 7, string.size());
+	output += string;
+}
+
+// An entry costs its name and value plus 32 octets (RFC 7541, Section 4.1).
+constexpr size_t get_entry_size(const std::string_view name, const std::string_view value)
+{
+	return name.size() + value.size() + 32;
+}
+} // namespace
+
+hpack_decoder::hpack_decoder() : dynamic_table_capacity_{HTTP2_HEADER_TABLE_SIZE} {}
+
+std::optional<header_list_type> hpack_decoder::decode(std::span<const uint8_t> header_block)
+{
+	header_list_type header_list;
+	size_t header_list_size = 0;
+	bool header_seen = false;
+	while (!header_block.empty())
+	{
+		const uint8_t first_byte = header_block.front();
+		if ((first_byte & 0xe0) == 0x20)
+		{
+			// A table size update is only allowed before the first field.
+			const std::optional<uint64_t> capacity = decode_integer(header_block, 5);
+			if (header_seen || !capacity.has_value() || capacity.value() > HTTP2_HEADER_TABLE_SIZE)
+			{
+				return std::nullopt;
+			}
+			dynamic_table_capacity_ = capacity.value();
+			evict(dynamic_table_capacity_);
+			continue;
+		}
+		header_seen = true;
+
+		std::optional<std::tuple<std::string, std::string>> header;
+		if ((first_byte & 0x80) != 0)
+		{
+			const std::optional<uint64_t> index = decode_integer(header_block, 7);
+			if (!index.has_value())
+			{
+				return std::nullopt;
+			}
+			header = get_entry(index.value());
+		}
+		else
+		{
+			const bool incremental_indexing = (first_byte & 0xc0) == 0x40;
+			const std::optional<uint64_t> index = decode_integer(header_block, incremental_indexing ? 6 : 4);
+			if (!index.has_value())
+			{
+				return std::nullopt;
+			}
+
+			std::optional<std::string> name;
+			if (index.value() == 0)
+			{
+				name = decode_string(header_block);
+			}
+			else if (const auto entry = get_entry(index.value()))
+			{
+				name = std::get<0>(entry.value());
+			}
+			std::optional<std::string> value = decode_string(header_block);
+			if (!name.has_value() || !value.has_value())
+			{
+				return std::nullopt;
+			}
+			if (incremental_indexing)
+			{
+				add_entry(name.value(), value.value());
+			}
+			header.emplace(std::move(name.value()), std::move(value.value()));
+		}
+		if (!header.has_value())
+		{
+			return std::nullopt;
+		}
+
+		header_list_size += get_entry_size(std::get<0>(header.value()), std::get<1>(header.value()));
+		if (header_list_size > HTTP2_MAX_HEADER_LIST_SIZE)
+		{
+			return std::nullopt;
+		}
+		header_list.emplace_back(std::move(header.value()));
+	}
+	return header_list;
+}
+
+std::optional<std::tuple<std::string, std::string>> hpack_decoder::get_entry(const uint64_t index) const
+{
+	if (index == 0)
+	{
+		return std::nullopt;
+	}
+	if (index <= STATIC_TABLE.size())
+	{
+		const auto &[name, value] = STATIC_TABLE[index - 1];
+		return std::tuple{std::string(name), std::string(value)};
+	}
+	const uint64_t dynamic_index = index - STATIC_TABLE.size() - 1;
+	if (dynamic_index >= dynamic_table_.size())
+	{
+		return std::nullopt;
+	}
+	return dynamic_table_[dynamic_index];
+}
+
+// An entry larger than the table empties it and is not added.
+void hpack_decoder::add_entry(std::string name, std::string value)
+{
+	const size_t entry_size = get_entry_size(name, value);
+	if (entry_size > dynamic_table_capacity_)
+	{
+		evict(0);
+		return;
+	}
+	evict(dynamic_table_capacity_ - entry_size);
+	dynamic_table_.emplace_front(std::move(name), std::move(value));
+	dynamic_table_size_ += entry_size;
+}
+
+void hpack_decoder::evict(const size_t capacity)
+{
+	while (dynamic_table_size_ > capacity)
+	{
+		const auto &[name, value] = dynamic_table_.back();
+		dynamic_table_size_ -= get_entry_size(name, value);
+		dynamic_table_.pop_back();
+	}
+}
+
+void hpack_encoder::encode(std::string &header_block, const std::string_view name, const std::string_view value)
+{
+	// An exact match is fully indexed, e.g. ':status: 200'.
+	size_t name_index = 0;
+	for (size_t index = 0; index < STATIC_TABLE.size(); ++index)
+	{
+		const auto &[static_name, static_value] = STATIC_TABLE[index];
+		if (static_name != name)
+		{
+			continue;
+		}
+		if (static_value == value)
+		{
+			encode_integer(header_block, 0x80, 7, index + 1);
+			return;
+		}
+		if (name_index == 0)
+		{
+			name_index = index + 1;
+		}
+	}
+
+	// Literal header field without indexing.
+	encode_integer(header_block, 0x00, 4, name_index);
+	if (name_index == 0)
+	{
+		encode_string(header_block, name);
+	}
+	encode_string(header_block, value);
+}
+} // namespace couringserver
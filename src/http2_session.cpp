@@ -0,0 +1,1163 @@
+#include "http2_session.hpp"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <cctype>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "asset_pack.hpp"
+#include "buffer_ring.hpp"
+#include "constant.hpp"
+#include "file_descriptor.hpp"
+#include "file_metadata_cache.hpp"
+#include "hpack.hpp"
+#include "http_message.hpp"
+#include "http_route.hpp"
+#include "http_server.hpp"
+#include "io_uring.hpp"
+#include "metrics.hpp"
+#include "when_all.hpp"
+
+namespace couringserver {
+namespace {
+constexpr std::string_view CONNECTION_PREFACE = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+constexpr size_t FRAME_HEADER_SIZE = 9;
+
+// The largest frame accepted from the peer, the default that is never raised.
+constexpr size_t MAX_FRAME_SIZE = 16384;
+
+constexpr int64_t DEFAULT_WINDOW_SIZE = 65535;
+constexpr int64_t MAX_WINDOW_SIZE = 0x7fffffff;
+
+// frame types
+constexpr uint8_t DATA_FRAME = 0x0;
+constexpr uint8_t HEADERS_FRAME = 0x1;
+constexpr uint8_t PRIORITY_FRAME = 0x2;
+constexpr uint8_t RST_STREAM_FRAME = 0x3;
+constexpr uint8_t SETTINGS_FRAME = 0x4;
+constexpr uint8_t PUSH_PROMISE_FRAME = 0x5;
+constexpr uint8_t PING_FRAME = 0x6;
+constexpr uint8_t GOAWAY_FRAME = 0x7;
+constexpr uint8_t WINDOW_UPDATE_FRAME = 0x8;
+constexpr uint8_t CONTINUATION_FRAME = 0x9;
+
+// frame flags
+constexpr uint8_t END_STREAM_FLAG = 0x1;
+constexpr uint8_t ACK_FLAG = 0x1;
+constexpr uint8_t END_HEADERS_FLAG = 0x4;
+constexpr uint8_t PADDED_FLAG = 0x8;
+constexpr uint8_t PRIORITY_FLAG = 0x20;
+
+// error codes
+constexpr uint32_t NO_ERROR = 0x0;
+constexpr uint32_t PROTOCOL_ERROR = 0x1;
+constexpr uint32_t FLOW_CONTROL_ERROR = 0x3;
+constexpr uint32_t STREAM_CLOSED = 0x5;
+constexpr uint32_t FRAME_SIZE_ERROR = 0x6;
+constexpr uint32_t REFUSED_STREAM = 0x7;
+constexpr uint32_t COMPRESSION_ERROR = 0x9;
+constexpr uint32_t ENHANCE_YOUR_CALM = 0xb;
+constexpr uint32_t HTTP_1_1_REQUIRED = 0xd;
+
+// settings parameters
+constexpr uint16_t SETTINGS_ENABLE_PUSH = 0x2;
+constexpr uint16_t SETTINGS_MAX_CONCURRENT_STREAMS = 0x3;
+constexpr uint16_t SETTINGS_INITIAL_WINDOW_SIZE = 0x4;
+constexpr uint16_t SETTINGS_MAX_FRAME_SIZE = 0x5;
+constexpr uint16_t SETTINGS_MAX_HEADER_LIST_SIZE = 0x6;
+
+uint32_t read_uint32(const std::span<const uint8_t> bytes)
+{
+	return static_cast<uint32_t>(bytes[0]) << 24 | static_cast<uint32_t>(bytes[1]) << 16 |
+		   static_cast<uint32_t>(bytes[2]) << 8 | static_cast<uint32_t>(bytes[3]);
+}
+
+void append_uint32(std::string &buffer, const uint32_t value)
+{
+	buffer += static_cast<char>(value >> 24);
+	buffer += static_cast<char>(value >> 16);
+	buffer += static_cast<char>(value >> 8);
+	buffer += static_cast<char>(value);
+}
+
+void append_frame_header(
+	std::string &buffer, const size_t length, const uint8_t type, const uint8_t flags,
+	const uint32_t stream_id)
+{
+	buffer += static_cast<char>(length >> 16);
+	buffer += static_cast<char>(length >> 8);
+	buffer += static_cast<char>(length);
+	buffer += static_cast<char>(type);
+	buffer += static_cast<char>(flags);
+	append_uint32(buffer, stream_id);
+}
+
+void append_setting(std::string &buffer, const uint16_t identifier, const uint32_t value)
+{
+	buffer += static_cast<char>(identifier >> 8);
+	buffer += static_cast<char>(identifier);
+	append_uint32(buffer, value);
+}
+
+// Remove the padding of a DATA or HEADERS frame, return std::nullopt if the
+// padding is longer than the frame.
+std::optional<std::span<const uint8_t>> remove_padding(std::span<const uint8_t> payload, const uint8_t flags)
+{
+	if ((flags & PADDED_FLAG) == 0)
+	{
+		return payload;
+	}
+	if (payload.empty() || payload[0] >= payload.size())
+	{
+		return std::nullopt;
+	}
+	const size_t padding_length = payload[0];
+	return payload.subspan(1, payload.size() - 1 - padding_length);
+}
+
+// Decode the unpadded base64url of an 'HTTP2-Settings' header.
+std::optional<std::string> decode_base64url(std::string_view encoded)
+{
+	while (encoded.ends_with('='))
+	{
+		encoded.remove_suffix(1);
+	}
+
+	std::string decoded;
+	uint32_t bits = 0;
+	int bit_count = 0;
+	for (const char character : encoded)
+	{
+		uint32_t value;
+		if (character >= 'A' && character <= 'Z')
+		{
+			value = character - 'A';
+		}
+		else if (character >= 'a' && character <= 'z')
+		{
+			value = character - 'a' + 26;
+		}
+		else if (character >= '0' && character <= '9')
+		{
+			value = character - '0' + 52;
+		}
+		else if (character == '-')
+		{
+			value = 62;
+		}
+		else if (character == '_')
+		{
+			value = 63;
+		}
+		else
+		{
+			return std::nullopt;
+		}
+
+		bits = (bits << 6) | value;
+		bit_count += 6;
+		if (bit_count >= 8)
+		{
+			bit_count -= 8;
+			decoded += static_cast<char>(bits >> bit_count);
+		}
+	}
+	return decoded;
+}
+
+std::span<const uint8_t> as_bytes(const std::string_view string)
+{
+	return {reinterpret_cast<const uint8_t *>(string.data()), string.size()};
+}
+
+bool contains_token(std::string_view list, const std::string_view token)
+{
+	while (!list.empty())
+	{
+		const size_t comma_position = list.find(',');
+		std::string_view element = list.substr(0, comma_position);
+		list = comma_position == std::string_view::npos ? std::string_view() : list.substr(comma_position + 1);
+
+		while (!element.empty() && element.front() == ' ')
+		{
+			element.remove_prefix(1);
+		}
+		while (!element.empty() && element.back() == ' ')
+		{
+			element.remove_suffix(1);
+		}
+		if (std::ranges::equal(element, token, [](const unsigned char left, const unsigned char right)
+							   { return std::tolower(left) == std::tolower(right); }))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Build the request from the decoded header list, return std::nullopt if the
+// request is malformed (RFC 9113, Section 8.1.1).
+std::optional<http_request> make_http_request(const header_list_type &header_list)
+{
+	http_request http_request;
+	http_request.version = "HTTP/2.0";
+	std::optional<std::string_view> authority;
+	bool regular_header_seen = false;
+	for (const auto &[name, value] : header_list)
+	{
+		if (name.starts_with(':'))
+		{
+			std::string *pseudo_header = nullptr;
+			if (name == ":method")
+			{
+				pseudo_header = &http_request.method;
+			}
+			else if (name == ":path")
+			{
+				pseudo_header = &http_request.url;
+			}
+			else if (name == ":authority")
+			{
+				authority = value;
+			}
+			else if (name != ":scheme")
+			{
+				return std::nullopt;
+			}
+
+			if (regular_header_seen || (pseudo_header != nullptr && !pseudo_header->empty()))
+			{
+				return std::nullopt;
+			}
+			if (pseudo_header != nullptr)
+			{
+				*pseudo_header = value;
+			}
+			continue;
+		}
+
+		regular_header_seen = true;
+		if (std::ranges::any_of(name, [](const unsigned char c)
+								{ return std::isupper(c); }) ||
+			name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+			name == "transfer-encoding" || name == "upgrade" || (name == "te" && value != "trailers"))
+		{
+			return std::nullopt;
+		}
+		http_request.header_list.emplace_back(name, value);
+	}
+
+	if (http_request.method.empty() || http_request.url.empty())
+	{
+		return std::nullopt;
+	}
+	if (authority.has_value() && !http_request.get_header("host").has_value())
+	{
+		http_request.header_list.emplace_back("host", authority.value());
+	}
+	return http_request;
+}
+
+local_task<ssize_t> read_file(const int raw_file_descriptor, const std::span<char> buffer, const uint64_t offset)
+{
+	co_return co_await read_awaiter(raw_file_descriptor, buffer, offset);
+}
+} // namespace
+
+bool is_http2_preface(const std::string_view packet)
+{
+	const size_t length = std::min(packet.size(), CONNECTION_PREFACE.size());
+	return length != 0 && packet.substr(0, length) == CONNECTION_PREFACE.substr(0, length);
+}
+
+bool is_http2_upgrade(const http_request &http_request)
+{
+	const std::optional<std::string_view> upgrade = http_request.get_header("upgrade");
+	const std::optional<std::string_view> settings = http_request.get_header("http2-settings");
+	if (http_request.version != "HTTP/1.1" || !upgrade.has_value() || !settings.has_value() ||
+		!contains_token(upgrade.value(), "h2c"))
+	{
+		return false;
+	}
+	const std::optional<std::string> decoded_settings = decode_base64url(settings.value());
+	return decoded_settings.has_value() && decoded_settings->size() % 6 == 0;
+}
+
+http2_session::http2_session(
+	thread_worker &thread_worker, client_socket &client_socket, multishot_recv_guard &multishot_recv_guard)
+	: thread_worker_{thread_worker}, client_socket_{client_socket}, multishot_recv_guard_{multishot_recv_guard},
+	  connection_send_window_{DEFAULT_WINDOW_SIZE}, peer_initial_window_size_{DEFAULT_WINDOW_SIZE},
+	  peer_max_frame_size_{MAX_FRAME_SIZE} {}
+
+local_task<> http2_session::serve(std::string received, const http_request *upgrade_request)
+{
+	// The SETTINGS frame is the server connection preface, it goes first.
+	append_frame_header(control_buffer_, 12, SETTINGS_FRAME, 0, 0);
+	append_setting(control_buffer_, SETTINGS_MAX_CONCURRENT_STREAMS, HTTP2_MAX_CONCURRENT_STREAMS);
+	append_setting(control_buffer_, SETTINGS_MAX_HEADER_LIST_SIZE, HTTP2_MAX_HEADER_LIST_SIZE);
+
+	if (upgrade_request != nullptr)
+	{
+		std::string send_buffer = "HTTP/1.1 101 Switching Protocols\r\nconnection: Upgrade\r\nupgrade: h2c\r\n\r\n";
+		if (co_await client_socket_.send(send_buffer, send_buffer.size()) == -1)
+		{
+			co_return;
+		}
+
+		// The settings of the upgrade count as the first SETTINGS of the
+		// peer, but they are not acknowledged.
+		const std::optional<std::string> settings =
+			decode_base64url(upgrade_request->get_header("http2-settings").value());
+		if (apply_settings(as_bytes(settings.value())) != NO_ERROR)
+		{
+			co_return;
+		}
+
+		// The upgraded request is stream 1, which is half-closed by the client.
+		last_stream_id_ = 1;
+		http2_stream &http2_stream = stream_map_[1];
+		http2_stream.send_window = peer_initial_window_size_;
+		http2_stream.request_complete = true;
+		respond(1, *upgrade_request);
+	}
+
+	co_await when_all(read_loop(std::move(received)), write_loop());
+}
+
+local_task<> http2_session::read_loop(std::string received)
+{
+	buffer_ring &buffer_ring = buffer_ring::get_instance();
+	input_buffer_ = std::move(received);
+	bool connection_usable = process_input();
+	notify_writer();
+	while (connection_usable && !writer_done_)
+	{
+		// Without any stream the connection is idle, it is closed right away
+		// when the worker is draining.
+		if (stream_map_.empty() && thread_worker_.is_draining())
+		{
+			break;
+		}
+		// A peer that does not read the control frames, e.g. the PING
+		// acknowledgements, is not read from either until they are sent.
+		if (control_buffer_.size() >= HTTP2_MAX_CONTROL_BUFFER_SIZE)
+		{
+			co_await park_awaiter(reader_coroutine_);
+			continue;
+		}
+		reader_waiting_ = true;
+		update_idle();
+		const auto [recv_buffer_id, recv_buffer_size] = co_await multishot_recv_guard_.recv();
+		reader_waiting_ = false;
+		update_idle();
+		if (recv_buffer_size <= 0)
+		{
+			break;
+		}
+
+		const std::span<char> recv_buffer = buffer_ring.borrow_buffer(recv_buffer_id, recv_buffer_size);
+		input_buffer_.append(recv_buffer.begin(), recv_buffer.end());
+		buffer_ring.return_buffer(recv_buffer_id);
+
+		connection_usable = process_input();
+		notify_writer();
+	}
+	reader_done_ = true;
+	notify_writer();
+}
+
+local_task<> http2_session::write_loop()
+{
+	while (true)
+	{
+		// Nothing more can be received, so the responses in progress are dropped.
+		if (reader_done_)
+		{
+			send_queue_.clear();
+			stream_map_.clear();
+		}
+		if (!goaway_sent_ && thread_worker_.is_draining())
+		{
+			send_goaway(NO_ERROR);
+		}
+		const bool closing = reader_done_ || ((goaway_sent_ || goaway_received_) && stream_map_.empty());
+
+		// The control frames lead the batch, the DATA frames are read into it.
+		send_buffer_.clear();
+		send_buffer_.swap(control_buffer_);
+		std::vector<size_t> read_length_list;
+		std::vector<local_task<ssize_t>> read_task_list = build_batch(read_length_list);
+		if (!read_task_list.empty())
+		{
+			const std::vector<ssize_t> read_result_list = co_await when_all(std::move(read_task_list));
+			// A file that shrank cannot fill its frames, the connection is dropped.
+			if (!std::ranges::equal(read_result_list, read_length_list, [](const ssize_t result, const size_t length)
+									{ return result >= 0 && static_cast<size_t>(result) == length; }))
+			{
+				break;
+			}
+		}
+		std::erase_if(stream_map_, [](const auto &stream_entry)
+					  { return stream_entry.second.reset || (stream_entry.second.sending && stream_entry.second.body_length == 0); });
+		update_idle();
+
+		if (send_buffer_.empty())
+		{
+			if (closing)
+			{
+				break;
+			}
+			co_await park_awaiter(writer_coroutine_);
+			continue;
+		}
+		if (co_await client_socket_.send(send_buffer_, send_buffer_.size()) == -1)
+		{
+			break;
+		}
+		notify_reader();
+	}
+
+	// The pending 'recv' of the reader completes with 0 bytes once the read
+	// side is shut down, a parked reader sees 'writer_done_' when resumed.
+	writer_done_ = true;
+	notify_reader();
+	if (!reader_done_)
+	{
+		::shutdown(client_socket_.get_raw_file_descriptor(), SHUT_RD);
+	}
+}
+
+void http2_session::notify_writer()
+{
+	if (writer_coroutine_)
+	{
+		std::exchange(writer_coroutine_, nullptr).resume();
+	}
+}
+
+void http2_session::notify_reader()
+{
+	if (reader_coroutine_)
+	{
+		std::exchange(reader_coroutine_, nullptr).resume();
+	}
+}
+
+bool http2_session::process_input()
+{
+	size_t position = 0;
+	if (!preface_received_)
+	{
+		if (!input_buffer_.empty() && !is_http2_preface(input_buffer_))
+		{
+			send_goaway(PROTOCOL_ERROR);
+			return false;
+		}
+		if (input_buffer_.size() < CONNECTION_PREFACE.size())
+		{
+			return true;
+		}
+		position = CONNECTION_PREFACE.size();
+		preface_received_ = true;
+	}
+
+	while (input_buffer_.size() - position >= FRAME_HEADER_SIZE)
+	{
+		const std::span<const uint8_t> frame = as_bytes(input_buffer_).subspan(position);
+		const size_t length = static_cast<size_t>(frame[0]) << 16 | static_cast<size_t>(frame[1]) << 8 | frame[2];
+		if (length > MAX_FRAME_SIZE)
+		{
+			send_goaway(FRAME_SIZE_ERROR);
+			return false;
+		}
+		if (frame.size() < FRAME_HEADER_SIZE + length)
+		{
+			break;
+		}
+
+		const uint32_t stream_id = read_uint32(frame.subspan(5)) & 0x7fffffff;
+		if (!process_frame(frame[3], frame[4], stream_id, frame.subspan(FRAME_HEADER_SIZE, length)))
+		{
+			return false;
+		}
+		position += FRAME_HEADER_SIZE + length;
+	}
+	input_buffer_.erase(0, position);
+	return true;
+}
+
+bool http2_session::process_frame(
+	const uint8_t type, const uint8_t flags, const uint32_t stream_id, const std::span<const uint8_t> payload)
+{
+	// The first frame must be SETTINGS, and a header block must not be
+	// interleaved with any other frame.
+	if ((!settings_received_ && type != SETTINGS_FRAME) ||
+		(header_block_stream_id_ != 0 && (type != CONTINUATION_FRAME || stream_id != header_block_stream_id_)))
+	{
+		send_goaway(PROTOCOL_ERROR);
+		return false;
+	}
+
+	switch (type)
+	{
+	case DATA_FRAME:
+		return process_data(flags, stream_id, payload);
+
+	case HEADERS_FRAME:
+	{
+		std::optional<std::span<const uint8_t>> header_block = remove_padding(payload, flags);
+		if (stream_id == 0 || !header_block.has_value() ||
+			((flags & PRIORITY_FLAG) != 0 && header_block->size() < 5))
+		{
+			send_goaway(PROTOCOL_ERROR);
+			return false;
+		}
+		if ((flags & PRIORITY_FLAG) != 0)
+		{
+			header_block = header_block->subspan(5);
+		}
+		header_block_.assign(header_block->begin(), header_block->end());
+		header_block_stream_id_ = stream_id;
+		header_block_end_stream_ = (flags & END_STREAM_FLAG) != 0;
+		return (flags & END_HEADERS_FLAG) == 0 || process_headers(stream_id, header_block_end_stream_);
+	}
+
+	case CONTINUATION_FRAME:
+		if (header_block_stream_id_ == 0)
+		{
+			send_goaway(PROTOCOL_ERROR);
+			return false;
+		}
+		// The compressed block is bounded as well, it is buffered in full.
+		header_block_.append(payload.begin(), payload.end());
+		if (header_block_.size() > HTTP2_MAX_HEADER_LIST_SIZE)
+		{
+			send_goaway(ENHANCE_YOUR_CALM);
+			return false;
+		}
+		return (flags & END_HEADERS_FLAG) == 0 || process_headers(stream_id, header_block_end_stream_);
+
+	case PRIORITY_FRAME:
+		// Streams are served round-robin, so the priority is ignored.
+		if (stream_id == 0)
+		{
+			send_goaway(PROTOCOL_ERROR);
+			return false;
+		}
+		if (payload.size() != 5)
+		{
+			reset_stream(stream_id, FRAME_SIZE_ERROR);
+		}
+		return true;
+
+	case RST_STREAM_FRAME:
+		if (stream_id == 0 || stream_id > last_stream_id_ || payload.size() != 4)
+		{
+			send_goaway(payload.size() != 4 ? FRAME_SIZE_ERROR : PROTOCOL_ERROR);
+			return false;
+		}
+		close_stream(stream_id);
+		return true;
+
+	case SETTINGS_FRAME:
+		return process_settings(flags, stream_id, payload);
+
+	case PING_FRAME:
+		if (stream_id != 0 || payload.size() != 8)
+		{
+			send_goaway(stream_id != 0 ? PROTOCOL_ERROR : FRAME_SIZE_ERROR);
+			return false;
+		}
+		if ((flags & ACK_FLAG) == 0)
+		{
+			append_frame_header(control_buffer_, payload.size(), PING_FRAME, ACK_FLAG, 0);
+			control_buffer_.append(payload.begin(), payload.end());
+		}
+		return true;
+
+	case GOAWAY_FRAME:
+		// The streams in progress are finished before the connection is closed.
+		if (stream_id != 0 || payload.size() < 8)
+		{
+			send_goaway(stream_id != 0 ? PROTOCOL_ERROR : FRAME_SIZE_ERROR);
+			return false;
+		}
+		goaway_received_ = true;
+		return true;
+
+	case WINDOW_UPDATE_FRAME:
+		return process_window_update(stream_id, payload);
+
+	case PUSH_PROMISE_FRAME:
+		send_goaway(PROTOCOL_ERROR);
+		return false;
+
+	default:
+		// Frames of unknown types are ignored.
+		return true;
+	}
+}
+
+bool http2_session::process_headers(const uint32_t stream_id, const bool end_stream)
+{
+	// The block is decoded even if the stream is refused, so that the dynamic
+	// table stays in sync with the peer.
+	header_block_stream_id_ = 0;
+	std::optional<header_list_type> header_list = hpack_decoder_.decode(as_bytes(header_block_));
+	header_block_.clear();
+	if (!header_list.has_value())
+	{
+		send_goaway(COMPRESSION_ERROR);
+		return false;
+	}
+
+	auto stream_iterator = stream_map_.find(stream_id);
+	if (stream_iterator == stream_map_.end())
+	{
+		if (stream_id % 2 == 0)
+		{
+			send_goaway(PROTOCOL_ERROR);
+			return false;
+		}
+		// e.g. the trailers of a request whose stream was reset.
+		if (stream_id <= last_stream_id_)
+		{
+			reset_stream(stream_id, STREAM_CLOSED);
+			return true;
+		}
+		last_stream_id_ = stream_id;
+		// The streams opened after a GOAWAY are ignored.
+		if (goaway_sent_)
+		{
+			return true;
+		}
+		if (stream_map_.size() >= HTTP2_MAX_CONCURRENT_STREAMS)
+		{
+			append_frame_header(control_buffer_, 4, RST_STREAM_FRAME, 0, stream_id);
+			append_uint32(control_buffer_, REFUSED_STREAM);
+			return true;
+		}
+		stream_iterator = stream_map_.try_emplace(stream_id).first;
+		stream_iterator->second.send_window = peer_initial_window_size_;
+		stream_iterator->second.header_list = std::move(header_list.value());
+	}
+	else if (stream_iterator->second.request_complete)
+	{
+		reset_stream(stream_id, STREAM_CLOSED);
+		return true;
+	}
+	else if (!end_stream)
+	{
+		// Trailers must end the stream.
+		reset_stream(stream_id, PROTOCOL_ERROR);
+		return true;
+	}
+
+	if (!end_stream)
+	{
+		return true;
+	}
+	http2_stream &http2_stream = stream_iterator->second;
+	http2_stream.request_complete = true;
+	const std::optional<http_request> http_request = make_http_request(http2_stream.header_list);
+	if (!http_request.has_value())
+	{
+		reset_stream(stream_id, PROTOCOL_ERROR);
+		return true;
+	}
+	respond(stream_id, http_request.value());
+	return true;
+}
+
+bool http2_session::process_data(const uint8_t flags, const uint32_t stream_id, const std::span<const uint8_t> payload)
+{
+	const std::optional<std::span<const uint8_t>> data = remove_padding(payload, flags);
+	if (stream_id == 0 || stream_id > last_stream_id_ || !data.has_value())
+	{
+		send_goaway(PROTOCOL_ERROR);
+		return false;
+	}
+
+	// The request body is discarded, so the window is given back right away.
+	if (!payload.empty())
+	{
+		append_frame_header(control_buffer_, 4, WINDOW_UPDATE_FRAME, 0, 0);
+		append_uint32(control_buffer_, payload.size());
+	}
+
+	const auto stream_iterator = stream_map_.find(stream_id);
+	if (stream_iterator == stream_map_.end() || stream_iterator->second.request_complete)
+	{
+		reset_stream(stream_id, STREAM_CLOSED);
+		return true;
+	}
+
+	http2_stream &http2_stream = stream_iterator->second;
+	if ((flags & END_STREAM_FLAG) == 0)
+	{
+		if (!payload.empty())
+		{
+			append_frame_header(control_buffer_, 4, WINDOW_UPDATE_FRAME, 0, stream_id);
+			append_uint32(control_buffer_, payload.size());
+		}
+		return true;
+	}
+
+	http2_stream.request_complete = true;
+	const std::optional<http_request> http_request = make_http_request(http2_stream.header_list);
+	if (!http_request.has_value())
+	{
+		reset_stream(stream_id, PROTOCOL_ERROR);
+		return true;
+	}
+	respond(stream_id, http_request.value());
+	return true;
+}
+
+bool http2_session::process_settings(
+	const uint8_t flags, const uint32_t stream_id, const std::span<const uint8_t> payload)
+{
+	if (stream_id != 0)
+	{
+		send_goaway(PROTOCOL_ERROR);
+		return false;
+	}
+	if ((flags & ACK_FLAG) != 0 ? !payload.empty() : payload.size() % 6 != 0)
+	{
+		send_goaway(FRAME_SIZE_ERROR);
+		return false;
+	}
+	if ((flags & ACK_FLAG) != 0)
+	{
+		return true;
+	}
+
+	if (const uint32_t error_code = apply_settings(payload); error_code != NO_ERROR)
+	{
+		send_goaway(error_code);
+		return false;
+	}
+	settings_received_ = true;
+	append_frame_header(control_buffer_, 0, SETTINGS_FRAME, ACK_FLAG, 0);
+	return true;
+}
+
+bool http2_session::process_window_update(const uint32_t stream_id, const std::span<const uint8_t> payload)
+{
+	if (payload.size() != 4)
+	{
+		send_goaway(FRAME_SIZE_ERROR);
+		return false;
+	}
+	const uint32_t increment = read_uint32(payload) & 0x7fffffff;
+	if (stream_id == 0)
+	{
+		connection_send_window_ += increment;
+		if (increment == 0 || connection_send_window_ > MAX_WINDOW_SIZE)
+		{
+			send_goaway(increment == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR);
+			return false;
+		}
+		return true;
+	}
+
+	if (stream_id > last_stream_id_)
+	{
+		send_goaway(PROTOCOL_ERROR);
+		return false;
+	}
+	const auto stream_iterator = stream_map_.find(stream_id);
+	if (stream_iterator == stream_map_.end())
+	{
+		return true;
+	}
+	http2_stream &http2_stream = stream_iterator->second;
+	http2_stream.send_window += increment;
+	if (increment == 0 || http2_stream.send_window > MAX_WINDOW_SIZE)
+	{
+		reset_stream(stream_id, increment == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR);
+		return true;
+	}
+	schedule_stream(stream_id, http2_stream);
+	return true;
+}
+
+uint32_t http2_session::apply_settings(const std::span<const uint8_t> payload)
+{
+	for (size_t position = 0; position + 6 <= payload.size(); position += 6)
+	{
+		const uint16_t identifier = static_cast<uint16_t>(payload[position] << 8 | payload[position + 1]);
+		const uint32_t value = read_uint32(payload.subspan(position + 2));
+		switch (identifier)
+		{
+		case SETTINGS_ENABLE_PUSH:
+			if (value > 1)
+			{
+				return PROTOCOL_ERROR;
+			}
+			break;
+
+		case SETTINGS_INITIAL_WINDOW_SIZE:
+		{
+			// The change applies to the windows of the open streams as well.
+			if (value > MAX_WINDOW_SIZE)
+			{
+				return FLOW_CONTROL_ERROR;
+			}
+			const int64_t delta = static_cast<int64_t>(value) - peer_initial_window_size_;
+			for (auto &[stream_id, http2_stream] : stream_map_)
+			{
+				http2_stream.send_window += delta;
+				if (http2_stream.send_window > MAX_WINDOW_SIZE)
+				{
+					return FLOW_CONTROL_ERROR;
+				}
+				schedule_stream(stream_id, http2_stream);
+			}
+			peer_initial_window_size_ = value;
+			break;
+		}
+
+		case SETTINGS_MAX_FRAME_SIZE:
+			if (value < MAX_FRAME_SIZE || value > 0xffffff)
+			{
+				return PROTOCOL_ERROR;
+			}
+			peer_max_frame_size_ = value;
+			break;
+
+		default:
+			// The encoder never indexes, so the header table size of the peer
+			// does not matter, and the other parameters are advisory.
+			break;
+		}
+	}
+	return NO_ERROR;
+}
+
+void http2_session::respond(const uint32_t stream_id, const http_request &http_request)
+{
+	http2_stream &http2_stream = stream_map_.at(stream_id);
+	http2_stream.header_list.clear();
+	// Streams cannot wait for a slot as HTTP/1.1 requests do, the client may
+	// retry a refused one.
+	if (!http2_stream.request_slot.take(thread_worker_))
+	{
+		reset_stream(stream_id, REFUSED_STREAM);
+		return;
+	}
+
+	// The handlers write HTTP/1.1 to the socket, so only the routes that are
+	// known here are served over HTTP/2.
+	http_response http_response;
+	const std::string_view path = std::string_view(http_request.url).substr(0, http_request.url.find('?'));
+	const http_handler *const http_handler = HTTP_ROUTE_TABLE.find(http_request.method, path);
+	if (http_handler == nullptr)
+	{
+		http_response.status = "404";
+		http_response.header_list.emplace_back("content-length", "0");
+	}
+	else if (*http_handler == serve_health)
+	{
+		http_response.status = "200";
+		http_response.header_list.emplace_back("content-type", "text/plain");
+		http2_stream.body_buffer = "ok\n";
+		http2_stream.body_length = http2_stream.body_buffer.size();
+		http_response.header_list.emplace_back("content-length", std::to_string(http2_stream.body_length));
+	}
+	else if (*http_handler == serve_static_file && thread_worker_.get_asset_pack() != nullptr)
+	{
+		// The variant is chosen as for HTTP/1.1, 'Range' is ignored.
+		const asset_pack &asset_pack = *thread_worker_.get_asset_pack();
+		const asset_pack_slot *const asset_pack_slot = asset_pack.find(path);
+		if (asset_pack_slot == nullptr)
+		{
+			http_response.status = "404";
+			http_response.header_list.emplace_back("content-length", "0");
+		}
+		else
+		{
+			const asset_encoding asset_encoding =
+				asset_pack::select_encoding(*asset_pack_slot, http_request.get_header("accept-encoding"));
+			const asset_pack_variant &asset_pack_variant =
+				asset_pack_slot->variant_list[static_cast<size_t>(asset_encoding)];
+			const std::string_view entity_tag = asset_pack.get_string(asset_pack_variant.entity_tag);
+			if (is_not_modified(http_request, entity_tag, asset_pack_slot->modification_time))
+			{
+				http_response.status = "304";
+				http_response.header_list.emplace_back("etag", entity_tag);
+				http_response.header_list.emplace_back(
+					"last-modified", asset_pack.get_string(asset_pack_slot->last_modified));
+			}
+			else
+			{
+				http_response.status = "200";
+				http_response.header_block = asset_pack.get_string(asset_pack_variant.header_block);
+				if (http_request.method == "GET")
+				{
+					http2_stream.body_mapping = asset_pack.get_body(asset_pack_variant);
+					http2_stream.body_length = http2_stream.body_mapping.size();
+				}
+			}
+		}
+	}
+	else if (*http_handler == serve_static_file)
+	{
+		// 'Range' is optional and ignored, the whole file is sent.
+		const std::filesystem::path file_path = http_request.url;
+		const file_metadata *const file_metadata = thread_worker_.get_file_metadata_cache().get(file_path);
+		if (file_metadata == nullptr)
+		{
+			http_response.status = "404";
+			http_response.header_list.emplace_back("content-length", "0");
+		}
+		else
+		{
+			http_response.header_list.emplace_back("etag", file_metadata->entity_tag);
+			http_response.header_list.emplace_back("last-modified", file_metadata->last_modified);
+			if (is_not_modified(http_request, *file_metadata))
+			{
+				http_response.status = "304";
+			}
+			else if (http_request.method != "GET" || file_metadata->size == 0)
+			{
+				http_response.status = "200";
+				http_response.header_list.emplace_back("content-length", std::to_string(file_metadata->size));
+			}
+			else
+			{
+				// The metadata may be cached from before the file was removed
+				// or made unreadable, as for HTTP/1.1.
+				const uintmax_t file_size = file_metadata->size;
+				std::error_code error_code;
+				file_descriptor file_descriptor = open(file_path, error_code);
+				if (error_code)
+				{
+					http_response.header_list.clear();
+					http_response.status =
+						thread_worker_.get_file_metadata_cache().report_open_error(file_path, error_code);
+					http_response.header_list.emplace_back("content-length", "0");
+				}
+				else
+				{
+					http_response.status = "200";
+					http_response.header_list.emplace_back("content-length", std::to_string(file_size));
+					// A large file gets a larger readahead window, as for HTTP/1.1.
+					if (file_size >= SEQUENTIAL_READ_THRESHOLD)
+					{
+						io_uring::get_instance().submit_fadvise_request(
+							nullptr, file_descriptor.get_raw_file_descriptor(), 0, 0, POSIX_FADV_SEQUENTIAL);
+					}
+					http2_stream.body_file.emplace(std::move(file_descriptor));
+					http2_stream.body_length = file_size;
+				}
+			}
+		}
+	}
+	else
+	{
+		reset_stream(stream_id, HTTP_1_1_REQUIRED);
+		return;
+	}
+
+	thread_worker_.get_worker_metrics().add_response(http_response.status, http2_stream.body_length);
+	const bool end_stream = http2_stream.body_length == 0;
+	send_headers(stream_id, http_response, end_stream);
+	if (end_stream)
+	{
+		stream_map_.erase(stream_id);
+		return;
+	}
+	http2_stream.sending = true;
+	schedule_stream(stream_id, http2_stream);
+}
+
+void http2_session::send_headers(const uint32_t stream_id, const http_response &http_response, const bool end_stream)
+{
+	std::string header_block;
+	hpack_encoder::encode(header_block, ":status", http_response.status);
+	for (const auto &[name, value] : http_response.header_list)
+	{
+		hpack_encoder::encode(header_block, name, value);
+	}
+	// The preformatted lines are lowercase, as HTTP/2 requires.
+	for (size_t start = 0; start < http_response.header_block.size();)
+	{
+		const size_t end = std::min(http_response.header_block.find("\r\n", start), http_response.header_block.size());
+		const std::string_view line = http_response.header_block.substr(start, end - start);
+		start = end + 2;
+		if (const size_t colon = line.find(':'); colon != std::string_view::npos)
+		{
+			hpack_encoder::encode(header_block, line.substr(0, colon), line.substr(colon + 1));
+		}
+	}
+
+	// A block larger than a frame is continued in CONTINUATION frames.
+	uint8_t type = HEADERS_FRAME;
+	size_t position = 0;
+	do
+	{
+		const size_t length = std::min(peer_max_frame_size_, header_block.size() - position);
+		uint8_t flags = position + length == header_block.size() ? END_HEADERS_FLAG : 0;
+		if (type == HEADERS_FRAME && end_stream)
+		{
+			flags |= END_STREAM_FLAG;
+		}
+		append_frame_header(control_buffer_, length, type, flags, stream_id);
+		control_buffer_.append(header_block, position, length);
+		position += length;
+		type = CONTINUATION_FRAME;
+	} while (position < header_block.size());
+}
+
+void http2_session::reset_stream(const uint32_t stream_id, const uint32_t error_code)
+{
+	append_frame_header(control_buffer_, 4, RST_STREAM_FRAME, 0, stream_id);
+	append_uint32(control_buffer_, error_code);
+	close_stream(stream_id);
+}
+
+// A stream that is sending may have reads in flight, so it is only marked and
+// the writer erases it.
+void http2_session::close_stream(const uint32_t stream_id)
+{
+	if (const auto stream_iterator = stream_map_.find(stream_id); stream_iterator != stream_map_.end())
+	{
+		if (stream_iterator->second.sending)
+		{
+			stream_iterator->second.reset = true;
+		}
+		else
+		{
+			stream_map_.erase(stream_iterator);
+		}
+	}
+}
+
+void http2_session::send_goaway(const uint32_t error_code)
+{
+	append_frame_header(control_buffer_, 8, GOAWAY_FRAME, 0, 0);
+	append_uint32(control_buffer_, last_stream_id_);
+	append_uint32(control_buffer_, error_code);
+	goaway_sent_ = true;
+}
+
+void http2_session::schedule_stream(const uint32_t stream_id, http2_stream &http2_stream)
+{
+	if (http2_stream.sending && !http2_stream.queued && !http2_stream.reset && http2_stream.body_length != 0)
+	{
+		http2_stream.queued = true;
+		send_queue_.emplace_back(stream_id);
+	}
+}
+
+std::vector<local_task<ssize_t>> http2_session::build_batch(std::vector<size_t> &read_length_list)
+{
+	// The reads fill the buffer in place, so it must not grow past its capacity.
+	std::vector<local_task<ssize_t>> read_task_list;
+	send_buffer_.reserve(send_buffer_.size() + HTTP2_SEND_BATCH_SIZE);
+	size_t batch_size = 0;
+	while (!send_queue_.empty() && connection_send_window_ > 0 &&
+		   batch_size + FRAME_HEADER_SIZE < HTTP2_SEND_BATCH_SIZE)
+	{
+		const uint32_t stream_id = send_queue_.front();
+		send_queue_.pop_front();
+		const auto stream_iterator = stream_map_.find(stream_id);
+		if (stream_iterator == stream_map_.end() || stream_iterator->second.reset)
+		{
+			continue;
+		}
+		http2_stream &http2_stream = stream_iterator->second;
+		http2_stream.queued = false;
+
+		// A stream without window waits for a WINDOW_UPDATE to be scheduled again.
+		const int64_t send_window = std::min(http2_stream.send_window, connection_send_window_);
+		if (send_window <= 0)
+		{
+			continue;
+		}
+		const size_t length = std::min<uintmax_t>(
+			{http2_stream.body_length, peer_max_frame_size_, static_cast<uintmax_t>(send_window),
+			 HTTP2_SEND_BATCH_SIZE - batch_size - FRAME_HEADER_SIZE});
+		http2_stream.body_length -= length;
+		append_frame_header(
+			send_buffer_, length, DATA_FRAME, http2_stream.body_length == 0 ? END_STREAM_FLAG : 0, stream_id);
+
+		const size_t position = send_buffer_.size();
+		send_buffer_.resize(position + length);
+		const std::span<char> data(send_buffer_.data() + position, length);
+		if (http2_stream.body_file.has_value())
+		{
+			read_task_list.emplace_back(
+				read_file(http2_stream.body_file->get_raw_file_descriptor(), data, http2_stream.body_offset));
+			read_length_list.emplace_back(length);
+		}
+		else if (!http2_stream.body_mapping.empty())
+		{
+			std::memcpy(data.data(), http2_stream.body_mapping.data() + http2_stream.body_offset, length);
+		}
+		else
+		{
+			http2_stream.body_buffer.copy(data.data(), length, http2_stream.body_offset);
+		}
+
+		http2_stream.body_offset += length;
+		http2_stream.send_window -= length;
+		connection_send_window_ -= length;
+		batch_size += FRAME_HEADER_SIZE + length;
+		schedule_stream(stream_id, http2_stream);
+	}
+	return read_task_list;
+}
+
+void http2_session::update_idle()
+{
+	thread_worker_.set_idle(client_socket_.get_raw_file_descriptor(), reader_waiting_ && stream_map_.empty());
+}
+
+http2_session::request_slot::request_slot(request_slot &&other) noexcept
+	: thread_worker_{std::exchange(other.thread_worker_, nullptr)} {}
+
+http2_session::request_slot::~request_slot()
+{
+	if (thread_worker_ != nullptr)
+	{
+		thread_worker_->release_request_slot();
+	}
+}
+
+bool http2_session::request_slot::take(thread_worker &thread_worker)
+{
+	if (!thread_worker.try_take_request_slot())
+	{
+		return false;
+	}
+	thread_worker_ = &thread_worker;
+	return true;
+}
+
+http2_session::park_awaiter::park_awaiter(std::coroutine_handle<> &parked_coroutine)
+	: parked_coroutine_{parked_coroutine} {}
+
+bool http2_session::park_awaiter::await_ready() const noexcept { return false; }
+
+void http2_session::park_awaiter::await_suspend(std::coroutine_handle<> coroutine) const noexcept
+{
+	parked_coroutine_ = coroutine;
+}
+
+void http2_session::park_awaiter::await_resume() const noexcept {}
+} // namespace couringserver
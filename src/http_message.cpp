@@ -1,9 +1,59 @@
 #include "http_message.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cctype>
 #include <sstream>
 #include <string>
 
 namespace couringserver {
+namespace {
+bool equal_header_name(const std::string_view left_name, const std::string_view right_name)
+{
+	return std::ranges::equal(left_name, right_name, [](const char left, const char right)
+							  { return std::tolower(static_cast<unsigned char>(left)) ==
+									   std::tolower(static_cast<unsigned char>(right)); });
+}
+
+std::optional<std::string_view> find_header(
+	const std::vector<std::tuple<std::string, std::string>> &header_list, const std::string_view name)
+{
+	for (const auto &[k, v] : header_list)
+	{
+		if (equal_header_name(k, name))
+		{
+			return v;
+		}
+	}
+	return std::nullopt;
+}
+} // namespace
+
+std::optional<std::string_view> http_request::get_header(const std::string_view name) const
+{
+	return find_header(header_list, name);
+}
+
+std::optional<std::string_view> http_response::get_header(const std::string_view name) const
+{
+	if (const std::optional<std::string_view> value = find_header(header_list, name); value.has_value())
+	{
+		return value;
+	}
+	for (size_t start = 0; start < header_block.size();)
+	{
+		const size_t end = std::min(header_block.find("\r\n", start), header_block.size());
+		const std::string_view line = header_block.substr(start, end - start);
+		start = end + 2;
+		const size_t colon = line.find(':');
+		if (colon != std::string_view::npos && equal_header_name(line.substr(0, colon), name))
+		{
+			return line.substr(colon + 1);
+		}
+	}
+	return std::nullopt;
+}
+
 std::string http_response::serialize() const
 {
 	std::stringstream raw_http_response;
@@ -12,7 +62,78 @@ std::string http_response::serialize() const
 	{
 		raw_http_response << k << ':' << v << "\r\n";
 	}
-	raw_http_response << "\r\n";
+	raw_http_response << header_block << "\r\n";
 	return raw_http_response.str();
 }
+
+std::string format_http_date(const std::time_t time)
+{
+	std::tm calendar_time;
+	gmtime_r(&time, &calendar_time);
+
+	std::array<char, 32> http_date;
+	const size_t length =
+		std::strftime(http_date.data(), http_date.size(), "%a, %d %b %Y %H:%M:%S GMT", &calendar_time);
+	return {http_date.data(), length};
+}
+
+std::optional<std::time_t> parse_http_date(const std::string_view http_date)
+{
+	// 'strptime' needs a null-terminated string.
+	const std::string http_date_string(http_date);
+	std::tm calendar_time{};
+	const char *const end = strptime(http_date_string.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &calendar_time);
+	if (end == nullptr || *end != '\0')
+	{
+		return std::nullopt;
+	}
+	return timegm(&calendar_time);
+}
+
+bool match_entity_tag(std::string_view entity_tag_list, std::string_view entity_tag, const bool weak_comparison)
+{
+	const auto remove_weak_prefix = [](std::string_view &entity_tag)
+	{
+		const bool weak = entity_tag.starts_with("W/");
+		if (weak)
+		{
+			entity_tag.remove_prefix(2);
+		}
+		return weak;
+	};
+	if (remove_weak_prefix(entity_tag) && !weak_comparison)
+	{
+		return false;
+	}
+
+	while (!entity_tag_list.empty())
+	{
+		const size_t comma_position = entity_tag_list.find(',');
+		std::string_view candidate = entity_tag_list.substr(0, comma_position);
+		entity_tag_list.remove_prefix(
+			comma_position == std::string_view::npos ? entity_tag_list.size() : comma_position + 1);
+
+		while (!candidate.empty() && (candidate.front() == ' ' || candidate.front() == '\t'))
+		{
+			candidate.remove_prefix(1);
+		}
+		while (!candidate.empty() && (candidate.back() == ' ' || candidate.back() == '\t'))
+		{
+			candidate.remove_suffix(1);
+		}
+		if (candidate == "*")
+		{
+			return true;
+		}
+		if (remove_weak_prefix(candidate) && !weak_comparison)
+		{
+			continue;
+		}
+		if (candidate == entity_tag)
+		{
+			return true;
+		}
+	}
+	return false;
+}
 } // namespace couringserver
@@ -2,92 +2,267 @@
 
 #include <algorithm>
 #include <cctype>
+#include <charconv>
 #include <cstddef>
-#include <iterator>
+#include <cstdint>
 #include <optional>
 #include <string_view>
-#include <tuple>
-#include <vector>
+#include <system_error>
+#include <utility>
 
 #include "http_message.hpp"
 
 namespace couringserver {
+namespace {
+// Trim the optional whitespace around a header value.
+std::string_view trim_whitespace(const std::string_view string)
+{
+	const size_t begin = string.find_first_not_of(" \t");
+	if (begin == std::string_view::npos)
+	{
+		return {};
+	}
+	return string.substr(begin, string.find_last_not_of(" \t") - begin + 1);
+}
+
+// Whether the string is a token, such as a method or a header name.
+bool is_token(const std::string_view string)
+{
+	constexpr std::string_view DELIMITER_LIST = "!#$%&'*+-.^_`|~";
+	return !string.empty() && std::ranges::all_of(string, [DELIMITER_LIST](const char character)
+												  { return std::isalnum(static_cast<unsigned char>(character)) ||
+														   DELIMITER_LIST.find(character) != std::string_view::npos; });
+}
+
+// Whether the string contains a control character other than a tab.
+bool has_control_character(const std::string_view string)
+{
+	return std::ranges::any_of(string, [](const char character)
+							   { const auto byte = static_cast<unsigned char>(character);
+								 return (byte < 0x20 && byte != '\t') || byte == 0x7f; });
+}
+
+bool is_http_version(const std::string_view version)
+{
+	return version.size() == 8 && version.starts_with("HTTP/") && std::isdigit(static_cast<unsigned char>(version[5])) &&
+		   version[6] == '.' && std::isdigit(static_cast<unsigned char>(version[7]));
+}
 
-std::string_view trim_whitespace(std::string_view string)
+bool equal_ignore_case(const std::string_view left, const std::string_view right)
 {
-	const auto first = std::find_if_not(string.cbegin(), string.cend(), [](unsigned char c)
-										{ return std::isspace(c); });
-	const auto last = std::find_if_not(string.crbegin(), string.crend(), [](unsigned char c)
-									   { return std::isspace(c); })
-						  .base();
-	return (last <= first) ? std::string_view()
-						   : std::string_view(&*first, static_cast<std::size_t>(last - first));
+	return std::ranges::equal(left, right, [](const char left, const char right)
+							  { return std::tolower(static_cast<unsigned char>(left)) ==
+									   std::tolower(static_cast<unsigned char>(right)); });
 }
 
-std::vector<std::string_view> split(std::string_view string, const char delimiter)
+std::optional<uintmax_t> parse_content_length(const std::string_view value)
 {
-	std::vector<std::string_view> result;
-	size_t segment_start = 0;
-	size_t segment_end = 0;
+	uintmax_t content_length = 0;
+	const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), content_length);
+	if (value.empty() || error != std::errc() || end != value.data() + value.size())
+	{
+		return std::nullopt;
+	}
+	return content_length;
+}
+} // namespace
+
+http_parser::http_parser(const http_parser_limits &http_parser_limits) : http_parser_limits_{http_parser_limits} {}
 
-	while ((segment_end = string.find(delimiter, segment_start)) != std::string::npos)
+std::optional<http_request> http_parser::parse_packet(const std::span<const char> packet)
+{
+	if (error_.has_value())
+	{
+		return std::nullopt;
+	}
+	if (!buffer_.empty())
 	{
-		std::string_view token = string.substr(segment_start, segment_end - segment_start);
-		result.emplace_back(token);
-		segment_start = segment_end + 1;
+		buffer_.append(packet.data(), packet.size());
+		return parse();
 	}
 
-	result.emplace_back(string.substr(segment_start));
-	return result;
+	// A packet that starts a request is parsed in place, only the bytes the
+	// request leaves are copied.
+	size_t consumed_size = 0;
+	std::optional<http_request> http_request = parse_request({packet.data(), packet.size()}, consumed_size);
+	if (error_.has_value())
+	{
+		return std::nullopt;
+	}
+	buffer_.assign(packet.data() + consumed_size, packet.size() - consumed_size);
+	scanned_size_ = http_request.has_value() ? 0 : buffer_.size();
+	return http_request;
 }
 
-std::vector<std::string_view> split(std::string_view string, std::string_view delimiter)
+std::optional<http_request> http_parser::parse()
 {
-	std::vector<std::string_view> result;
-	size_t segment_start = 0;
-	size_t segment_end = 0;
-	const size_t delimiter_length = delimiter.length();
+	// An incomplete head is only scanned again once more bytes arrived.
+	if (error_.has_value() || buffer_.size() == scanned_size_)
+	{
+		return std::nullopt;
+	}
 
-	while ((segment_end = string.find(delimiter, segment_start)) != std::string::npos)
+	size_t consumed_size = 0;
+	std::optional<http_request> http_request = parse_request(buffer_, consumed_size);
+	if (http_request.has_value())
+	{
+		buffer_.erase(0, consumed_size);
+		scanned_size_ = 0;
+	}
+	else
 	{
-		std::string_view token = string.substr(segment_start, segment_end - segment_start);
-		result.emplace_back(token);
-		segment_start = segment_end + delimiter_length;
+		scanned_size_ = buffer_.size();
 	}
+	return http_request;
+}
+
+std::optional<http_parse_error> http_parser::get_error() const noexcept { return error_; }
+
+bool http_parser::empty() const noexcept { return buffer_.empty(); }
 
-	result.emplace_back(string.substr(segment_start));
-	return result;
+size_t http_parser::get_memory_size() const noexcept
+{
+	// A short string is kept within the object.
+	static const size_t INLINE_CAPACITY = std::string().capacity();
+	return buffer_.capacity() > INLINE_CAPACITY ? buffer_.capacity() : 0;
 }
 
-std::optional<http_request> http_parser::parse_packet(std::span<char> packet)
+void http_parser::reset() noexcept
 {
-	raw_http_request_.reserve(raw_http_request_.size() + packet.size());
-	raw_http_request_.insert(raw_http_request_.end(), packet.begin(), packet.end());
+	std::string().swap(buffer_);
+	scanned_size_ = 0;
+}
 
-	std::string_view raw_http_request(raw_http_request_.data());
-	if (!raw_http_request.ends_with("\r\n\r\n"))
+std::string http_parser::take_buffer() noexcept
+{
+	scanned_size_ = 0;
+	return std::exchange(buffer_, {});
+}
+
+std::optional<http_request> http_parser::parse_request(const std::string_view data, size_t &consumed_size)
+{
+	// The empty lines before a request are ignored, but count towards the
+	// request line, so that they cannot grow the buffer without bound.
+	size_t request_line_start = 0;
+	while (data.substr(request_line_start, 2) == "\r\n")
 	{
-		return {};
+		request_line_start += 2;
+	}
+	const size_t request_line_end = data.find("\r\n", request_line_start);
+	if (request_line_end == std::string_view::npos)
+	{
+		if (data.size() > http_parser_limits_.max_request_line_size)
+		{
+			error_ = http_parse_error::request_line_too_long;
+		}
+		return std::nullopt;
+	}
+	if (request_line_end > http_parser_limits_.max_request_line_size)
+	{
+		error_ = http_parse_error::request_line_too_long;
+		return std::nullopt;
 	}
 
-	http_request http_request;
-	const std::vector<std::string_view> request_line_list = split(raw_http_request, "\r\n");
-	const std::vector<std::string_view> status_line_list = split(request_line_list[0], ' ');
-	http_request.method = status_line_list[0];
-	http_request.url = status_line_list[1];
-	http_request.version = status_line_list[2];
+	// The header lines end with an empty line, which directly follows the
+	// request line if there are none.
+	const size_t header_start = request_line_end + 2;
+	const size_t head_end = data.find("\r\n\r\n", request_line_end);
+	if (head_end == std::string_view::npos)
+	{
+		if (data.size() - header_start > http_parser_limits_.max_header_size)
+		{
+			error_ = http_parse_error::header_too_large;
+		}
+		return std::nullopt;
+	}
+	const std::string_view header_section = data.substr(header_start, head_end + 2 - header_start);
+	if (header_section.size() > http_parser_limits_.max_header_size)
+	{
+		error_ = http_parse_error::header_too_large;
+		return std::nullopt;
+	}
 
-	for (size_t line_index = 1; line_index < request_line_list.size(); ++line_index)
+	const std::string_view request_line =
+		data.substr(request_line_start, request_line_end - request_line_start);
+	const size_t method_end = request_line.find(' ');
+	const size_t url_end =
+		method_end == std::string_view::npos ? std::string_view::npos : request_line.find(' ', method_end + 1);
+	if (url_end == std::string_view::npos)
+	{
+		error_ = http_parse_error::bad_request;
+		return std::nullopt;
+	}
+	const std::string_view method = request_line.substr(0, method_end);
+	const std::string_view url = request_line.substr(method_end + 1, url_end - method_end - 1);
+	const std::string_view version = request_line.substr(url_end + 1);
+	if (!is_token(method) || url.empty() || has_control_character(url) || url.find('\t') != std::string_view::npos ||
+		!is_http_version(version))
 	{
-		const std::string_view header_line = request_line_list[line_index];
-		const std::vector<std::string_view> header = split(header_line, ':');
-		if (header.size() == 2)
+		error_ = http_parse_error::bad_request;
+		return std::nullopt;
+	}
+
+	http_request http_request;
+	http_request.method = method;
+	http_request.url = url;
+	http_request.version = version;
+	for (size_t line_start = 0; line_start < header_section.size();)
+	{
+		const size_t line_end = header_section.find("\r\n", line_start);
+		const std::string_view header_line = header_section.substr(line_start, line_end - line_start);
+		line_start = line_end + 2;
+		if (http_request.header_list.size() == http_parser_limits_.max_header_count)
 		{
-			http_request.header_list.emplace_back(header[0], trim_whitespace(header[1]));
+			error_ = http_parse_error::header_too_large;
+			return std::nullopt;
 		}
+
+		// Split at the first colon only, values such as HTTP-dates contain
+		// colons. A folded line starts with whitespace, which is no token.
+		const size_t colon_position = header_line.find(':');
+		const std::string_view name = header_line.substr(0, colon_position);
+		const std::string_view value =
+			colon_position == std::string_view::npos ? std::string_view{}
+													 : trim_whitespace(header_line.substr(colon_position + 1));
+		if (colon_position == std::string_view::npos || !is_token(name) || has_control_character(value))
+		{
+			error_ = http_parse_error::bad_request;
+			return std::nullopt;
+		}
+		http_request.header_list.emplace_back(name, value);
 	}
+	consumed_size = head_end + 4;
 
-	raw_http_request_.clear();
+	// A body is only delimited by 'content-length' here. Conflicting lengths,
+	// or a length next to 'transfer-encoding', could make a proxy on the way
+	// split the requests differently, so they are rejected.
+	std::optional<uintmax_t> body_size;
+	for (const auto &[k, v] : http_request.header_list)
+	{
+		if (!equal_ignore_case(k, "content-length"))
+		{
+			continue;
+		}
+		const std::optional<uintmax_t> content_length = parse_content_length(v);
+		if (!content_length.has_value() || (body_size.has_value() && body_size != content_length))
+		{
+			error_ = http_parse_error::bad_request;
+			return std::nullopt;
+		}
+		body_size = content_length;
+	}
+	if (body_size.has_value())
+	{
+		if (http_request.get_header("transfer-encoding").has_value())
+		{
+			error_ = http_parse_error::bad_request;
+			return std::nullopt;
+		}
+		const size_t received_body_size = std::min<uintmax_t>(body_size.value(), data.size() - consumed_size);
+		http_request.body = data.substr(consumed_size, received_body_size);
+		http_request.unread_body_size = body_size.value() - received_body_size;
+		consumed_size += received_body_size;
+	}
 	return http_request;
 }
 } // namespace couringserver
@@ -0,0 +1,391 @@
+#include "http_proxy.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <tuple>
+#include <utility>
+
+#include "buffer_ring.hpp"
+#include "cancellation.hpp"
+#include "constant.hpp"
+#include "file_descriptor.hpp"
+#include "http_route.hpp"
+#include "when_all.hpp"
+
+namespace couringserver {
+namespace {
+// Headers that only apply to a single connection, they are not forwarded.
+constexpr std::array<std::string_view, 6> HOP_BY_HOP_HEADER_LIST{
+	"connection", "keep-alive", "proxy-connection", "te", "transfer-encoding", "upgrade"};
+
+// Methods whose request may be sent twice with the effect of sending it once,
+// see RFC 9110 section 9.2.2.
+constexpr std::array<std::string_view, 6> IDEMPOTENT_METHOD_LIST{
+	"GET", "HEAD", "PUT", "DELETE", "OPTIONS", "TRACE"};
+
+bool equal_ignore_case(const std::string_view left, const std::string_view right)
+{
+	return std::ranges::equal(left, right, [](const char left, const char right)
+							  { return std::tolower(static_cast<unsigned char>(left)) ==
+									   std::tolower(static_cast<unsigned char>(right)); });
+}
+
+bool is_hop_by_hop_header(const std::string_view name)
+{
+	return std::ranges::any_of(HOP_BY_HOP_HEADER_LIST, [name](const std::string_view hop_by_hop_header)
+							   { return equal_ignore_case(name, hop_by_hop_header); });
+}
+
+std::optional<uintmax_t> parse_content_length(const std::string_view value)
+{
+	uintmax_t content_length = 0;
+	const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), content_length);
+	if (value.empty() || error != std::errc() || end != value.data() + value.size())
+	{
+		return std::nullopt;
+	}
+	return content_length;
+}
+
+std::string serialize_upstream_request(const http_request &http_request)
+{
+	std::string upstream_request = http_request.method + ' ' + http_request.url + " HTTP/1.0\r\n";
+	for (const auto &[k, v] : http_request.header_list)
+	{
+		if (!is_hop_by_hop_header(k))
+		{
+			upstream_request += k + ": " + v + "\r\n";
+		}
+	}
+	upstream_request += "connection: keep-alive\r\n\r\n";
+	return upstream_request;
+}
+
+// Parse the status line and the header lines, each ending with CRLF.
+std::optional<http_response> parse_response_head(std::string_view head)
+{
+	http_response http_response;
+	const size_t status_line_end = head.find("\r\n");
+	const std::string_view status_line = head.substr(0, status_line_end);
+	const size_t version_end = status_line.find(' ');
+	if (version_end == std::string_view::npos || !status_line.starts_with("HTTP/"))
+	{
+		return std::nullopt;
+	}
+	const size_t status_end = status_line.find(' ', version_end + 1);
+	http_response.version = status_line.substr(0, version_end);
+	http_response.status = status_line.substr(version_end + 1, status_end - version_end - 1);
+	if (status_end != std::string_view::npos)
+	{
+		http_response.status_text = status_line.substr(status_end + 1);
+	}
+	if (http_response.status.size() != 3 || !std::ranges::all_of(http_response.status, [](const unsigned char c)
+																	  { return std::isdigit(c); }))
+	{
+		return std::nullopt;
+	}
+
+	head.remove_prefix(status_line_end + 2);
+	while (!head.empty())
+	{
+		const size_t line_end = head.find("\r\n");
+		const std::string_view header_line = head.substr(0, line_end);
+		head.remove_prefix(line_end + 2);
+
+		const size_t colon_position = header_line.find(':');
+		if (colon_position == std::string_view::npos)
+		{
+			return std::nullopt;
+		}
+		std::string_view value = header_line.substr(colon_position + 1);
+		while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+		{
+			value.remove_prefix(1);
+		}
+		while (!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+		{
+			value.remove_suffix(1);
+		}
+		http_response.header_list.emplace_back(header_line.substr(0, colon_position), value);
+	}
+	return http_response;
+}
+
+bool is_idempotent(const std::string_view method)
+{
+	return std::ranges::find(IDEMPOTENT_METHOD_LIST, method) != IDEMPOTENT_METHOD_LIST.end();
+}
+
+// Receive until the end of the response head, waiting at most
+// 'UPSTREAM_RESPONSE_TIMEOUT' for each packet. The result holds the head and
+// the start of the body, it is incomplete if the upstream failed. The flag is
+// set if the upstream closed the connection without sending anything.
+local_task<std::tuple<std::string, bool>> receive_response_head(client_socket &upstream_socket)
+{
+	buffer_ring &buffer_ring = buffer_ring::get_instance();
+	std::string received;
+	while (received.find("\r\n\r\n") == std::string::npos &&
+		   received.size() <= MAX_UPSTREAM_RESPONSE_HEAD_SIZE)
+	{
+		cancellation_token cancellation_token;
+		const auto [winner_index, result] = co_await when_any(
+			cancellation_token, upstream_socket.recv(buffer_ring.get_buffer_size(), &cancellation_token),
+			timeout_awaiter(UPSTREAM_RESPONSE_TIMEOUT, &cancellation_token));
+		const auto [recv_buffer_id, recv_buffer_size] = std::get<0>(result);
+		if (recv_buffer_size <= 0)
+		{
+			// A timeout cancels the receive, so its result is not an EOF.
+			const bool closed = winner_index == 0 && recv_buffer_size == 0 && received.empty();
+			co_return std::tuple{std::move(received), closed};
+		}
+
+		const std::span<char> recv_buffer = buffer_ring.borrow_buffer(recv_buffer_id, recv_buffer_size);
+		received.append(recv_buffer.data(), recv_buffer.size());
+		buffer_ring.return_buffer(recv_buffer_id);
+	}
+	co_return std::tuple{std::move(received), false};
+}
+
+// Splice until the upstream closes the connection.
+local_task<bool> relay_until_close(
+	client_socket &upstream_socket, client_socket &client_socket,
+	const std::tuple<file_descriptor, file_descriptor> &pipe)
+{
+	const auto &[read_pipe, write_pipe] = pipe;
+	while (true)
+	{
+		const ssize_t bytes_read = co_await splice_awaiter(
+			upstream_socket.get_raw_file_descriptor(), -1, write_pipe.get_raw_file_descriptor(),
+			STREAM_CHUNK_SIZE);
+		if (bytes_read == 0)
+		{
+			co_return true;
+		}
+		if (bytes_read < 0)
+		{
+			co_return false;
+		}
+
+		size_t bytes_in_pipe = bytes_read;
+		while (bytes_in_pipe > 0)
+		{
+			const ssize_t result = co_await splice_awaiter(
+				read_pipe.get_raw_file_descriptor(), -1, client_socket.get_raw_file_descriptor(),
+				bytes_in_pipe);
+			if (result <= 0)
+			{
+				co_return false;
+			}
+			bytes_in_pipe -= result;
+		}
+	}
+}
+
+local_task<> send_error(
+	client_socket &client_socket, http_response &http_response, const char *status,
+	const char *status_text)
+{
+	http_response.status = status;
+	http_response.status_text = status_text;
+	co_await send_response(client_socket, http_response);
+}
+} // namespace
+
+local_task<> forward_request(
+	upstream_pool &upstream_pool, const upstream_address &upstream_address,
+	client_socket &client_socket, const http_request &http_request, http_response &http_response)
+{
+	// The parser does not decode chunked request bodies, the connection is
+	// closed after a request with one.
+	if (http_request.get_header("transfer-encoding").has_value())
+	{
+		co_await send_error(client_socket, http_response, "411", "Length Required");
+		co_return;
+	}
+	if (!upstream_pool.is_available(upstream_address))
+	{
+		co_await send_error(client_socket, http_response, "502", "Bad Gateway");
+		co_return;
+	}
+
+	// The body bytes that arrived with the head are sent along with it, the
+	// rest is spliced from the client.
+	std::string upstream_request = serialize_upstream_request(http_request);
+	upstream_request.append(http_request.body);
+	const uintmax_t request_body_size = http_request.unread_body_size;
+	std::optional<std::tuple<file_descriptor, file_descriptor>> splice_pipe;
+	for (size_t attempt = 0;; ++attempt)
+	{
+		auto acquire_result = co_await upstream_pool.acquire(upstream_address);
+		if (!acquire_result.has_value())
+		{
+			co_await send_error(client_socket, http_response, "502", "Bad Gateway");
+			co_return;
+		}
+		auto &[upstream_socket, reused] = acquire_result.value();
+
+		// The upstream may have closed a pooled connection while it was idle.
+		// An idempotent request is replayed on a new connection if sending it
+		// fails or the upstream closes the connection without answering,
+		// unless its body has already been consumed. It is never replayed
+		// after a timeout, as the upstream may still be processing it.
+		const bool retryable = reused && request_body_size == 0 && attempt < UPSTREAM_RETRY_COUNT &&
+							   is_idempotent(http_request.method);
+		if (co_await upstream_socket.send(upstream_request, upstream_request.size()) == -1)
+		{
+			if (retryable)
+			{
+				continue;
+			}
+			upstream_pool.report_failure(upstream_address);
+			co_await send_error(client_socket, http_response, "502", "Bad Gateway");
+			co_return;
+		}
+		if (request_body_size != 0)
+		{
+			if (!splice_pipe.has_value())
+			{
+				std::error_code error_code;
+				splice_pipe = pipe(error_code);
+				if (error_code)
+				{
+					splice_pipe.reset();
+					co_await send_error(client_socket, http_response, "502", "Bad Gateway");
+					co_return;
+				}
+			}
+			if (co_await splice(client_socket, -1, upstream_socket, request_body_size, splice_pipe.value()) == -1)
+			{
+				// The rest of the body may still be in flight, the client
+				// connection is closed as for any unread body.
+				co_await send_error(client_socket, http_response, "502", "Bad Gateway");
+				co_return;
+			}
+		}
+
+		const auto [received, upstream_closed] = co_await receive_response_head(upstream_socket);
+		if (upstream_closed && retryable)
+		{
+			continue;
+		}
+		const size_t head_end = received.find("\r\n\r\n");
+		const auto upstream_response =
+			head_end == std::string::npos
+				? std::nullopt
+				: parse_response_head(std::string_view(received).substr(0, head_end + 2));
+		if (!upstream_response.has_value())
+		{
+			upstream_pool.report_failure(upstream_address);
+			co_await send_error(client_socket, http_response, "502", "Bad Gateway");
+			co_return;
+		}
+		upstream_pool.report_success(upstream_address);
+
+		// A body is delimited by 'content-length', or else by the upstream
+		// closing the connection, in which case the client connection is
+		// closed as well.
+		const bool has_body = http_request.method != "HEAD" && upstream_response->status[0] != '1' &&
+							  upstream_response->status != "204" && upstream_response->status != "304";
+		std::optional<uintmax_t> content_length;
+		if (has_body && !upstream_response->get_header("transfer-encoding").has_value())
+		{
+			if (const auto value = upstream_response->get_header("content-length"))
+			{
+				content_length = parse_content_length(value.value());
+			}
+		}
+		const bool close_delimited = has_body && !content_length.has_value();
+		const std::optional<std::string_view> upstream_connection = upstream_response->get_header("connection");
+		const bool upstream_keep_alive =
+			!close_delimited &&
+			(upstream_response->version == "HTTP/1.0"
+				 ? upstream_connection.has_value() && equal_ignore_case(upstream_connection.value(), "keep-alive")
+				 : !upstream_connection.has_value() || !equal_ignore_case(upstream_connection.value(), "close"));
+
+		http_response.status = upstream_response->status;
+		http_response.status_text = upstream_response->status_text;
+		for (const auto &[k, v] : upstream_response->header_list)
+		{
+			if (!equal_ignore_case(k, "connection") && !equal_ignore_case(k, "keep-alive") &&
+				!equal_ignore_case(k, "proxy-connection"))
+			{
+				http_response.header_list.emplace_back(k, v);
+			}
+		}
+		if (close_delimited && !http_response.get_header("connection").has_value())
+		{
+			http_response.header_list.emplace_back("connection", "close");
+		}
+
+		// The pipe for the body is created before the head is sent, so that
+		// running out of file descriptors can still be answered with '502'.
+		if (has_body && !splice_pipe.has_value())
+		{
+			std::error_code error_code;
+			splice_pipe = pipe(error_code);
+			if (error_code)
+			{
+				splice_pipe.reset();
+				http_response.header_list.clear();
+				co_await send_error(client_socket, http_response, "502", "Bad Gateway");
+				co_return;
+			}
+		}
+
+		std::string_view body_prefix = std::string_view(received).substr(head_end + 4);
+		if (!has_body)
+		{
+			body_prefix = {};
+		}
+		else if (content_length.has_value() && body_prefix.size() > content_length.value())
+		{
+			body_prefix = body_prefix.substr(0, content_length.value());
+		}
+		std::string send_buffer = http_response.serialize();
+		send_buffer.append(body_prefix);
+		if (co_await client_socket.send(send_buffer, send_buffer.size()) == -1)
+		{
+			// The upstream connection is dropped, its response is unread.
+			abort_response(http_response);
+			co_return;
+		}
+
+		if (!has_body)
+		{
+			if (upstream_keep_alive)
+			{
+				upstream_pool.release(upstream_address, std::move(upstream_socket));
+			}
+			co_return;
+		}
+		if (close_delimited)
+		{
+			co_await relay_until_close(upstream_socket, client_socket, splice_pipe.value());
+			co_return;
+		}
+
+		const uintmax_t remaining_size = content_length.value() - body_prefix.size();
+		if (remaining_size != 0 &&
+			co_await splice(upstream_socket, -1, client_socket, remaining_size, splice_pipe.value()) == -1)
+		{
+			// The response is cut short, the client can only tell by the
+			// connection closing.
+			http_response.header_list.emplace_back("connection", "close");
+			co_return;
+		}
+		if (upstream_keep_alive)
+		{
+			upstream_pool.release(upstream_address, std::move(upstream_socket));
+		}
+		co_return;
+	}
+}
+} // namespace couringserver
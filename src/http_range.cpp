@@ -0,0 +1,136 @@
+#include "http_range.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstddef>
+
+#include "constant.hpp"
+
+namespace couringserver {
+namespace {
+std::string_view trim(std::string_view string)
+{
+	while (!string.empty() && (string.front() == ' ' || string.front() == '\t'))
+	{
+		string.remove_prefix(1);
+	}
+	while (!string.empty() && (string.back() == ' ' || string.back() == '\t'))
+	{
+		string.remove_suffix(1);
+	}
+	return string;
+}
+
+std::optional<uintmax_t> parse_number(std::string_view string)
+{
+	uintmax_t number = 0;
+	const auto [end, error] = std::from_chars(string.data(), string.data() + string.size(), number);
+	if (string.empty() || error != std::errc() || end != string.data() + string.size())
+	{
+		return std::nullopt;
+	}
+	return number;
+}
+} // namespace
+
+std::optional<std::vector<byte_range>> parse_range(std::string_view value, const uintmax_t size)
+{
+	constexpr std::string_view unit = "bytes=";
+	value = trim(value);
+	if (value.size() < unit.size() ||
+		!std::equal(unit.begin(), unit.end(), value.begin(), [](const char left, const char right)
+					{ return std::tolower(static_cast<unsigned char>(left)) == right; }))
+	{
+		return std::nullopt;
+	}
+	value.remove_prefix(unit.size());
+
+	std::vector<byte_range> byte_range_list;
+	size_t range_count = 0;
+	while (!value.empty())
+	{
+		const size_t comma = value.find(',');
+		const std::string_view range = trim(value.substr(0, comma));
+		value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
+		if (range.empty())
+		{
+			continue;
+		}
+		if (++range_count > MAX_RANGE_COUNT)
+		{
+			return std::nullopt;
+		}
+
+		const size_t dash = range.find('-');
+		if (dash == std::string_view::npos)
+		{
+			return std::nullopt;
+		}
+		const std::string_view first = range.substr(0, dash);
+		const std::string_view last = range.substr(dash + 1);
+
+		if (first.empty())
+		{
+			// suffix range, the last N bytes
+			const std::optional<uintmax_t> suffix_length = parse_number(last);
+			if (!suffix_length.has_value())
+			{
+				return std::nullopt;
+			}
+			if (suffix_length.value() != 0 && size != 0)
+			{
+				const uintmax_t length = std::min(suffix_length.value(), size);
+				byte_range_list.push_back({size - length, length});
+			}
+			continue;
+		}
+
+		const std::optional<uintmax_t> first_position = parse_number(first);
+		const std::optional<uintmax_t> last_position =
+			last.empty() ? std::optional<uintmax_t>(UINTMAX_MAX) : parse_number(last);
+		if (!first_position.has_value() || !last_position.has_value() ||
+			last_position.value() < first_position.value())
+		{
+			return std::nullopt;
+		}
+		if (first_position.value() >= size)
+		{
+			continue;
+		}
+		const uintmax_t last_byte = std::min(last_position.value(), size - 1);
+		byte_range_list.push_back({first_position.value(), last_byte - first_position.value() + 1});
+	}
+	if (range_count == 0)
+	{
+		return std::nullopt;
+	}
+
+	std::sort(byte_range_list.begin(), byte_range_list.end(), [](const byte_range &left, const byte_range &right)
+			  { return left.offset < right.offset; });
+	std::vector<byte_range> coalesced_list;
+	for (const byte_range &byte_range : byte_range_list)
+	{
+		if (!coalesced_list.empty() &&
+			byte_range.offset <= coalesced_list.back().offset + coalesced_list.back().length)
+		{
+			const uintmax_t end = std::max(
+				coalesced_list.back().offset + coalesced_list.back().length,
+				byte_range.offset + byte_range.length);
+			coalesced_list.back().length = end - coalesced_list.back().offset;
+		}
+		else
+		{
+			coalesced_list.push_back(byte_range);
+		}
+	}
+	return coalesced_list;
+}
+
+std::string format_content_range(const byte_range &byte_range, const uintmax_t size)
+{
+	return "bytes " + std::to_string(byte_range.offset) + '-' +
+		   std::to_string(byte_range.offset + byte_range.length - 1) + '/' + std::to_string(size);
+}
+} // namespace couringserver
@@ -0,0 +1,76 @@
+#include "http_route.hpp"
+
+#include <string>
+#include <string_view>
+
+#include "http_message.hpp"
+#include "http_proxy.hpp"
+#include "http_server.hpp"
+#include "io_trace.hpp"
+#include "metrics.hpp"
+#include "socket.hpp"
+#include "upstream_pool.hpp"
+
+namespace couringserver {
+void abort_response(http_response &http_response)
+{
+	http_response.header_list.emplace_back("connection", "close");
+}
+
+local_task<bool> send_response(
+	client_socket &client_socket, http_response &http_response, const std::string_view body)
+{
+	http_response.header_list.emplace_back("content-length", std::to_string(body.size()));
+	std::string send_buffer = http_response.serialize();
+	send_buffer.append(body);
+	if (co_await client_socket.send(send_buffer, send_buffer.size()) == -1)
+	{
+		abort_response(http_response);
+		co_return false;
+	}
+	co_return true;
+}
+
+local_task<> serve_health(
+	thread_worker &, client_socket &client_socket, const http_request &, http_response &http_response)
+{
+	http_response.status = "200";
+	http_response.status_text = "OK";
+	http_response.header_list.emplace_back("content-type", "text/plain");
+	co_await send_response(client_socket, http_response, "ok\n");
+}
+
+local_task<> serve_metrics(
+	thread_worker &thread_worker, client_socket &client_socket, const http_request &,
+	http_response &http_response)
+{
+	http_response.status = "200";
+	http_response.status_text = "OK";
+	http_response.header_list.emplace_back("content-type", "text/plain; version=0.0.4");
+	co_await send_response(client_socket, http_response, thread_worker.get_server_metrics().serialize());
+}
+
+local_task<> serve_trace(
+	thread_worker &, client_socket &client_socket, const http_request &, http_response &http_response)
+{
+	http_response.status = "200";
+	http_response.status_text = "OK";
+	http_response.header_list.emplace_back("content-type", "application/json");
+	co_await send_response(client_socket, http_response, io_trace::serialize_all());
+}
+
+local_task<> serve_static_file(
+	thread_worker &thread_worker, client_socket &client_socket, const http_request &http_request,
+	http_response &http_response)
+{
+	co_await thread_worker.serve_file(client_socket, http_request, http_response);
+}
+
+local_task<> serve_proxy(
+	const upstream_address &upstream_address, thread_worker &thread_worker,
+	client_socket &client_socket, const http_request &http_request, http_response &http_response)
+{
+	return forward_request(
+		thread_worker.get_upstream_pool(), upstream_address, client_socket, http_request, http_response);
+}
+} // namespace couringserver
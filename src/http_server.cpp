@@ -1,156 +1,1197 @@
 #include "http_server.hpp"
 
+#include <fcntl.h>
 #include <liburing.h>
 #include <liburing/io_uring.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
 #include <coroutine>
 #include <cstddef>
 #include <cstdint>
+#include <ctime>
 #include <filesystem>
 #include <optional>
 #include <span>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <utility>
 #include <vector>
 
+#include "access_log.hpp"
+#include "asset_pack.hpp"
 #include "buffer_ring.hpp"
+#include "cancellation.hpp"
 #include "constant.hpp"
 #include "file_descriptor.hpp"
+#include "file_metadata_cache.hpp"
+#include "http2_session.hpp"
 #include "http_message.hpp"
 #include "http_parser.hpp"
+#include "http_range.hpp"
+#include "http_route.hpp"
+#include "io_trace.hpp"
 #include "io_uring.hpp"
+#include "metrics.hpp"
 #include "socket.hpp"
 #include "sync_wait.hpp"
 
 namespace couringserver {
-thread_worker::thread_worker(const char *port)
+namespace {
+struct error_status
 {
-	buffer_ring::get_instance().register_buffer_ring(BUFFER_RING_SIZE, BUFFER_SIZE);
+	std::string_view status;
+	std::string_view status_text;
+};
 
-	server_socket_.bind(port);
-	server_socket_.listen();
+error_status get_error_status(const http_parse_error http_parse_error)
+{
+	switch (http_parse_error)
+	{
+	case http_parse_error::request_line_too_long:
+		return {"414", "URI Too Long"};
+	case http_parse_error::header_too_large:
+		return {"431", "Request Header Fields Too Large"};
+	default:
+		return {"400", "Bad Request"};
+	}
+}
+
+// Return the ranges a 'GET' request asks for, empty if none is satisfiable, or
+// std::nullopt if the whole representation is to be sent. 'If-Range' carries
+// either an entity-tag or the 'Last-Modified' date, the ranges are only
+// honored if it names the current representation. Both require a strong
+// match, so a weak entity-tag never satisfies it.
+std::optional<std::vector<byte_range>> get_byte_range_list(
+	const http_request &http_request, const uintmax_t size, const std::string_view entity_tag,
+	const std::string_view last_modified)
+{
+	const std::optional<std::string_view> range = http_request.get_header("range");
+	const std::optional<std::string_view> if_range = http_request.get_header("if-range");
+	const bool strong_validator = !entity_tag.starts_with("W/");
+	const bool if_range_match =
+		!if_range.has_value() || (if_range->starts_with('"') ? match_entity_tag(if_range.value(), entity_tag, false)
+															 : strong_validator && if_range.value() == last_modified);
+	if (http_request.method == "GET" && range.has_value() && if_range_match)
+	{
+		return parse_range(range.value(), size);
+	}
+	return std::nullopt;
+}
+
+// Open a file to be streamed, or set 'error_code'. A large file gets a larger
+// readahead window, the hint is not waited for.
+file_descriptor open_stream_file(
+	const std::filesystem::path &path, const uintmax_t size, std::error_code &error_code)
+{
+	file_descriptor file_descriptor = open(path, error_code);
+	if (!error_code && size >= SEQUENTIAL_READ_THRESHOLD)
+	{
+		io_uring::get_instance().submit_fadvise_request(
+			nullptr, file_descriptor.get_raw_file_descriptor(), 0, 0, POSIX_FADV_SEQUENTIAL);
+	}
+	return file_descriptor;
+}
+} // namespace
+
+thread_worker::thread_worker(
+	const server_config &server_config, std::vector<server_socket> server_socket_list,
+	const tls_context *tls_context, const asset_pack *asset_pack, const int raw_drain_event_descriptor,
+	worker_metrics &worker_metrics, const server_metrics &server_metrics,
+	const std::filesystem::path &access_log_path, const std::atomic<uint64_t> &access_log_generation)
+	: server_config_{server_config}, server_socket_list_{std::move(server_socket_list)}, tls_context_{tls_context},
+	  asset_pack_{asset_pack},
+	  http_parser_limits_{
+		  server_config.max_request_line_size, server_config.max_header_count, server_config.max_header_size},
+	  socket_options_{get_socket_options(server_config)},
+	  worker_metrics_{worker_metrics}, server_metrics_{server_metrics},
+	  access_log_{access_log_path, access_log_generation, worker_metrics}
+{
+	buffer_ring::get_instance().register_buffer_ring(server_config_.buffer_ring_size, server_config_.buffer_size);
+	worker_metrics_.event_loop_statistics.store(
+		&io_uring::get_instance().get_event_loop_statistics(), std::memory_order_release);
+	worker_metrics_.ring_statistics.store(
+		&io_uring::get_instance().get_ring_statistics(), std::memory_order_release);
+	worker_metrics_.buffer_ring_statistics.store(
+		&buffer_ring::get_instance().get_statistics(), std::memory_order_release);
+	// NAPI is only selected where the probe could register it.
+	if (io_uring::get_features().napi &&
+		!io_uring::get_instance().register_napi(std::chrono::microseconds(server_config_.napi_busy_poll_timeout)))
+	{
+		throw std::runtime_error("failed to invoke 'io_uring_register_napi'");
+	}
 
-	task<> accept_client_task = accept_client();
-	accept_client_task.resume();
-	accept_client_task.detach();
+	for (server_socket &server_socket : server_socket_list_)
+	{
+		local_task<> accept_client_task = accept_client(server_socket);
+		accept_client_task.resume();
+		accept_client_task.detach();
+	}
+
+	local_task<> watch_drain_task = watch_drain(raw_drain_event_descriptor);
+	watch_drain_task.resume();
+	watch_drain_task.detach();
 }
 
-task<> thread_worker::accept_client()
+thread_worker::connection::connection(
+	couringserver::client_socket client_socket, const http_parser_limits &http_parser_limits,
+	std::string peer_address, const bool tls)
+	: client_socket{std::move(client_socket)}, multishot_recv_guard{this->client_socket.get_raw_file_descriptor()},
+	  http_parser{http_parser_limits}, peer_address{std::move(peer_address)}, tls{tls} {}
+
+local_task<> thread_worker::accept_client(server_socket &server_socket)
 {
 	while (true)
 	{
-		const int raw_file_descriptor = co_await server_socket_.accept();
-		if (raw_file_descriptor == -1)
+		const int raw_file_descriptor = co_await server_socket.accept();
+		if (raw_file_descriptor >= 0)
 		{
-			continue;
+			add_connection();
+			client_socket client_socket(raw_file_descriptor);
+			if (server_socket.get_family() != AF_UNIX)
+			{
+				client_socket.set_options(socket_options_);
+			}
+			if (server_config_.socket_busy_poll_timeout != 0)
+			{
+				client_socket.set_busy_poll(std::chrono::microseconds(server_config_.socket_busy_poll_timeout));
+			}
+			local_task<> handle_client_task = handle_client(std::move(client_socket), server_socket.is_tls());
+			handle_client_task.resume();
+			handle_client_task.detach();
 		}
 
-		task<> handle_client_task = handle_client(client_socket(raw_file_descriptor));
-		handle_client_task.resume();
-		handle_client_task.detach();
+		if (draining_ && !server_socket.is_accepting())
+		{
+			break;
+		}
 	}
 }
 
-task<> thread_worker::handle_client(client_socket client_socket)
+local_task<> thread_worker::handle_client(client_socket client_socket, const bool tls)
 {
-	http_parser http_parser;
-	buffer_ring &buffer_ring = buffer_ring::get_instance();
+	if (tls && !co_await tls_context_->accept(client_socket))
+	{
+		remove_connection();
+		co_return;
+	}
+
+	// The frame of this coroutine holds an idle connection, the packets are
+	// handled in frames of their own.
+	std::string peer_address = access_log_.is_enabled() ? client_socket.get_peer_address() : std::string{};
+	connection connection(std::move(client_socket), http_parser_limits_, std::move(peer_address), tls);
+	const int raw_file_descriptor = connection.client_socket.get_raw_file_descriptor();
 	while (true)
 	{
-		const auto [recv_buffer_id, recv_buffer_size] = co_await client_socket.recv(BUFFER_SIZE);
-		if (recv_buffer_size == 0)
+		// A connection without a partial request is idle, it holds no parser
+		// memory and is closed right away when the worker is draining.
+		const bool idle = connection.http_parser.empty();
+		if (idle)
+		{
+			connection.http_parser.reset();
+			update_parser_memory(connection.parser_memory_size, connection.http_parser);
+			if (draining_)
+			{
+				break;
+			}
+		}
+		set_idle(raw_file_descriptor, idle);
+		const auto [recv_buffer_id, recv_buffer_size] = co_await connection.multishot_recv_guard.recv();
+		set_idle(raw_file_descriptor, false);
+		if (recv_buffer_size <= 0 || !co_await handle_packet(connection, recv_buffer_id, recv_buffer_size))
 		{
 			break;
 		}
+	}
+	co_await connection.multishot_recv_guard.stop();
+	connection.multishot_recv_guard.clear();
+	connection.http_parser.reset();
+	update_parser_memory(connection.parser_memory_size, connection.http_parser);
+	set_connection_state(raw_file_descriptor, connection_state::closed);
+	remove_connection();
+}
+
+local_task<bool> thread_worker::handle_packet(
+	connection &connection, const unsigned int recv_buffer_id, const size_t recv_buffer_size)
+{
+	// A request is timed from its first packet.
+	const metrics_clock::time_point recv_time = metrics_clock::now();
+	if (connection.http_parser.empty())
+	{
+		connection.request_start = recv_time;
+		connection.parse_duration = std::chrono::nanoseconds{0};
+	}
+	worker_metrics_.add_received_bytes(recv_buffer_size);
+
+	// A cleartext client with prior knowledge starts with the HTTP/2
+	// connection preface instead of a request.
+	buffer_ring &buffer_ring = buffer_ring::get_instance();
+	const std::span<char> recv_buffer = buffer_ring.borrow_buffer(recv_buffer_id, recv_buffer_size);
+	if (!connection.tls && std::exchange(connection.first_packet, false) &&
+		is_http2_preface(std::string_view(recv_buffer.data(), recv_buffer.size())))
+	{
+		std::string received(recv_buffer.data(), recv_buffer.size());
+		buffer_ring.return_buffer(recv_buffer_id);
+		co_await serve_http2(connection, std::move(received), nullptr);
+		co_return false;
+	}
+
+	// The parser copies what it keeps of the packet, so the buffer is given
+	// back right away.
+	std::optional<http_request> parse_result = connection.http_parser.parse_packet(recv_buffer);
+	connection.parse_duration += metrics_clock::now() - recv_time;
+	buffer_ring.return_buffer(recv_buffer_id);
+
+	// Over the memory budget, the connections that grow a partial request are
+	// shed.
+	if (!update_parser_memory(connection.parser_memory_size, connection.http_parser) && !parse_result.has_value() &&
+		!connection.http_parser.get_error().has_value())
+	{
+		worker_metrics_.add_shed_connection();
+		co_await close_with_error(connection, nullptr, "503", "Service Unavailable");
+		co_return false;
+	}
 
-		const std::span<char> recv_buffer = buffer_ring.borrow_buffer(recv_buffer_id, recv_buffer_size);
-		if (const auto parse_result = http_parser.parse_packet(recv_buffer); parse_result.has_value())
+	// The complete requests are served in order, a partial one waits for the
+	// next packet.
+	for (bool pipelined = false;; pipelined = true)
+	{
+		if (const std::optional<http_parse_error> http_parse_error = connection.http_parser.get_error())
+		{
+			const error_status error_status = get_error_status(http_parse_error.value());
+			co_await close_with_error(connection, nullptr, error_status.status, error_status.status_text);
+			co_return false;
+		}
+		if (!parse_result.has_value())
 		{
-			const http_request &http_request = parse_result.value();
-			// const std::filesystem::path file_path = std::filesystem::relative(http_request.url, "/");
+			co_return true;
+		}
+		if (!pipelined)
+		{
+			worker_metrics_.record(request_phase::recv, recv_time - connection.request_start);
+		}
+		worker_metrics_.record(request_phase::parse, connection.parse_duration);
+		connection.client_socket.reset_first_send_time();
 
-			const std::filesystem::path file_path = http_request.url;
-			http_response http_response;
-			http_response.version = http_request.version;
-			if (std::filesystem::exists(file_path) && std::filesystem::is_regular_file(file_path))
+		// The proxy splices the rest of a body from the socket, so the receive
+		// request is stopped first and the body bytes it has queued are taken
+		// into the request.
+		if (parse_result->unread_body_size != 0)
+		{
+			co_await connection.multishot_recv_guard.stop();
+			unsigned int body_buffer_id = 0;
+			ssize_t body_buffer_size = 0;
+			while (connection.multishot_recv_guard.take_packet(body_buffer_id, body_buffer_size) &&
+				   body_buffer_size > 0)
 			{
-				http_response.status = "200";
-				http_response.status_text = "OK";
-				const uintmax_t file_size = std::filesystem::file_size(file_path);
-				http_response.header_list.emplace_back("content-length", std::to_string(file_size));
+				worker_metrics_.add_received_bytes(body_buffer_size);
+				const std::span<char> body_buffer = buffer_ring.borrow_buffer(body_buffer_id, body_buffer_size);
+				const size_t body_size = std::min<uintmax_t>(body_buffer.size(), parse_result->unread_body_size);
+				parse_result->body.append(body_buffer.data(), body_size);
+				parse_result->unread_body_size -= body_size;
+				buffer_ring.return_buffer(body_buffer_id);
+			}
+			connection.multishot_recv_guard.clear();
+		}
 
-				std::string send_buffer = http_response.serialize();
-				if (co_await client_socket.send(send_buffer, send_buffer.size()) == -1)
-				{
-					throw std::runtime_error("failed to invoke 'send'");
-				}
+		const http_request &http_request = parse_result.value();
+		if (!connection.tls && is_http2_upgrade(http_request))
+		{
+			co_await serve_http2(connection, connection.http_parser.take_buffer(), &http_request);
+			co_return false;
+		}
+		if (!co_await serve_request(connection, http_request))
+		{
+			co_return false;
+		}
 
-				const file_descriptor file_descriptor = open(file_path);
-				if (co_await splice(file_descriptor, client_socket, file_size) == -1)
-				{
-					throw std::runtime_error("failed to invoke 'splice'");
-				}
+		// A pipelined request may be buffered already.
+		connection.request_start = metrics_clock::now();
+		parse_result = connection.http_parser.parse();
+		connection.parse_duration = metrics_clock::now() - connection.request_start;
+	}
+}
+
+local_task<bool> thread_worker::serve_request(connection &connection, const http_request &http_request)
+{
+	if (inflight_request_count_ < server_config_.max_inflight_request_count)
+	{
+		++inflight_request_count_;
+	}
+	else if (server_config_.reject_on_overload)
+	{
+		co_await close_with_error(connection, &http_request, "503", "Service Unavailable");
+		co_return false;
+	}
+	else
+	{
+		co_await queue_awaiter(request_slot_queue_);
+	}
+
+	http_response http_response;
+	http_response.version = http_request.version;
+	// Only the proxy reads a body that is still in the socket or that the
+	// parser cannot delimit, so the connection is not reused after it.
+	if (draining_ || http_request.unread_body_size != 0 || http_request.get_header("transfer-encoding").has_value())
+	{
+		http_response.header_list.emplace_back("connection", "close");
+	}
+	const std::string_view path = std::string_view(http_request.url).substr(0, http_request.url.find('?'));
+	const http_handler *const http_handler = HTTP_ROUTE_TABLE.find(http_request.method, path);
+	if (http_handler != nullptr)
+	{
+		co_await (*http_handler)(*this, connection.client_socket, http_request, http_response);
+	}
+	else
+	{
+		http_response.status = "404";
+		http_response.status_text = "Not Found";
+		co_await send_response(connection.client_socket, http_response);
+	}
+	record_response(connection, http_request, http_response);
+
+	release_request_slot();
+
+	// The handler closes the connection with 'connection: close' when it
+	// cannot be reused, e.g. after a body delimited by the upstream closing.
+	co_return http_response.get_header("connection") != "close";
+}
+
+local_task<> thread_worker::serve_http2(
+	connection &connection, std::string received, const http_request *const upgrade_request)
+{
+	http2_session http2_session(*this, connection.client_socket, connection.multishot_recv_guard);
+	co_await http2_session.serve(std::move(received), upgrade_request);
+}
+
+upstream_pool &thread_worker::get_upstream_pool() noexcept { return upstream_pool_; }
+
+file_metadata_cache &thread_worker::get_file_metadata_cache() noexcept { return file_metadata_cache_; }
+
+const asset_pack *thread_worker::get_asset_pack() const noexcept { return asset_pack_; }
+
+worker_metrics &thread_worker::get_worker_metrics() noexcept { return worker_metrics_; }
+
+const server_metrics &thread_worker::get_server_metrics() const noexcept { return server_metrics_; }
+
+bool thread_worker::is_draining() const noexcept { return draining_; }
+
+void thread_worker::set_idle(const int raw_file_descriptor, const bool idle)
+{
+	set_connection_state(raw_file_descriptor, idle ? connection_state::idle : connection_state::busy);
+}
+
+void thread_worker::set_connection_state(const int raw_file_descriptor, const connection_state connection_state)
+{
+	if (static_cast<size_t>(raw_file_descriptor) >= connection_state_list_.size())
+	{
+		connection_state_list_.resize(raw_file_descriptor + 1, connection_state::closed);
+	}
+	connection_state_list_[raw_file_descriptor] = connection_state;
+}
+
+local_task<> thread_worker::serve_file(
+	client_socket &client_socket, const http_request &http_request, http_response &http_response)
+{
+	if (asset_pack_ != nullptr)
+	{
+		co_await serve_asset(client_socket, http_request, http_response);
+		co_return;
+	}
+
+	// const std::filesystem::path file_path = std::filesystem::relative(http_request.url, "/");
+
+	const std::filesystem::path file_path = http_request.url;
+	// The metadata may be evicted by another coroutine of this worker, so it
+	// is only used before the first suspension.
+	const metrics_clock::time_point lookup_start = metrics_clock::now();
+	const file_metadata *const file_metadata = file_metadata_cache_.get(file_path);
+	worker_metrics_.record(request_phase::file_lookup, lookup_start);
+	if (file_metadata == nullptr)
+	{
+		http_response.status = "404";
+		http_response.status_text = "Not Found";
+		http_response.header_list.emplace_back("content-length", "0");
+
+		std::string send_buffer = http_response.serialize();
+		if (co_await client_socket.send(send_buffer, send_buffer.size()) == -1)
+		{
+			abort_response(http_response);
+		}
+		co_return;
+	}
+
+	const uintmax_t file_size = file_metadata->size;
+	// The validators are dropped if the file cannot be opened after all.
+	const size_t header_count = http_response.header_list.size();
+	http_response.header_list.emplace_back("accept-ranges", "bytes");
+	http_response.header_list.emplace_back("etag", file_metadata->entity_tag);
+	http_response.header_list.emplace_back("last-modified", file_metadata->last_modified);
+
+	// A met condition turns the response into a '304 Not Modified' without a body.
+	if (is_not_modified(http_request, *file_metadata))
+	{
+		http_response.status = "304";
+		http_response.status_text = "Not Modified";
+
+		std::string send_buffer = http_response.serialize();
+		if (co_await client_socket.send(send_buffer, send_buffer.size()) == -1)
+		{
+			abort_response(http_response);
+		}
+		co_return;
+	}
+
+	const std::optional<std::vector<byte_range>> byte_range_list =
+		get_byte_range_list(http_request, file_size, file_metadata->entity_tag, file_metadata->last_modified);
+	// The metadata may be cached from before the file was removed or made
+	// unreadable, so the file is opened before the head is sent. It is not
+	// opened for a 'HEAD' request or a '416 Range Not Satisfiable'.
+	file_descriptor file_descriptor;
+	if (http_request.method != "HEAD" && (!byte_range_list.has_value() || !byte_range_list->empty()))
+	{
+		std::error_code error_code;
+		file_descriptor = open_stream_file(file_path, file_size, error_code);
+		if (error_code)
+		{
+			http_response.header_list.erase(
+				http_response.header_list.begin() + header_count, http_response.header_list.end());
+			co_await serve_open_error(client_socket, file_path, error_code, http_response);
+			co_return;
+		}
+	}
+
+	if (!byte_range_list.has_value())
+	{
+		http_response.status = "200";
+		http_response.status_text = "OK";
+		http_response.header_list.emplace_back("content-length", std::to_string(file_size));
+
+		const metrics_clock::time_point send_start = metrics_clock::now();
+		std::string send_buffer = http_response.serialize();
+		if (co_await client_socket.send(send_buffer, send_buffer.size()) == -1)
+		{
+			abort_response(http_response);
+			co_return;
+		}
+		worker_metrics_.record(request_phase::send, send_start);
+		if (http_request.method == "HEAD")
+		{
+			co_return;
+		}
+
+		const metrics_clock::time_point splice_start = metrics_clock::now();
+		const std::tuple<couringserver::file_descriptor, couringserver::file_descriptor> splice_pipe = pipe();
+		if (co_await stream_file(client_socket, file_descriptor, splice_pipe, byte_range{0, file_size}) == -1)
+		{
+			abort_response(http_response);
+			co_return;
+		}
+		worker_metrics_.record(request_phase::splice, splice_start);
+		co_return;
+	}
+
+	co_await serve_range(client_socket, http_response, file_descriptor, 0, file_size, byte_range_list.value());
+}
+
+local_task<> thread_worker::serve_open_error(
+	client_socket &client_socket, const std::filesystem::path &file_path, const std::error_code error_code,
+	http_response &http_response)
+{
+	http_response.status = file_metadata_cache_.report_open_error(file_path, error_code);
+	if (http_response.status == "404")
+	{
+		http_response.status_text = "Not Found";
+	}
+	else if (http_response.status == "403")
+	{
+		http_response.status_text = "Forbidden";
+	}
+	else
+	{
+		http_response.status_text = "Internal Server Error";
+		abort_response(http_response);
+	}
+	co_await send_response(client_socket, http_response);
+}
+
+local_task<> thread_worker::serve_asset(
+	client_socket &client_socket, const http_request &http_request, http_response &http_response)
+{
+	// The query does not name the asset.
+	const std::string_view path = std::string_view(http_request.url).substr(0, http_request.url.find('?'));
+	const metrics_clock::time_point lookup_start = metrics_clock::now();
+	const asset_pack_slot *const asset_pack_slot = asset_pack_->find(path);
+	worker_metrics_.record(request_phase::file_lookup, lookup_start);
+	if (asset_pack_slot == nullptr)
+	{
+		http_response.status = "404";
+		http_response.status_text = "Not Found";
+		http_response.header_list.emplace_back("content-length", "0");
+
+		std::string send_buffer = http_response.serialize();
+		if (co_await client_socket.send(send_buffer, send_buffer.size()) == -1)
+		{
+			abort_response(http_response);
+		}
+		co_return;
+	}
+
+	// Ranges are only served from the original, as a range of a compressed
+	// variant would depend on the encoding the client asked for.
+	const bool range = http_request.get_header("range").has_value();
+	const asset_encoding asset_encoding =
+		range ? asset_encoding::identity
+			  : asset_pack::select_encoding(*asset_pack_slot, http_request.get_header("accept-encoding"));
+	const asset_pack_variant &asset_pack_variant = asset_pack_slot->variant_list[static_cast<size_t>(asset_encoding)];
+	const std::string_view entity_tag = asset_pack_->get_string(asset_pack_variant.entity_tag);
+	const std::string_view last_modified = asset_pack_->get_string(asset_pack_slot->last_modified);
+	const bool vary = asset_pack_slot->variant_mask != 1U << static_cast<uint32_t>(asset_encoding::identity);
+
+	if (is_not_modified(http_request, entity_tag, asset_pack_slot->modification_time))
+	{
+		http_response.status = "304";
+		http_response.status_text = "Not Modified";
+		http_response.header_list.emplace_back("etag", entity_tag);
+		http_response.header_list.emplace_back("last-modified", last_modified);
+		if (vary)
+		{
+			http_response.header_list.emplace_back("vary", "accept-encoding");
+		}
+
+		std::string send_buffer = http_response.serialize();
+		if (co_await client_socket.send(send_buffer, send_buffer.size()) == -1)
+		{
+			abort_response(http_response);
+		}
+		co_return;
+	}
+
+	const std::optional<std::vector<byte_range>> byte_range_list =
+		get_byte_range_list(http_request, asset_pack_variant.body_size, entity_tag, last_modified);
+	if (!byte_range_list.has_value())
+	{
+		// The header lines are stored in the pack, and a small body is sent
+		// from the mapping along with them.
+		http_response.status = "200";
+		http_response.status_text = "OK";
+		http_response.header_block = asset_pack_->get_string(asset_pack_variant.header_block);
+
+		const metrics_clock::time_point send_start = metrics_clock::now();
+		std::string send_buffer = http_response.serialize();
+		const std::span<const char> body = asset_pack_->get_body(asset_pack_variant);
+		const bool inline_body = body.size() <= ASSET_PACK_INLINE_BODY_SIZE;
+		if (http_request.method != "HEAD" && inline_body)
+		{
+			send_buffer.append(body.data(), body.size());
+		}
+		if (co_await client_socket.send(send_buffer, send_buffer.size()) == -1)
+		{
+			abort_response(http_response);
+			co_return;
+		}
+		worker_metrics_.record(request_phase::send, send_start);
+		if (http_request.method == "HEAD" || inline_body)
+		{
+			co_return;
+		}
+
+		const metrics_clock::time_point splice_start = metrics_clock::now();
+		const std::tuple<file_descriptor, file_descriptor> splice_pipe = pipe();
+		if (co_await stream_file(
+				client_socket, asset_pack_->get_file_descriptor(), splice_pipe,
+				byte_range{asset_pack_variant.body_offset, asset_pack_variant.body_size}) == -1)
+		{
+			abort_response(http_response);
+			co_return;
+		}
+		worker_metrics_.record(request_phase::splice, splice_start);
+		co_return;
+	}
+
+	http_response.header_list.emplace_back("accept-ranges", "bytes");
+	http_response.header_list.emplace_back("etag", entity_tag);
+	http_response.header_list.emplace_back("last-modified", last_modified);
+	if (vary)
+	{
+		http_response.header_list.emplace_back("vary", "accept-encoding");
+	}
+	co_await serve_range(
+		client_socket, http_response, asset_pack_->get_file_descriptor(), asset_pack_variant.body_offset,
+		asset_pack_variant.body_size, byte_range_list.value());
+}
+
+local_task<> thread_worker::serve_range(
+	client_socket &client_socket, http_response &http_response, const file_descriptor &file_descriptor,
+	const uintmax_t body_offset, const uintmax_t body_size, const std::vector<byte_range> &byte_range_list)
+{
+	if (byte_range_list.empty())
+	{
+		http_response.status = "416";
+		http_response.status_text = "Range Not Satisfiable";
+		http_response.header_list.emplace_back("content-range", "bytes */" + std::to_string(body_size));
+		http_response.header_list.emplace_back("content-length", "0");
+
+		std::string send_buffer = http_response.serialize();
+		if (co_await client_socket.send(send_buffer, send_buffer.size()) == -1)
+		{
+			abort_response(http_response);
+		}
+		co_return;
+	}
+
+	const std::tuple<couringserver::file_descriptor, couringserver::file_descriptor> splice_pipe = pipe();
+	http_response.status = "206";
+	http_response.status_text = "Partial Content";
+	if (byte_range_list.size() == 1)
+	{
+		const byte_range &byte_range = byte_range_list.front();
+		http_response.header_list.emplace_back("content-range", format_content_range(byte_range, body_size));
+		http_response.header_list.emplace_back("content-length", std::to_string(byte_range.length));
+
+		const metrics_clock::time_point send_start = metrics_clock::now();
+		std::string send_buffer = http_response.serialize();
+		if (co_await client_socket.send(send_buffer, send_buffer.size()) == -1)
+		{
+			abort_response(http_response);
+			co_return;
+		}
+		worker_metrics_.record(request_phase::send, send_start);
+		const metrics_clock::time_point splice_start = metrics_clock::now();
+		const couringserver::byte_range file_range{body_offset + byte_range.offset, byte_range.length};
+		if (co_await stream_file(client_socket, file_descriptor, splice_pipe, file_range) == -1)
+		{
+			abort_response(http_response);
+			co_return;
+		}
+		worker_metrics_.record(request_phase::splice, splice_start);
+		co_return;
+	}
+
+	// Every part is spliced from its own offset, only the part headers are
+	// built in user space. The content length is known up front, so the
+	// response is not chunked.
+	std::array<char, 16> random_hex;
+	const auto [random_hex_end, _] =
+		std::to_chars(random_hex.data(), random_hex.data() + random_hex.size(), random_engine_(), 16);
+	const std::string boundary(random_hex.data(), random_hex_end);
+	std::vector<std::string> part_header_list;
+	uintmax_t content_length = 0;
+	for (const byte_range &byte_range : byte_range_list)
+	{
+		const std::string &part_header = part_header_list.emplace_back(
+			"\r\n--" + boundary + "\r\ncontent-range: " + format_content_range(byte_range, body_size) + "\r\n\r\n");
+		content_length += part_header.size() + byte_range.length;
+	}
+	std::string closing_delimiter = "\r\n--" + boundary + "--\r\n";
+	content_length += closing_delimiter.size();
+
+	http_response.header_list.emplace_back("content-type", "multipart/byteranges; boundary=" + boundary);
+	http_response.header_list.emplace_back("content-length", std::to_string(content_length));
+
+	const metrics_clock::time_point send_start = metrics_clock::now();
+	std::string send_buffer = http_response.serialize();
+	if (co_await client_socket.send(send_buffer, send_buffer.size()) == -1)
+	{
+		abort_response(http_response);
+		co_return;
+	}
+	worker_metrics_.record(request_phase::send, send_start);
+	// The part headers are sent between the splices and count as splicing.
+	const metrics_clock::time_point splice_start = metrics_clock::now();
+	for (size_t index = 0; index < byte_range_list.size(); ++index)
+	{
+		const byte_range &byte_range = byte_range_list[index];
+		if (co_await client_socket.send(part_header_list[index], part_header_list[index].size()) == -1)
+		{
+			abort_response(http_response);
+			co_return;
+		}
+		const couringserver::byte_range file_range{body_offset + byte_range.offset, byte_range.length};
+		if (co_await stream_file(client_socket, file_descriptor, splice_pipe, file_range) == -1)
+		{
+			abort_response(http_response);
+			co_return;
+		}
+	}
+	if (co_await client_socket.send(closing_delimiter, closing_delimiter.size()) == -1)
+	{
+		abort_response(http_response);
+		co_return;
+	}
+	worker_metrics_.record(request_phase::splice, splice_start);
+}
+
+local_task<ssize_t> thread_worker::stream_file(
+	client_socket &client_socket, const file_descriptor &file_descriptor_in,
+	const std::tuple<file_descriptor, file_descriptor> &pipe, const byte_range &byte_range)
+{
+	uintmax_t bytes_sent = 0;
+	size_t turn_bytes_sent = 0;
+	while (bytes_sent < byte_range.length)
+	{
+		if (bytes_sent != 0)
+		{
+			// A large transfer goes to the back of the turn, behind the
+			// completions of small responses.
+			if (turn_bytes_sent >= STREAM_TURN_BYTE_BUDGET)
+			{
+				co_await queue_awaiter(yield_queue_);
+				turn_bytes_sent = 0;
 			}
-			else
+			// Wait for room in the send buffer, so that the splice does not
+			// block an io-wq worker on a slow client.
+			if (co_await poll_awaiter(client_socket.get_raw_file_descriptor(), POLLOUT) < 0)
 			{
-				http_response.status = "404";
-				http_response.status_text = "Not Found";
-				http_response.header_list.emplace_back("content-length", "0");
-
-				std::string send_buffer = http_response.serialize();
-				if (co_await client_socket.send(send_buffer, send_buffer.size()) == -1)
-				{
-					throw std::runtime_error("failed to invoke 'send'");
-				}
+				co_return -1;
 			}
 		}
 
-		buffer_ring.return_buffer(recv_buffer_id);
+		const size_t chunk_size = std::min<uintmax_t>(STREAM_CHUNK_SIZE, byte_range.length - bytes_sent);
+		if (co_await splice(
+				file_descriptor_in, byte_range.offset + bytes_sent, client_socket, chunk_size, pipe) == -1)
+		{
+			co_return -1;
+		}
+		bytes_sent += chunk_size;
+		turn_bytes_sent += chunk_size;
+	}
+	co_return bytes_sent;
+}
+
+local_task<> thread_worker::watch_drain(const int raw_drain_event_descriptor)
+{
+	eventfd_t drain_event = 0;
+	co_await read_awaiter(
+		raw_drain_event_descriptor, {reinterpret_cast<char *>(&drain_event), sizeof(drain_event)});
+
+	draining_ = true;
+	for (server_socket &server_socket : server_socket_list_)
+	{
+		server_socket.cancel_accept();
+	}
+	// The pending 'recv' of an idle connection completes with 0 bytes after
+	// the read side is shut down, so the connection is closed by its coroutine.
+	for (size_t raw_file_descriptor = 0; raw_file_descriptor < connection_state_list_.size(); ++raw_file_descriptor)
+	{
+		if (connection_state_list_[raw_file_descriptor] == connection_state::idle)
+		{
+			::shutdown(static_cast<int>(raw_file_descriptor), SHUT_RD);
+		}
+	}
+
+	// A client may hold a partial request or leave a stream stalled on its
+	// flow control window for good. After the grace period the connections
+	// left are shut down, so that their receives and sends fail and the
+	// worker can exit. The timer is abandoned if the worker drains first.
+	co_await timeout_awaiter(std::chrono::seconds(server_config_.drain_grace_period));
+	for (size_t raw_file_descriptor = 0; raw_file_descriptor < connection_state_list_.size(); ++raw_file_descriptor)
+	{
+		if (connection_state_list_[raw_file_descriptor] != connection_state::closed)
+		{
+			::shutdown(static_cast<int>(raw_file_descriptor), SHUT_RDWR);
+		}
 	}
 }
 
-task<> thread_worker::event_loop()
+local_task<> thread_worker::event_loop()
 {
 	io_uring &io_uring = io_uring::get_instance();
 
-	while (true)
+	while (!is_drained())
 	{
-		io_uring.submit_and_wait(1);
+		// Yielded streams are runnable, so only wait when there are none.
+		if (yield_queue_.empty())
+		{
+			io_uring.wait_for_completion(std::chrono::microseconds(server_config_.event_loop_spin_budget));
+		}
+		else
+		{
+			io_uring.submit_and_wait(0);
+		}
 		for (io_uring_cqe *const cqe : io_uring)
 		{
+			io_uring.record_completion(cqe);
 			auto *sqe_data = reinterpret_cast<struct sqe_data *>(io_uring_cqe_get_data(cqe));
+			if (sqe_data == nullptr)
+			{
+				io_uring.cqe_seen(cqe);
+				continue;
+			}
 			sqe_data->cqe_res = cqe->res;
 			sqe_data->cqe_flags = cqe->flags;
 			void *const coroutine_address = sqe_data->coroutine;
 			io_uring.cqe_seen(cqe);
 
-			if (coroutine_address != nullptr)
+			if (sqe_data->completion_handler != nullptr)
+			{
+				if (const std::coroutine_handle<> coroutine =
+						sqe_data->completion_handler->handle_completion(*sqe_data))
+				{
+					resume(coroutine);
+				}
+			}
+			else if (coroutine_address != nullptr)
 			{
-				std::coroutine_handle<>::from_address(coroutine_address).resume();
+				resume(std::coroutine_handle<>::from_address(coroutine_address));
 			}
 		};
+
+		// Streams that yield again are resumed in the next turn.
+		std::deque<std::coroutine_handle<>> yield_queue;
+		yield_queue.swap(yield_queue_);
+		for (const std::coroutine_handle<> coroutine : yield_queue)
+		{
+			resume(coroutine);
+		}
+
+		// The entries of the turn are written together.
+		access_log_.flush();
+	}
+	co_return;
+}
+
+thread_worker::queue_awaiter::queue_awaiter(std::deque<std::coroutine_handle<>> &queue)
+	: queue_{queue} {}
+
+bool thread_worker::queue_awaiter::await_ready() const noexcept { return false; }
+
+void thread_worker::queue_awaiter::await_suspend(std::coroutine_handle<> coroutine) const
+{
+	queue_.emplace_back(coroutine);
+}
+
+void thread_worker::queue_awaiter::await_resume() const noexcept {}
+
+void thread_worker::resume(const std::coroutine_handle<> coroutine)
+{
+	if constexpr (IO_TRACE)
+	{
+		const uint64_t resume_start = io_trace::now();
+		const void *const coroutine_address = coroutine.address();
+		coroutine.resume();
+		io_uring::get_instance().get_trace().record_resume(coroutine_address, resume_start);
+	}
+	else
+	{
+		coroutine.resume();
+	}
+}
+
+// Pause the multishot accept at the connection cap, the clients then wait in
+// the kernel backlog or are taken by the other 'SO_REUSEPORT' listeners.
+void thread_worker::add_connection()
+{
+	++connection_count_;
+	worker_metrics_.add_connection(1);
+	if (!accept_paused_ && connection_count_ >= server_config_.max_connection_count)
+	{
+		accept_paused_ = true;
+		for (server_socket &server_socket : server_socket_list_)
+		{
+			server_socket.pause_accept();
+		}
 	}
 }
 
-http_server::http_server(const size_t thread_count) : thread_pool_{thread_count} {}
+// Resume the multishot accept once the connection count drops to the low watermark.
+void thread_worker::remove_connection()
+{
+	--connection_count_;
+	worker_metrics_.add_connection(-1);
+	if (accept_paused_ && !draining_ && connection_count_ <= server_config_.connection_low_watermark)
+	{
+		accept_paused_ = false;
+		for (server_socket &server_socket : server_socket_list_)
+		{
+			server_socket.resume_accept();
+		}
+	}
+}
 
-void http_server::listen(const char *port)
+// Requests only queue while every slot is taken, so the count alone tells
+// whether one is free.
+bool thread_worker::try_take_request_slot() noexcept
 {
-	const auto construct_task = [&]() -> task<>
+	if (inflight_request_count_ >= server_config_.max_inflight_request_count)
+	{
+		return false;
+	}
+	++inflight_request_count_;
+	return true;
+}
+
+void thread_worker::release_request_slot()
+{
+	if (request_slot_queue_.empty())
+	{
+		--inflight_request_count_;
+		return;
+	}
+	const std::coroutine_handle<> coroutine = request_slot_queue_.front();
+	request_slot_queue_.pop_front();
+	coroutine.resume();
+}
+
+void thread_worker::record_response(
+	const connection &connection, const http_request &http_request, const http_response &http_response)
+{
+	const client_socket &client_socket = connection.client_socket;
+	const metrics_clock::time_point request_start = connection.request_start;
+	const metrics_clock::time_point response_end = metrics_clock::now();
+	worker_metrics_.request_latency.record(response_end - request_start);
+	if (const auto first_send_time = client_socket.get_first_send_time(); first_send_time.has_value())
+	{
+		worker_metrics_.first_byte_latency.record(first_send_time.value() - request_start);
+	}
+
+	// The body size is taken from 'content-length', the responses to 'HEAD'
+	// and '304 Not Modified' announce a body that is not sent.
+	uint64_t body_size = 0;
+	const std::optional<std::string_view> content_length = http_response.get_header("content-length");
+	if (content_length.has_value() && http_request.method != "HEAD" && http_response.status != "304")
+	{
+		std::from_chars(content_length->data(), content_length->data() + content_length->size(), body_size);
+	}
+	worker_metrics_.add_response(http_response.status, body_size);
+
+	if (!access_log_.is_enabled())
+	{
+		return;
+	}
+	if (inflight_request_count_ >= server_config_.access_log_overload_threshold &&
+		access_log_sample_count_++ % server_config_.access_log_overload_sample_interval != 0)
+	{
+		worker_metrics_.add_access_log_skipped();
+		return;
+	}
+	access_log_.append(
+		connection.peer_address, http_request, http_response, body_size, response_end - request_start);
+}
+
+bool thread_worker::update_parser_memory(size_t &parser_memory_size, const http_parser &http_parser)
+{
+	const size_t memory_size = http_parser.get_memory_size();
+	parser_memory_size_ = parser_memory_size_ - parser_memory_size + memory_size;
+	parser_memory_size = memory_size;
+	worker_metrics_.set_parser_memory_size(parser_memory_size_);
+	return parser_memory_size_ <= server_config_.parser_memory_budget;
+}
+
+local_task<> thread_worker::close_with_error(
+	connection &connection, const http_request *const http_request, const std::string_view status,
+	const std::string_view status_text)
+{
+	const couringserver::http_request unknown_request;
+	http_response http_response;
+	http_response.version = http_request == nullptr ? "HTTP/1.1" : http_request->version;
+	http_response.status = status;
+	http_response.status_text = status_text;
+	if (status == "503")
+	{
+		http_response.header_list.emplace_back("retry-after", "1");
+	}
+	http_response.header_list.emplace_back("connection", "close");
+	http_response.header_list.emplace_back("content-length", "0");
+
+	connection.client_socket.reset_first_send_time();
+	std::string send_buffer = http_response.serialize();
+	co_await connection.client_socket.send(send_buffer, send_buffer.size());
+	record_response(connection, http_request == nullptr ? unknown_request : *http_request, http_response);
+}
+
+bool thread_worker::is_drained() const noexcept
+{
+	return draining_ && connection_count_ == 0 &&
+		   std::ranges::none_of(server_socket_list_, &server_socket::is_accepting) && access_log_.is_idle();
+}
+
+http_server::http_server(const server_config &server_config)
+	: server_config_{server_config}, thread_pool_{server_config.thread_count},
+	  server_metrics_{server_config.thread_count}
+{
+	for (size_t _ = 0; _ < server_config_.thread_count; ++_)
+	{
+		const int raw_file_descriptor = eventfd(0, EFD_CLOEXEC);
+		if (raw_file_descriptor == -1)
+		{
+			throw std::runtime_error("failed to invoke 'eventfd'");
+		}
+		drain_event_list_.emplace_back(raw_file_descriptor);
+	}
+	if (!server_config_.asset_pack_path.empty())
+	{
+		asset_pack_.emplace(
+			server_config_.asset_pack_path, server_config_.asset_pack_populate, server_config_.asset_pack_huge_pages);
+	}
+}
+
+void http_server::enable_tls(
+	const char *port, const std::filesystem::path &certificate_path,
+	const std::filesystem::path &private_key_path)
+{
+	tls_port_ = port;
+	tls_context_.emplace(certificate_path, private_key_path);
+}
+
+void http_server::listen(const char *port, const bool take_over)
+{
+	const socket_options socket_options = get_socket_options(server_config_);
+	const std::vector<socket_address> socket_address_list = resolve_listen_address_list(port);
+	const std::vector<socket_address> tls_socket_address_list =
+		tls_port_ != nullptr ? resolve_listen_address_list(tls_port_) : std::vector<socket_address>{};
+	std::vector<server_socket> server_socket_list;
+	if (take_over)
+	{
+		server_socket_list = listener_handoff::take_over(server_config_.listener_handoff_path.c_str());
+		// The inherited TLS listeners are recognized by their address. They get
+		// the options of this server, which may differ from the previous one.
+		for (server_socket &server_socket : server_socket_list)
+		{
+			server_socket.set_tls(
+				std::ranges::find(tls_socket_address_list, server_socket.get_address()) !=
+				tls_socket_address_list.end());
+			server_socket.set_options(socket_options);
+			server_socket.listen(socket_options);
+		}
+	}
+	std::vector<socket_address> listener_address_list;
+	for (const server_socket &server_socket : server_socket_list)
+	{
+		listener_address_list.emplace_back(server_socket.get_address());
+	}
+
+	// Every worker gets a listener of its own for each address, except for a
+	// Unix domain socket, which is bound once.
+	const auto bind_listener_list = [&](const std::vector<socket_address> &socket_address_list, const bool tls)
+	{
+		for (const socket_address &socket_address : socket_address_list)
+		{
+			const size_t target_count = socket_address.get_family() == AF_UNIX ? 1 : thread_pool_.size();
+			for (size_t listener_count = std::ranges::count(listener_address_list, socket_address);
+				 listener_count < target_count; ++listener_count)
+			{
+				server_socket &server_socket = server_socket_list.emplace_back();
+				server_socket.bind(socket_address);
+				server_socket.set_options(socket_options);
+				server_socket.listen(socket_options);
+				server_socket.set_tls(tls);
+				listener_address_list.emplace_back(socket_address);
+			}
+		}
+	};
+	bind_listener_list(socket_address_list, false);
+	bind_listener_list(tls_socket_address_list, true);
+
+	std::vector<int> raw_listener_list;
+	for (const server_socket &server_socket : server_socket_list)
+	{
+		raw_listener_list.emplace_back(server_socket.get_raw_file_descriptor());
+	}
+
+	{
+		std::lock_guard lock(handoff_mutex_);
+		listener_handoff_.emplace(server_config_.listener_handoff_path.c_str());
+	}
+	std::jthread handoff_thread([&]()
+								{
+		if (listener_handoff_->serve(raw_listener_list))
+		{
+			drain();
+		} });
+
+	// Every worker accepts on every address, the workers beyond the listeners
+	// of an address share a duplicate of one of them. Every inherited listener
+	// must keep being accepted on, otherwise the clients queued in its backlog
+	// would never be served.
+	std::vector<std::vector<server_socket>> server_socket_group_list(thread_pool_.size());
+	std::vector<bool> distributed_list(server_socket_list.size());
+	for (size_t first_index = 0; first_index < server_socket_list.size(); ++first_index)
+	{
+		if (distributed_list[first_index])
+		{
+			continue;
+		}
+		std::vector<size_t> index_list;
+		for (size_t index = first_index; index < server_socket_list.size(); ++index)
+		{
+			if (listener_address_list[index] == listener_address_list[first_index])
+			{
+				index_list.emplace_back(index);
+				distributed_list[index] = true;
+			}
+		}
+		for (size_t group_index = index_list.size(); group_index < thread_pool_.size(); ++group_index)
+		{
+			server_socket_group_list[group_index].emplace_back(
+				server_socket_list[index_list[group_index % index_list.size()]].duplicate());
+		}
+		for (size_t group_index = 0; group_index < index_list.size(); ++group_index)
+		{
+			server_socket_group_list[group_index % thread_pool_.size()].emplace_back(
+				std::move(server_socket_list[index_list[group_index]]));
+		}
+	}
+
+	const auto construct_task = [&](
+									std::vector<server_socket> server_socket_list,
+									const size_t index) -> task<>
 	{
 		co_await thread_pool_.schedule();
-		co_await thread_worker(port).event_loop();
+		// Every worker appends to a file of its own.
+		const std::string access_log_path = server_config_.access_log_path.empty()
+												? ""
+												: server_config_.access_log_path + "." + std::to_string(index);
+		thread_worker thread_worker(
+			server_config_, std::move(server_socket_list), tls_context_.has_value() ? &tls_context_.value() : nullptr,
+			asset_pack_.has_value() ? &asset_pack_.value() : nullptr,
+			drain_event_list_[index].get_raw_file_descriptor(), server_metrics_.get_worker_metrics(index),
+			server_metrics_, access_log_path, access_log_generation_);
+		co_await thread_worker.event_loop();
 	};
 
 	std::vector<task<>> thread_worker_list;
-	for (size_t _ = 0; _ < thread_pool_.size(); ++_)
+	for (size_t index = 0; index < thread_pool_.size(); ++index)
 	{
-		task<> thread_worker = construct_task();
-		thread_worker.resume();
-		thread_worker_list.emplace_back(std::move(thread_worker));
+		thread_worker_list.emplace_back(construct_task(std::move(server_socket_group_list[index]), index));
 	}
 	sync_wait_all(thread_worker_list);
+
+	{
+		std::lock_guard lock(handoff_mutex_);
+		listener_handoff_->close();
+	}
+	handoff_thread.join();
+	std::lock_guard lock(handoff_mutex_);
+	listener_handoff_.reset();
+}
+
+void http_server::drain()
+{
+	{
+		std::lock_guard lock(handoff_mutex_);
+		if (listener_handoff_.has_value())
+		{
+			listener_handoff_->close();
+		}
+	}
+
+	for (const file_descriptor &drain_event : drain_event_list_)
+	{
+		eventfd_write(drain_event.get_raw_file_descriptor(), 1);
+	}
+}
+
+void http_server::reopen_access_log() noexcept
+{
+	access_log_generation_.fetch_add(1, std::memory_order_relaxed);
 }
 } // namespace couringserver
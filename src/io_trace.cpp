@@ -0,0 +1,195 @@
+#include "io_trace.hpp"
+
+#include <liburing/io_uring.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "io_uring.hpp"
+
+namespace couringserver {
+namespace {
+std::mutex io_trace_list_mutex;
+std::vector<const io_trace *> io_trace_list;
+
+void append_format(std::string &buffer, const char *format, const auto... argument_list)
+{
+	std::array<char, 256> format_buffer;
+	const int length = std::snprintf(format_buffer.data(), format_buffer.size(), format, argument_list...);
+	buffer.append(format_buffer.data(), std::min<size_t>(length, format_buffer.size() - 1));
+}
+} // namespace
+
+io_trace::io_trace() : thread_id_{gettid()}
+{
+	std::lock_guard lock(io_trace_list_mutex);
+	io_trace_list.emplace_back(this);
+}
+
+io_trace::~io_trace()
+{
+	std::lock_guard lock(io_trace_list_mutex);
+	std::erase(io_trace_list, this);
+}
+
+uint64_t io_trace::now() noexcept
+{
+	timespec timespec;
+	clock_gettime(CLOCK_MONOTONIC, &timespec);
+	return static_cast<uint64_t>(timespec.tv_sec) * 1000000000 + timespec.tv_nsec;
+}
+
+void io_trace::record_submit(const uint8_t opcode, const int raw_file_descriptor, const uint64_t user_data) noexcept
+{
+	record(event_type::submit, opcode, 0, now(), user_data, raw_file_descriptor);
+}
+
+void io_trace::record_completion(const uint64_t user_data, const int result, const uint32_t flags) noexcept
+{
+	record(event_type::completion, 0, flags, now(), user_data, result);
+}
+
+void io_trace::record_enter(const uint64_t start, const int submitted_count) noexcept
+{
+	record(event_type::enter, 0, submitted_count, start, 0, now() - start);
+}
+
+void io_trace::record_resume(const void *coroutine_address, const uint64_t start) noexcept
+{
+	record(event_type::resume, 0, 0, start, reinterpret_cast<uintptr_t>(coroutine_address), now() - start);
+}
+
+// Like a seqlock, the started count is published before the event is
+// written and the recorded count after it, so that a reader can tell which
+// of the events it copied may have been overwritten meanwhile.
+void io_trace::record(
+	const event_type event_type, const uint8_t opcode, const uint32_t flags, const uint64_t time,
+	const uint64_t user_data, const int64_t value) noexcept
+{
+	const uint64_t index = recorded_count_.load(std::memory_order_relaxed);
+	started_count_.store(index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	event &event = event_list_[index & (IO_TRACE_EVENT_COUNT - 1)];
+	event.time.store(time, std::memory_order_relaxed);
+	event.user_data.store(user_data, std::memory_order_relaxed);
+	event.kind.store(
+		static_cast<uint64_t>(event_type) | static_cast<uint64_t>(opcode) << 8 | static_cast<uint64_t>(flags) << 32,
+		std::memory_order_relaxed);
+	event.value.store(value, std::memory_order_relaxed);
+
+	recorded_count_.store(index + 1, std::memory_order_release);
+}
+
+void io_trace::append_chrome_trace(std::string &buffer, bool &first) const
+{
+	struct event_copy
+	{
+		uint64_t time;
+		uint64_t user_data;
+		uint64_t kind;
+		int64_t value;
+	};
+
+	const uint64_t recorded_count = recorded_count_.load(std::memory_order_acquire);
+	const uint64_t begin = recorded_count - std::min<uint64_t>(recorded_count, IO_TRACE_EVENT_COUNT);
+	std::vector<event_copy> event_copy_list;
+	event_copy_list.reserve(recorded_count - begin);
+	for (uint64_t index = begin; index < recorded_count; ++index)
+	{
+		const event &event = event_list_[index & (IO_TRACE_EVENT_COUNT - 1)];
+		event_copy_list.emplace_back(
+			event.time.load(std::memory_order_relaxed), event.user_data.load(std::memory_order_relaxed),
+			event.kind.load(std::memory_order_relaxed), event.value.load(std::memory_order_relaxed));
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+	const uint64_t started_count = started_count_.load(std::memory_order_relaxed);
+	const uint64_t valid_begin = started_count - std::min<uint64_t>(started_count, IO_TRACE_EVENT_COUNT);
+
+	const pid_t process_id = getpid();
+	// A CQE is named after the opcode of its SQE, if the SQE is still in the ring.
+	std::unordered_map<uint64_t, std::string_view> opcode_name_map;
+	for (uint64_t index = std::max(begin, valid_begin); index < recorded_count; ++index)
+	{
+		const event_copy &event_copy = event_copy_list[index - begin];
+		const auto event_type = static_cast<io_trace::event_type>(event_copy.kind & 0xff);
+		const auto opcode = static_cast<uint8_t>(event_copy.kind >> 8);
+		const auto flags = static_cast<uint32_t>(event_copy.kind >> 32);
+		const double timestamp = static_cast<double>(event_copy.time) / 1000;
+
+		buffer.append(std::exchange(first, false) ? "\n" : ",\n");
+		switch (event_type)
+		{
+		case event_type::submit:
+		{
+			const std::string_view opcode_name = get_opcode_name(opcode);
+			opcode_name_map[event_copy.user_data] = opcode_name;
+			append_format(
+				buffer,
+				R"({"name":"%.*s","cat":"io","ph":"b","id":"0x%lx","ts":%.3f,"pid":%d,"tid":%d,"args":{"fd":%ld}})",
+				static_cast<int>(opcode_name.size()), opcode_name.data(), event_copy.user_data, timestamp,
+				process_id, thread_id_, event_copy.value);
+			break;
+		}
+		case event_type::completion:
+		{
+			const auto opcode_name_iterator = opcode_name_map.find(event_copy.user_data);
+			const std::string_view opcode_name =
+				opcode_name_iterator == opcode_name_map.end() ? "cqe" : opcode_name_iterator->second;
+			// A multishot request keeps going while 'IORING_CQE_F_MORE' is set.
+			append_format(
+				buffer,
+				R"({"name":"%.*s","cat":"io","ph":"%s","id":"0x%lx","ts":%.3f,"pid":%d,"tid":%d,"args":{"res":%ld,"flags":%u}})",
+				static_cast<int>(opcode_name.size()), opcode_name.data(), (flags & IORING_CQE_F_MORE) != 0 ? "n" : "e",
+				event_copy.user_data, timestamp, process_id, thread_id_, event_copy.value, flags);
+			break;
+		}
+		case event_type::enter:
+			append_format(
+				buffer,
+				R"({"name":"io_uring_enter","cat":"io","ph":"X","ts":%.3f,"dur":%.3f,"pid":%d,"tid":%d,"args":{"submitted":%u}})",
+				timestamp, static_cast<double>(event_copy.value) / 1000, process_id, thread_id_, flags);
+			break;
+		case event_type::resume:
+			append_format(
+				buffer,
+				R"({"name":"resume","cat":"coroutine","ph":"X","ts":%.3f,"dur":%.3f,"pid":%d,"tid":%d,"args":{"coroutine":"0x%lx"}})",
+				timestamp, static_cast<double>(event_copy.value) / 1000, process_id, thread_id_,
+				event_copy.user_data);
+			break;
+		}
+	}
+}
+
+std::string io_trace::serialize_all()
+{
+	std::string buffer = R"({"displayTimeUnit":"ns","traceEvents":[)";
+	bool first = true;
+	{
+		std::lock_guard lock(io_trace_list_mutex);
+		for (const io_trace *const io_trace : io_trace_list)
+		{
+			io_trace->append_chrome_trace(buffer, first);
+		}
+	}
+	buffer.append("\n]}\n");
+	return buffer;
+}
+
+bool io_trace::dump_all(const std::filesystem::path &path)
+{
+	std::ofstream file_stream(path, std::ios::trunc);
+	file_stream << serialize_all();
+	return file_stream.good();
+}
+} // namespace couringserver
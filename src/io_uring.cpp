@@ -2,20 +2,134 @@
 
 #include <liburing.h>
 #include <liburing/barrier.h>
+#include <fcntl.h>
 #include <liburing/io_uring.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
 #include <sys/types.h>
+#include <unistd.h>
 
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
 #include <stdexcept>
 
 #include "constant.hpp"
 
 namespace couringserver {
+namespace {
+// the queue size of the rings that probe the kernel
+constexpr unsigned int PROBE_QUEUE_SIZE = 8;
+
+unsigned int configured_queue_size = IO_URING_QUEUE_SIZE;
+io_uring_features configured_features;
+
+// The setup flags of the selected features. 'IORING_SETUP_TASKRUN_FLAG' tells
+// the event loop that it has to enter the kernel for pending completions.
+unsigned int get_setup_flags(const io_uring_features &io_uring_features)
+{
+	if (io_uring_features.defer_taskrun)
+	{
+		return IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_TASKRUN_FLAG;
+	}
+	if (io_uring_features.coop_taskrun)
+	{
+		return IORING_SETUP_COOP_TASKRUN | IORING_SETUP_TASKRUN_FLAG;
+	}
+	return 0;
+}
+
+bool try_setup(const unsigned int flags)
+{
+	::io_uring io_uring;
+	io_uring_params io_uring_params{};
+	io_uring_params.flags = flags;
+	if (io_uring_queue_init_params(PROBE_QUEUE_SIZE, &io_uring, &io_uring_params) != 0)
+	{
+		return false;
+	}
+	io_uring_queue_exit(&io_uring);
+	return true;
+}
+
+// Socket commands came in 6.7, years after 'IORING_OP_URING_CMD' itself, so
+// the probe sets an option of a socket through the ring.
+bool try_socket_command(::io_uring &io_uring)
+{
+	const int raw_file_descriptor = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (raw_file_descriptor == -1)
+	{
+		return false;
+	}
+	int no_delay = 1;
+	io_uring_sqe *sqe = io_uring_get_sqe(&io_uring);
+	io_uring_prep_cmd_sock(
+		sqe, SOCKET_URING_OP_SETSOCKOPT, raw_file_descriptor, IPPROTO_TCP, TCP_NODELAY, &no_delay,
+		sizeof(no_delay));
+	io_uring_cqe *cqe = nullptr;
+	const bool supported =
+		io_uring_submit(&io_uring) == 1 && io_uring_wait_cqe(&io_uring, &cqe) == 0 && cqe->res == 0;
+	if (cqe != nullptr)
+	{
+		io_uring_cqe_seen(&io_uring, cqe);
+	}
+	close(raw_file_descriptor);
+	return supported;
+}
+
+// Multishot receive came in 6.0 as a flag of 'IORING_OP_RECV', so the probe
+// receives a byte from a socket pair with the registered buffer ring and
+// checks that the request stays armed.
+bool try_multishot_recv(::io_uring &io_uring, io_uring_buf_ring *buffer_ring)
+{
+	std::array<int, 2> socket_pair;
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, socket_pair.data()) == -1)
+	{
+		return false;
+	}
+	char buffer = 0;
+	io_uring_buf_ring_init(buffer_ring);
+	io_uring_buf_ring_add(buffer_ring, &buffer, sizeof(buffer), 0, io_uring_buf_ring_mask(1), 0);
+	io_uring_buf_ring_advance(buffer_ring, 1);
+
+	io_uring_sqe *sqe = io_uring_get_sqe(&io_uring);
+	io_uring_prep_recv_multishot(sqe, socket_pair[0], nullptr, 0, 0);
+	io_uring_sqe_set_flags(sqe, IOSQE_BUFFER_SELECT);
+	sqe->buf_group = BUFFER_GROUP_ID;
+	io_uring_cqe *cqe = nullptr;
+	bool supported = false;
+	if (io_uring_submit(&io_uring) == 1 && write(socket_pair[1], &buffer, sizeof(buffer)) == sizeof(buffer) &&
+		io_uring_wait_cqe(&io_uring, &cqe) == 0)
+	{
+		supported = cqe->res == sizeof(buffer) && (cqe->flags & IORING_CQE_F_MORE) != 0;
+		io_uring_cqe_seen(&io_uring, cqe);
+	}
+	// The armed request ends once the peer is closed.
+	close(socket_pair[1]);
+	if (supported && io_uring_wait_cqe(&io_uring, &cqe) == 0)
+	{
+		io_uring_cqe_seen(&io_uring, cqe);
+	}
+	close(socket_pair[0]);
+	return supported;
+}
+} // namespace
+
 io_uring::io_uring()
 {
-	if (const int result = io_uring_queue_init(IO_URING_QUEUE_SIZE, &io_uring_, 0); result != 0)
+	io_uring_params io_uring_params{};
+	io_uring_params.flags = get_setup_flags(configured_features);
+	if (const int result = io_uring_queue_init_params(configured_queue_size, &io_uring_, &io_uring_params);
+		result != 0)
 	{
 		throw std::runtime_error("failed to invoke 'io_uring_queue_init'");
 	}
+	if constexpr (IO_TRACE)
+	{
+		io_trace_ = std::make_unique<io_trace>();
+	}
 }
 
 io_uring::~io_uring() { io_uring_queue_exit(&io_uring_); }
@@ -26,6 +140,62 @@ io_uring &io_uring::get_instance() noexcept
 	return instance;
 }
 
+io_uring_features io_uring::probe()
+{
+	io_uring_features io_uring_features;
+	io_uring_features.defer_taskrun = try_setup(get_setup_flags({.defer_taskrun = true}));
+	io_uring_features.coop_taskrun = try_setup(get_setup_flags({.coop_taskrun = true}));
+
+	::io_uring io_uring;
+	if (io_uring_queue_init(PROBE_QUEUE_SIZE, &io_uring, 0) != 0)
+	{
+		throw std::runtime_error("failed to invoke 'io_uring_queue_init'");
+	}
+
+	// Multishot accept came with buffer rings in 5.19, it has no flag of its
+	// own.
+	const size_t page_size = sysconf(_SC_PAGESIZE);
+	const std::unique_ptr<void, decltype(&std::free)> buffer_ring(std::aligned_alloc(page_size, page_size), &std::free);
+	io_uring_buf_reg io_uring_buf_reg{};
+	io_uring_buf_reg.ring_addr = reinterpret_cast<__uint64_t>(buffer_ring.get());
+	io_uring_buf_reg.ring_entries = 1;
+	io_uring_buf_reg.bgid = BUFFER_GROUP_ID;
+	io_uring_features.buffer_ring = io_uring_register_buf_ring(&io_uring, &io_uring_buf_reg, 0) == 0;
+	if (io_uring_features.buffer_ring)
+	{
+		io_uring_features.multishot_recv =
+			try_multishot_recv(io_uring, reinterpret_cast<io_uring_buf_ring *>(buffer_ring.get()));
+		io_uring_unregister_buf_ring(&io_uring, BUFFER_GROUP_ID);
+	}
+	io_uring_features.multishot_accept = io_uring_features.buffer_ring;
+
+	io_uring_features.socket_command = try_socket_command(io_uring);
+	if (io_uring_probe *io_uring_probe = io_uring_get_probe_ring(&io_uring); io_uring_probe != nullptr)
+	{
+		io_uring_features.send_zc = io_uring_opcode_supported(io_uring_probe, IORING_OP_SEND_ZC);
+		io_uring_free_probe(io_uring_probe);
+	}
+#if defined(IO_URING_VERSION_MAJOR) && \
+	(IO_URING_VERSION_MAJOR > 2 || (IO_URING_VERSION_MAJOR == 2 && IO_URING_VERSION_MINOR >= 6))
+	io_uring_napi napi{};
+	io_uring_features.napi = io_uring_register_napi(&io_uring, &napi) == 0;
+	if (io_uring_features.napi)
+	{
+		io_uring_unregister_napi(&io_uring, &napi);
+	}
+#endif
+	io_uring_queue_exit(&io_uring);
+	return io_uring_features;
+}
+
+void io_uring::configure(const unsigned int queue_size, const io_uring_features &io_uring_features)
+{
+	configured_queue_size = queue_size;
+	configured_features = io_uring_features;
+}
+
+const io_uring_features &io_uring::get_features() noexcept { return configured_features; }
+
 io_uring::cqe_iterator::cqe_iterator(const ::io_uring *io_uring, const unsigned int head)
 	: io_uring_{io_uring}, head_{head} {}
 
@@ -54,66 +224,407 @@ io_uring::cqe_iterator io_uring::end()
 
 void io_uring::cqe_seen(io_uring_cqe *const cqe) { io_uring_cqe_seen(&io_uring_, cqe); }
 
+namespace {
+void add_relaxed(std::atomic<uint64_t> &counter, const uint64_t value)
+{
+	counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+void max_relaxed(std::atomic<uint64_t> &counter, const uint64_t value)
+{
+	if (value > counter.load(std::memory_order_relaxed))
+	{
+		counter.store(value, std::memory_order_relaxed);
+	}
+}
+
+void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	asm volatile("yield");
+#endif
+}
+} // namespace
+
 int io_uring::submit_and_wait(const int wait_nr)
 {
+	max_relaxed(ring_statistics_.max_sq_ready_count, io_uring_sq_ready(&io_uring_));
+	uint64_t enter_start = 0;
+	if constexpr (IO_TRACE)
+	{
+		enter_start = io_trace::now();
+	}
 	const int result = io_uring_submit_and_wait(&io_uring_, wait_nr);
 	if (result < 0)
 	{
 		throw std::runtime_error("failed to invoke 'io_uring_submit_and_wait'");
 	}
+	if constexpr (IO_TRACE)
+	{
+		io_trace_->record_enter(enter_start, result);
+	}
+	max_relaxed(ring_statistics_.max_cq_ready_count, io_uring_cq_ready(&io_uring_));
+	ring_statistics_.cq_overflow_count.store(
+		io_uring_smp_load_acquire(io_uring_.cq.koverflow), std::memory_order_relaxed);
 	return result;
 }
 
-void io_uring::submit_multishot_accept_request(
-	sqe_data *sqe_data, const int raw_file_descriptor, sockaddr *client_addr, socklen_t *client_len)
+void io_uring::record_completion(const io_uring_cqe *cqe) noexcept
+{
+	if constexpr (IO_TRACE)
+	{
+		io_trace_->record_completion(cqe->user_data, cqe->res, cqe->flags);
+	}
+	add_relaxed(ring_statistics_.completed_count, 1);
+
+	// A multishot request stays in flight while 'IORING_CQE_F_MORE' is set.
+	const auto *sqe_data = reinterpret_cast<const struct sqe_data *>(io_uring_cqe_get_data(cqe));
+	if (sqe_data == nullptr || (cqe->flags & IORING_CQE_F_MORE) != 0 || sqe_data->opcode >= IORING_OP_LAST)
+	{
+		return;
+	}
+	std::atomic<uint64_t> &inflight_count = ring_statistics_.inflight_count_list[sqe_data->opcode];
+	inflight_count.store(inflight_count.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+	if (sqe_data->submit_time != 0)
+	{
+		ring_statistics_.latency_list[sqe_data->opcode].record(
+			std::chrono::nanoseconds{io_trace::now() - sqe_data->submit_time});
+	}
+}
+
+void io_uring::wait_for_completion(const std::chrono::nanoseconds spin_budget)
+{
+	if (spin_budget.count() == 0)
+	{
+		submit_and_wait(1);
+		return;
+	}
+
+	// With deferred or cooperative task work, the completions are posted
+	// once the worker enters the kernel, which it is told by a flag.
+	const auto has_task_work = [this]()
+	{ return (io_uring_smp_load_acquire(io_uring_.sq.kflags) & IORING_SQ_TASKRUN) != 0; };
+	submit_and_wait(0);
+	const auto spin_start = std::chrono::steady_clock::now();
+	auto spin_stop = spin_start;
+	while (io_uring_cq_ready(&io_uring_) == 0 && !has_task_work() && spin_stop - spin_start < spin_budget)
+	{
+		cpu_relax();
+		spin_stop = std::chrono::steady_clock::now();
+	}
+	add_relaxed(
+		event_loop_statistics_.spin_nanoseconds,
+		std::chrono::duration_cast<std::chrono::nanoseconds>(spin_stop - spin_start).count());
+
+	if (io_uring_cq_ready(&io_uring_) == 0 && has_task_work())
+	{
+		submit_and_wait(0);
+	}
+	if (io_uring_cq_ready(&io_uring_) != 0)
+	{
+		add_relaxed(event_loop_statistics_.spin_count, 1);
+		return;
+	}
+
+	submit_and_wait(1);
+	add_relaxed(
+		event_loop_statistics_.sleep_nanoseconds,
+		std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - spin_stop)
+			.count());
+	add_relaxed(event_loop_statistics_.sleep_count, 1);
+}
+
+bool io_uring::register_napi(const std::chrono::microseconds busy_poll_timeout)
+{
+#if defined(IO_URING_VERSION_MAJOR) && \
+	(IO_URING_VERSION_MAJOR > 2 || (IO_URING_VERSION_MAJOR == 2 && IO_URING_VERSION_MINOR >= 6))
+	io_uring_napi napi{};
+	napi.busy_poll_to = busy_poll_timeout.count();
+	napi.prefer_busy_poll = 1;
+	return io_uring_register_napi(&io_uring_, &napi) == 0;
+#else
+	static_cast<void>(busy_poll_timeout);
+	return false;
+#endif
+}
+
+const event_loop_statistics &io_uring::get_event_loop_statistics() const noexcept
+{
+	return event_loop_statistics_;
+}
+
+const ring_statistics &io_uring::get_ring_statistics() const noexcept { return ring_statistics_; }
+
+io_trace &io_uring::get_trace() noexcept { return *io_trace_; }
+
+io_uring_sqe *io_uring::get_sqe()
 {
 	io_uring_sqe *sqe = io_uring_get_sqe(&io_uring_);
-	io_uring_prep_multishot_accept(sqe, raw_file_descriptor, client_addr, client_len, 0);
+	if (sqe != nullptr)
+	{
+		return sqe;
+	}
+
+	add_relaxed(ring_statistics_.sq_full_count, 1);
+	max_relaxed(ring_statistics_.max_sq_ready_count, io_uring_sq_ready(&io_uring_));
+	if (io_uring_submit(&io_uring_) < 0 || (sqe = io_uring_get_sqe(&io_uring_)) == nullptr)
+	{
+		throw std::runtime_error("failed to invoke 'io_uring_get_sqe'");
+	}
+	return sqe;
+}
+
+void io_uring::record_submit(const io_uring_sqe *sqe) noexcept
+{
+	if constexpr (IO_TRACE)
+	{
+		io_trace_->record_submit(sqe->opcode, sqe->fd, sqe->user_data);
+	}
+	add_relaxed(ring_statistics_.submitted_count, 1);
+	if (sqe->opcode >= IORING_OP_LAST)
+	{
+		return;
+	}
+	// Each opcode is sampled on its own, as the submissions of a connection
+	// follow a fixed pattern that a shared count would alias with.
+	std::atomic<uint64_t> &submitted_count = ring_statistics_.submitted_count_list[sqe->opcode];
+	const uint64_t sample_index = submitted_count.load(std::memory_order_relaxed);
+	submitted_count.store(sample_index + 1, std::memory_order_relaxed);
+
+	auto *sqe_data = reinterpret_cast<struct sqe_data *>(sqe->user_data);
+	if (sqe_data == nullptr)
+	{
+		return;
+	}
+	sqe_data->opcode = sqe->opcode;
+	sqe_data->submit_time = sample_index % IO_LATENCY_SAMPLE_INTERVAL == 0 ? io_trace::now() : 0;
+	add_relaxed(ring_statistics_.inflight_count_list[sqe->opcode], 1);
+}
+
+std::string_view get_opcode_name(const uint8_t opcode)
+{
+	switch (opcode)
+	{
+	case IORING_OP_ACCEPT:
+		return "accept";
+	case IORING_OP_CONNECT:
+		return "connect";
+	case IORING_OP_RECV:
+		return "recv";
+	case IORING_OP_SEND:
+		return "send";
+	case IORING_OP_SEND_ZC:
+		return "send_zc";
+	case IORING_OP_READ:
+		return "read";
+	case IORING_OP_WRITE:
+		return "write";
+	case IORING_OP_OPENAT:
+		return "openat";
+	case IORING_OP_SPLICE:
+		return "splice";
+	case IORING_OP_POLL_ADD:
+		return "poll_add";
+	case IORING_OP_TIMEOUT:
+		return "timeout";
+	case IORING_OP_ASYNC_CANCEL:
+		return "async_cancel";
+	case IORING_OP_PROVIDE_BUFFERS:
+		return "provide_buffers";
+	case IORING_OP_URING_CMD:
+		return "uring_cmd";
+	case IORING_OP_FADVISE:
+		return "fadvise";
+	default:
+		return "sqe";
+	}
+}
+
+void io_uring::submit_accept_request(
+	sqe_data *sqe_data, const int raw_file_descriptor, sockaddr *client_addr, socklen_t *client_len)
+{
+	io_uring_sqe *sqe = get_sqe();
+	if (configured_features.multishot_accept)
+	{
+		io_uring_prep_multishot_accept(sqe, raw_file_descriptor, client_addr, client_len, 0);
+	}
+	else
+	{
+		io_uring_prep_accept(sqe, raw_file_descriptor, client_addr, client_len, 0);
+	}
+	io_uring_sqe_set_data(sqe, sqe_data);
+	record_submit(sqe);
+}
+
+void io_uring::submit_connect_request(
+	sqe_data *sqe_data, const int raw_file_descriptor, const sockaddr *address,
+	const socklen_t address_size)
+{
+	io_uring_sqe *sqe = get_sqe();
+	io_uring_prep_connect(sqe, raw_file_descriptor, address, address_size);
 	io_uring_sqe_set_data(sqe, sqe_data);
+	record_submit(sqe);
 }
 
 void io_uring::submit_recv_request(
 	sqe_data *sqe_data, const int raw_file_descriptor, const size_t length)
 {
-	io_uring_sqe *sqe = io_uring_get_sqe(&io_uring_);
+	io_uring_sqe *sqe = get_sqe();
 	io_uring_prep_recv(sqe, raw_file_descriptor, nullptr, length, 0);
 	io_uring_sqe_set_flags(sqe, IOSQE_BUFFER_SELECT);
 	io_uring_sqe_set_data(sqe, sqe_data);
+	record_submit(sqe);
 	sqe->buf_group = BUFFER_GROUP_ID;
 }
 
+void io_uring::submit_multishot_recv_request(sqe_data *sqe_data, const int raw_file_descriptor, const size_t length)
+{
+	io_uring_sqe *sqe = get_sqe();
+	if (configured_features.multishot_recv)
+	{
+		// The buffers of the ring bound each packet, the length must be 0.
+		io_uring_prep_recv_multishot(sqe, raw_file_descriptor, nullptr, 0, 0);
+	}
+	else
+	{
+		io_uring_prep_recv(sqe, raw_file_descriptor, nullptr, length, 0);
+	}
+	io_uring_sqe_set_flags(sqe, IOSQE_BUFFER_SELECT);
+	io_uring_sqe_set_data(sqe, sqe_data);
+	record_submit(sqe);
+	sqe->buf_group = BUFFER_GROUP_ID;
+}
+
+void io_uring::submit_read_request(
+	sqe_data *sqe_data, const int raw_file_descriptor, std::span<char> buffer, const uint64_t offset)
+{
+	io_uring_sqe *sqe = get_sqe();
+	io_uring_prep_read(sqe, raw_file_descriptor, buffer.data(), buffer.size(), offset);
+	io_uring_sqe_set_data(sqe, sqe_data);
+	record_submit(sqe);
+}
+
+void io_uring::submit_send_zc_request(
+	sqe_data *sqe_data, const int raw_file_descriptor, const std::span<char> &buffer, const size_t length)
+{
+	io_uring_sqe *sqe = get_sqe();
+	io_uring_prep_send_zc(sqe, raw_file_descriptor, buffer.data(), length, 0, 0);
+	io_uring_sqe_set_data(sqe, sqe_data);
+	record_submit(sqe);
+}
+
 void io_uring::submit_send_request(
 	sqe_data *sqe_data, const int raw_file_descriptor, const std::span<char> &buffer,
 	const size_t length)
 {
-	io_uring_sqe *sqe = io_uring_get_sqe(&io_uring_);
+	io_uring_sqe *sqe = get_sqe();
 	io_uring_prep_send(sqe, raw_file_descriptor, buffer.data(), length, 0);
 	io_uring_sqe_set_data(sqe, sqe_data);
+	record_submit(sqe);
+}
+
+void io_uring::submit_write_request(
+	sqe_data *sqe_data, const int raw_file_descriptor, const std::span<const char> buffer,
+	const uint64_t offset)
+{
+	io_uring_sqe *sqe = get_sqe();
+	io_uring_prep_write(sqe, raw_file_descriptor, buffer.data(), buffer.size(), offset);
+	io_uring_sqe_set_data(sqe, sqe_data);
+	record_submit(sqe);
+}
+
+void io_uring::submit_openat_request(
+	sqe_data *sqe_data, const char *path, const int flags, const mode_t mode)
+{
+	io_uring_sqe *sqe = get_sqe();
+	io_uring_prep_openat(sqe, AT_FDCWD, path, flags, mode);
+	io_uring_sqe_set_data(sqe, sqe_data);
+	record_submit(sqe);
 }
 
 void io_uring::submit_splice_request(
-	sqe_data *sqe_data, int raw_file_descriptor_in, int raw_file_descriptor_out, size_t length)
+	sqe_data *sqe_data, const int raw_file_descriptor_in, const int64_t offset_in,
+	const int raw_file_descriptor_out, const size_t length)
 {
-	io_uring_sqe *sqe = io_uring_get_sqe(&io_uring_);
-	io_uring_prep_splice(sqe, raw_file_descriptor_in, -1, raw_file_descriptor_out, -1, length, 0);
+	io_uring_sqe *sqe = get_sqe();
+	io_uring_prep_splice(
+		sqe, raw_file_descriptor_in, offset_in, raw_file_descriptor_out, -1, length, 0);
 	io_uring_sqe_set_data(sqe, sqe_data);
+	record_submit(sqe);
 }
 
-void io_uring::submit_cancel_request(sqe_data *sqe_data)
+void io_uring::submit_poll_request(
+	sqe_data *sqe_data, const int raw_file_descriptor, const unsigned int poll_mask)
 {
-	io_uring_sqe *sqe = io_uring_get_sqe(&io_uring_);
-	io_uring_prep_cancel(sqe, sqe_data, 0);
+	io_uring_sqe *sqe = get_sqe();
+	io_uring_prep_poll_add(sqe, raw_file_descriptor, poll_mask);
+	io_uring_sqe_set_data(sqe, sqe_data);
+	record_submit(sqe);
+}
+
+void io_uring::submit_timeout_request(sqe_data *sqe_data, __kernel_timespec *timespec)
+{
+	io_uring_sqe *sqe = get_sqe();
+	io_uring_prep_timeout(sqe, timespec, 0, 0);
+	io_uring_sqe_set_data(sqe, sqe_data);
+	record_submit(sqe);
+}
+
+void io_uring::submit_fadvise_request(
+	sqe_data *sqe_data, const int raw_file_descriptor, const uint64_t offset, const uint32_t length,
+	const int advice)
+{
+	io_uring_sqe *sqe = get_sqe();
+	io_uring_prep_fadvise(sqe, raw_file_descriptor, offset, length, advice);
+	io_uring_sqe_set_data(sqe, sqe_data);
+	record_submit(sqe);
+}
+
+void io_uring::submit_setsockopt_request(
+	const int raw_file_descriptor, const int level, const int option_name, const int *option_value)
+{
+	if (!configured_features.socket_command)
+	{
+		setsockopt(raw_file_descriptor, level, option_name, option_value, sizeof(*option_value));
+		return;
+	}
+
+	io_uring_sqe *sqe = get_sqe();
+	io_uring_prep_cmd_sock(
+		sqe, SOCKET_URING_OP_SETSOCKOPT, raw_file_descriptor, level, option_name,
+		const_cast<int *>(option_value), sizeof(*option_value));
+	io_uring_sqe_set_data(sqe, nullptr);
+	record_submit(sqe);
+}
+
+void io_uring::submit_cancel_request(sqe_data *sqe_data, const struct sqe_data *target_sqe_data)
+{
+	io_uring_sqe *sqe = get_sqe();
+	io_uring_prep_cancel(sqe, const_cast<struct sqe_data *>(target_sqe_data), 0);
+	io_uring_sqe_set_data(sqe, sqe_data);
+	record_submit(sqe);
 }
 
 void io_uring::setup_buffer_ring(
 	io_uring_buf_ring *buffer_ring, std::span<std::vector<char>> buffer_list,
 	const unsigned int buffer_ring_size)
 {
-	io_uring_buf_reg io_uring_buf_reg{
-		.ring_addr = reinterpret_cast<__uint64_t>(buffer_ring),
-		.ring_entries = buffer_ring_size,
-		.bgid = BUFFER_GROUP_ID,
-	};
+	if (!configured_features.buffer_ring)
+	{
+		for (unsigned int buffer_id = 0; buffer_id < buffer_ring_size; ++buffer_id)
+		{
+			provide_buffer(buffer_list[buffer_id], buffer_id);
+		}
+		return;
+	}
+
+	io_uring_buf_reg io_uring_buf_reg{};
+	io_uring_buf_reg.ring_addr = reinterpret_cast<__uint64_t>(buffer_ring);
+	io_uring_buf_reg.ring_entries = buffer_ring_size;
+	io_uring_buf_reg.bgid = BUFFER_GROUP_ID;
 
 	const int result = io_uring_register_buf_ring(&io_uring_, &io_uring_buf_reg, 0);
 	if (result != 0)
@@ -136,8 +647,26 @@ void io_uring::add_buffer(
 	io_uring_buf_ring *buffer_ring, std::span<char> buffer, const unsigned int buffer_id,
 	const unsigned int buffer_ring_size)
 {
+	if (!configured_features.buffer_ring)
+	{
+		provide_buffer(buffer, buffer_id);
+		return;
+	}
+
+	// Buffers come back in any order, so the buffer always goes to the slot
+	// at the tail, the kernel finds its id in the entry.
 	const unsigned int mask = io_uring_buf_ring_mask(buffer_ring_size);
-	io_uring_buf_ring_add(buffer_ring, buffer.data(), buffer.size(), buffer_id, mask, buffer_id);
+	io_uring_buf_ring_add(buffer_ring, buffer.data(), buffer.size(), buffer_id, mask, 0);
 	io_uring_buf_ring_advance(buffer_ring, 1);
 }
+
+// The completion of the request is ignored, a failure surfaces as '-ENOBUFS'
+// on a later receive.
+void io_uring::provide_buffer(const std::span<char> buffer, const unsigned int buffer_id)
+{
+	io_uring_sqe *sqe = get_sqe();
+	io_uring_prep_provide_buffers(sqe, buffer.data(), buffer.size(), 1, BUFFER_GROUP_ID, buffer_id);
+	io_uring_sqe_set_data(sqe, nullptr);
+	record_submit(sqe);
+}
 } // namespace couringserver
@@ -0,0 +1,219 @@
+#include "listener_handoff.hpp"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+
+#include "constant.hpp"
+
+namespace couringserver {
+namespace {
+sockaddr_un make_unix_address(const char *path)
+{
+	sockaddr_un address;
+	std::memset(&address, 0, sizeof(sockaddr_un));
+	address.sun_family = AF_UNIX;
+	if (std::strlen(path) >= sizeof(address.sun_path))
+	{
+		throw std::runtime_error("the handoff socket path is too long");
+	}
+	std::strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+	return address;
+}
+
+// Create the directory of the socket unless it exists. It must belong to this
+// user and be closed to everyone else, so that no other user can connect to
+// the socket or replace it. A path without a directory is refused, as the
+// working directory is hardly ever private.
+void make_private_directory(const char *path)
+{
+	const std::filesystem::path directory = std::filesystem::path(path).parent_path();
+	if (directory.empty())
+	{
+		throw std::runtime_error("the handoff socket path has no directory");
+	}
+	if (::mkdir(directory.c_str(), 0700) == -1 && errno != EEXIST)
+	{
+		throw std::runtime_error("failed to invoke 'mkdir'");
+	}
+
+	struct stat directory_status;
+	if (::lstat(directory.c_str(), &directory_status) == -1)
+	{
+		throw std::runtime_error("failed to invoke 'lstat'");
+	}
+	if (!S_ISDIR(directory_status.st_mode) || directory_status.st_uid != ::geteuid() ||
+		(directory_status.st_mode & (S_IRWXG | S_IRWXO)) != 0)
+	{
+		throw std::runtime_error("the handoff socket directory is not private: " + directory.string());
+	}
+}
+
+// Wait for a successor and return its connection, which is invalid if the
+// handoff socket was closed. Connections of other users are refused.
+file_descriptor accept_successor(const int raw_unix_socket)
+{
+	while (true)
+	{
+		file_descriptor successor{::accept4(raw_unix_socket, nullptr, nullptr, SOCK_CLOEXEC)};
+		if (successor.get_raw_file_descriptor() == -1)
+		{
+			return successor;
+		}
+
+		ucred peer_credentials;
+		socklen_t peer_credentials_size = sizeof(ucred);
+		if (::getsockopt(
+				successor.get_raw_file_descriptor(), SOL_SOCKET, SO_PEERCRED, &peer_credentials,
+				&peer_credentials_size) == 0 &&
+			peer_credentials.uid == ::geteuid())
+		{
+			return successor;
+		}
+	}
+}
+
+// Send a batch of file descriptors. The payload holds the number of file
+// descriptors in the batch, and an empty batch marks the end of the handoff.
+void send_batch(const int raw_unix_socket, std::span<const int> raw_file_descriptor_list)
+{
+	std::uint32_t count = raw_file_descriptor_list.size();
+	iovec payload{.iov_base = &count, .iov_len = sizeof(count)};
+
+	alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_HANDOFF_BATCH_SIZE)];
+	msghdr message;
+	std::memset(&message, 0, sizeof(msghdr));
+	message.msg_iov = &payload;
+	message.msg_iovlen = 1;
+
+	if (count != 0)
+	{
+		message.msg_control = control;
+		message.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+		cmsghdr *header = CMSG_FIRSTHDR(&message);
+		header->cmsg_level = SOL_SOCKET;
+		header->cmsg_type = SCM_RIGHTS;
+		header->cmsg_len = CMSG_LEN(sizeof(int) * count);
+		std::memcpy(CMSG_DATA(header), raw_file_descriptor_list.data(), sizeof(int) * count);
+	}
+
+	if (sendmsg(raw_unix_socket, &message, MSG_NOSIGNAL) == -1)
+	{
+		throw std::runtime_error("failed to invoke 'sendmsg'");
+	}
+}
+
+// Receive a batch of file descriptors, return false on the end marker.
+bool receive_batch(const int raw_unix_socket, std::vector<server_socket> &server_socket_list)
+{
+	std::uint32_t count = 0;
+	iovec payload{.iov_base = &count, .iov_len = sizeof(count)};
+
+	alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_HANDOFF_BATCH_SIZE)];
+	msghdr message;
+	std::memset(&message, 0, sizeof(msghdr));
+	message.msg_iov = &payload;
+	message.msg_iovlen = 1;
+	message.msg_control = control;
+	message.msg_controllen = sizeof(control);
+
+	if (recvmsg(raw_unix_socket, &message, MSG_CMSG_CLOEXEC) != sizeof(count))
+	{
+		throw std::runtime_error("failed to invoke 'recvmsg'");
+	}
+
+	for (cmsghdr *header = CMSG_FIRSTHDR(&message); header != nullptr;
+		 header = CMSG_NXTHDR(&message, header))
+	{
+		if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+		{
+			continue;
+		}
+		const size_t received = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for (size_t index = 0; index < received; ++index)
+		{
+			int raw_file_descriptor;
+			std::memcpy(&raw_file_descriptor, CMSG_DATA(header) + index * sizeof(int), sizeof(int));
+			server_socket_list.emplace_back(raw_file_descriptor);
+		}
+	}
+	return count != 0;
+}
+} // namespace
+
+listener_handoff::listener_handoff(const char *path)
+	: unix_socket_{socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)}
+{
+	if (unix_socket_.get_raw_file_descriptor() == -1)
+	{
+		throw std::runtime_error("failed to invoke 'socket'");
+	}
+
+	const sockaddr_un address = make_unix_address(path);
+	make_private_directory(path);
+	unlink(path);
+	if (::bind(
+			unix_socket_.get_raw_file_descriptor(), reinterpret_cast<const sockaddr *>(&address),
+			sizeof(sockaddr_un)) == -1)
+	{
+		throw std::runtime_error("failed to invoke 'bind'");
+	}
+
+	if (::listen(unix_socket_.get_raw_file_descriptor(), 1) == -1)
+	{
+		throw std::runtime_error("failed to invoke 'listen'");
+	}
+}
+
+bool listener_handoff::serve(std::span<const int> raw_file_descriptor_list)
+{
+	const file_descriptor successor = accept_successor(unix_socket_.get_raw_file_descriptor());
+	if (successor.get_raw_file_descriptor() == -1)
+	{
+		return false;
+	}
+
+	while (!raw_file_descriptor_list.empty())
+	{
+		const size_t batch_size = std::min<size_t>(raw_file_descriptor_list.size(), MAX_HANDOFF_BATCH_SIZE);
+		send_batch(successor.get_raw_file_descriptor(), raw_file_descriptor_list.first(batch_size));
+		raw_file_descriptor_list = raw_file_descriptor_list.subspan(batch_size);
+	}
+	send_batch(successor.get_raw_file_descriptor(), {});
+	return true;
+}
+
+void listener_handoff::close() { ::shutdown(unix_socket_.get_raw_file_descriptor(), SHUT_RDWR); }
+
+std::vector<server_socket> listener_handoff::take_over(const char *path)
+{
+	const file_descriptor unix_socket{socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+	if (unix_socket.get_raw_file_descriptor() == -1)
+	{
+		throw std::runtime_error("failed to invoke 'socket'");
+	}
+
+	const sockaddr_un address = make_unix_address(path);
+	if (::connect(
+			unix_socket.get_raw_file_descriptor(), reinterpret_cast<const sockaddr *>(&address),
+			sizeof(sockaddr_un)) == -1)
+	{
+		throw std::runtime_error("failed to invoke 'connect'");
+	}
+
+	std::vector<server_socket> server_socket_list;
+	while (receive_batch(unix_socket.get_raw_file_descriptor(), server_socket_list))
+	{
+	}
+	return server_socket_list;
+}
+} // namespace couringserver
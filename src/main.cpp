@@ -1,6 +1,117 @@
+#include <pthread.h>
+#include <signal.h>
+#include <sys/resource.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+#include "constant.hpp"
 #include "http_server.hpp"
+#include "io_trace.hpp"
+#include "io_uring.hpp"
+#include "page_cache.hpp"
+#include "server_config.hpp"
+
+int main(int argc, char *argv[]) {
+  // The defaults of 'constant.hpp' are overridden by the configuration files
+  // and the command line.
+  couringserver::server_config server_config;
+  try {
+    if (!couringserver::parse_command_line(server_config, argc, argv)) {
+      std::fputs(couringserver::format_usage(server_config).c_str(), stdout);
+      return EXIT_SUCCESS;
+    }
+  } catch (const std::exception &exception) {
+    std::fprintf(stderr, "couringserver: %s\n", exception.what());
+    return EXIT_FAILURE;
+  }
+
+  // The rings of the workers use the fastest paths the kernel supports.
+  const couringserver::io_uring_features supported_features =
+      couringserver::io_uring::probe();
+  const couringserver::io_uring_features selected_features =
+      couringserver::select_features(server_config, supported_features);
+  couringserver::io_uring::configure(server_config.io_uring_queue_size,
+                                     selected_features);
+  std::fputs(couringserver::format_feature_report(supported_features,
+                                                  selected_features)
+                 .c_str(),
+             stderr);
+
+  // Every connection holds a file descriptor, so the soft limit is raised to
+  // the hard one.
+  rlimit file_descriptor_limit;
+  if (getrlimit(RLIMIT_NOFILE, &file_descriptor_limit) == 0) {
+    file_descriptor_limit.rlim_cur = file_descriptor_limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &file_descriptor_limit);
+  }
+
+  // The files are read ahead before the first client is accepted, so that the
+  // first requests do not wait for the disk in the middle of a 'splice'.
+  const std::vector<std::filesystem::path> page_cache_warm_path_list =
+      couringserver::get_page_cache_warm_path_list(server_config);
+  const auto warm_page_cache = [&]() {
+    if (page_cache_warm_path_list.empty()) {
+      return;
+    }
+    const couringserver::page_cache_warm_report page_cache_warm_report =
+        couringserver::warm_page_cache(
+            page_cache_warm_path_list,
+            server_config.page_cache_warm_queue_depth,
+            server_config.page_cache_warm_budget);
+    std::fputs(couringserver::format_page_cache_warm_report(
+                   page_cache_warm_report)
+                   .c_str(),
+               stderr);
+  };
+
+  // SIGINT and SIGTERM are handled by a dedicated thread, which drains the
+  // server so that in-flight responses are finished before exiting. SIGHUP
+  // reopens the access logs and SIGUSR1 warms the page cache again, e.g.
+  // after a deployment. With 'IO_TRACE', SIGUSR2 writes the trace of the
+  // workers to 'IO_TRACE_PATH'.
+  sigset_t signal_set;
+  sigemptyset(&signal_set);
+  sigaddset(&signal_set, SIGINT);
+  sigaddset(&signal_set, SIGTERM);
+  sigaddset(&signal_set, SIGHUP);
+  sigaddset(&signal_set, SIGUSR1);
+  if constexpr (couringserver::IO_TRACE) {
+    sigaddset(&signal_set, SIGUSR2);
+  }
+  pthread_sigmask(SIG_BLOCK, &signal_set, nullptr);
+  warm_page_cache();
+
+  couringserver::http_server http_server(server_config);
+  std::jthread signal_thread([&]() {
+    int signal_number;
+    while (sigwait(&signal_set, &signal_number) == 0) {
+      if (signal_number == SIGHUP) {
+        http_server.reopen_access_log();
+      } else if (signal_number == SIGUSR1) {
+        warm_page_cache();
+      } else if (signal_number == SIGUSR2) {
+        couringserver::io_trace::dump_all(couringserver::IO_TRACE_PATH);
+      } else {
+        break;
+      }
+    }
+    http_server.drain();
+  });
+
+  // HTTPS is served as well when a certificate and its key are present.
+  if (std::filesystem::exists(server_config.tls_certificate_path) &&
+      std::filesystem::exists(server_config.tls_private_key_path)) {
+    http_server.enable_tls(server_config.tls_port.c_str(),
+                           server_config.tls_certificate_path,
+                           server_config.tls_private_key_path);
+  }
 
-int main() {
-  couringserver::http_server http_server;
-  http_server.listen("8080");
+  // '--take-over' inherits the listening sockets of the running server.
+  http_server.listen(server_config.port.c_str(), server_config.take_over);
+  pthread_kill(signal_thread.native_handle(), SIGTERM);
 }
@@ -0,0 +1,513 @@
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+#include "buffer_ring.hpp"
+#include "io_uring.hpp"
+
+namespace couringserver {
+namespace {
+void add_relaxed(std::atomic<uint64_t> &counter, const uint64_t value)
+{
+	counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+void append_number(std::string &buffer, const uint64_t value)
+{
+	std::array<char, 24> digit_list;
+	const auto [digit_end, _] = std::to_chars(digit_list.data(), digit_list.data() + digit_list.size(), value);
+	buffer.append(digit_list.data(), digit_end);
+}
+
+void append_seconds(std::string &buffer, const uint64_t nanoseconds)
+{
+	std::array<char, 32> digit_list;
+	const int length =
+		std::snprintf(digit_list.data(), digit_list.size(), "%.9g", static_cast<double>(nanoseconds) / 1e9);
+	buffer.append(digit_list.data(), length);
+}
+
+void append_header(
+	std::string &buffer, const std::string_view name, const std::string_view type,
+	const std::string_view help)
+{
+	buffer.append("# HELP ").append(name).append(" ").append(help).append("\n");
+	buffer.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+// Append the sample lines of the histograms summed over 'histogram_list'.
+// 'label' is empty or a 'name="value"' pair put in front of 'le'.
+void append_histogram(
+	std::string &buffer, const std::string_view name, const std::string_view label,
+	const std::vector<const latency_histogram *> &histogram_list)
+{
+	uint64_t cumulative_count = 0;
+	for (size_t index = 0; index < latency_histogram::BUCKET_COUNT; ++index)
+	{
+		for (const latency_histogram *const latency_histogram : histogram_list)
+		{
+			cumulative_count += latency_histogram->get_bucket_count(index);
+		}
+		buffer.append(name).append("_bucket{");
+		if (!label.empty())
+		{
+			buffer.append(label).append(",");
+		}
+		buffer.append("le=\"");
+		if (const uint64_t bucket_bound = latency_histogram::get_bucket_bound(index); bucket_bound != 0)
+		{
+			append_seconds(buffer, bucket_bound);
+		}
+		else
+		{
+			buffer.append("+Inf");
+		}
+		buffer.append("\"} ");
+		append_number(buffer, cumulative_count);
+		buffer.append("\n");
+	}
+
+	// The count is taken from the buckets, so that it matches '+Inf' even if
+	// a worker records while the histograms are read.
+	uint64_t sum_nanoseconds = 0;
+	for (const latency_histogram *const latency_histogram : histogram_list)
+	{
+		sum_nanoseconds += latency_histogram->get_sum_nanoseconds();
+	}
+	std::string label_set;
+	if (!label.empty())
+	{
+		label_set.append("{").append(label).append("}");
+	}
+	buffer.append(name).append("_sum").append(label_set).append(" ");
+	append_seconds(buffer, sum_nanoseconds);
+	buffer.append("\n");
+	buffer.append(name).append("_count").append(label_set).append(" ");
+	append_number(buffer, cumulative_count);
+	buffer.append("\n");
+}
+
+constexpr std::array<std::string_view, static_cast<size_t>(request_phase::count)> REQUEST_PHASE_NAME_LIST{
+	"recv", "parse", "file_lookup", "send", "splice"};
+} // namespace
+
+void latency_histogram::record(const std::chrono::nanoseconds duration) noexcept
+{
+	const uint64_t nanoseconds = std::max<std::chrono::nanoseconds::rep>(duration.count(), 0);
+	size_t index = 0;
+	if (nanoseconds >= uint64_t{1} << MAX_SHIFT)
+	{
+		index = BUCKET_COUNT - 1;
+	}
+	else if (nanoseconds >= uint64_t{1} << MIN_SHIFT)
+	{
+		const unsigned int shift = std::bit_width(nanoseconds) - 1;
+		const uint64_t sub_bucket = (nanoseconds >> (shift - SUB_BUCKET_BITS)) & (SUB_BUCKET_COUNT - 1);
+		index = 1 + ((shift - MIN_SHIFT) << SUB_BUCKET_BITS) + sub_bucket;
+	}
+	add_relaxed(bucket_list_[index], 1);
+	add_relaxed(count_, 1);
+	add_relaxed(sum_nanoseconds_, nanoseconds);
+}
+
+uint64_t latency_histogram::get_bucket_count(const size_t index) const noexcept
+{
+	return bucket_list_[index].load(std::memory_order_relaxed);
+}
+
+uint64_t latency_histogram::get_count() const noexcept { return count_.load(std::memory_order_relaxed); }
+
+uint64_t latency_histogram::get_sum_nanoseconds() const noexcept
+{
+	return sum_nanoseconds_.load(std::memory_order_relaxed);
+}
+
+uint64_t latency_histogram::get_bucket_bound(const size_t index) noexcept
+{
+	if (index == 0)
+	{
+		return uint64_t{1} << MIN_SHIFT;
+	}
+	if (index == BUCKET_COUNT - 1)
+	{
+		return 0;
+	}
+	const unsigned int shift = MIN_SHIFT + ((index - 1) >> SUB_BUCKET_BITS);
+	const uint64_t sub_bucket = (index - 1) & (SUB_BUCKET_COUNT - 1);
+	return (SUB_BUCKET_COUNT + sub_bucket + 1) << (shift - SUB_BUCKET_BITS);
+}
+
+uint64_t latency_histogram::get_quantile_bound(const double quantile) const noexcept
+{
+	const uint64_t count = get_count();
+	if (count == 0)
+	{
+		return 0;
+	}
+	const auto rank = static_cast<uint64_t>(quantile * static_cast<double>(count - 1)) + 1;
+	uint64_t cumulative_count = 0;
+	for (size_t index = 0; index < BUCKET_COUNT - 1; ++index)
+	{
+		cumulative_count += get_bucket_count(index);
+		if (cumulative_count >= rank)
+		{
+			return get_bucket_bound(index);
+		}
+	}
+	return uint64_t{1} << MAX_SHIFT;
+}
+
+void worker_metrics::add_response(const std::string_view status, const uint64_t body_size) noexcept
+{
+	size_t status_code = 0;
+	std::from_chars(status.data(), status.data() + status.size(), status_code);
+	if (status_code >= MIN_STATUS && status_code <= MAX_STATUS)
+	{
+		add_relaxed(status_count_list[status_code - MIN_STATUS], 1);
+	}
+	add_relaxed(sent_body_byte_count, body_size);
+}
+
+void worker_metrics::add_received_bytes(const uint64_t byte_count) noexcept
+{
+	add_relaxed(received_byte_count, byte_count);
+}
+
+void worker_metrics::add_connection(const int64_t delta) noexcept
+{
+	add_relaxed(connection_count, static_cast<uint64_t>(delta));
+}
+
+void worker_metrics::add_access_log_dropped(const uint64_t entry_count) noexcept
+{
+	add_relaxed(access_log_dropped_count, entry_count);
+}
+
+void worker_metrics::add_access_log_skipped() noexcept { add_relaxed(access_log_skipped_count, 1); }
+
+void worker_metrics::add_shed_connection() noexcept { add_relaxed(shed_connection_count, 1); }
+
+void worker_metrics::set_parser_memory_size(const uint64_t memory_size) noexcept
+{
+	parser_memory_size.store(memory_size, std::memory_order_relaxed);
+}
+
+void worker_metrics::record(const request_phase request_phase, const std::chrono::nanoseconds duration) noexcept
+{
+	phase_latency_list[static_cast<size_t>(request_phase)].record(duration);
+}
+
+void worker_metrics::record(const request_phase request_phase, const metrics_clock::time_point start) noexcept
+{
+	record(request_phase, metrics_clock::now() - start);
+}
+
+server_metrics::server_metrics(const size_t worker_count) : worker_metrics_list_(worker_count) {}
+
+worker_metrics &server_metrics::get_worker_metrics(const size_t index) noexcept
+{
+	return worker_metrics_list_[index];
+}
+
+size_t server_metrics::get_worker_count() const noexcept { return worker_metrics_list_.size(); }
+
+std::optional<ring_snapshot> server_metrics::get_ring_snapshot(const size_t index) const
+{
+	const worker_metrics &worker_metrics = worker_metrics_list_[index];
+	const ring_statistics *const ring_statistics =
+		worker_metrics.ring_statistics.load(std::memory_order_acquire);
+	const buffer_ring_statistics *const buffer_ring_statistics =
+		worker_metrics.buffer_ring_statistics.load(std::memory_order_acquire);
+	if (ring_statistics == nullptr || buffer_ring_statistics == nullptr)
+	{
+		return std::nullopt;
+	}
+
+	ring_snapshot ring_snapshot{
+		.submitted_count = ring_statistics->submitted_count.load(std::memory_order_relaxed),
+		.completed_count = ring_statistics->completed_count.load(std::memory_order_relaxed),
+		.sq_full_count = ring_statistics->sq_full_count.load(std::memory_order_relaxed),
+		.max_sq_ready_count = ring_statistics->max_sq_ready_count.load(std::memory_order_relaxed),
+		.max_cq_ready_count = ring_statistics->max_cq_ready_count.load(std::memory_order_relaxed),
+		.cq_overflow_count = ring_statistics->cq_overflow_count.load(std::memory_order_relaxed),
+		.borrowed_buffer_count = buffer_ring_statistics->borrowed_count.load(std::memory_order_relaxed),
+		.max_borrowed_buffer_count = buffer_ring_statistics->max_borrowed_count.load(std::memory_order_relaxed),
+		.no_buffer_count = buffer_ring_statistics->no_buffer_count.load(std::memory_order_relaxed),
+		.opcode_snapshot_list = {},
+	};
+	for (size_t opcode = 0; opcode < ring_statistics->submitted_count_list.size(); ++opcode)
+	{
+		const uint64_t submitted_count = ring_statistics->submitted_count_list[opcode].load(std::memory_order_relaxed);
+		if (submitted_count == 0)
+		{
+			continue;
+		}
+		const latency_histogram &latency_histogram = ring_statistics->latency_list[opcode];
+		ring_snapshot.opcode_snapshot_list.emplace_back(
+			static_cast<uint8_t>(opcode), submitted_count,
+			ring_statistics->inflight_count_list[opcode].load(std::memory_order_relaxed), latency_histogram.get_count(),
+			latency_histogram.get_quantile_bound(0.5), latency_histogram.get_quantile_bound(0.99),
+			latency_histogram.get_quantile_bound(1));
+	}
+	return ring_snapshot;
+}
+
+std::string server_metrics::serialize() const
+{
+	std::string buffer;
+
+	append_header(buffer, "couringserver_http_responses_total", "counter", "HTTP responses sent, by status code.");
+	for (size_t status_code = worker_metrics::MIN_STATUS; status_code <= worker_metrics::MAX_STATUS; ++status_code)
+	{
+		uint64_t status_count = 0;
+		for (const worker_metrics &worker_metrics : worker_metrics_list_)
+		{
+			status_count +=
+				worker_metrics.status_count_list[status_code - worker_metrics::MIN_STATUS].load(std::memory_order_relaxed);
+		}
+		if (status_count != 0)
+		{
+			buffer.append("couringserver_http_responses_total{code=\"");
+			append_number(buffer, status_code);
+			buffer.append("\"} ");
+			append_number(buffer, status_count);
+			buffer.append("\n");
+		}
+	}
+
+	const auto append_counter = [&](
+									const std::string_view name, const std::string_view help,
+									const std::atomic<uint64_t> worker_metrics::*counter)
+	{
+		uint64_t sum = 0;
+		for (const worker_metrics &worker_metrics : worker_metrics_list_)
+		{
+			sum += (worker_metrics.*counter).load(std::memory_order_relaxed);
+		}
+		append_header(buffer, name, "counter", help);
+		buffer.append(name).append(" ");
+		append_number(buffer, sum);
+		buffer.append("\n");
+	};
+	append_counter(
+		"couringserver_http_received_bytes_total", "Bytes received from HTTP/1.1 clients.",
+		&worker_metrics::received_byte_count);
+	append_counter(
+		"couringserver_http_response_body_bytes_total", "Content length of the response bodies sent.",
+		&worker_metrics::sent_body_byte_count);
+	append_counter(
+		"couringserver_access_log_dropped_total", "Access log entries lost to full buffers or failed writes.",
+		&worker_metrics::access_log_dropped_count);
+	append_counter(
+		"couringserver_access_log_skipped_total", "Access log entries left out by sampling under overload.",
+		&worker_metrics::access_log_skipped_count);
+	append_counter(
+		"couringserver_shed_connections_total", "Connections closed over the parser memory budget.",
+		&worker_metrics::shed_connection_count);
+
+	append_header(buffer, "couringserver_open_connections", "gauge", "Client connections open, by worker.");
+	for (size_t index = 0; index < worker_metrics_list_.size(); ++index)
+	{
+		buffer.append("couringserver_open_connections{worker=\"");
+		append_number(buffer, index);
+		buffer.append("\"} ");
+		append_number(buffer, worker_metrics_list_[index].connection_count.load(std::memory_order_relaxed));
+		buffer.append("\n");
+	}
+
+	append_header(
+		buffer, "couringserver_parser_memory_bytes", "gauge", "Bytes held by the request parsers, by worker.");
+	for (size_t index = 0; index < worker_metrics_list_.size(); ++index)
+	{
+		buffer.append("couringserver_parser_memory_bytes{worker=\"");
+		append_number(buffer, index);
+		buffer.append("\"} ");
+		append_number(buffer, worker_metrics_list_[index].parser_memory_size.load(std::memory_order_relaxed));
+		buffer.append("\n");
+	}
+
+	std::vector<const latency_histogram *> histogram_list;
+	const auto collect_histogram_list = [&](const auto &get_histogram) -> const std::vector<const latency_histogram *> &
+	{
+		histogram_list.clear();
+		for (const worker_metrics &worker_metrics : worker_metrics_list_)
+		{
+			histogram_list.emplace_back(&get_histogram(worker_metrics));
+		}
+		return histogram_list;
+	};
+	append_header(
+		buffer, "couringserver_http_request_duration_seconds", "histogram",
+		"Time from the first packet of an HTTP/1.1 request until its response is sent.");
+	append_histogram(
+		buffer, "couringserver_http_request_duration_seconds", {},
+		collect_histogram_list([](const worker_metrics &worker_metrics) -> const latency_histogram &
+							   { return worker_metrics.request_latency; }));
+	append_header(
+		buffer, "couringserver_http_time_to_first_byte_seconds", "histogram",
+		"Time from the first packet of an HTTP/1.1 request until the first byte of its response is sent.");
+	append_histogram(
+		buffer, "couringserver_http_time_to_first_byte_seconds", {},
+		collect_histogram_list([](const worker_metrics &worker_metrics) -> const latency_histogram &
+							   { return worker_metrics.first_byte_latency; }));
+	append_header(
+		buffer, "couringserver_http_request_phase_duration_seconds", "histogram",
+		"Time spent in each phase of an HTTP/1.1 request.");
+	for (size_t phase = 0; phase < REQUEST_PHASE_NAME_LIST.size(); ++phase)
+	{
+		const std::string label = "phase=\"" + std::string(REQUEST_PHASE_NAME_LIST[phase]) + "\"";
+		append_histogram(
+			buffer, "couringserver_http_request_phase_duration_seconds", label,
+			collect_histogram_list([&](const worker_metrics &worker_metrics) -> const latency_histogram &
+								   { return worker_metrics.phase_latency_list[phase]; }));
+	}
+
+	std::vector<std::optional<ring_snapshot>> ring_snapshot_list;
+	for (size_t index = 0; index < worker_metrics_list_.size(); ++index)
+	{
+		ring_snapshot_list.emplace_back(get_ring_snapshot(index));
+	}
+	const auto append_ring_sample = [&](
+										const std::string_view name, const std::string_view type,
+										const std::string_view help, const uint64_t ring_snapshot::*value)
+	{
+		append_header(buffer, name, type, help);
+		for (size_t index = 0; index < ring_snapshot_list.size(); ++index)
+		{
+			if (!ring_snapshot_list[index].has_value())
+			{
+				continue;
+			}
+			buffer.append(name).append("{worker=\"");
+			append_number(buffer, index);
+			buffer.append("\"} ");
+			append_number(buffer, ring_snapshot_list[index].value().*value);
+			buffer.append("\n");
+		}
+	};
+	append_ring_sample(
+		"couringserver_io_uring_submitted_total", "counter", "SQEs submitted.", &ring_snapshot::submitted_count);
+	append_ring_sample(
+		"couringserver_io_uring_completed_total", "counter", "CQEs processed.", &ring_snapshot::completed_count);
+	append_ring_sample(
+		"couringserver_io_uring_sq_full_total", "counter", "Submissions that found the submission queue full.",
+		&ring_snapshot::sq_full_count);
+	append_ring_sample(
+		"couringserver_io_uring_max_sq_ready", "gauge", "The most SQEs submitted at once.",
+		&ring_snapshot::max_sq_ready_count);
+	append_ring_sample(
+		"couringserver_io_uring_max_cq_ready", "gauge", "The most CQEs ready at once.",
+		&ring_snapshot::max_cq_ready_count);
+	append_ring_sample(
+		"couringserver_io_uring_cq_overflow_total", "counter", "Completions dropped by a full completion queue.",
+		&ring_snapshot::cq_overflow_count);
+	append_ring_sample(
+		"couringserver_buffer_ring_borrowed", "gauge", "Receive buffers held by the server.",
+		&ring_snapshot::borrowed_buffer_count);
+	append_ring_sample(
+		"couringserver_buffer_ring_max_borrowed", "gauge", "The most receive buffers held at once.",
+		&ring_snapshot::max_borrowed_buffer_count);
+	append_ring_sample(
+		"couringserver_buffer_ring_no_buffer_total", "counter", "Receives that failed for lack of a buffer.",
+		&ring_snapshot::no_buffer_count);
+
+	append_header(buffer, "couringserver_io_uring_inflight", "gauge", "Requests in flight, by opcode.");
+	for (size_t index = 0; index < ring_snapshot_list.size(); ++index)
+	{
+		if (!ring_snapshot_list[index].has_value())
+		{
+			continue;
+		}
+		for (const opcode_snapshot &opcode_snapshot : ring_snapshot_list[index]->opcode_snapshot_list)
+		{
+			buffer.append("couringserver_io_uring_inflight{worker=\"");
+			append_number(buffer, index);
+			buffer.append("\",opcode=\"").append(get_opcode_name(opcode_snapshot.opcode)).append("\"} ");
+			append_number(buffer, opcode_snapshot.inflight_count);
+			buffer.append("\n");
+		}
+	}
+
+	// The opcodes are taken from the snapshots, so that only the ones in use
+	// get a histogram.
+	std::vector<bool> used_opcode_list(IORING_OP_LAST);
+	for (const std::optional<ring_snapshot> &ring_snapshot : ring_snapshot_list)
+	{
+		if (!ring_snapshot.has_value())
+		{
+			continue;
+		}
+		for (const opcode_snapshot &opcode_snapshot : ring_snapshot->opcode_snapshot_list)
+		{
+			if (opcode_snapshot.sample_count != 0)
+			{
+				used_opcode_list[opcode_snapshot.opcode] = true;
+			}
+		}
+	}
+	append_header(
+		buffer, "couringserver_io_uring_latency_seconds", "histogram",
+		"Sampled time from submission to completion, by opcode.");
+	for (size_t opcode = 0; opcode < used_opcode_list.size(); ++opcode)
+	{
+		if (!used_opcode_list[opcode])
+		{
+			continue;
+		}
+		const std::string label = "opcode=\"" + std::string(get_opcode_name(opcode)) + "\"";
+		histogram_list.clear();
+		for (const worker_metrics &worker_metrics : worker_metrics_list_)
+		{
+			if (const ring_statistics *const ring_statistics =
+					worker_metrics.ring_statistics.load(std::memory_order_acquire);
+				ring_statistics != nullptr)
+			{
+				histogram_list.emplace_back(&ring_statistics->latency_list[opcode]);
+			}
+		}
+		append_histogram(buffer, "couringserver_io_uring_latency_seconds", label, histogram_list);
+	}
+
+	const auto append_event_loop_counter = [&](
+											   const std::string_view name, const std::string_view help,
+											   const bool seconds,
+											   const std::atomic<uint64_t> event_loop_statistics::*counter)
+	{
+		append_header(buffer, name, "counter", help);
+		for (size_t index = 0; index < worker_metrics_list_.size(); ++index)
+		{
+			const event_loop_statistics *const event_loop_statistics =
+				worker_metrics_list_[index].event_loop_statistics.load(std::memory_order_acquire);
+			if (event_loop_statistics == nullptr)
+			{
+				continue;
+			}
+			const uint64_t value = (event_loop_statistics->*counter).load(std::memory_order_relaxed);
+			buffer.append(name).append("{worker=\"");
+			append_number(buffer, index);
+			buffer.append("\"} ");
+			seconds ? append_seconds(buffer, value) : append_number(buffer, value);
+			buffer.append("\n");
+		}
+	};
+	append_event_loop_counter(
+		"couringserver_event_loop_spin_seconds_total", "Time the event loop polled for completions.", true,
+		&event_loop_statistics::spin_nanoseconds);
+	append_event_loop_counter(
+		"couringserver_event_loop_sleep_seconds_total", "Time the event loop blocked for completions.", true,
+		&event_loop_statistics::sleep_nanoseconds);
+	append_event_loop_counter(
+		"couringserver_event_loop_spins_total", "Waits satisfied by polling.", false,
+		&event_loop_statistics::spin_count);
+	append_event_loop_counter(
+		"couringserver_event_loop_sleeps_total", "Waits that had to block.", false,
+		&event_loop_statistics::sleep_count);
+
+	return buffer;
+}
+} // namespace couringserver
@@ -0,0 +1,170 @@
+#include "page_cache.hpp"
+
+#include <fcntl.h>
+#include <liburing.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "file_descriptor.hpp"
+#include "io_uring.hpp"
+
+namespace couringserver {
+namespace {
+// a file being advised, free once its completion is reaped
+struct warm_slot
+{
+	couringserver::sqe_data sqe_data;
+	couringserver::file_descriptor file_descriptor;
+	uintmax_t size = 0;
+	bool busy = false;
+};
+
+class page_cache_warmer
+{
+public:
+	page_cache_warmer(const size_t queue_depth, const uintmax_t byte_budget)
+		: warm_slot_list_(queue_depth), byte_budget_{byte_budget} {}
+
+	void warm(const std::filesystem::path &path)
+	{
+		const int raw_file_descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (raw_file_descriptor == -1)
+		{
+			++page_cache_warm_report_.skipped_count;
+			return;
+		}
+		file_descriptor file_descriptor{raw_file_descriptor};
+		struct stat file_status;
+		if (fstat(raw_file_descriptor, &file_status) == -1 || !S_ISREG(file_status.st_mode) ||
+			static_cast<uintmax_t>(file_status.st_size) > byte_budget_ - page_cache_warm_report_.byte_count)
+		{
+			++page_cache_warm_report_.skipped_count;
+			return;
+		}
+
+		warm_slot &warm_slot = acquire_slot();
+		warm_slot.file_descriptor = std::move(file_descriptor);
+		warm_slot.size = file_status.st_size;
+		warm_slot.busy = true;
+		++inflight_count_;
+		// The length 0 covers the whole file.
+		io_uring::get_instance().submit_fadvise_request(
+			&warm_slot.sqe_data, raw_file_descriptor, 0, 0, POSIX_FADV_WILLNEED);
+		++page_cache_warm_report_.file_count;
+		page_cache_warm_report_.byte_count += file_status.st_size;
+	}
+
+	page_cache_warm_report finish()
+	{
+		while (inflight_count_ != 0)
+		{
+			reap();
+		}
+		return page_cache_warm_report_;
+	}
+
+private:
+	warm_slot &acquire_slot()
+	{
+		while (true)
+		{
+			for (warm_slot &warm_slot : warm_slot_list_)
+			{
+				if (!warm_slot.busy)
+				{
+					return warm_slot;
+				}
+			}
+			reap();
+		}
+	}
+
+	// Wait for a completion and free the slots of the completed requests.
+	void reap()
+	{
+		io_uring &io_uring = io_uring::get_instance();
+		io_uring.submit_and_wait(1);
+		for (io_uring_cqe *const cqe : io_uring)
+		{
+			io_uring.record_completion(cqe);
+			auto *const sqe_data = reinterpret_cast<struct sqe_data *>(io_uring_cqe_get_data(cqe));
+			const int cqe_res = cqe->res;
+			io_uring.cqe_seen(cqe);
+			if (sqe_data == nullptr)
+			{
+				continue;
+			}
+			warm_slot &warm_slot = *std::ranges::find(
+				warm_slot_list_, sqe_data, [](struct warm_slot &warm_slot) { return &warm_slot.sqe_data; });
+			if (cqe_res < 0)
+			{
+				--page_cache_warm_report_.file_count;
+				page_cache_warm_report_.byte_count -= warm_slot.size;
+				++page_cache_warm_report_.skipped_count;
+			}
+			warm_slot.file_descriptor = file_descriptor{};
+			warm_slot.busy = false;
+			--inflight_count_;
+		}
+	}
+
+	std::vector<warm_slot> warm_slot_list_;
+	const uintmax_t byte_budget_;
+	size_t inflight_count_ = 0;
+	page_cache_warm_report page_cache_warm_report_;
+};
+} // namespace
+
+page_cache_warm_report warm_page_cache(
+	const std::span<const std::filesystem::path> path_list, const size_t queue_depth, const uintmax_t byte_budget)
+{
+	const auto start_time = std::chrono::steady_clock::now();
+	page_cache_warmer page_cache_warmer(std::max<size_t>(1, queue_depth), byte_budget);
+	for (const std::filesystem::path &path : path_list)
+	{
+		std::error_code error_code;
+		if (!std::filesystem::is_directory(path, error_code))
+		{
+			page_cache_warmer.warm(path);
+			continue;
+		}
+		// Unreadable directories are skipped rather than ending the pass.
+		for (std::filesystem::recursive_directory_iterator directory_iterator(
+				 path, std::filesystem::directory_options::skip_permission_denied, error_code);
+			 !error_code && directory_iterator != std::filesystem::recursive_directory_iterator();
+			 directory_iterator.increment(error_code))
+		{
+			if (directory_iterator->is_regular_file(error_code))
+			{
+				page_cache_warmer.warm(directory_iterator->path());
+			}
+		}
+	}
+	page_cache_warm_report page_cache_warm_report = page_cache_warmer.finish();
+	page_cache_warm_report.duration = std::chrono::steady_clock::now() - start_time;
+	return page_cache_warm_report;
+}
+
+std::string format_page_cache_warm_report(const page_cache_warm_report &page_cache_warm_report)
+{
+	std::array<char, 160> report;
+	const int length = std::snprintf(
+		report.data(), report.size(), "page cache: read-ahead requested for %zu files, %.1f MiB in %.1f ms, %zu skipped\n",
+		page_cache_warm_report.file_count, static_cast<double>(page_cache_warm_report.byte_count) / (1 << 20),
+		std::chrono::duration<double, std::milli>(page_cache_warm_report.duration).count(),
+		page_cache_warm_report.skipped_count);
+	return {report.data(), static_cast<size_t>(std::max(length, 0))};
+}
+} // namespace couringserver
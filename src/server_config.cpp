@@ -0,0 +1,419 @@
+#include "server_config.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#include "constant.hpp"
+#include "io_uring.hpp"
+
+namespace couringserver {
+namespace {
+// the most entries of an io_uring or of a buffer ring that the kernel accepts
+constexpr unsigned int MAX_KERNEL_QUEUE_SIZE = 32768;
+
+using config_member = std::variant<
+	std::string server_config::*, bool server_config::*, unsigned int server_config::*, size_t server_config::*>;
+
+struct config_option
+{
+	std::string_view key;
+	config_member member;
+	std::string_view description;
+};
+
+const auto CONFIG_OPTION_LIST = std::to_array<config_option>({
+	{"port", &server_config::port, "HTTP listen addresses: port, host:port, [host]:port or unix:path"},
+	{"tls_port", &server_config::tls_port, "HTTPS listen addresses, comma-separated like 'port'"},
+	{"tls_certificate_path", &server_config::tls_certificate_path, "HTTPS is served when both files exist"},
+	{"tls_private_key_path", &server_config::tls_private_key_path, ""},
+	{"take_over", &server_config::take_over, "inherit the listeners of the running server"},
+	{"listener_handoff_path", &server_config::listener_handoff_path, "Unix socket in a directory of mode 0700"},
+	{"thread_count", &server_config::thread_count, "number of workers"},
+	{"io_uring_queue_size", &server_config::io_uring_queue_size, "submission queue entries per worker"},
+	{"buffer_ring_size", &server_config::buffer_ring_size, "receive buffers per worker, a power of two"},
+	{"buffer_size", &server_config::buffer_size, "size of a receive buffer"},
+	{"max_connection_count", &server_config::max_connection_count, "accepting pauses at this many connections"},
+	{"connection_low_watermark", &server_config::connection_low_watermark, "and resumes at this many"},
+	{"max_inflight_request_count", &server_config::max_inflight_request_count, "requests served at once per worker"},
+	{"reject_on_overload", &server_config::reject_on_overload, "answer '503' beyond it instead of queueing"},
+	{"drain_grace_period", &server_config::drain_grace_period, "seconds before busy connections are cut on drain"},
+	{"max_request_line_size", &server_config::max_request_line_size, "longer request lines get '414'"},
+	{"max_header_count", &server_config::max_header_count, "more header lines get '431'"},
+	{"max_header_size", &server_config::max_header_size, "larger header sections get '431'"},
+	{"parser_memory_budget", &server_config::parser_memory_budget, "bytes of partial requests per worker"},
+	{"listen_backlog", &server_config::listen_backlog, "clients waiting to be accepted per listener"},
+	{"tcp_defer_accept", &server_config::tcp_defer_accept, "seconds to wait for the first bytes, 0 to disable"},
+	{"tcp_fastopen", &server_config::tcp_fastopen, "TCP Fast Open queue length, 0 to disable"},
+	{"tcp_nodelay", &server_config::tcp_nodelay, "disable Nagle's algorithm on the clients"},
+	{"tcp_quickack", &server_config::tcp_quickack, "acknowledge the first packets of a client at once"},
+	{"socket_send_buffer_size", &server_config::socket_send_buffer_size, "0 to leave it to autotuning"},
+	{"socket_receive_buffer_size", &server_config::socket_receive_buffer_size, ""},
+	{"tcp_notsent_lowat", &server_config::tcp_notsent_lowat, "unsent bytes that block a send, 0 for the default"},
+	{"send_zc_threshold", &server_config::send_zc_threshold, "bytes from which a send to a client is zero-copy, 0 to disable"},
+	{"event_loop_spin_budget", &server_config::event_loop_spin_budget, "microseconds to poll before sleeping, 0 to disable"},
+	{"napi_busy_poll_timeout", &server_config::napi_busy_poll_timeout, "microseconds of NAPI busy polling, 0 to disable"},
+	{"socket_busy_poll_timeout", &server_config::socket_busy_poll_timeout, "'SO_BUSY_POLL' of the clients, 0 to disable"},
+	{"access_log_path", &server_config::access_log_path, "empty to disable the access log"},
+	{"access_log_overload_threshold", &server_config::access_log_overload_threshold, "sample beyond this many requests in flight"},
+	{"access_log_overload_sample_interval", &server_config::access_log_overload_sample_interval, "and log one in this many"},
+	{"asset_pack_path", &server_config::asset_pack_path, "serve static files from the pack, empty for files"},
+	{"asset_pack_populate", &server_config::asset_pack_populate, "read the whole pack into memory at startup"},
+	{"asset_pack_huge_pages", &server_config::asset_pack_huge_pages, "map the pack with transparent huge pages"},
+	{"page_cache_warm_path", &server_config::page_cache_warm_path, "files to read ahead at startup and on SIGUSR1"},
+	{"page_cache_warm_queue_depth", &server_config::page_cache_warm_queue_depth, "read-ahead requests in flight"},
+	{"page_cache_warm_budget", &server_config::page_cache_warm_budget, "bytes to read ahead at most"},
+	{"defer_taskrun", &server_config::defer_taskrun, "use the io_uring feature if supported"},
+	{"coop_taskrun", &server_config::coop_taskrun, ""},
+	{"buffer_ring", &server_config::buffer_ring, ""},
+	{"multishot_accept", &server_config::multishot_accept, ""},
+	{"multishot_recv", &server_config::multishot_recv, ""},
+	{"socket_command", &server_config::socket_command, ""},
+});
+
+struct feature_description
+{
+	std::string_view name;
+	bool io_uring_features::*member;
+	// what is used instead
+	std::string_view fallback;
+	// the feature that makes this one unnecessary, if any
+	bool io_uring_features::*superseding_member = nullptr;
+};
+
+const auto FEATURE_DESCRIPTION_LIST = std::to_array<feature_description>({
+	{"defer_taskrun", &io_uring_features::defer_taskrun, "coop_taskrun if enabled"},
+	{"coop_taskrun", &io_uring_features::coop_taskrun, "task work interrupts", &io_uring_features::defer_taskrun},
+	{"buffer_ring", &io_uring_features::buffer_ring, "IORING_OP_PROVIDE_BUFFERS"},
+	{"multishot_accept", &io_uring_features::multishot_accept, "an accept request per client"},
+	{"multishot_recv", &io_uring_features::multishot_recv, "a receive request per packet"},
+	{"socket_command", &io_uring_features::socket_command, "setsockopt"},
+	{"napi", &io_uring_features::napi, "interrupts"},
+	{"send_zc", &io_uring_features::send_zc, "copying sends"},
+});
+
+std::string_view trim(std::string_view string)
+{
+	constexpr std::string_view WHITESPACE = " \t\r\n";
+	const size_t begin = string.find_first_not_of(WHITESPACE);
+	if (begin == std::string_view::npos)
+	{
+		return {};
+	}
+	return string.substr(begin, string.find_last_not_of(WHITESPACE) - begin + 1);
+}
+
+const config_option *find_option(const std::string_view key)
+{
+	const auto option_iterator = std::ranges::find(CONFIG_OPTION_LIST, key, &config_option::key);
+	return option_iterator == CONFIG_OPTION_LIST.end() ? nullptr : &*option_iterator;
+}
+
+template <typename T>
+T parse_number(const std::string_view key, const std::string_view value)
+{
+	T number;
+	const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), number);
+	if (error != std::errc{} || end != value.data() + value.size())
+	{
+		throw std::runtime_error("invalid value for '" + std::string(key) + "': '" + std::string(value) + "'");
+	}
+	return number;
+}
+
+bool parse_bool(const std::string_view key, const std::string_view value)
+{
+	if (value == "true" || value == "yes" || value == "on" || value == "1")
+	{
+		return true;
+	}
+	if (value == "false" || value == "no" || value == "off" || value == "0")
+	{
+		return false;
+	}
+	throw std::runtime_error("invalid value for '" + std::string(key) + "': '" + std::string(value) + "'");
+}
+
+void set_config_value(server_config &server_config, const std::string_view key, const std::string_view value)
+{
+	const config_option *const config_option = find_option(key);
+	if (config_option == nullptr)
+	{
+		throw std::runtime_error("unknown setting '" + std::string(key) + "'");
+	}
+
+	std::visit(
+		[&]<typename T>(T server_config::*const member)
+		{
+			if constexpr (std::is_same_v<T, std::string>)
+			{
+				server_config.*member = value;
+			}
+			else if constexpr (std::is_same_v<T, bool>)
+			{
+				server_config.*member = parse_bool(key, value);
+			}
+			else
+			{
+				server_config.*member = parse_number<T>(key, value);
+			}
+		},
+		config_option->member);
+}
+
+void validate(const server_config &server_config)
+{
+	const auto require = [](const bool condition, const std::string_view key)
+	{
+		if (!condition)
+		{
+			throw std::runtime_error("invalid value for '" + std::string(key) + "'");
+		}
+	};
+	require(!server_config.port.empty(), "port");
+	require(std::filesystem::path(server_config.listener_handoff_path).has_parent_path(), "listener_handoff_path");
+	// kTLS needs TCP.
+	require(server_config.tls_port.find("unix:") == std::string::npos, "tls_port");
+	require(server_config.thread_count != 0, "thread_count");
+	require(
+		server_config.io_uring_queue_size != 0 && server_config.io_uring_queue_size <= MAX_KERNEL_QUEUE_SIZE,
+		"io_uring_queue_size");
+	// The buffer ids are kept in a bitset of 'MAX_BUFFER_RING_SIZE' bits.
+	require(
+		std::has_single_bit(server_config.buffer_ring_size) &&
+			server_config.buffer_ring_size <= std::min(MAX_BUFFER_RING_SIZE, MAX_KERNEL_QUEUE_SIZE),
+		"buffer_ring_size");
+	require(
+		server_config.buffer_size != 0 && server_config.buffer_size <= std::numeric_limits<int>::max(),
+		"buffer_size");
+	require(server_config.max_connection_count != 0, "max_connection_count");
+	require(server_config.connection_low_watermark < server_config.max_connection_count, "connection_low_watermark");
+	require(server_config.max_inflight_request_count != 0, "max_inflight_request_count");
+	require(server_config.max_request_line_size != 0, "max_request_line_size");
+	require(server_config.max_header_size != 0, "max_header_size");
+	require(server_config.listen_backlog != 0, "listen_backlog");
+	require(server_config.access_log_overload_sample_interval != 0, "access_log_overload_sample_interval");
+	require(server_config.page_cache_warm_queue_depth != 0, "page_cache_warm_queue_depth");
+	// The kernel takes the sizes as an 'int' and doubles them.
+	require(
+		server_config.socket_send_buffer_size <= std::numeric_limits<int>::max() / 2, "socket_send_buffer_size");
+	require(
+		server_config.socket_receive_buffer_size <= std::numeric_limits<int>::max() / 2,
+		"socket_receive_buffer_size");
+	require(
+		server_config.socket_busy_poll_timeout <= static_cast<unsigned int>(std::numeric_limits<int>::max()),
+		"socket_busy_poll_timeout");
+}
+} // namespace
+
+std::string get_default_listener_handoff_path()
+{
+	// systemd creates the runtime directory with mode 0700.
+	if (const char *const runtime_directory = std::getenv("XDG_RUNTIME_DIR");
+		runtime_directory != nullptr && runtime_directory[0] == '/')
+	{
+		return std::string(runtime_directory) + '/' + LISTENER_HANDOFF_SOCKET_NAME;
+	}
+	return LISTENER_HANDOFF_DIRECTORY_PREFIX + std::to_string(::geteuid()) + '/' + LISTENER_HANDOFF_SOCKET_NAME;
+}
+
+void load_config_file(server_config &server_config, const std::filesystem::path &path)
+{
+	std::ifstream file_stream(path);
+	if (!file_stream.is_open())
+	{
+		throw std::runtime_error("failed to open '" + path.string() + "'");
+	}
+
+	std::string line;
+	for (size_t line_number = 1; std::getline(file_stream, line); ++line_number)
+	{
+		const std::string_view content = trim(std::string_view(line).substr(0, line.find('#')));
+		if (content.empty())
+		{
+			continue;
+		}
+		const size_t equal_position = content.find('=');
+		if (equal_position == std::string_view::npos)
+		{
+			throw std::runtime_error(
+				"invalid line " + std::to_string(line_number) + " of '" + path.string() + "'");
+		}
+		set_config_value(server_config, trim(content.substr(0, equal_position)), trim(content.substr(equal_position + 1)));
+	}
+}
+
+bool parse_command_line(server_config &server_config, const int argc, char *argv[])
+{
+	for (int index = 1; index < argc; ++index)
+	{
+		const std::string_view argument = argv[index];
+		if (!argument.starts_with("--"))
+		{
+			throw std::runtime_error("unexpected argument '" + std::string(argument) + "'");
+		}
+
+		// The keys may be spelled with dashes on the command line.
+		const size_t equal_position = argument.find('=');
+		std::string key(argument.substr(2, equal_position - 2));
+		std::ranges::replace(key, '-', '_');
+		if (key == "help")
+		{
+			return false;
+		}
+
+		std::string_view value;
+		if (equal_position != std::string_view::npos)
+		{
+			value = argument.substr(equal_position + 1);
+		}
+		else if (const config_option *const config_option = find_option(key);
+				 config_option != nullptr && std::holds_alternative<bool server_config::*>(config_option->member))
+		{
+			value = "true";
+		}
+		else if (index + 1 < argc)
+		{
+			value = argv[++index];
+		}
+		else
+		{
+			throw std::runtime_error("missing value for '" + key + "'");
+		}
+
+		if (key == "config")
+		{
+			load_config_file(server_config, value);
+		}
+		else
+		{
+			set_config_value(server_config, key, value);
+		}
+	}
+	validate(server_config);
+	return true;
+}
+
+std::string format_usage(const server_config &server_config)
+{
+	std::string usage = "usage: couringserver [--config <path>] [--<key>=<value>]...\n\n"
+						"The settings are applied in order, a configuration file holds 'key = value' lines.\n\n";
+	for (const config_option &config_option : CONFIG_OPTION_LIST)
+	{
+		std::string option = "  --" + std::string(config_option.key) + "=";
+		std::visit(
+			[&]<typename T>(T server_config::*const member)
+			{
+				if constexpr (std::is_same_v<T, std::string>)
+				{
+					option.append(server_config.*member);
+				}
+				else if constexpr (std::is_same_v<T, bool>)
+				{
+					option.append(server_config.*member ? "true" : "false");
+				}
+				else
+				{
+					option.append(std::to_string(server_config.*member));
+				}
+			},
+			config_option.member);
+		if (!config_option.description.empty())
+		{
+			option.resize(std::max<size_t>(option.size() + 2, 48), ' ');
+			option.append(config_option.description);
+		}
+		usage.append(option).append("\n");
+	}
+	return usage;
+}
+
+socket_options get_socket_options(const server_config &server_config)
+{
+	return {
+		.listen_backlog = server_config.listen_backlog,
+		.defer_accept_timeout = server_config.tcp_defer_accept,
+		.fastopen_queue_size = server_config.tcp_fastopen,
+		.no_delay = server_config.tcp_nodelay,
+		.quick_ack = server_config.tcp_quickack,
+		.send_buffer_size = server_config.socket_send_buffer_size,
+		.receive_buffer_size = server_config.socket_receive_buffer_size,
+		.notsent_low_watermark = server_config.tcp_notsent_lowat,
+		.send_zc_threshold = server_config.send_zc_threshold,
+	};
+}
+
+std::vector<std::filesystem::path> get_page_cache_warm_path_list(const server_config &server_config)
+{
+	std::vector<std::filesystem::path> path_list;
+	const std::string_view page_cache_warm_path = server_config.page_cache_warm_path;
+	for (size_t start = 0; start < page_cache_warm_path.size();)
+	{
+		const size_t end = std::min(page_cache_warm_path.find(',', start), page_cache_warm_path.size());
+		if (const std::string_view path = trim(page_cache_warm_path.substr(start, end - start)); !path.empty())
+		{
+			path_list.emplace_back(path);
+		}
+		start = end + 1;
+	}
+	return path_list;
+}
+
+io_uring_features select_features(const server_config &server_config, const io_uring_features &supported_features)
+{
+	io_uring_features selected_features;
+	selected_features.defer_taskrun = server_config.defer_taskrun && supported_features.defer_taskrun;
+	selected_features.coop_taskrun =
+		!selected_features.defer_taskrun && server_config.coop_taskrun && supported_features.coop_taskrun;
+	selected_features.buffer_ring = server_config.buffer_ring && supported_features.buffer_ring;
+	selected_features.multishot_accept = server_config.multishot_accept && supported_features.multishot_accept;
+	// The packets of a multishot receive are taken from the buffer ring.
+	selected_features.multishot_recv =
+		selected_features.buffer_ring && server_config.multishot_recv && supported_features.multishot_recv;
+	selected_features.socket_command = server_config.socket_command && supported_features.socket_command;
+	selected_features.napi = server_config.napi_busy_poll_timeout != 0 && supported_features.napi;
+	selected_features.send_zc = server_config.send_zc_threshold != 0 && supported_features.send_zc;
+	return selected_features;
+}
+
+std::string format_feature_report(
+	const io_uring_features &supported_features, const io_uring_features &selected_features)
+{
+	std::string report;
+	for (const feature_description &feature_description : FEATURE_DESCRIPTION_LIST)
+	{
+		report.append("io_uring feature ").append(feature_description.name).append(": ");
+		const bool supported = supported_features.*feature_description.member;
+		if (selected_features.*feature_description.member)
+		{
+			report.append("enabled");
+		}
+		else if (
+			feature_description.superseding_member != nullptr &&
+			selected_features.*feature_description.superseding_member)
+		{
+			report.append("supported, superseded");
+		}
+		else
+		{
+			report.append(supported ? "disabled" : "not supported").append(", using ").append(feature_description.fallback);
+		}
+		report.append("\n");
+	}
+	return report;
+}
+} // namespace couringserver
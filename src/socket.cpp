@@ -1,71 +1,226 @@
 #include "socket.hpp"
 
+#include <arpa/inet.h>
+#include <fcntl.h>
 #include <liburing/io_uring.h>
 #include <netdb.h>
-
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
 #include <cstring>
+#include <filesystem>
 #include <span>
 #include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
 
+#include "buffer_ring.hpp"
 #include "constant.hpp"
 #include "file_descriptor.hpp"
 
 namespace couringserver {
-server_socket::server_socket() = default;
+namespace {
+// Split 'host:port' or '[host]:port', a port alone leaves the host empty.
+std::pair<std::string, std::string> split_host_port(const std::string_view listen_address)
+{
+	const size_t colon_position = listen_address.rfind(':');
+	if (colon_position == std::string_view::npos)
+	{
+		return {"", std::string(listen_address)};
+	}
+	std::string_view host = listen_address.substr(0, colon_position);
+	if (host.starts_with('[') && host.ends_with(']'))
+	{
+		host = host.substr(1, host.size() - 2);
+	}
+	return {std::string(host), std::string(listen_address.substr(colon_position + 1))};
+}
 
-void server_socket::bind(const char *port)
+void resolve_listen_address(const std::string_view listen_address, std::vector<socket_address> &socket_address_list)
 {
-	addrinfo address_hints;
-	addrinfo *socket_address;
+	constexpr std::string_view UNIX_PREFIX = "unix:";
+	if (listen_address.starts_with(UNIX_PREFIX))
+	{
+		const std::string_view path = listen_address.substr(UNIX_PREFIX.size());
+		socket_address &socket_address = socket_address_list.emplace_back();
+		auto *unix_address = reinterpret_cast<sockaddr_un *>(&socket_address.storage);
+		if (path.empty() || path.size() >= sizeof(unix_address->sun_path))
+		{
+			throw std::runtime_error("invalid listen address '" + std::string(listen_address) + "'");
+		}
+		unix_address->sun_family = AF_UNIX;
+		path.copy(unix_address->sun_path, path.size());
+		socket_address.size = offsetof(sockaddr_un, sun_path) + path.size() + 1;
+		return;
+	}
 
-	std::memset(&address_hints, 0, sizeof(addrinfo));
+	const auto [host, port] = split_host_port(listen_address);
+	addrinfo address_hints{};
 	address_hints.ai_family = AF_UNSPEC;
 	address_hints.ai_socktype = SOCK_STREAM;
-	address_hints.ai_flags = AI_PASSIVE;
-
-	if (getaddrinfo(nullptr, port, &address_hints, &socket_address) != 0)
+	address_hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+	addrinfo *socket_address_info;
+	if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &address_hints, &socket_address_info) != 0)
 	{
 		throw std::runtime_error("failed to invoke 'getaddrinfo'");
 	}
+	for (const addrinfo *node = socket_address_info; node != nullptr; node = node->ai_next)
+	{
+		socket_address socket_address;
+		std::memcpy(&socket_address.storage, node->ai_addr, node->ai_addrlen);
+		socket_address.size = node->ai_addrlen;
+		if (std::ranges::find(socket_address_list, socket_address) == socket_address_list.end())
+		{
+			socket_address_list.emplace_back(socket_address);
+		}
+	}
+	freeaddrinfo(socket_address_info);
+}
+} // namespace
 
-	for (auto *node = socket_address; node != nullptr; node = node->ai_next)
+bool socket_address::operator==(const socket_address &other) const noexcept
+{
+	return size == other.size && std::memcmp(&storage, &other.storage, size) == 0;
+}
+
+int socket_address::get_family() const noexcept { return storage.ss_family; }
+
+std::vector<socket_address> resolve_listen_address_list(const std::string_view listen_address_list)
+{
+	std::vector<socket_address> socket_address_list;
+	for (size_t start = 0; start <= listen_address_list.size();)
 	{
-		raw_file_descriptor_ = socket(node->ai_family, node->ai_socktype, node->ai_protocol);
-		if (raw_file_descriptor_.value() == -1)
+		const size_t end = std::min(listen_address_list.find(',', start), listen_address_list.size());
+		const std::string_view listen_address = listen_address_list.substr(start, end - start);
+		if (listen_address.empty())
 		{
-			throw std::runtime_error("failed to invoke 'socket'");
+			throw std::runtime_error("invalid listen address list '" + std::string(listen_address_list) + "'");
 		}
+		resolve_listen_address(listen_address, socket_address_list);
+		start = end + 1;
+	}
+	return socket_address_list;
+}
+
+server_socket::server_socket() = default;
 
-		const int flag = 1;
-		if (setsockopt(raw_file_descriptor_.value(), SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag)) ==
-			-1)
+server_socket::server_socket(const int raw_file_descriptor) : file_descriptor{raw_file_descriptor}
+{
+	socklen_t family_size = sizeof(family_);
+	getsockopt(raw_file_descriptor, SOL_SOCKET, SO_DOMAIN, &family_, &family_size);
+}
+
+void server_socket::bind(const socket_address &socket_address)
+{
+	family_ = socket_address.get_family();
+	raw_file_descriptor_ = socket(family_, SOCK_STREAM, 0);
+	if (raw_file_descriptor_.value() == -1)
+	{
+		throw std::runtime_error("failed to invoke 'socket'");
+	}
+
+	const int flag = 1;
+	if (family_ == AF_UNIX)
+	{
+		// The socket file outlives its server, unless the listener was handed
+		// over, so it is removed before binding again.
+		const char *const path = reinterpret_cast<const sockaddr_un *>(&socket_address.storage)->sun_path;
+		std::error_code error_code;
+		if (std::filesystem::is_socket(path, error_code))
+		{
+			std::filesystem::remove(path, error_code);
+		}
+	}
+	else
+	{
+		if (setsockopt(raw_file_descriptor_.value(), SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag)) == -1)
 		{
 			throw std::runtime_error("failed to invoke 'setsockopt'");
 		}
 
-		if (setsockopt(raw_file_descriptor_.value(), SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag)) ==
-			-1)
+		if (setsockopt(raw_file_descriptor_.value(), SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag)) == -1)
 		{
 			throw std::runtime_error("failed to invoke 'setsockopt'");
 		}
+	}
+
+	if (family_ == AF_INET6 &&
+		setsockopt(raw_file_descriptor_.value(), IPPROTO_IPV6, IPV6_V6ONLY, &flag, sizeof(flag)) == -1)
+	{
+		throw std::runtime_error("failed to invoke 'setsockopt'");
+	}
+
+	if (::bind(raw_file_descriptor_.value(), reinterpret_cast<const sockaddr *>(&socket_address.storage),
+			   socket_address.size) == -1)
+	{
+		throw std::runtime_error("failed to invoke 'bind'");
+	}
+}
+
+server_socket server_socket::duplicate() const
+{
+	const int raw_file_descriptor = fcntl(raw_file_descriptor_.value(), F_DUPFD_CLOEXEC, 0);
+	if (raw_file_descriptor == -1)
+	{
+		throw std::runtime_error("failed to invoke 'fcntl'");
+	}
+	server_socket server_socket(raw_file_descriptor);
+	server_socket.set_tls(tls_);
+	return server_socket;
+}
 
-		if (::bind(raw_file_descriptor_.value(), node->ai_addr, node->ai_addrlen) == -1)
+void server_socket::set_options(const socket_options &socket_options)
+{
+	if (!raw_file_descriptor_.has_value())
+	{
+		throw std::runtime_error("the file descriptor is invalid");
+	}
+	if (family_ == AF_UNIX)
+	{
+		return;
+	}
+
+	const auto set_option = [this](const int level, const int option_name, const int option_value)
+	{
+		if (setsockopt(raw_file_descriptor_.value(), level, option_name, &option_value, sizeof(option_value)) == -1)
 		{
-			throw std::runtime_error("failed to invoke 'bind'");
+			throw std::runtime_error("failed to invoke 'setsockopt'");
 		}
-		break;
+	};
+	// The options that 0 disables are always set, so that an inherited
+	// listener does not keep those of the previous server.
+	set_option(IPPROTO_TCP, TCP_DEFER_ACCEPT, socket_options.defer_accept_timeout);
+	set_option(IPPROTO_TCP, TCP_FASTOPEN, socket_options.fastopen_queue_size);
+	set_option(IPPROTO_TCP, TCP_NODELAY, socket_options.no_delay);
+	set_option(IPPROTO_TCP, TCP_NOTSENT_LOWAT, socket_options.notsent_low_watermark);
+	// A buffer size turns off the autotuning of the buffer, so the kernel
+	// default is left alone for 0.
+	if (socket_options.send_buffer_size != 0)
+	{
+		set_option(SOL_SOCKET, SO_SNDBUF, socket_options.send_buffer_size);
+	}
+	if (socket_options.receive_buffer_size != 0)
+	{
+		set_option(SOL_SOCKET, SO_RCVBUF, socket_options.receive_buffer_size);
 	}
-	freeaddrinfo(socket_address);
 }
 
-void server_socket::listen() const
+void server_socket::listen(const socket_options &socket_options) const
 {
 	if (!raw_file_descriptor_.has_value())
 	{
 		throw std::runtime_error("the file descriptor is invalid");
 	}
 
-	if (::listen(raw_file_descriptor_.value(), SOCKET_LISTEN_QUEUE_SIZE) == -1)
+	if (::listen(raw_file_descriptor_.value(), socket_options.listen_backlog) == -1)
 	{
 		throw std::runtime_error("failed to invoke 'listen'");
 	}
@@ -78,7 +233,10 @@ server_socket::multishot_accept_guard::multishot_accept_guard(
 
 server_socket::multishot_accept_guard::~multishot_accept_guard()
 {
-	io_uring::get_instance().submit_cancel_request(&sqe_data_);
+	if (armed_ && !paused_ && !cancelled_)
+	{
+		io_uring::get_instance().submit_cancel_request(nullptr, &sqe_data_);
+	}
 }
 
 bool server_socket::multishot_accept_guard::await_ready() const { return false; }
@@ -86,12 +244,13 @@ bool server_socket::multishot_accept_guard::await_ready() const { return false;
 void server_socket::multishot_accept_guard::await_suspend(std::coroutine_handle<> coroutine)
 {
 	sqe_data_.coroutine = coroutine.address();
-	if (initial_await_)
+	if (initial_await_ && !cancelled_)
 	{
-		io_uring::get_instance().submit_multishot_accept_request(
+		io_uring::get_instance().submit_accept_request(
 			&sqe_data_, raw_file_descriptor_, reinterpret_cast<sockaddr *>(client_address_),
 			client_address_size_);
 		initial_await_ = false;
+		armed_ = true;
 	}
 }
 
@@ -99,14 +258,78 @@ int server_socket::multishot_accept_guard::await_resume()
 {
 	if (!(sqe_data_.cqe_flags & IORING_CQE_F_MORE))
 	{
-		io_uring::get_instance().submit_multishot_accept_request(
+		if (paused_ || cancelled_)
+		{
+			armed_ = false;
+		}
+		else
+		{
+			io_uring::get_instance().submit_accept_request(
+				&sqe_data_, raw_file_descriptor_, reinterpret_cast<sockaddr *>(client_address_),
+				client_address_size_);
+		}
+	}
+	return sqe_data_.cqe_res;
+}
+
+void server_socket::multishot_accept_guard::pause()
+{
+	if (armed_ && !paused_ && !cancelled_)
+	{
+		io_uring::get_instance().submit_cancel_request(nullptr, &sqe_data_);
+	}
+	paused_ = true;
+}
+
+void server_socket::multishot_accept_guard::resume()
+{
+	paused_ = false;
+	if (!armed_ && !initial_await_ && !cancelled_)
+	{
+		io_uring::get_instance().submit_accept_request(
 			&sqe_data_, raw_file_descriptor_, reinterpret_cast<sockaddr *>(client_address_),
 			client_address_size_);
+		armed_ = true;
 	}
-	return sqe_data_.cqe_res;
 }
 
-server_socket::multishot_accept_guard &server_socket::accept(sockaddr_storage *client_address, socklen_t *client_address_size)
+void server_socket::multishot_accept_guard::cancel()
+{
+	if (cancelled_)
+	{
+		return;
+	}
+	cancelled_ = true;
+
+	if (armed_ && !paused_)
+	{
+		io_uring::get_instance().submit_cancel_request(nullptr, &sqe_data_);
+	}
+	else if (!armed_ && !initial_await_)
+	{
+		// The coroutine is suspended on a paused guard and no completion will
+		// arrive, so it is resumed here to observe the cancellation.
+		sqe_data_.cqe_res = -ECANCELED;
+		sqe_data_.cqe_flags = 0;
+		std::coroutine_handle<>::from_address(sqe_data_.coroutine).resume();
+	}
+}
+
+bool server_socket::multishot_accept_guard::is_armed() const noexcept { return armed_; }
+
+server_socket::accept_awaiter::accept_awaiter(multishot_accept_guard &multishot_accept_guard)
+	: multishot_accept_guard_{multishot_accept_guard} {}
+
+bool server_socket::accept_awaiter::await_ready() const { return multishot_accept_guard_.await_ready(); }
+
+void server_socket::accept_awaiter::await_suspend(std::coroutine_handle<> coroutine)
+{
+	multishot_accept_guard_.await_suspend(coroutine);
+}
+
+int server_socket::accept_awaiter::await_resume() { return multishot_accept_guard_.await_resume(); }
+
+server_socket::accept_awaiter server_socket::accept(sockaddr_storage *client_address, socklen_t *client_address_size)
 {
 	if (!raw_file_descriptor_.has_value())
 	{
@@ -118,58 +341,388 @@ server_socket::multishot_accept_guard &server_socket::accept(sockaddr_storage *c
 		multishot_accept_guard_.emplace(
 			raw_file_descriptor_.value(), client_address, client_address_size);
 	}
-	return multishot_accept_guard_.value();
+	return accept_awaiter{multishot_accept_guard_.value()};
+}
+
+void server_socket::pause_accept()
+{
+	if (multishot_accept_guard_.has_value())
+	{
+		multishot_accept_guard_->pause();
+	}
+}
+
+void server_socket::resume_accept()
+{
+	if (multishot_accept_guard_.has_value())
+	{
+		multishot_accept_guard_->resume();
+	}
+}
+
+void server_socket::cancel_accept()
+{
+	if (multishot_accept_guard_.has_value())
+	{
+		multishot_accept_guard_->cancel();
+	}
+}
+
+bool server_socket::is_accepting() const noexcept
+{
+	return multishot_accept_guard_.has_value() && multishot_accept_guard_->is_armed();
+}
+
+multishot_recv_guard::multishot_recv_guard(const int raw_file_descriptor)
+	: raw_file_descriptor_{raw_file_descriptor}
+{
+	sqe_data_.completion_handler = this;
+}
+
+multishot_recv_guard::recv_awaiter::recv_awaiter(multishot_recv_guard &multishot_recv_guard)
+	: multishot_recv_guard_{multishot_recv_guard} {}
+
+bool multishot_recv_guard::recv_awaiter::await_ready() const noexcept
+{
+	return multishot_recv_guard_.packet_index_ < multishot_recv_guard_.packet_list_.size();
+}
+
+void multishot_recv_guard::recv_awaiter::await_suspend(std::coroutine_handle<> coroutine)
+{
+	multishot_recv_guard_.waiting_coroutine_ = coroutine;
+	if (!multishot_recv_guard_.armed_)
+	{
+		multishot_recv_guard_.submit();
+	}
+}
+
+std::tuple<unsigned int, ssize_t> multishot_recv_guard::recv_awaiter::await_resume()
+{
+	std::tuple<unsigned int, ssize_t> result{0, 0};
+	multishot_recv_guard_.take_packet(std::get<0>(result), std::get<1>(result));
+	return result;
+}
+
+multishot_recv_guard::stop_awaiter::stop_awaiter(multishot_recv_guard &multishot_recv_guard)
+	: multishot_recv_guard_{multishot_recv_guard} {}
+
+bool multishot_recv_guard::stop_awaiter::await_ready() const noexcept { return !multishot_recv_guard_.armed_; }
+
+void multishot_recv_guard::stop_awaiter::await_suspend(std::coroutine_handle<> coroutine)
+{
+	multishot_recv_guard_.stopping_ = true;
+	multishot_recv_guard_.waiting_coroutine_ = coroutine;
+	multishot_recv_guard_.cancel();
+}
+
+void multishot_recv_guard::stop_awaiter::await_resume() const noexcept { multishot_recv_guard_.stopping_ = false; }
+
+multishot_recv_guard::recv_awaiter multishot_recv_guard::recv() { return recv_awaiter{*this}; }
+
+multishot_recv_guard::stop_awaiter multishot_recv_guard::stop() { return stop_awaiter{*this}; }
+
+bool multishot_recv_guard::take_packet(unsigned int &buffer_id, ssize_t &size)
+{
+	if (packet_index_ == packet_list_.size())
+	{
+		return false;
+	}
+	buffer_id = packet_list_[packet_index_].buffer_id;
+	size = packet_list_[packet_index_].size;
+	if (++packet_index_ == packet_list_.size())
+	{
+		packet_list_.clear();
+		packet_index_ = 0;
+		// An idle connection keeps no more than a full queue.
+		if (packet_list_.capacity() > MULTISHOT_RECV_QUEUE_SIZE)
+		{
+			packet_list_.shrink_to_fit();
+		}
+	}
+	return true;
+}
+
+void multishot_recv_guard::clear()
+{
+	buffer_ring &buffer_ring = buffer_ring::get_instance();
+	for (; packet_index_ < packet_list_.size(); ++packet_index_)
+	{
+		if (packet_list_[packet_index_].size > 0)
+		{
+			buffer_ring.return_buffer(packet_list_[packet_index_].buffer_id);
+		}
+	}
+	packet_list_.clear();
+	packet_index_ = 0;
+}
+
+std::coroutine_handle<> multishot_recv_guard::handle_completion(sqe_data &sqe_data)
+{
+	buffer_ring &buffer_ring = buffer_ring::get_instance();
+	if (sqe_data.cqe_res == -ENOBUFS)
+	{
+		buffer_ring.record_no_buffer();
+	}
+	const bool more = sqe_data.cqe_flags & IORING_CQE_F_MORE;
+	if (!more)
+	{
+		armed_ = false;
+		// The end of a request that was cancelled here is no packet, nor is
+		// running out of buffers while packets are queued. The request is
+		// submitted again once the queue has been taken.
+		const bool cancelled = std::exchange(cancelling_, false) && sqe_data.cqe_res == -ECANCELED;
+		if (cancelled || (sqe_data.cqe_res == -ENOBUFS && packet_index_ < packet_list_.size()))
+		{
+			if (!stopping_ && waiting_coroutine_ && packet_index_ == packet_list_.size())
+			{
+				submit();
+				return {};
+			}
+			return stopping_ ? std::exchange(waiting_coroutine_, {}) : std::coroutine_handle<>{};
+		}
+	}
+
+	// A queued packet holds its buffer like a borrowed one.
+	const unsigned int buffer_id =
+		(sqe_data.cqe_flags & IORING_CQE_F_BUFFER) ? sqe_data.cqe_flags >> IORING_CQE_BUFFER_SHIFT : 0;
+	if (sqe_data.cqe_flags & IORING_CQE_F_BUFFER)
+	{
+		buffer_ring.borrow_buffer(buffer_id, sqe_data.cqe_res);
+	}
+	packet_list_.push_back({buffer_id, sqe_data.cqe_res});
+
+	// A stopping guard resumes its coroutine once the request has ended.
+	if (stopping_)
+	{
+		return armed_ ? std::coroutine_handle<>{} : std::exchange(waiting_coroutine_, {});
+	}
+	if (armed_ && packet_list_.size() - packet_index_ >= MULTISHOT_RECV_QUEUE_SIZE)
+	{
+		cancel();
+	}
+	return std::exchange(waiting_coroutine_, {});
+}
+
+void multishot_recv_guard::submit()
+{
+	io_uring::get_instance().submit_multishot_recv_request(
+		&sqe_data_, raw_file_descriptor_, buffer_ring::get_instance().get_buffer_size());
+	armed_ = true;
+}
+
+void multishot_recv_guard::cancel()
+{
+	if (armed_ && !cancelling_)
+	{
+		io_uring::get_instance().submit_cancel_request(nullptr, &sqe_data_);
+		cancelling_ = true;
+	}
 }
 
 client_socket::client_socket(const int raw_file_descriptor)
 	: file_descriptor{raw_file_descriptor} {}
 
-client_socket::recv_awaiter::recv_awaiter(const int raw_file_descriptor, const size_t length)
-	: raw_file_descriptor_{raw_file_descriptor}, length_{length} {}
+socket_address server_socket::get_address() const
+{
+	socket_address socket_address;
+	socket_address.size = sizeof(socket_address.storage);
+	if (getsockname(
+			raw_file_descriptor_.value(), reinterpret_cast<sockaddr *>(&socket_address.storage),
+			&socket_address.size) == -1)
+	{
+		throw std::runtime_error("failed to invoke 'getsockname'");
+	}
+	return socket_address;
+}
+
+int server_socket::get_family() const noexcept { return family_; }
+
+void server_socket::set_tls(const bool tls) noexcept { tls_ = tls; }
+
+bool server_socket::is_tls() const noexcept { return tls_; }
+
+bool client_socket::set_no_delay()
+{
+	const int no_delay = 1;
+	return setsockopt(
+			   raw_file_descriptor_.value(), IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay)) == 0;
+}
+
+void client_socket::set_options(const socket_options &socket_options)
+{
+	// The value has to outlive the request.
+	static const int ENABLE = 1;
+	if (socket_options.quick_ack)
+	{
+		io_uring::get_instance().submit_setsockopt_request(
+			raw_file_descriptor_.value(), IPPROTO_TCP, TCP_QUICKACK, &ENABLE);
+	}
+	if (io_uring::get_features().send_zc)
+	{
+		send_zc_threshold_ = socket_options.send_zc_threshold;
+	}
+}
+
+bool client_socket::set_busy_poll(const std::chrono::microseconds timeout)
+{
+	const int busy_poll = timeout.count();
+	return setsockopt(
+			   raw_file_descriptor_.value(), SOL_SOCKET, SO_BUSY_POLL, &busy_poll, sizeof(busy_poll)) == 0;
+}
+
+std::string client_socket::get_peer_address() const
+{
+	sockaddr_storage address;
+	socklen_t address_size = sizeof(address);
+	if (getpeername(raw_file_descriptor_.value(), reinterpret_cast<sockaddr *>(&address), &address_size) == -1)
+	{
+		return "-";
+	}
+	std::array<char, INET6_ADDRSTRLEN> address_buffer;
+	const void *const raw_address =
+		address.ss_family == AF_INET6
+			? static_cast<const void *>(&reinterpret_cast<const sockaddr_in6 *>(&address)->sin6_addr)
+			: static_cast<const void *>(&reinterpret_cast<const sockaddr_in *>(&address)->sin_addr);
+	if ((address.ss_family != AF_INET && address.ss_family != AF_INET6) ||
+		inet_ntop(address.ss_family, raw_address, address_buffer.data(), address_buffer.size()) == nullptr)
+	{
+		return "-";
+	}
+	return address_buffer.data();
+}
+
+client_socket::recv_awaiter::recv_awaiter(
+	const int raw_file_descriptor, const size_t length, cancellation_token *cancellation_token)
+	: raw_file_descriptor_{raw_file_descriptor}, length_{length},
+	  cancellation_token_{cancellation_token} {}
 
-bool client_socket::recv_awaiter::await_ready() const { return false; }
+bool client_socket::recv_awaiter::await_ready()
+{
+	return skip_cancelled_request(cancellation_token_, sqe_data_);
+}
 
 void client_socket::recv_awaiter::await_suspend(std::coroutine_handle<> coroutine)
 {
 	sqe_data_.coroutine = coroutine.address();
+	if (cancellation_token_ != nullptr)
+	{
+		cancellation_token_->register_request(&sqe_data_);
+	}
 	io_uring::get_instance().submit_recv_request(&sqe_data_, raw_file_descriptor_, length_);
 }
 
 std::tuple<unsigned int, ssize_t> client_socket::recv_awaiter::await_resume()
 {
-	if (sqe_data_.cqe_flags | IORING_CQE_F_BUFFER)
+	if (cancellation_token_ != nullptr)
+	{
+		cancellation_token_->unregister_request(&sqe_data_);
+	}
+	if (sqe_data_.cqe_res == -ENOBUFS)
+	{
+		buffer_ring::get_instance().record_no_buffer();
+	}
+	if (sqe_data_.cqe_flags & IORING_CQE_F_BUFFER)
 	{
 		const unsigned int buffer_id = sqe_data_.cqe_flags >> IORING_CQE_BUFFER_SHIFT;
 		return {buffer_id, sqe_data_.cqe_res};
 	}
-	return {};
+	return {0, sqe_data_.cqe_res};
 }
 
-client_socket::recv_awaiter client_socket::recv(const size_t length)
+client_socket::recv_awaiter client_socket::recv(
+	const size_t length, cancellation_token *cancellation_token)
 {
 	if (raw_file_descriptor_.has_value())
 	{
-		return {raw_file_descriptor_.value(), length};
+		return {raw_file_descriptor_.value(), length, cancellation_token};
 	}
 	throw std::runtime_error("the file descriptor is invalid");
 }
 
 client_socket::send_awaiter::send_awaiter(
-	const int raw_file_descriptor, const std::span<char> &buffer, const size_t length)
-	: raw_file_descriptor_{raw_file_descriptor}, length_{length}, buffer_{buffer} {};
+	const int raw_file_descriptor, const std::span<char> &buffer, const size_t length,
+	cancellation_token *cancellation_token)
+	: raw_file_descriptor_{raw_file_descriptor}, length_{length}, buffer_{buffer},
+	  cancellation_token_{cancellation_token} {};
 
-bool client_socket::send_awaiter::await_ready() const { return false; }
+bool client_socket::send_awaiter::await_ready()
+{
+	return skip_cancelled_request(cancellation_token_, sqe_data_);
+}
 
 void client_socket::send_awaiter::await_suspend(std::coroutine_handle<> coroutine)
 {
 	sqe_data_.coroutine = coroutine.address();
+	if (cancellation_token_ != nullptr)
+	{
+		cancellation_token_->register_request(&sqe_data_);
+	}
 
 	io_uring::get_instance().submit_send_request(&sqe_data_, raw_file_descriptor_, buffer_, length_);
 }
 
-ssize_t client_socket::send_awaiter::await_resume() const { return sqe_data_.cqe_res; }
+ssize_t client_socket::send_awaiter::await_resume()
+{
+	if (cancellation_token_ != nullptr)
+	{
+		cancellation_token_->unregister_request(&sqe_data_);
+	}
+	return sqe_data_.cqe_res;
+}
+
+client_socket::send_zc_awaiter::send_zc_awaiter(
+	const int raw_file_descriptor, const std::span<char> &buffer, const size_t length,
+	cancellation_token *cancellation_token)
+	: raw_file_descriptor_{raw_file_descriptor}, length_{length}, buffer_{buffer},
+	  cancellation_token_{cancellation_token} {}
 
-task<ssize_t> client_socket::send(const std::span<char> &buffer, const size_t length)
+bool client_socket::send_zc_awaiter::await_ready()
+{
+	if (!skip_cancelled_request(cancellation_token_, sqe_data_))
+	{
+		return false;
+	}
+	result_ = sqe_data_.cqe_res;
+	return true;
+}
+
+void client_socket::send_zc_awaiter::await_suspend(std::coroutine_handle<> coroutine)
+{
+	sqe_data_.coroutine = coroutine.address();
+	sqe_data_.completion_handler = this;
+	if (cancellation_token_ != nullptr)
+	{
+		cancellation_token_->register_request(&sqe_data_);
+	}
+
+	io_uring::get_instance().submit_send_zc_request(&sqe_data_, raw_file_descriptor_, buffer_, length_);
+}
+
+ssize_t client_socket::send_zc_awaiter::await_resume()
+{
+	if (cancellation_token_ != nullptr)
+	{
+		cancellation_token_->unregister_request(&sqe_data_);
+	}
+	return result_;
+}
+
+std::coroutine_handle<> client_socket::send_zc_awaiter::handle_completion(sqe_data &sqe_data)
+{
+	if (!(sqe_data.cqe_flags & IORING_CQE_F_NOTIF))
+	{
+		result_ = sqe_data.cqe_res;
+		// The notification follows, the buffer is still in use until then.
+		if (sqe_data.cqe_flags & IORING_CQE_F_MORE)
+		{
+			return {};
+		}
+	}
+	return std::coroutine_handle<>::from_address(sqe_data.coroutine);
+}
+
+local_task<ssize_t> client_socket::send(
+	const std::span<char> buffer, const size_t length, cancellation_token *cancellation_token)
 {
 	if (!raw_file_descriptor_.has_value())
 	{
@@ -179,15 +732,70 @@ task<ssize_t> client_socket::send(const std::span<char> &buffer, const size_t le
 	size_t bytes_sent = 0;
 	while (bytes_sent < length)
 	{
-		ssize_t result =
-			co_await send_awaiter(raw_file_descriptor_.value(), buffer.subspan(bytes_sent), length);
+		ssize_t result = 0;
+		if (send_zc_threshold_ != 0 && length - bytes_sent >= send_zc_threshold_)
+		{
+			result = co_await send_zc_awaiter(
+				raw_file_descriptor_.value(), buffer.subspan(bytes_sent), length - bytes_sent,
+				cancellation_token);
+			if (result == -EOPNOTSUPP)
+			{
+				send_zc_threshold_ = 0;
+				continue;
+			}
+		}
+		else
+		{
+			result = co_await send_awaiter(
+				raw_file_descriptor_.value(), buffer.subspan(bytes_sent), length - bytes_sent,
+				cancellation_token);
+		}
 		if (result < 0)
 		{
 			co_return -1;
 		}
+		if (!first_send_time_.has_value())
+		{
+			first_send_time_ = std::chrono::steady_clock::now();
+		}
 		bytes_sent += result;
 	}
 	co_return bytes_sent;
 }
 
+void client_socket::reset_first_send_time() noexcept { first_send_time_.reset(); }
+
+std::optional<std::chrono::steady_clock::time_point> client_socket::get_first_send_time() const noexcept
+{
+	return first_send_time_;
+}
+
+connect_awaiter::connect_awaiter(
+	const int raw_file_descriptor, const sockaddr *address, const socklen_t address_size,
+	cancellation_token *cancellation_token)
+	: raw_file_descriptor_{raw_file_descriptor}, address_{address}, address_size_{address_size},
+	  cancellation_token_{cancellation_token} {}
+
+bool connect_awaiter::await_ready() { return skip_cancelled_request(cancellation_token_, sqe_data_); }
+
+void connect_awaiter::await_suspend(std::coroutine_handle<> coroutine)
+{
+	sqe_data_.coroutine = coroutine.address();
+	if (cancellation_token_ != nullptr)
+	{
+		cancellation_token_->register_request(&sqe_data_);
+	}
+
+	io_uring::get_instance().submit_connect_request(
+		&sqe_data_, raw_file_descriptor_, address_, address_size_);
+}
+
+int connect_awaiter::await_resume()
+{
+	if (cancellation_token_ != nullptr)
+	{
+		cancellation_token_->unregister_request(&sqe_data_);
+	}
+	return sqe_data_.cqe_res;
+}
 } // namespace couringserver
@@ -0,0 +1,96 @@
+#include "tls_context.hpp"
+
+#include <fcntl.h>
+#include <openssl/bio.h>
+#include <openssl/opensslv.h>
+#include <openssl/ssl.h>
+#include <poll.h>
+
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+
+#include "cancellation.hpp"
+#include "constant.hpp"
+#include "file_descriptor.hpp"
+#include "when_all.hpp"
+
+namespace couringserver {
+tls_context::tls_context(
+	const std::filesystem::path &certificate_path, const std::filesystem::path &private_key_path)
+	: ssl_context_{SSL_CTX_new(TLS_server_method()), &SSL_CTX_free}
+{
+	if (ssl_context_ == nullptr)
+	{
+		throw std::runtime_error("failed to invoke 'SSL_CTX_new'");
+	}
+	if (SSL_CTX_use_certificate_chain_file(ssl_context_.get(), certificate_path.c_str()) != 1 ||
+		SSL_CTX_use_PrivateKey_file(ssl_context_.get(), private_key_path.c_str(), SSL_FILETYPE_PEM) != 1)
+	{
+		throw std::runtime_error("failed to load the TLS certificate or private key");
+	}
+
+	// Only the AEAD ciphers the kernel implements are offered. OpenSSL
+	// before 3.2 cannot offload the receive side of TLS 1.3 on Linux.
+	SSL_CTX_set_options(ssl_context_.get(), SSL_OP_ENABLE_KTLS);
+	SSL_CTX_set_min_proto_version(ssl_context_.get(), TLS1_2_VERSION);
+#if OPENSSL_VERSION_NUMBER < 0x30200000L
+	SSL_CTX_set_max_proto_version(ssl_context_.get(), TLS1_2_VERSION);
+#endif
+	SSL_CTX_set_cipher_list(
+		ssl_context_.get(),
+		"ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:"
+		"ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384:"
+		"ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-CHACHA20-POLY1305");
+	// Session tickets would be written by OpenSSL after the handshake, when
+	// the socket already belongs to the kernel.
+	SSL_CTX_set_num_tickets(ssl_context_.get(), 0);
+	SSL_CTX_set_options(ssl_context_.get(), SSL_OP_NO_TICKET);
+}
+
+local_task<bool> tls_context::accept(client_socket &client_socket) const
+{
+	const int raw_file_descriptor = client_socket.get_raw_file_descriptor();
+	const std::unique_ptr<SSL, decltype(&SSL_free)> ssl{SSL_new(ssl_context_.get()), &SSL_free};
+	if (ssl == nullptr || SSL_set_fd(ssl.get(), raw_file_descriptor) != 1)
+	{
+		co_return false;
+	}
+	SSL_set_accept_state(ssl.get());
+
+	// OpenSSL reads and writes the socket itself during the handshake, so it
+	// is non-blocking until then and io_uring only reports readiness.
+	const int file_status_flags = fcntl(raw_file_descriptor, F_GETFL);
+	fcntl(raw_file_descriptor, F_SETFL, file_status_flags | O_NONBLOCK);
+	while (true)
+	{
+		const int result = SSL_do_handshake(ssl.get());
+		if (result == 1)
+		{
+			break;
+		}
+
+		const int error = SSL_get_error(ssl.get(), result);
+		if (error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE)
+		{
+			co_return false;
+		}
+		cancellation_token cancellation_token;
+		const auto [winner, _] = co_await when_any(
+			cancellation_token,
+			poll_awaiter(
+				raw_file_descriptor, error == SSL_ERROR_WANT_READ ? POLLIN : POLLOUT, &cancellation_token),
+			timeout_awaiter(TLS_HANDSHAKE_TIMEOUT, &cancellation_token));
+		if (winner != 0)
+		{
+			co_return false;
+		}
+	}
+	fcntl(raw_file_descriptor, F_SETFL, file_status_flags);
+
+	// Freeing the session leaves the socket open, and the keys stay in the
+	// kernel.
+	co_return BIO_get_ktls_send(SSL_get_wbio(ssl.get())) && BIO_get_ktls_recv(SSL_get_rbio(ssl.get()));
+}
+} // namespace couringserver
@@ -0,0 +1,140 @@
+#include "upstream_pool.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <chrono>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include "cancellation.hpp"
+#include "constant.hpp"
+#include "socket.hpp"
+#include "when_all.hpp"
+
+namespace couringserver {
+// A down upstream lets a single request through as a probe and moves the
+// retry time on, so the requests behind it keep failing fast until the probe
+// reports success. A probe that never reports, e.g. because its client went
+// away, only delays the next one by another interval.
+bool upstream_pool::is_available(const upstream_address &upstream_address)
+{
+	upstream_state &upstream_state = get_upstream_state(upstream_address);
+	if (upstream_state.consecutive_failure_count < UPSTREAM_FAILURE_THRESHOLD)
+	{
+		return true;
+	}
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (now < upstream_state.retry_time)
+	{
+		return false;
+	}
+	upstream_state.retry_time = now + UPSTREAM_RETRY_INTERVAL;
+	return true;
+}
+
+local_task<std::optional<std::tuple<client_socket, bool>>> upstream_pool::acquire(
+	const upstream_address &upstream_address)
+{
+	// The state is never erased, so the reference survives the suspension.
+	upstream_state &upstream_state = get_upstream_state(upstream_address);
+	if (!upstream_state.idle_connection_list.empty())
+	{
+		client_socket upstream_socket = std::move(upstream_state.idle_connection_list.back());
+		upstream_state.idle_connection_list.pop_back();
+		co_return std::tuple{std::move(upstream_socket), true};
+	}
+
+	const int raw_file_descriptor =
+		::socket(upstream_state.address.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (raw_file_descriptor == -1)
+	{
+		// The worker is out of file descriptors or memory, which is not held
+		// against the upstream.
+		co_return std::nullopt;
+	}
+	client_socket upstream_socket(raw_file_descriptor);
+
+	cancellation_token cancellation_token;
+	const auto [_, result] = co_await when_any(
+		cancellation_token,
+		connect_awaiter(
+			raw_file_descriptor, reinterpret_cast<const sockaddr *>(&upstream_state.address),
+			upstream_state.address_size, &cancellation_token),
+		timeout_awaiter(UPSTREAM_CONNECT_TIMEOUT, &cancellation_token));
+	if (std::get<0>(result) != 0)
+	{
+		report_failure(upstream_address);
+		co_return std::nullopt;
+	}
+
+	upstream_socket.set_no_delay();
+	co_return std::tuple{std::move(upstream_socket), false};
+}
+
+void upstream_pool::release(const upstream_address &upstream_address, client_socket upstream_socket)
+{
+	upstream_state &upstream_state = get_upstream_state(upstream_address);
+	if (upstream_state.idle_connection_list.size() < MAX_IDLE_UPSTREAM_CONNECTION_COUNT)
+	{
+		upstream_state.idle_connection_list.emplace_back(std::move(upstream_socket));
+	}
+}
+
+void upstream_pool::report_success(const upstream_address &upstream_address)
+{
+	get_upstream_state(upstream_address).consecutive_failure_count = 0;
+}
+
+// Once the upstream is down, the idle connections are dropped as well, since
+// they most likely point at the failed process.
+void upstream_pool::report_failure(const upstream_address &upstream_address)
+{
+	upstream_state &upstream_state = get_upstream_state(upstream_address);
+	if (++upstream_state.consecutive_failure_count >= UPSTREAM_FAILURE_THRESHOLD)
+	{
+		upstream_state.retry_time = std::chrono::steady_clock::now() + UPSTREAM_RETRY_INTERVAL;
+		upstream_state.idle_connection_list.clear();
+	}
+}
+
+upstream_pool::upstream_state &upstream_pool::get_upstream_state(
+	const upstream_address &upstream_address)
+{
+	const auto [iterator, inserted] = upstream_state_map_.try_emplace(&upstream_address);
+	upstream_state &upstream_state = iterator->second;
+	if (!inserted)
+	{
+		return upstream_state;
+	}
+
+	// 'inet_pton' needs a null-terminated string.
+	const std::string host(upstream_address.host);
+	std::memset(&upstream_state.address, 0, sizeof(upstream_state.address));
+	auto *const ipv4_address = reinterpret_cast<sockaddr_in *>(&upstream_state.address);
+	auto *const ipv6_address = reinterpret_cast<sockaddr_in6 *>(&upstream_state.address);
+	if (inet_pton(AF_INET, host.c_str(), &ipv4_address->sin_addr) == 1)
+	{
+		ipv4_address->sin_family = AF_INET;
+		ipv4_address->sin_port = htons(upstream_address.port);
+		upstream_state.address_size = sizeof(sockaddr_in);
+	}
+	else if (inet_pton(AF_INET6, host.c_str(), &ipv6_address->sin6_addr) == 1)
+	{
+		ipv6_address->sin6_family = AF_INET6;
+		ipv6_address->sin6_port = htons(upstream_address.port);
+		upstream_state.address_size = sizeof(sockaddr_in6);
+	}
+	else
+	{
+		upstream_state_map_.erase(iterator);
+		throw std::invalid_argument("the upstream host is not an IP address");
+	}
+	return upstream_state;
+}
+} // namespace couringserver
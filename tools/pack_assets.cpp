@@ -0,0 +1,42 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+
+#include "asset_pack.hpp"
+
+int main(int argc, char *argv[])
+{
+	if (argc != 3)
+	{
+		std::fprintf(
+			stderr,
+			"usage: %s directory pack\n"
+			"  packs the files below the directory for 'asset_pack_path', a file with a\n"
+			"  '.br' or '.gz' sibling is packed with it as a compressed variant\n",
+			argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const auto start_time = std::chrono::steady_clock::now();
+	couringserver::asset_pack_summary asset_pack_summary;
+	try
+	{
+		asset_pack_summary = couringserver::build_asset_pack(argv[1], argv[2]);
+		// The pack is opened as the server would, which checks its header.
+		const couringserver::asset_pack asset_pack(argv[2], false, false);
+	}
+	catch (const std::exception &exception)
+	{
+		std::fprintf(stderr, "%s: %s\n", argv[0], exception.what());
+		return EXIT_FAILURE;
+	}
+	const double build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	std::printf(
+		"{\"assets\": %zu, \"indexes\": %zu, \"compressed_variants\": %zu, \"body_bytes\": %ju, "
+		"\"pack_bytes\": %ju, \"build_seconds\": %.3f}\n",
+		asset_pack_summary.asset_count, asset_pack_summary.index_count, asset_pack_summary.variant_count,
+		asset_pack_summary.body_size, asset_pack_summary.pack_size, build_seconds);
+	return EXIT_SUCCESS;
+}